@@ -742,6 +742,10 @@ pool_do_auth(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * cp)
 		}
 	}
 
+	/* Remember the parameters the session started with */
+	if (pool_config->transaction_pooling)
+		pool_copy_params(&MAIN(cp)->startup_params, &MAIN(cp)->params);
+
 	/*
 	 * message length (V3 only)
 	 */
@@ -904,6 +908,15 @@ static POOL_STATUS pool_send_backend_key_data(POOL_CONNECTION * frontend, int pi
 	char		kind;
 	int			len;
 
+	/*
+	 * In transaction pooling mode, sessions sharing a backend connection must
+	 * be told apart by their cancel keys.  Give each session its own key.
+	 */
+	if (pool_config->transaction_pooling)
+		pool_random(&key, sizeof(key));
+	frontend->cancel_pid = pid;
+	frontend->cancel_key = key;
+
 	/* Send backend key data */
 	kind = 'K';
 	pool_write(frontend, &kind, 1);
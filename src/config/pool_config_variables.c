@@ -35,6 +35,10 @@
 #include "pool_config_variables.h"
 #include "utils/regex_array.h"
 
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
 #ifndef POOL_PRIVATE
 #include "utils/elog.h"
 #include "parser/stringinfo.h"
@@ -95,6 +99,7 @@ static bool get_index_in_var_name(struct config_generic *record,
 static bool MakeDBRedirectListRegex(char *newval, int elevel);
 static bool MakeAppRedirectListRegex(char *newval, int elevel);
 static bool MakeDMLAdaptiveObjectRelationList(char *newval, int elevel);
+static bool MakeMemqcacheTableExpireListRegex(char *newval, int elevel);
 static char* getParsedToken(char *token, DBObjectTypes *object_type);
 
 static bool check_redirect_node_spec(char *node_spec);
@@ -270,6 +275,14 @@ static const struct config_enum_entry disable_load_balance_on_write_options[] =
 	{NULL, 0, false}
 };
 
+static const struct config_enum_entry load_balance_policy_options[] = {
+	{"weighted_random", LBP_WEIGHTED_RANDOM, false},
+	{"least_outstanding", LBP_LEAST_OUTSTANDING, false},
+	{"ewma_latency", LBP_EWMA_LATENCY, false},
+	{"power_of_two_choices", LBP_POWER_OF_TWO_CHOICES, false},
+	{NULL, 0, false}
+};
+
 static const struct config_enum_entry relcache_query_target_options[] = {
 	{"primary", RELQTARGET_PRIMARY, false},
 	{"load_balance_node", RELQTARGET_LOAD_BALANCE_NODE, false},
@@ -376,6 +389,15 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL,					/* check func */
 		NULL					/* show hook */
 	},
+	{
+		{"accept_dispatcher", CFGCXT_INIT, CONNECTION_CONFIG,
+			"whether to accept connections in a dedicated process and hand them to idle children",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.accept_dispatcher,
+		false,
+		NULL, NULL, NULL
+	},
 	{
 		{"failover_when_quorum_exists", CFGCXT_INIT, FAILOVER_CONFIG,
 			"Do failover only when cluster has the quorum.",
@@ -502,6 +524,16 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"replicate_write_in_parallel", CFGCXT_RELOAD, REPLICATION_CONFIG,
+			"Send write queries to all nodes at once instead of the main node first.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.replicate_write_in_parallel,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"connection_cache", CFGCXT_INIT, CONNECTION_POOL_CONFIG,
 			"Caches connections to backends.",
@@ -512,6 +544,16 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"transaction_pooling", CFGCXT_INIT, CONNECTION_POOL_CONFIG,
+			"Share backend connections among sessions of a child between transactions.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.transaction_pooling,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"fail_over_on_backend_error", CFGCXT_RELOAD, FAILOVER_CONFIG,
 			"Old config parameter for failover_on_backend_error.",
@@ -542,6 +584,16 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"failover_keep_sessions", CFGCXT_RELOAD, FAILOVER_CONFIG,
+			"Keeps client sessions when a standby node is failed over.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.failover_keep_sessions,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"insert_lock", CFGCXT_RELOAD, REPLICATION_CONFIG,
 			"Automatically locks table with INSERT to keep SERIAL data consistency",
@@ -672,6 +724,26 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_memcached_pipelining", CFGCXT_INIT, CACHE_CONFIG,
+			"Send stores and deletes to memcached without waiting for replies.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.memqcache_memcached_pipelining,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_compression", CFGCXT_RELOAD, CACHE_CONFIG,
+			"Compress query cache entries.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.memqcache_compression,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"allow_sql_comments", CFGCXT_SESSION, LOAD_BALANCE_CONFIG,
 			"Ignore SQL comments, while judging if load balance or query cache is possible.",
@@ -1236,6 +1308,29 @@ static struct config_string ConfigureNamesString[] =
 		NULL, NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_snapshot_file", CFGCXT_INIT, CACHE_CONFIG,
+			"File to save the shmem query cache across restarts.",
+			CONFIG_VAR_TYPE_STRING, false, 0
+		},
+		&g_pool_config.memqcache_snapshot_file,
+		"",
+		NULL, NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_table_expire_list", CFGCXT_RELOAD, CACHE_CONFIG,
+			"Per table life time of memory cache entries.",
+			CONFIG_VAR_TYPE_STRING, false, 0
+		},
+		&g_pool_config.memqcache_table_expire_list,	/* variable */
+		NULL,					/* boot value */
+		NULL,					/* assign_func */
+		NULL,					/* check_func */
+		MakeMemqcacheTableExpireListRegex,	/* process func */
+		NULL					/* show hook */
+	},
+
 	{
 		{"memqcache_memcached_host", CFGCXT_INIT, CACHE_CONFIG,
 			"Hostname or IP address of memcached.",
@@ -1859,6 +1954,28 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"spare_children", CFGCXT_INIT, CONNECTION_POOL_CONFIG,
+			"Number of pre-forked spare child processes taking over exited ones.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.spare_children,
+		0,
+		0, 1024,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"child_respawn_rate", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Maximum number of child processes forked per second to replace exited ones.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.child_respawn_rate,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"authentication_timeout", CFGCXT_INIT, CONNECTION_CONFIG,
 			"Time out value in seconds for client authentication.",
@@ -1881,6 +1998,28 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"sessions_per_child", CFGCXT_INIT, CONNECTION_POOL_CONFIG,
+			"Maximum number of frontend sessions served concurrently by a child process.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.sessions_per_child,
+		1,
+		1, MAX_SESSIONS_PER_CHILD,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"health_check_probe_interval", CFGCXT_RELOAD, HEALTH_CHECK_CONFIG,
+			"Time interval in milliseconds between the connection probes of the health check prober.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_MS
+		},
+		&g_pool_config.health_check_probe_interval,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"sr_check_period", CFGCXT_RELOAD, STREAMING_REPLICATION_CONFIG,
 			"Time interval in seconds between the streaming replication delay checks.",
@@ -1892,6 +2031,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"sr_check_lag_interval", CFGCXT_RELOAD, STREAMING_REPLICATION_CONFIG,
+			"Time interval in milliseconds between the streaming replication delay checks.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_MS
+		},
+		&g_pool_config.sr_check_lag_interval,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"recovery_timeout", CFGCXT_RELOAD, RECOVERY_CONFIG,
 			"Maximum time in seconds to wait for the recovering PostgreSQL node.",
@@ -1991,6 +2141,28 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"shared_relcache_size", CFGCXT_INIT, CACHE_CONFIG,
+			"Number of relation cache entry on shared memory.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.shared_relcache_size,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"parse_cache_size", CFGCXT_INIT, CACHE_CONFIG,
+			"Number of parse tree cache entry.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.parse_cache_size,
+		256,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"memqcache_memcached_port", CFGCXT_INIT, CACHE_CONFIG,
 			"Port number of Memcached server.",
@@ -2024,6 +2196,39 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_stale_while_revalidate", CFGCXT_RELOAD, CACHE_CONFIG,
+			"Seconds an expired memory cache entry may still be used while it is refreshed.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_S
+		},
+		&g_pool_config.memqcache_stale_while_revalidate,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_admission_min_duration", CFGCXT_RELOAD, CACHE_CONFIG,
+			"Minimum execution time of SELECT in milliseconds to cache the result.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_MS
+		},
+		&g_pool_config.memqcache_admission_min_duration,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_admission_min_count", CFGCXT_RELOAD, CACHE_CONFIG,
+			"Minimum number of executions of SELECT to cache the result.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.memqcache_admission_min_count,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"memqcache_maxcache", CFGCXT_INIT, CACHE_CONFIG,
 			"Maximum SELECT result size in bytes.",
@@ -2046,6 +2251,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_compression_threshold", CFGCXT_RELOAD, CACHE_CONFIG,
+			"Minimum SELECT result size in bytes to be compressed.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_BYTE
+		},
+		&g_pool_config.memqcache_compression_threshold,
+		1024,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"auto_failback_interval", CFGCXT_RELOAD, FAILOVER_CONFIG,
 			"min interval of executing auto_failback in seconds",
@@ -2196,6 +2412,17 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, NULL, NULL, NULL
 	},
 
+	{
+		{"load_balance_policy", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
+			"How to choose the load balance node.",
+			CONFIG_VAR_TYPE_ENUM, false, 0
+		},
+		(int *) &g_pool_config.load_balance_policy,
+		LBP_WEIGHTED_RANDOM,
+		load_balance_policy_options,
+		NULL, NULL, NULL, NULL
+	},
+
 	{
 		{"relcache_query_target", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
 			"Target node to send relache queries.",
@@ -4704,6 +4931,49 @@ config_post_processor(ConfigContext context, int elevel)
 				(errmsg("invalid configuration, failover_when_quorum_exists is not allowed in native replication mode")));
 		return false;
 	}
+
+	/*
+	 * Transaction pooling shares cached backend connections among the
+	 * sessions of a multiplexed child.
+	 */
+	if (pool_config->transaction_pooling &&
+		(pool_config->sessions_per_child <= 1 || !pool_config->connection_cache))
+	{
+		pool_config->transaction_pooling = false;
+		ereport(elevel,
+				(errmsg("invalid configuration, transaction_pooling requires sessions_per_child greater than 1 and connection_cache to be on")));
+		return false;
+	}
+
+	/*
+	 * A child process still waits for its sockets by select() in places,
+	 * thus the descriptors of all the sessions of a multiplexed child must
+	 * stay below FD_SETSIZE.  In transaction pooling mode the sessions
+	 * share at most max_pool backend connections.
+	 */
+	if (pool_config->sessions_per_child > 1)
+	{
+		int			sessions;
+		int			child_fds;
+
+		if (pool_config->transaction_pooling)
+			child_fds = pool_config->sessions_per_child +
+				pool_config->max_pool * pool_config->backend_desc->num_backends;
+		else
+		{
+			sessions = Max(Min(pool_config->sessions_per_child, pool_config->max_pool), 1);
+			child_fds = sessions * (1 + pool_config->backend_desc->num_backends);
+		}
+
+		if (child_fds > FD_SETSIZE - CHILD_RESERVED_FDS)
+		{
+			ereport(elevel,
+					(errmsg("invalid configuration, sessions_per_child is too large"),
+					 errdetail("a child process would need %d descriptors for its sessions, which exceeds %d",
+							   child_fds, FD_SETSIZE - CHILD_RESERVED_FDS)));
+			return false;
+		}
+	}
 	return true;
 }
 
@@ -4876,6 +5146,50 @@ MakeDBRedirectListRegex(char *newval, int elevel)
 	return true;
 }
 
+static bool
+MakeMemqcacheTableExpireListRegex(char *newval, int elevel)
+{
+	int			i;
+	Left_right_tokens *lrtokens;
+
+	if (newval == NULL)
+	{
+		pool_config->memqcache_expire_tables = NULL;
+		pool_config->memqcache_expire_tokens = NULL;
+		return true;
+	}
+
+	lrtokens = create_lrtoken_array();
+	extract_string_tokens2(newval, ",", ':', lrtokens);
+
+	pool_config->memqcache_expire_tables = create_regex_array();
+	pool_config->memqcache_expire_tokens = lrtokens;
+
+	for (i = 0; i < lrtokens->pos; i++)
+	{
+		char	   *right_token = lrtokens->token[i].right_token;
+
+		if (*right_token == '\0' ||
+			strspn(right_token, "0123456789") != strlen(right_token))
+		{
+			ereport(elevel,
+					(errmsg("invalid configuration for key \"memqcache_table_expire_list\""),
+					 errdetail("wrong expire: \"%s\"", right_token)));
+			return false;
+		}
+
+		if (*(lrtokens->token[i].left_token) == '\0' ||
+			add_regex_array(pool_config->memqcache_expire_tables, lrtokens->token[i].left_token))
+		{
+			ereport(elevel,
+					(errmsg("invalid configuration for key \"memqcache_table_expire_list\""),
+					 errdetail("wrong table name regular expression: \"%s\"", lrtokens->token[i].left_token)));
+			return false;
+		}
+	}
+	return true;
+}
+
 /* Read the pgpool_node_id file */
 static bool
 SetPgpoolNodeId(int elevel)
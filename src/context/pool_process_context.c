@@ -209,6 +209,75 @@ pool_coninfo_pid(int pid, int connection_pool, int backend)
 					 backend];
 }
 
+/*
+ * Return byte size of frontend cancel key table(FrontendCancelKey) on
+ * shmem.
+ */
+int
+pool_frontend_cancel_key_size(void)
+{
+	return pool_config->num_init_children *
+		pool_config->max_pool *
+		sizeof(FrontendCancelKey);
+}
+
+/*
+ * Return pointer to the frontend cancel key of i th child and j th
+ * connection pool on shmem.  Returns NULL if transaction pooling is not
+ * enabled.
+ */
+FrontendCancelKey *
+pool_frontend_cancel_key(int child, int connection_pool)
+{
+	if (frontend_cancel_keys == NULL)
+		return NULL;
+
+	if (child < 0 || child >= pool_config->num_init_children ||
+		connection_pool < 0 || connection_pool >= pool_config->max_pool)
+	{
+		ereport(WARNING,
+				(errmsg("failed to get frontend cancel key, invalid child number: %d or connection pool number: %d",
+						child, connection_pool)));
+		return NULL;
+	}
+
+	return &frontend_cancel_keys[child * pool_config->max_pool + connection_pool];
+}
+
+/*
+ * Return byte size of connection pool statistics table(ConnectionPoolStats)
+ * on shmem.
+ */
+int
+pool_connection_pool_stats_size(void)
+{
+	return pool_config->num_init_children *
+		pool_config->max_pool *
+		sizeof(ConnectionPoolStats);
+}
+
+/*
+ * Return pointer to the statistics of i th child and j th connection pool
+ * on shmem.
+ */
+ConnectionPoolStats *
+pool_connection_pool_stats(int child, int connection_pool)
+{
+	if (connection_pool_stats == NULL)
+		return NULL;
+
+	if (child < 0 || child >= pool_config->num_init_children ||
+		connection_pool < 0 || connection_pool >= pool_config->max_pool)
+	{
+		ereport(WARNING,
+				(errmsg("failed to get connection pool statistics, invalid child number: %d or connection pool number: %d",
+						child, connection_pool)));
+		return NULL;
+	}
+
+	return &connection_pool_stats[child * pool_config->max_pool + connection_pool];
+}
+
 /*
  * locate and return the shared memory ConnectionInfo having the
  * backend connection with the pid
@@ -138,6 +138,33 @@ pool_query_context_shallow_copy(POOL_QUERY_CONTEXT * query_context)
 	return qc;
 }
 
+/*
+ * Copy given query context including the query strings and the parse
+ * tree, so that the copy can outlive the original.  Used in Bind to send a
+ * named statement to other nodes than the ones it was parsed on.
+ */
+POOL_QUERY_CONTEXT *
+pool_query_context_copy(POOL_QUERY_CONTEXT * query_context)
+{
+	POOL_QUERY_CONTEXT *qc;
+	MemoryContext old_context;
+
+	qc = pool_query_context_shallow_copy(query_context);
+
+	old_context = MemoryContextSwitchTo(qc->memory_context);
+	if (query_context->original_query)
+		qc->original_query = pstrdup(query_context->original_query);
+	if (query_context->rewritten_query)
+		qc->rewritten_query = pstrdup(query_context->rewritten_query);
+	if (query_context->parse_tree)
+		qc->parse_tree = copyObject(query_context->parse_tree);
+	qc->rewritten_parse_tree = NULL;
+	qc->query_w_hex = NULL;
+	MemoryContextSwitchTo(old_context);
+
+	return qc;
+}
+
 /*
  * Start query
  */
@@ -547,12 +574,13 @@ pool_where_to_send(POOL_QUERY_CONTEXT * query_context, char *query, Node *node)
 					 */
 
 					/*
-					 * If replication delay is too much, we prefer to send to
-					 * the primary.
+					 * If replication delay is too much or could not be
+					 * measured, we prefer to send to the primary.
 					 */
 					if (STREAM &&
 						pool_config->delay_threshold &&
-						bkinfo->standby_delay > pool_config->delay_threshold)
+						(bkinfo->standby_delay > pool_config->delay_threshold ||
+						 standby_delay_is_unknown(session_context->load_balance_node_id)))
 					{
 						ereport(DEBUG1,
 								(errmsg("could not load balance because of too much replication delay"),
@@ -1543,9 +1571,34 @@ where_to_send_deallocate(POOL_QUERY_CONTEXT * query_context, Node *node)
 		msg = pool_get_sent_message('Q', d->name, POOL_SENT_MESSAGE_CREATED);
 		if (!msg)
 			msg = pool_get_sent_message('P', d->name, POOL_SENT_MESSAGE_CREATED);
-		if (msg)
+		if (msg && msg->kind == 'P')
+		{
+			int			i;
+			bool		found = false;
+
+			/*
+			 * The statement may have been parsed on other nodes than the
+			 * ones the parse message was sent to, by statement level load
+			 * balancing or parse_before_bind().  Deallocate it on all of
+			 * them as close message does.
+			 */
+			for (i = 0; i < NUM_BACKENDS; i++)
+			{
+				query_context->where_to_send[i] = msg->prepared_on[i] && VALID_BACKEND_RAW(i);
+				if (query_context->where_to_send[i])
+					found = true;
+			}
+
+			/* all the nodes the statement exists on are down */
+			if (!found)
+				pool_setall_node_to_be_sent(query_context);
+
+			/* copy load balance node id as well */
+			query_context->load_balance_node_id = msg->query_context->load_balance_node_id;
+		}
+		else if (msg)
 		{
-			/* Inherit same map from PREPARE or PARSE */
+			/* Inherit same map from PREPARE */
 			pool_copy_prep_where(msg->query_context->where_to_send,
 								 query_context->where_to_send);
 
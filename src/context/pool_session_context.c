@@ -209,6 +209,30 @@ pool_session_context_destroy(void)
 	session_context = NULL;
 }
 
+/*
+ * Detach the per session context from this process and copy it to
+ * "save" so that another session can be started.  Used by multiplexed
+ * child mode (sessions_per_child > 1) to park an idle session.
+ */
+void
+pool_session_context_save(POOL_SESSION_CONTEXT * save)
+{
+	if (session_context)
+		memcpy(save, session_context, sizeof(*save));
+	memset(&session_context_d, 0, sizeof(session_context_d));
+	session_context = NULL;
+}
+
+/*
+ * Reattach a per session context saved by pool_session_context_save().
+ */
+void
+pool_session_context_restore(POOL_SESSION_CONTEXT * saved)
+{
+	memcpy(&session_context_d, saved, sizeof(session_context_d));
+	session_context = &session_context_d;
+}
+
 /*
  * Return session context
  */
@@ -585,6 +609,7 @@ pool_create_sent_message(char kind, int len, char *contents,
 	msg->num_tsparams = num_tsparams;
 	msg->name = pstrdup(name);
 	msg->query_context = query_context;
+	memset(msg->prepared_on, 0, sizeof(msg->prepared_on));
 	MemoryContextSwitchTo(old_context);
 
 	return msg;
@@ -1822,6 +1847,95 @@ pool_unset_suspend_reading_from_frontend(void)
 	session_context->suspend_reading_from_frontend = false;
 }
 
+/*
+ * Set pin_backend flag, or pin_backend_params flag if params is true.  The
+ * session keeps its backend connection until the flag is unset or the
+ * session ends in transaction pooling mode.
+ */
+void
+pool_set_pin_backend(bool params)
+{
+	if (!session_context)
+		return;
+
+	if (params && !session_context->pin_backend_params)
+	{
+		ereport(DEBUG1,
+				(errmsg("run time parameter changed, backend connection is kept until RESET ALL")));
+		session_context->pin_backend_params = true;
+	}
+	else if (!params && !session_context->pin_backend)
+	{
+		ereport(DEBUG1,
+				(errmsg("session state changed, backend connection is kept until DISCARD ALL")));
+		session_context->pin_backend = true;
+	}
+}
+
+/*
+ * Unset pin_backend_params flag, and pin_backend flag too unless
+ * params_only is true.
+ */
+void
+pool_unset_pin_backend(bool params_only)
+{
+	if (!session_context)
+		return;
+
+	if (session_context->pin_backend_params ||
+		(!params_only && session_context->pin_backend))
+		ereport(DEBUG1,
+				(errmsg("session state reset, backend connection can be shared again")));
+
+	session_context->pin_backend_params = false;
+	if (!params_only)
+		session_context->pin_backend = false;
+}
+
+/*
+ * Is pin_backend or pin_backend_params flag set?
+ */
+bool
+pool_is_pin_backend(void)
+{
+	return session_context->pin_backend || session_context->pin_backend_params;
+}
+
+/*
+ * Return true if the backend connection of the idle session can be used
+ * by other sessions in transaction pooling mode, that is, no transaction
+ * is open, neither session state nor named prepared statements and portals
+ * remain on the backend, and the parameters reported by the backend have
+ * the values at the connection start up.
+ */
+bool
+pool_can_release_backend(void)
+{
+	POOL_CONNECTION_POOL *backend;
+	int			i;
+
+	if (!session_context || pool_is_pin_backend())
+		return false;
+
+	backend = session_context->backend;
+	if (pool_params_changed(&MAIN(backend)->params, &MAIN(backend)->startup_params))
+		return false;
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (VALID_BACKEND(i) && TSTATE(backend, i) != 'I')
+			return false;
+	}
+
+	for (i = 0; i < session_context->message_list.size; i++)
+	{
+		POOL_SENT_MESSAGE *msg = session_context->message_list.sent_messages[i];
+
+		if (msg->name && *msg->name != '\0')
+			return false;
+	}
+	return true;
+}
+
 #ifdef NOT_USED
 /*
  * Set preferred "main" node id.
@@ -67,6 +67,10 @@ extern int	pool_coninfo_size(void);
 extern int	pool_coninfo_num(void);
 extern ConnectionInfo * pool_coninfo(int child, int connection_pool, int backend);
 extern ConnectionInfo * pool_coninfo_pid(int pid, int connection_pool, int backend);
+extern int	pool_frontend_cancel_key_size(void);
+extern FrontendCancelKey * pool_frontend_cancel_key(int child, int connection_pool);
+extern int	pool_connection_pool_stats_size(void);
+extern ConnectionPoolStats * pool_connection_pool_stats(int child, int connection_pool);
 extern void pool_coninfo_set_frontend_connected(int proc_id, int pool_index);
 extern void pool_coninfo_unset_frontend_connected(int proc_id, int pool_index);
 
@@ -90,12 +90,19 @@ typedef struct
 									 * extended query, do not commit cache if
 									 * this flag is true. */
 
+	bool		prefer_prepared_nodes;	/* if true, load balancing prefers
+										 * the nodes in prepared_on */
+	bool		prepared_on[MAX_NUM_BACKENDS];	/* nodes on which the named
+												 * statement being bound has
+												 * been parsed */
+
 	MemoryContext memory_context;	/* memory context for query context */
 }			POOL_QUERY_CONTEXT;
 
 extern POOL_QUERY_CONTEXT * pool_init_query_context(void);
 extern void pool_query_context_destroy(POOL_QUERY_CONTEXT * query_context);
 extern POOL_QUERY_CONTEXT * pool_query_context_shallow_copy(POOL_QUERY_CONTEXT * query_context);
+extern POOL_QUERY_CONTEXT * pool_query_context_copy(POOL_QUERY_CONTEXT * query_context);
 extern void pool_start_query(POOL_QUERY_CONTEXT * query_context, char *query, int len, Node *node);
 extern void pool_set_node_to_be_sent(POOL_QUERY_CONTEXT * query_context, int node_id);
 extern bool pool_is_node_to_be_sent(POOL_QUERY_CONTEXT * query_context, int node_id);
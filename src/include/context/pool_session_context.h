@@ -83,6 +83,12 @@ typedef struct
 	char	   *name;			/* object name of prepared statement or portal */
 	POOL_QUERY_CONTEXT *query_context;
 
+	/*
+	 * Nodes on which the statement has been parsed.  Only used for kind =
+	 * 'P' in streaming and logical replication mode.
+	 */
+	bool		prepared_on[MAX_NUM_BACKENDS];
+
 	/*
 	 * Following members are only used when memcache is enabled.
 	 */
@@ -302,10 +308,31 @@ typedef struct
 	/* Whether transaction is read only. Only used by Snapshot Isolation mode. */
 	SI_STATE	transaction_read_only;
 
+	/*
+	 * Startup packet of the session.  Used to get a backend connection
+	 * again in transaction pooling mode.
+	 */
+	StartupPacket *startup_packet;
+
+	/*
+	 * True if the session has changed the state of the backend session
+	 * (LISTEN, temporary tables etc.) and must keep its backend connection
+	 * in transaction pooling mode.  Cleared by DISCARD ALL.
+	 */
+	bool		pin_backend;
+
+	/*
+	 * True if the session has changed run time parameters by SET.  Cleared
+	 * by RESET ALL and DISCARD ALL.
+	 */
+	bool		pin_backend_params;
+
 }			POOL_SESSION_CONTEXT;
 
 extern void pool_init_session_context(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern void pool_session_context_destroy(void);
+extern void pool_session_context_save(POOL_SESSION_CONTEXT * save);
+extern void pool_session_context_restore(POOL_SESSION_CONTEXT * saved);
 extern POOL_SESSION_CONTEXT * pool_get_session_context(bool noerror);
 extern int	pool_get_local_session_id(void);
 extern bool pool_is_query_in_progress(void);
@@ -373,6 +400,10 @@ extern void pool_set_major_version(int major);
 extern void pool_set_minor_version(int minor);
 extern int	pool_get_minor_version(void);
 extern bool pool_is_suspend_reading_from_frontend(void);
+extern void pool_set_pin_backend(bool params);
+extern void pool_unset_pin_backend(bool params_only);
+extern bool pool_is_pin_backend(void);
+extern bool pool_can_release_backend(void);
 extern void pool_set_suspend_reading_from_frontend(void);
 extern void pool_unset_suspend_reading_from_frontend(void);
 
@@ -39,11 +39,16 @@ typedef struct {
 	time_t	last_successful_health_check;	/* last succesfull health check timestamp */
 	time_t	last_skip_health_check;			/* last skipped health check timestamp */
 	time_t	last_failed_health_check;		/* last failed health check timestamp */
+	uint64	probe_count;	/* total count of probes by the health check prober */
+	uint64	probe_fail_count;	/* total count of failed probes */
+	time_t	last_failed_probe;	/* last failed probe timestamp */
+	pid_t	pid;			/* pid of the health check process of the node */
 } POOL_HEALTH_CHECK_STATISTICS;
 
 extern volatile POOL_HEALTH_CHECK_STATISTICS	*health_check_stats;	/* health check stats area in shared memory */
 
 extern void do_health_check_child(int *node_id);
+extern void do_health_check_prober(void);
 extern size_t	health_check_stats_shared_memory_size(void);
 extern void		health_check_stats_init(POOL_HEALTH_CHECK_STATISTICS *addr);
 
@@ -172,6 +172,7 @@ typedef struct
 #define POOLCONFIG_MAXDATELEN 128
 #define POOLCONFIG_MAXCOUNTLEN 16
 #define POOLCONFIG_MAXLONGCOUNTLEN 20
+#define POOLCONFIG_MAXLAGHISTORYLEN 680
 
 /* config report struct*/
 typedef struct
@@ -224,6 +225,8 @@ typedef struct
 	int			pool_counter;
 	int			pool_backendpid;
 	int			pool_connected;
+	int			pool_hits;
+	int			pool_misses;
 }			POOL_REPORT_POOLS;
 
 /* version struct */
@@ -255,6 +258,9 @@ typedef struct
 	char		last_successful_health_check[POOLCONFIG_MAXDATELEN];
 	char		last_skip_health_check[POOLCONFIG_MAXDATELEN];
 	char		last_failed_health_check[POOLCONFIG_MAXDATELEN];
+	char		probe_count[POOLCONFIG_MAXLONGCOUNTLEN+1];
+	char		probe_fail_count[POOLCONFIG_MAXLONGCOUNTLEN+1];
+	char		last_failed_probe[POOLCONFIG_MAXDATELEN];
 }			POOL_HEALTH_CHECK_STATS;
 
 /* show backend statistics report struct */
@@ -274,6 +280,20 @@ typedef struct
 	char		panic_cnt[POOLCONFIG_MAXWEIGHTLEN + 1];	
 	char		fatal_cnt[POOLCONFIG_MAXWEIGHTLEN + 1];	
 	char		error_cnt[POOLCONFIG_MAXWEIGHTLEN + 1];	
+	char		bytes_in[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		bytes_out[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		latency_p50[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		latency_p90[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		latency_p99[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		select_p99[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		insert_p99[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		update_p99[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		delete_p99[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		ddl_p99[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		other_p99[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		replication_lag[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		last_lag_check[POOLCONFIG_MAXDATELEN];
+	char		replication_lag_history[POOLCONFIG_MAXLAGHISTORYLEN + 1];
 }			POOL_BACKEND_STATS;
 
 typedef enum
@@ -336,9 +356,11 @@ extern PCPResultInfo * pcp_terminate_pgpool(PCPConnInfo * pcpConn, char mode, ch
 extern PCPResultInfo * pcp_node_count(PCPConnInfo * pcpCon);
 extern PCPResultInfo * pcp_node_info(PCPConnInfo * pcpCon, int nid);
 extern PCPResultInfo * pcp_health_check_stats(PCPConnInfo * pcpCon, int nid);
+extern PCPResultInfo * pcp_backend_stats(PCPConnInfo * pcpCon, int nid);
 extern PCPResultInfo * pcp_process_count(PCPConnInfo * pcpConn);
 extern PCPResultInfo * pcp_process_info(PCPConnInfo * pcpConn, int pid);
 extern PCPResultInfo * pcp_reload_config(PCPConnInfo * pcpConn,char command_scope);
+extern PCPResultInfo * pcp_snapshot_query_cache(PCPConnInfo * pcpConn);
 
 extern PCPResultInfo * pcp_detach_node(PCPConnInfo * pcpConn, int nid);
 extern PCPResultInfo * pcp_detach_node_gracefully(PCPConnInfo * pcpConn, int nid);
@@ -366,6 +388,7 @@ extern int	pcp_result_is_empty(PCPResultInfo * res);
 extern char *role_to_str(SERVER_ROLE role);
 
 extern	int * pool_health_check_stats_offsets(int *n);
+extern	int * pool_backend_stats_offsets(int *n);
 
 /* ------------------------------
  * pcp_error.c
@@ -237,6 +237,13 @@ typedef struct
 	 */
 	ParamStatus params;
 
+	/*
+	 * parameter status reported by the backend at connection start up. In
+	 * transaction pooling mode the connection can be shared only while the
+	 * parameters have these values.
+	 */
+	ParamStatus startup_params;
+
 	int			no_forward;		/* if non 0, do not write to frontend */
 
 	char		kind;			/* kind cache */
@@ -258,6 +265,8 @@ typedef struct
 	PasswordMapping *passwordMapping;
 	ConnectionInfo *con_info;	/* shared memory coninfo used for handling the
 								 * query containing pg_terminate_backend */
+	int			cancel_pid;		/* backend key data sent to the frontend */
+	int			cancel_key;
 }			POOL_CONNECTION;
 
 /*
@@ -278,8 +287,36 @@ typedef struct
 {
 	ConnectionInfo *info;		/* connection info on shmem */
 	POOL_CONNECTION_POOL_SLOT *slots[MAX_NUM_BACKENDS];
+	int			released_sessions;	/* # of sessions which released their
+									 * connection in transaction pooling mode
+									 * and count on this one to continue */
 }			POOL_CONNECTION_POOL;
 
+/*
+ * Cancel key of the frontend currently using a connection pool slot in
+ * transaction pooling mode.  A frontend keeps the cancel key it received
+ * at connection start while it may use other slots afterwards.
+ */
+typedef struct
+{
+	int			pid;			/* backend pid sent to the frontend */
+	int			key;			/* cancel key sent to the frontend */
+}			FrontendCancelKey;
+
+/*
+ * Usage statistics of a connection pool slot.  Unlike ConnectionInfo,
+ * they survive discarding the connection in the slot and are reset only
+ * when the child process starts.
+ */
+typedef struct
+{
+	int			hits;			/* number of times a pooled connection in
+								 * the slot was reused */
+	int			misses;			/* number of times a new connection was
+								 * made in the slot because no pooled
+								 * connection matched */
+}			ConnectionPoolStats;
+
 
 /* Defined in pool_session_context.h */
 extern int	pool_get_major_version(void);
@@ -379,7 +416,7 @@ typedef enum
 #define Min(x, y)		((x) < (y) ? (x) : (y))
 
 
-#define MAX_NUM_SEMAPHORES		7
+#define MAX_NUM_SEMAPHORES		10
 #define CONN_COUNTER_SEM		0
 #define REQUEST_INFO_SEM		1
 #define SHM_CACHE_SEM			2
@@ -387,6 +424,10 @@ typedef enum
 #define PCP_REQUEST_SEM			4
 #define ACCEPT_FD_SEM			5
 #define SI_CRITICAL_REGION_SEM	6
+#define SHM_CACHE_WRITER_SEM	7
+#define SHARED_RELCACHE_SEM		8
+#define SHM_CACHE_REFRESH_SEM	9
+#define SHM_CACHE_MAX_READERS	32767	/* SEMVMX on most platforms */
 #define MAX_REQUEST_QUEUE_SIZE	10
 
 #define MAX_SEC_WAIT_FOR_CLUSTER_TRANSATION 10	/* time in seconds to keep
@@ -509,6 +550,7 @@ typedef enum
 	PT_PCP_WORKER,
 	PT_HEALTH_CHECK,
 	PT_LOGGER,
+	PT_ACCEPT_DISPATCHER,
 	PT_LAST_PTYPE	/* last ptype marker. any ptype must be above this. */
 }			ProcessType;
 
@@ -559,8 +601,16 @@ extern volatile sig_atomic_t backend_timer_expired; /* flag for connection
 extern volatile sig_atomic_t health_check_timer_expired;	/* non 0 if health check
 															 * timer expired */
 extern int	my_proc_id;			/* process table id (!= UNIX's PID) */
+extern int	my_spare_id;		/* spare child table id, -1 if not a spare */
+extern volatile sig_atomic_t *spare_child_slots;	/* shmem process table id
+													 * handed over to each
+													 * spare child */
 extern ProcessInfo * process_info;	/* shmem process information table */
 extern ConnectionInfo * con_info;	/* shmem connection info table */
+extern FrontendCancelKey * frontend_cancel_keys;	/* shmem frontend cancel
+													 * key table */
+extern ConnectionPoolStats * connection_pool_stats;	/* shmem connection pool
+													 * statistics table */
 extern POOL_REQUEST_INFO * Req_info;
 extern volatile sig_atomic_t *InRecovery;
 extern volatile sig_atomic_t got_sighup;
@@ -592,8 +642,13 @@ extern void pcp_main(int unix_fd, int inet_fd);
 
 /*child.c*/
 
+extern int	accept_dispatch_fds[2];
+
 extern void do_child(int *fds);
+extern void do_accept_dispatcher(int *fds);
+extern void create_accept_dispatch_socket(void);
 extern void child_exit(int code);
+extern bool pool_is_multiplexed_child(void);
 
 extern void cancel_request(CancelPacket * sp);
 extern void check_stop_request(void);
@@ -635,7 +690,32 @@ extern size_t strlcpy(char *dst, const char *src, size_t siz);
 #endif
 
 /* pool_worker_child.c */
+
+/*
+ * Replication lag history of a node, kept as a ring buffer in shared
+ * memory.  Only the worker process writes it.
+ */
+#define SR_LAG_HISTORY_SIZE	32
+
+typedef struct
+{
+	int64		time;			/* time of the measurement in milliseconds */
+	int64		lag;			/* replication lag in bytes. -1 if the lag
+								 * could not be measured */
+}			SR_LAG_SAMPLE;
+
+typedef struct
+{
+	uint32		count;			/* total number of samples written */
+	SR_LAG_SAMPLE samples[SR_LAG_HISTORY_SIZE];
+}			SR_LAG_HISTORY;
+
+extern volatile SR_LAG_HISTORY *sr_lag_history;
+
 extern void do_worker_child(void);
 extern int	get_query_result(POOL_CONNECTION_POOL_SLOT * *slots, int backend_id, char *query, POOL_SELECT_RESULT * *res);
+extern size_t sr_lag_history_shared_memory_size(void);
+extern void sr_lag_history_init(SR_LAG_HISTORY *addr);
+extern bool standby_delay_is_unknown(int node_id);
 
 #endif							/* POOL_H */
@@ -49,6 +49,18 @@
 #define WRITELIST	0
 #define READONLYLIST	1
 #define PATTERN_ARR_SIZE 16		/* Default length of regex array: 16 patterns */
+
+/*
+ * Number of descriptors a child process may use besides the ones of its
+ * client sessions: listening sockets, inherited pipes, log and so on.
+ */
+#define CHILD_RESERVED_FDS	64
+
+/*
+ * Upper limit of sessions_per_child.  Each session uses at least its
+ * frontend socket, which must stay below FD_SETSIZE.
+ */
+#define MAX_SESSIONS_PER_CHILD	(FD_SETSIZE - CHILD_RESERVED_FDS)
 typedef struct
 {
 	char	   *pattern;
@@ -104,6 +116,14 @@ typedef enum DLBOW_OPTION
 	DLBOW_DML_ADAPTIVE
 }			DLBOW_OPTION;
 
+typedef enum LOAD_BALANCE_POLICY
+{
+	LBP_WEIGHTED_RANDOM = 1,
+	LBP_LEAST_OUTSTANDING,
+	LBP_EWMA_LATENCY,
+	LBP_POWER_OF_TWO_CHOICES
+}			LOAD_BALANCE_POLICY;
+
 typedef enum RELQTARGET_OPTION
 {
 	RELQTARGET_PRIMARY = 1,
@@ -216,11 +236,18 @@ typedef struct
 	int			reserved_connections;	/* # of reserved connections */
 	bool		serialize_accept;	/* if non 0, serialize call to accept() to
 									 * avoid thundering herd problem */
+	bool		accept_dispatcher;	/* if true, a dedicated process accepts
+									 * connections and hands them to idle
+									 * children */
 	int			child_life_time;	/* if idle for this seconds, child exits */
 	int			connection_life_time;	/* if idle for this seconds,
 										 * connection closes */
 	int			child_max_connections;	/* if max_connections received, child
 										 * exits */
+	int			spare_children;	/* # of pre-forked spare children taking
+								 * over exited children */
+	int			child_respawn_rate;	/* max # of children forked per second
+									 * to replace exited ones */
 	int			client_idle_limit;	/* If client_idle_limit is n (n > 0), the
 									 * client is forced to be disconnected
 									 * after n seconds idle */
@@ -234,6 +261,11 @@ typedef struct
 	int			authentication_timeout; /* maximum time in seconds to complete
 										 * client authentication */
 	int			max_pool;		/* max # of connection pool per child */
+	int			sessions_per_child;	/* max # of frontend sessions served
+										 * concurrently per child */
+	bool		transaction_pooling;	/* if true, sessions of a multiplexed
+										 * child share backend connections
+										 * between transactions */
 	char	   *logdir;			/* logging directory */
 	char	   *log_destination_str;	/* log destination: stderr and/or
 										 * syslog */
@@ -273,6 +305,9 @@ typedef struct
 	int			auto_failback_interval;	/* min interval of executing auto_failback */
 	bool		replicate_select;	/* replicate SELECT statement when load
 									 * balancing is disabled. */
+	bool		replicate_write_in_parallel;	/* send write queries to all
+												 * nodes at once in native
+												 * replication mode */
 	char	  **reset_query_list;	/* comma separated list of queries to be
 									 * issued at the end of session */
 	char	  **read_only_function_list;	/* list of functions with no side
@@ -319,7 +354,14 @@ typedef struct
 									 * connecting to backend */
 	HealthCheckParams *health_check_params; /* per node health check
 											 * parameters */
+	int			health_check_probe_interval;	/* interval in milliseconds
+												 * between connection probes of
+												 * the health check prober. 0
+												 * disables the prober */
 	int			sr_check_period;	/* streaming replication check period */
+	int			sr_check_lag_interval;	/* interval in milliseconds between
+										 * replication lag checks. 0 means
+										 * sr_check_period is used */
 	char	   *sr_check_user;	/* PostgreSQL user name for streaming
 								 * replication check */
 	char	   *sr_check_password;	/* password for sr_check_user */
@@ -339,6 +381,9 @@ typedef struct
 											 * report an error and disconnect
 											 * the session. */
 	bool		detach_false_primary;	/* If true, detach false primary */
+	bool		failover_keep_sessions;	/* If true, keep sessions over failover
+										 * of a standby node in streaming
+										 * replication mode */
 	char	   *recovery_user;	/* PostgreSQL user name for online recovery */
 	char	   *recovery_password;	/* PostgreSQL user password for online
 									 * recovery */
@@ -407,7 +452,10 @@ typedef struct
 	CHECK_TEMP_TABLE_OPTION		check_temp_table;	/* how to check temporary table */
 	bool		check_unlogged_table;	/* enable unlogged table check */
 	bool		enable_shared_relcache;	/* If true, relation cache stored in memory cache */
+	int			shared_relcache_size;	/* number of relation cache entries
+										 * on shared memory */
 	RELQTARGET_OPTION	relcache_query_target;	/* target node to send relcache queries */
+	int			parse_cache_size;	/* number of parse tree cache entries */
 
 	/*
 	 * followings are for regex support and do not exist in the configuration
@@ -433,6 +481,10 @@ typedef struct
 	int			memqcache_memcached_port;	/* Memcached port number.
 											 * Mandatory if
 											 * memqcache_method=memcached. */
+	bool		memqcache_memcached_pipelining; /* If true, send stores and
+												 * deletes to memcached
+												 * without waiting for
+												 * replies */
 	int64		memqcache_total_size;	/* Total memory size in bytes for
 										 * storing memory cache. Mandatory if
 										 * memqcache_method=shmem. */
@@ -441,6 +493,16 @@ typedef struct
 											 * memqcache_method=shmem. */
 	int			memqcache_expire;	/* Memory cache entry life time specified
 									 * in seconds. 60 by default. */
+	int			memqcache_stale_while_revalidate;	/* Seconds an expired
+													 * cache entry may still
+													 * be used while one
+													 * process refreshes it */
+	int			memqcache_admission_min_duration;	/* Minimum execution time
+													 * in milliseconds of
+													 * SELECT to be cached */
+	int			memqcache_admission_min_count;	/* Minimum number of
+												 * executions of SELECT to be
+												 * cached */
 	bool		memqcache_auto_cache_invalidation;	/* If true, invalidation
 													 * of query cache is
 													 * triggered by
@@ -450,8 +512,15 @@ typedef struct
 	int			memqcache_maxcache; /* Maximum SELECT result size in bytes. */
 	int			memqcache_cache_block_size; /* Cache block size in bytes. 8192
 											 * by default */
+	bool		memqcache_compression;	/* If true, compress query cache
+										 * entries */
+	int			memqcache_compression_threshold;	/* Minimum SELECT result
+													 * size in bytes to be
+													 * compressed */
 	char	   *memqcache_oiddir;	/* Temporary work directory to record
 									 * table oids */
+	char	   *memqcache_snapshot_file;	/* File to save the shmem query
+											 * cache across restarts */
 	char	  **cache_safe_memqcache_table_list; /* list of tables to memqcache */
 	char	  **cache_unsafe_memqcache_table_list; /* list of tables not to memqcache */
 
@@ -461,6 +530,15 @@ typedef struct
 	int			current_memqcache_table_pattern_size;	/* size of the regex
 														 * pattern array */
 
+	/*
+	 * memqcache_table_expire_list = 'dashboard_.*:600,hot_table:5'
+	 */
+	char	   *memqcache_table_expire_list;	/* raw string in pgpool.conf */
+	RegArray   *memqcache_expire_tables;	/* Precompiled regex patterns for
+											 * table expire list */
+	Left_right_tokens *memqcache_expire_tokens; /* table name and expire
+												 * string */
+
 	/*
 	 * database_redirect_preference_list =
 	 * 'postgres:primary,mydb[0-4]:1,mydb[5-9]:2'
@@ -514,6 +592,9 @@ typedef struct
 	DBObjectRelation *parsed_dml_adaptive_object_relationship_list;
 
 	bool		statement_level_load_balance; /* if on, select load balancing node per statement */
+	LOAD_BALANCE_POLICY load_balance_policy;	/* how to choose the load
+												 * balance node among the
+												 * candidates */
 
 	/*
 	 * add for watchdog
@@ -28,6 +28,12 @@ extern int pool_init_cp(void);
 extern POOL_CONNECTION_POOL * pool_create_cp(void);
 extern POOL_CONNECTION_POOL * pool_get_cp(char *user, char *database, int protoMajor, int check_socket);
 extern void pool_discard_cp(char *user, char *database, int protoMajor);
+extern bool pool_detach_down_backends(POOL_CONNECTION_POOL * backend);
+extern void pool_release_cp(POOL_CONNECTION_POOL * p);
+extern bool pool_has_free_cp(void);
+extern POOL_CONNECTION_POOL * pool_acquire_cp(StartupPacket *sp, bool *busy);
+extern void pool_register_cp(POOL_CONNECTION_POOL * p);
+extern void pool_invalidate_cp_index(void);
 extern void pool_backend_timer(void);
 extern void pool_connection_pool_timer(POOL_CONNECTION_POOL * backend);
 extern RETSIGTYPE pool_backend_timer_handler(int sig);
@@ -36,5 +42,6 @@ extern int	connect_unix_domain_socket(int slot, bool retry);
 extern int	connect_inet_domain_socket_by_port(char *host, int port, bool retry);
 extern int	connect_unix_domain_socket_by_port(int port, char *socket_dir, bool retry);
 extern int	pool_pool_index(void);
+extern void pool_set_pool_index(int index);
 extern void close_all_backend_connections(void);
 #endif /* pool_connection_pool_h */
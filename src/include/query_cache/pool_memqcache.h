@@ -75,12 +75,30 @@ typedef struct
 #define POOL_ITEM_HAS_NEXT	0x0002	/* is this item has "next" item? */
 #define POOL_ITEM_DELETED	0x0004	/* is this item deleted? */
 
+/*
+ * Maximum usage count of cache item. Each cache hit counts up the usage
+ * count and the clock sweep of pool_reuse_block() counts it down. Items
+ * with zero usage count are evicted.
+ */
+#define POOL_ITEM_MAX_USAGE_COUNT	5
+
+/*
+ * While an expired item is within memqcache_stale_while_revalidate, one
+ * process is allowed to refresh it and the others keep on using it.  If
+ * the refreshing process does not register the fresh result within this
+ * many seconds, another process is allowed to try.
+ */
+#define POOL_CACHE_REFRESH_TIMEOUT	10
+
 typedef struct
 {
 	POOL_QUERY_HASH query_hash; /* md5 hashed query signature */
 	POOL_CACHEID next;			/* next cache item if any */
 	unsigned int offset;		/* item offset in this block */
 	unsigned char flags;		/* flags. see above */
+	unsigned char usage_count;	/* usage count. see above */
+	time_t		refresh_time;	/* time when a process started refreshing
+								 * this expired item. 0 if none */
 }			POOL_CACHE_ITEM_POINTER;
 
 /*
@@ -122,6 +140,14 @@ typedef struct
 #define MAX_VALUE 8192
 #define MAX_KEY 256
 
+/*
+ * Compressed SELECT result. Uncompressed data always begins with a message
+ * kind, so the leading zero byte tells them apart. The length of the
+ * uncompressed data (int32) and the compressed data follow.
+ */
+#define POOL_CACHE_COMPRESSED_MARK '\0'
+#define POOL_CACHE_COMPRESSED_HEADER_SIZE (1 + sizeof(int32))
+
 extern int	memcached_connect(void);
 extern void memcached_disconnect(void);
 extern void memqcache_register(char kind, POOL_CONNECTION * frontend, char *data, int data_len);
@@ -158,6 +184,8 @@ typedef struct
 	POOL_INTERNAL_BUFFER *buffer;
 	int			num_oids;
 	POOL_INTERNAL_BUFFER *oids;
+	int			expire;			/* cache expire in seconds */
+	struct timeval start_time;	/* time when the query was sent to backend */
 }			POOL_TEMP_QUERY_CACHE;
 
 /*
@@ -179,8 +207,35 @@ typedef struct
 	time_t		start_time;		/* start time when the statistics begins */
 	long long int num_selects;	/* number of successful SELECTs */
 	long long int num_cache_hits;	/* number of SELECTs extracted from cache */
+	long long int num_compressed_entries;	/* number of cache entries
+											 * stored compressed */
+	long long int compressed_raw_size;	/* total size of compressed entries
+										 * before compression */
+	long long int compressed_size;	/* total size of compressed entries
+									 * after compression */
+	long long int num_admission_rejects;	/* number of SELECT results not
+											 * cached by admission policy */
 }			POOL_QUERY_CACHE_STATS;
 
+/*
+ * Per query execution statistics used by the cache admission policy
+ * (memqcache_admission_min_duration and memqcache_admission_min_count).
+ * This area must be placed on shared memory and protected by
+ * QUERY_CACHE_STATS_SEM.  Queries are identified by the cache key.  The
+ * array is a set associative table and the least recently used entry in a
+ * set is replaced by a new query.
+ */
+#define POOL_ADMISSION_STATS_SETS	1024
+#define POOL_ADMISSION_STATS_WAYS	4
+
+typedef struct
+{
+	POOL_QUERY_HASH query_hash; /* md5 hashed query signature */
+	long long int num_executions;	/* number of executions on backend */
+	long long int total_time;	/* total execution time in microseconds */
+	time_t		last_used;		/* last time the query was executed */
+}			POOL_ADMISSION_STATS;
+
 /*
  * Shared memory cache stats interface.
  */
@@ -229,6 +284,81 @@ typedef struct
 	POOL_HEADER_ELEMENT elements[1];	/* actual hash elements follows */
 }			POOL_HASH_HEADER;
 
+/*--------------------------------------------------------------------------------
+ * On shared memory table oid map implementation
+ *--------------------------------------------------------------------------------
+ */
+
+#define POOL_OID_MAP_NONE	(-1)	/* end of chain */
+
+/* Table oid map element */
+typedef struct
+{
+	int			dboid;			/* database oid */
+	int			tableoid;		/* table oid used by the cached SELECT */
+	POOL_QUERY_HASH query_hash; /* query hash of the SELECT result */
+	int			next;			/* index of next element in the hash chain
+								 * or the free list */
+}			POOL_OID_MAP_ELEMENT;
+
+/* Table oid map header */
+typedef struct
+{
+	int			nbuckets;		/* number of hash buckets (power of 2) */
+	uint32		mask;			/* mask for hash function */
+	int			nelements;		/* number of elements */
+	int			used_elements;	/* number of used elements */
+	int			free_list;		/* first free element */
+	bool		snapshot_saved; /* true if memqcache_snapshot_file has not
+								 * been outdated by invalidation yet */
+	uint32		invalidations;	/* incremented on each invalidation, to
+								 * detect ones racing with snapshot saving */
+	int			buckets[1];		/* first element of each hash chain.
+								 * actual buckets follow */
+}			POOL_OID_MAP_HEADER;
+
+extern size_t pool_oid_map_size(int nelements);
+extern int	pool_oid_map_init(int nelements);
+
+/*--------------------------------------------------------------------------------
+ * Snapshot of shared memory query cache
+ *--------------------------------------------------------------------------------
+ */
+
+/*
+ * The hash table and the cache blocks cannot be dumped as they are, since
+ * the hash table links elements by pointers and the snapshot may be
+ * reloaded with different cache parameters. So the snapshot file holds a
+ * header, the table oid map entries and then the cache items. Each cache
+ * item is written as its query hash and POOL_CACHE_ITEM_HEADER followed by
+ * the data.
+ */
+#define POOL_CACHE_SNAPSHOT_MAGIC	"PGPQCSNP"
+#define POOL_CACHE_SNAPSHOT_VERSION	1
+#define POOL_SYSTEM_IDENTIFIER_LEN	32	/* enough for uint64 in decimal */
+
+typedef struct
+{
+	char		magic[8];		/* POOL_CACHE_SNAPSHOT_MAGIC */
+	int			version;		/* POOL_CACHE_SNAPSHOT_VERSION */
+	char		system_identifier[POOL_SYSTEM_IDENTIFIER_LEN];	/* of the main
+																 * node */
+	time_t		created;		/* time when the snapshot was taken */
+	int			num_oids;		/* number of table oid map entries */
+	int			num_items;		/* number of cache items */
+}			POOL_CACHE_SNAPSHOT_HEADER;
+
+/* Table oid map entry in snapshot file */
+typedef struct
+{
+	int			dboid;			/* database oid */
+	int			tableoid;		/* table oid used by the cached SELECT */
+	POOL_QUERY_HASH query_hash; /* query hash of the SELECT result */
+}			POOL_CACHE_SNAPSHOT_OID;
+
+extern void pool_save_memqcache_snapshot(void);
+extern void pool_load_memqcache_snapshot(void);
+
 extern int	pool_hash_init(int nelements);
 extern size_t pool_hash_size(int nelements);
 extern POOL_CACHEID * pool_hash_search(POOL_QUERY_HASH * key);
@@ -239,7 +369,7 @@ extern POOL_STATUS pool_fetch_from_memory_cache(POOL_CONNECTION * frontend,
 												POOL_CONNECTION_POOL * backend,
 												char *contents, bool *foundp);
 
-extern int pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf, size_t *len);
+extern int pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf, size_t *len, bool allow_stale);
 extern int pool_catalog_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen);
 
 extern bool pool_is_likely_select(char *query);
@@ -267,10 +397,13 @@ extern POOL_TEMP_QUERY_CACHE * pool_create_temp_query_cache(char *query);
 extern void pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node, char state);
 
 extern int	pool_init_memqcache_stats(void);
+extern size_t pool_admission_stats_size(void);
+extern void pool_init_admission_stats(void);
 extern POOL_QUERY_CACHE_STATS * pool_get_memqcache_stats(void);
 extern void pool_reset_memqcache_stats(void);
 extern long long int pool_stats_count_up_num_selects(long long int num);
 extern long long int pool_stats_count_up_num_cache_hits(void);
+extern long long int pool_stats_count_up_num_compressed_entries(size_t raw_size, size_t compressed_size);
 extern long long int pool_tmp_stats_count_up_num_selects(void);
 extern long long int pool_tmp_stats_get_num_selects(void);
 extern void pool_tmp_stats_reset_num_selects(void);
@@ -280,9 +413,22 @@ extern POOL_TEMP_QUERY_CACHE * pool_get_current_cache(void);
 extern POOL_TEMP_QUERY_CACHE * pool_get_current_cache(void);
 extern void pool_discard_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache);
 
-extern void pool_shmem_lock(void);
+/*
+ * Lock mode of the query cache on shared memory. Cache lookups only need
+ * POOL_MEMQ_SHARED_LOCK so that they can run concurrently. Anything that
+ * modifies the cache (registering, deleting, invalidating or clearing
+ * entries) needs POOL_MEMQ_EXCLUSIVE_LOCK.
+ */
+typedef enum
+{
+	POOL_MEMQ_SHARED_LOCK = 1,
+	POOL_MEMQ_EXCLUSIVE_LOCK
+}			POOL_MEMQ_LOCK_TYPE;
+
+extern void pool_shmem_lock(POOL_MEMQ_LOCK_TYPE type);
 extern void pool_shmem_unlock(void);
 extern bool pool_is_shmem_lock(void);
+extern bool pool_is_shmem_exclusive_lock(void);
 
 extern void InvalidateQueryCache(int tableoid, int dboid);
 
@@ -34,5 +34,10 @@ extern void pool_semaphore_create(int numSems);
 extern void pool_semaphore_lock(int semNum);
 extern int	pool_semaphore_lock_allow_interrupt(int semNum);
 extern void pool_semaphore_unlock(int semNum);
+extern void pool_semaphore_set_value(int semNum, int value);
+extern void pool_semaphore_lock_shared(int semNum, int writerSemNum);
+extern void pool_semaphore_unlock_shared(int semNum);
+extern void pool_semaphore_lock_exclusive(int semNum, int writerSemNum, int nreaders);
+extern void pool_semaphore_unlock_exclusive(int semNum, int writerSemNum, int nreaders);
 
 #endif							/* IPC_H */
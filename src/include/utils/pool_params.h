@@ -33,6 +33,8 @@ extern void pool_discard_params(ParamStatus * params);
 extern char *pool_find_name(ParamStatus * params, char *name, int *pos);
 extern int	pool_get_param(ParamStatus * params, int index, char **name, char **value);
 extern int	pool_add_param(ParamStatus * params, char *name, char *value);
+extern void pool_copy_params(ParamStatus * dst, ParamStatus * src);
+extern bool pool_params_changed(ParamStatus * params, ParamStatus * base);
 extern void pool_param_debug_print(ParamStatus * params);
 
 
@@ -44,6 +44,8 @@ typedef struct
 	int			refcnt;			/* reference count */
 	int			session_id;		/* LocalSessionId */
 	time_t		expire;			/* cache expiration absolute time in seconds */
+	uint32		hashval;		/* hash value of dbname, relname and session_id */
+	int			next;			/* next entry in the hash chain. -1 if none */
 }			PoolRelCache;
 
 typedef struct
@@ -68,6 +70,8 @@ typedef struct
 	bool		no_cache_if_zero;	/* if register func returns 0, do not
 									 * cache the data */
 	PoolRelCache *cache;		/* cache data */
+	int			nbuckets;		/* number of hash buckets (power of 2) */
+	int		   *buckets;		/* hash buckets pointing to cache entry */
 }			POOL_RELCACHE;
 
 extern POOL_RELCACHE * pool_create_relcache(int cachesize, char *sql,
@@ -81,5 +85,7 @@ extern void *int_unregister_func(void *data);
 extern void *string_register_func(POOL_SELECT_RESULT * res);
 extern void *string_unregister_func(void *data);
 extern bool SplitIdentifierString(char *rawstring, char separator, Node **namelist);
+extern size_t pool_shared_relcache_size(void);
+extern void pool_shared_relcache_init(void);
 
 #endif							/* POOL_RELCACHE_H */
@@ -30,6 +30,7 @@
 
 #define READBUFSZ 1024
 #define WRITEBUFSZ 8192
+#define BULK_READBUFSZ (64 * 1024)	/* read size of pool_forward_messages */
 
 /*
  * Return true if read buffer is empty. Argument is POOL_CONNECTION.
@@ -53,6 +54,7 @@ extern void pool_read_with_error(POOL_CONNECTION * cp, void *buf, int len,
 extern char *pool_read2(POOL_CONNECTION * cp, int len);
 extern int	pool_write(POOL_CONNECTION * cp, void *buf, int len);
 extern int	pool_write_noerror(POOL_CONNECTION * cp, void *buf, int len);
+extern int	pool_forward_messages(POOL_CONNECTION * src, POOL_CONNECTION * dst, char kind);
 extern int	pool_flush(POOL_CONNECTION * cp);
 extern int	pool_flush_noerror(POOL_CONNECTION * cp);
 extern int	pool_flush_it(POOL_CONNECTION * cp);
@@ -21,11 +21,27 @@
 #ifndef statistics_h
 #define statistics_h
 
+/* Statement types of per node statistics */
+typedef enum
+{
+	STAT_SELECT,
+	STAT_INSERT,
+	STAT_UPDATE,
+	STAT_DELETE,
+	STAT_DDL,
+	STAT_OTHER,
+	STAT_NUM_STATEMENT_TYPES	/* must be last */
+}			StatStatementType;
+
 extern size_t	stat_shared_memory_size(void);
 extern void		stat_set_stat_area(void *address);
 extern void		stat_init_stat_area(void);
 extern void		stat_count_up(int backend_node_id, Node *parsetree);
+extern void		stat_end_query(int backend_node_id);
+extern void		stat_reset_queries_in_progress(void);
 extern void		error_stat_count_up(int backend_node_id, char *str);
+extern void		stat_count_bytes_in(int backend_node_id, int len);
+extern void		stat_count_bytes_out(int backend_node_id, int len);
 extern uint64	stat_get_select_count(int backend_node_id);
 extern uint64	stat_get_insert_count(int backend_node_id);
 extern uint64	stat_get_update_count(int backend_node_id);
@@ -35,5 +51,10 @@ extern uint64	stat_get_other_count(int backend_node_id);
 extern uint64	stat_get_panic_count(int backend_node_id);
 extern uint64	stat_get_fatal_count(int backend_node_id);
 extern uint64	stat_get_error_count(int backend_node_id);
+extern uint64	stat_get_bytes_in(int backend_node_id);
+extern uint64	stat_get_bytes_out(int backend_node_id);
+extern uint64	stat_get_latency_percentile(int backend_node_id, StatStatementType type, double percentile);
+extern uint64	stat_get_queries_in_progress(int backend_node_id);
+extern double	stat_get_latency_ewma(int backend_node_id);
 
 #endif /* statistics_h */
@@ -66,6 +66,7 @@ static void setResultIntData(PCPResultInfo * res, unsigned int slotno, int value
 
 static void process_node_info_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void	process_health_check_stats_response(PCPConnInfo * pcpConn, char *buf, int len);
+static void	process_backend_stats_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_command_complete_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_watchdog_info_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_process_info_response(PCPConnInfo * pcpConn, char *buf, int len);
@@ -442,6 +443,13 @@ static PCPResultInfo * process_pcp_response(PCPConnInfo * pcpConn, char sentMsg)
 					process_health_check_stats_response(pcpConn, buf, rsize);
 				break;
 
+			case 's':
+				if (sentMsg != 'S')
+					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+				else
+					process_backend_stats_response(pcpConn, buf, rsize);
+				break;
+
 			case 'l':
 				if (sentMsg != 'L')
 					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
@@ -477,6 +485,13 @@ static PCPResultInfo * process_pcp_response(PCPConnInfo * pcpConn, char sentMsg)
 					process_command_complete_response(pcpConn, buf, rsize);
 				break;
 
+			case 'q':
+				if (sentMsg != 'Q')
+					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+				else
+					process_command_complete_response(pcpConn, buf, rsize);
+				break;
+
 			case 'w':
 				if (sentMsg != 'W')
 					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
@@ -860,6 +875,39 @@ pcp_health_check_stats(PCPConnInfo * pcpConn, int nid)
 	return process_pcp_response(pcpConn, 'H');
 }
 
+/* --------------------------------
+ * pcp_backend_stats - get statistics of the backend node pointed by given argument
+ *
+ * return structure of backend stats on success, -1 otherwise
+ * --------------------------------
+ */
+PCPResultInfo *
+pcp_backend_stats(PCPConnInfo * pcpConn, int nid)
+{
+	int			wsize;
+	char		node_id[16];
+
+	if (PCPConnectionStatus(pcpConn) != PCP_CONNECTION_OK)
+	{
+		pcp_internal_error(pcpConn,
+						   "invalid PCP connection");
+		return NULL;
+	}
+
+	snprintf(node_id, sizeof(node_id), "%d", nid);
+
+	pcp_write(pcpConn->pcpConn, "S", 1);
+	wsize = htonl(strlen(node_id) + 1 + sizeof(int));
+	pcp_write(pcpConn->pcpConn, &wsize, sizeof(int));
+	pcp_write(pcpConn->pcpConn, node_id, strlen(node_id) + 1);
+	if (PCPFlush(pcpConn) < 0)
+		return NULL;
+	if (pcpConn->Pfdebug)
+		fprintf(pcpConn->Pfdebug, "DEBUG: send: tos=\"S\", len=%d\n", ntohl(wsize));
+
+	return process_pcp_response(pcpConn, 'S');
+}
+
 PCPResultInfo *
 pcp_reload_config(PCPConnInfo * pcpConn,char command_scope)
 {
@@ -886,6 +934,32 @@ pcp_reload_config(PCPConnInfo * pcpConn,char command_scope)
 	return process_pcp_response(pcpConn, 'Z');
 }
 
+PCPResultInfo *
+pcp_snapshot_query_cache(PCPConnInfo * pcpConn)
+{
+	int			wsize;
+
+/*
+ * pcp packet format for pcp_snapshot_query_cache
+ * Q[size]
+ */
+	if (PCPConnectionStatus(pcpConn) != PCP_CONNECTION_OK)
+	{
+		pcp_internal_error(pcpConn, "invalid PCP connection");
+		return NULL;
+	}
+
+	pcp_write(pcpConn->pcpConn, "Q", 1);
+	wsize = htonl(sizeof(int));
+	pcp_write(pcpConn->pcpConn, &wsize, sizeof(int));
+	if (PCPFlush(pcpConn) < 0)
+		return NULL;
+	if (pcpConn->Pfdebug)
+		fprintf(pcpConn->Pfdebug, "DEBUG: send: tos=\"Q\", len=%d\n", ntohl(wsize));
+
+	return process_pcp_response(pcpConn, 'Q');
+}
+
 
 /*
  * Process health check response from PCP server.
@@ -945,6 +1019,64 @@ process_health_check_stats_response
 
 }
 
+/*
+ * Process backend stats response from PCP server.
+ * pcpConn: connection to the server
+ * buf:		returned data from server
+ * len:		length of the data
+ */
+static void
+process_backend_stats_response
+(PCPConnInfo * pcpConn, char *buf, int len)
+{
+	POOL_BACKEND_STATS *stats;
+	int		*offsets;
+	int		n;
+	int		i;
+	char	*p;
+	int		maxstr;
+	char	c[] = "CommandComplete";
+
+	if (strcmp(buf, c) != 0)
+	{
+		pcp_internal_error(pcpConn,
+						   "command failed. invalid response");
+		setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+		return;
+	}
+	buf += sizeof(c);
+
+	/* Allocate backend stats memory */
+	stats = palloc0(sizeof(POOL_BACKEND_STATS));
+	p = (char *)stats;
+
+	/* Calculate total packet length */
+	offsets = pool_backend_stats_offsets(&n);
+
+	for (i = 0; i < n; i++)
+	{
+		if (i == n -1)
+			maxstr = sizeof(POOL_BACKEND_STATS) - offsets[i];
+		else
+			maxstr = offsets[i + 1] - offsets[i];
+
+		StrNCpy(p + offsets[i], buf, maxstr -1);
+		buf += strlen(buf) + 1;
+	}
+
+	if (setNextResultBinaryData(pcpConn->pcpResInfo, (void *) stats, sizeof(POOL_BACKEND_STATS), NULL) < 0)
+	{
+		if (stats)
+			pfree(stats);
+		pcp_internal_error(pcpConn,
+						   "command failed. invalid response");
+		setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+	}
+	else
+		setCommandSuccessful(pcpConn);
+
+}
+
 static void
 process_process_count_response(PCPConnInfo * pcpConn, char *buf, int len)
 {
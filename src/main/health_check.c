@@ -37,6 +37,7 @@
 #endif
 
 #include <signal.h>
+#include <poll.h>
 
 #include <stdio.h>
 #include <errno.h>
@@ -60,6 +61,7 @@
 #include "utils/pool_ip.h"
 #include "utils/ps_status.h"
 #include "utils/pool_stream.h"
+#include "utils/socket_stream.h"
 
 #include "context/pool_process_context.h"
 #include "context/pool_session_context.h"
@@ -73,6 +75,7 @@ volatile POOL_HEALTH_CHECK_STATISTICS	*health_check_stats;	/* health check stats
 static POOL_CONNECTION_POOL_SLOT * slot;
 static volatile sig_atomic_t reload_config_request = 0;
 static volatile sig_atomic_t restart_request = 0;
+static volatile sig_atomic_t check_now_request = 0;
 volatile POOL_HEALTH_CHECK_STATISTICS *stats;
 
 static bool establish_persistent_connection(int node);
@@ -81,6 +84,32 @@ static RETSIGTYPE my_signal_handler(int sig);
 static RETSIGTYPE reload_config_handler(int sig);
 static void reload_config(void);
 static RETSIGTYPE health_check_timer_handler(int sig);
+static RETSIGTYPE check_now_handler(int sig);
+static void health_check_sleep(int seconds);
+
+/*
+ * Per node state of the health check prober
+ */
+typedef struct
+{
+	int			fd;				/* socket of the probe in progress or -1 */
+	double		start;			/* start time of the probe in progress */
+	double		next_probe;		/* time to start the next probe */
+	int			interval;		/* current probe interval in milliseconds */
+	bool		failed;			/* true if the last probe failed */
+	char		hostname[MAX_DB_HOST_NAMELEN];	/* address of the node we */
+	int			port;			/* resolved last time */
+	struct sockaddr_storage addr;
+	socklen_t	addrlen;
+} HealthCheckProbe;
+
+static HealthCheckProbe probes[MAX_NUM_BACKENDS];
+
+static double probe_now(void);
+static bool probe_target(int node);
+static void start_probe(int node, double now);
+static void finish_probe(int node, double now, bool ok, const char *reason);
+static void reset_probe(int node);
 
 #ifdef HEALTHCHECK_OPTS
 #if HEALTHCHECK_OPTS > 0
@@ -147,9 +176,12 @@ do_health_check_child(int *node_id)
 	signal(SIGQUIT, my_signal_handler);
 	signal(SIGCHLD, SIG_IGN);
 	signal(SIGUSR1, my_signal_handler);
-	signal(SIGUSR2, SIG_IGN);
+	signal(SIGUSR2, check_now_handler);
 	signal(SIGPIPE, SIG_IGN);
 
+	/* Let the health check prober know whom to wake up */
+	stats->pid = getpid();
+
 	/* Create per loop iteration memory context */
 	HealthCheckMemoryContext = AllocSetContextCreate(TopMemoryContext,
 													 "health_check_main_loop",
@@ -202,6 +234,7 @@ do_health_check_child(int *node_id)
 			bool		result;
 			BackendInfo *bkinfo = pool_get_node_info(*node_id);
 
+			check_now_request = 0;
 			stats->total_count++;
 			gettimeofday(&start_time, NULL);
 
@@ -295,7 +328,7 @@ do_health_check_child(int *node_id)
 
 			memcpy(&mystat, (void *)stats, sizeof(mystat));
 
-			sleep(pool_config->health_check_params[*node_id].health_check_period);
+			health_check_sleep(pool_config->health_check_params[*node_id].health_check_period);
 		}
 	}
 	exit(0);
@@ -534,6 +567,374 @@ static RETSIGTYPE health_check_timer_handler(int sig)
 	errno = save_errno;
 }
 
+/*
+ * health check prober main loop.  Unlike the health check processes, which
+ * run one per node and do the whole check (authentication, retries and
+ * failover) with blocking I/O, the prober is a single process.  It starts a
+ * non-blocking connect to every node each health_check_probe_interval and
+ * waits for all of them with poll().  When a probe changes its result, the
+ * health check process of the node is woken up to do the health check at
+ * once.
+ */
+void
+do_health_check_prober(void)
+{
+	sigjmp_buf	local_sigjmp_buf;
+	struct pollfd pfds[MAX_NUM_BACKENDS];
+	int			pfd_nodes[MAX_NUM_BACKENDS];
+	int			i;
+
+	ereport(DEBUG1,
+			(errmsg("I am health check prober pid:%d", getpid())));
+
+	/* Identify myself via ps */
+	init_ps_display("", "", "", "");
+	set_ps_display("health check prober", false);
+
+	/* set up signal handlers */
+	signal(SIGALRM, SIG_IGN);
+	signal(SIGTERM, my_signal_handler);
+	signal(SIGINT, my_signal_handler);
+	signal(SIGHUP, reload_config_handler);
+	signal(SIGQUIT, my_signal_handler);
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGUSR1, my_signal_handler);
+	signal(SIGUSR2, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+
+	MemoryContextSwitchTo(TopMemoryContext);
+
+	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
+	{
+		error_context_stack = NULL;
+		EmitErrorReport();
+		MemoryContextSwitchTo(TopMemoryContext);
+		FlushErrorState();
+	}
+	/* We can now handle ereport(ERROR) */
+	PG_exception_stack = &local_sigjmp_buf;
+
+	for (i = 0; i < MAX_NUM_BACKENDS; i++)
+	{
+		probes[i].fd = -1;
+		reset_probe(i);
+	}
+
+	for (;;)
+	{
+		double		now;
+		int			timeout;
+		int			nfds = 0;
+		int			rc;
+
+		CHECK_REQUEST;
+
+		/*
+		 * The prober has been disabled by reloading the configuration.  Exit
+		 * without being restarted.  pgpool main forks it again when it is
+		 * enabled.
+		 */
+		if (pool_config->health_check_probe_interval <= 0)
+		{
+			ereport(LOG,
+					(errmsg("health check prober exits because health_check_probe_interval is 0")));
+			exit(0);
+		}
+
+		/*
+		 * Start the probes which are due and compute how long we can wait
+		 * for the probes in progress.
+		 */
+		now = probe_now();
+		timeout = pool_config->health_check_probe_interval;
+
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			HealthCheckProbe *p = &probes[i];
+			double		wakeup;
+
+			if (!probe_target(i))
+			{
+				reset_probe(i);
+				continue;
+			}
+
+			if (p->fd < 0 && now >= p->next_probe)
+				start_probe(i, now);
+
+			if (p->fd >= 0)
+			{
+				int			conn_timeout = pool_config->health_check_params[i].connect_timeout;
+
+				if (conn_timeout <= 0)
+					conn_timeout = pool_config->health_check_params[i].health_check_period * 1000;
+
+				pfds[nfds].fd = p->fd;
+				pfds[nfds].events = POLLOUT;
+				pfds[nfds].revents = 0;
+				pfd_nodes[nfds++] = i;
+				wakeup = p->start + conn_timeout / 1000.0;
+			}
+			else
+				wakeup = p->next_probe;
+
+			if ((wakeup - now) * 1000 < timeout)
+				timeout = Max((int) ((wakeup - now) * 1000), 0);
+		}
+
+		rc = poll(pfds, nfds, timeout);
+		if (rc < 0 && errno != EINTR)
+			ereport(LOG,
+					(errmsg("health check prober: poll() failed with error \"%m\"")));
+
+		/* Collect the results */
+		now = probe_now();
+		for (i = 0; i < nfds; i++)
+		{
+			int			node = pfd_nodes[i];
+			HealthCheckProbe *p = &probes[node];
+			int			conn_timeout = pool_config->health_check_params[node].connect_timeout;
+
+			if (rc > 0 && pfds[i].revents)
+			{
+				int			error = 0;
+				socklen_t	len = sizeof(error);
+
+				if (getsockopt(p->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0)
+					error = errno;
+				if (error == 0 && (pfds[i].revents & (POLLERR | POLLHUP)))
+					error = ECONNRESET;
+				finish_probe(node, now, error == 0, error ? strerror(error) : NULL);
+			}
+			else
+			{
+				if (conn_timeout <= 0)
+					conn_timeout = pool_config->health_check_params[node].health_check_period * 1000;
+				if (now >= p->start + conn_timeout / 1000.0)
+					finish_probe(node, now, false, "timed out");
+			}
+		}
+	}
+	exit(0);
+}
+
+/*
+ * Returns current time in seconds
+ */
+static double
+probe_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * Returns true if the node should be probed.  Nodes whose health check is
+ * disabled and nodes which are down are not probed, except quarantined nodes
+ * since we want to find out early when they come back.
+ */
+static bool
+probe_target(int node)
+{
+	BackendInfo *bkinfo = pool_get_node_info(node);
+
+	if (pool_config->health_check_params[node].health_check_period <= 0)
+		return false;
+
+	if (Req_info->switching)
+		return false;
+
+	if (bkinfo->backend_status == CON_UP || bkinfo->backend_status == CON_CONNECT_WAIT)
+		return true;
+
+	return bkinfo->backend_status == CON_DOWN && bkinfo->quarantine == true;
+}
+
+/*
+ * Start a non-blocking connect to the node.  The address is resolved again
+ * when the node has been changed or after a failed probe.
+ */
+static void
+start_probe(int node, double now)
+{
+	HealthCheckProbe *p = &probes[node];
+	BackendInfo *bkinfo = pool_get_node_info(node);
+
+	p->start = now;
+
+	if (p->addrlen == 0 || p->failed || p->port != bkinfo->backend_port ||
+		strcmp(p->hostname, bkinfo->backend_hostname) != 0)
+	{
+		StrNCpy(p->hostname, bkinfo->backend_hostname, sizeof(p->hostname));
+		p->port = bkinfo->backend_port;
+		p->addrlen = 0;
+
+		if (*p->hostname == '/')
+		{
+			struct sockaddr_un *addr = (struct sockaddr_un *) &p->addr;
+
+			memset(addr, 0, sizeof(*addr));
+			addr->sun_family = AF_UNIX;
+			snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/.s.PGSQL.%d",
+					 p->hostname, p->port);
+			p->addrlen = sizeof(*addr);
+		}
+		else
+		{
+			struct addrinfo hints;
+			struct addrinfo *res;
+			char		portstr[16];
+			int			ret;
+
+			memset(&hints, 0, sizeof(hints));
+			hints.ai_family = PF_UNSPEC;
+			hints.ai_socktype = SOCK_STREAM;
+			snprintf(portstr, sizeof(portstr), "%d", p->port);
+
+			if ((ret = getaddrinfo(p->hostname, portstr, &hints, &res)) != 0)
+			{
+				finish_probe(node, now, false, gai_strerror(ret));
+				return;
+			}
+			memcpy(&p->addr, res->ai_addr, res->ai_addrlen);
+			p->addrlen = res->ai_addrlen;
+			freeaddrinfo(res);
+		}
+	}
+
+	p->fd = socket(p->addr.ss_family, SOCK_STREAM, 0);
+	if (p->fd < 0)
+	{
+		finish_probe(node, now, false, strerror(errno));
+		return;
+	}
+	socket_set_nonblock(p->fd);
+
+	if (connect(p->fd, (struct sockaddr *) &p->addr, p->addrlen) == 0)
+		finish_probe(node, now, true, NULL);
+	else if (errno != EINPROGRESS && errno != EINTR)
+		finish_probe(node, now, false, strerror(errno));
+}
+
+/*
+ * Record the result of a probe and schedule the next one.  A failed probe of
+ * an up node, or a successful probe of a quarantined node, wakes up the health
+ * check process of the node.  Failed probes back off exponentially up to
+ * health_check_period.
+ */
+static void
+finish_probe(int node, double now, bool ok, const char *reason)
+{
+	HealthCheckProbe *p = &probes[node];
+	BackendInfo *bkinfo = pool_get_node_info(node);
+	volatile POOL_HEALTH_CHECK_STATISTICS *nstats = &health_check_stats[node];
+	bool		quarantined = (bkinfo->backend_status == CON_DOWN && bkinfo->quarantine);
+	bool		wakeup = false;
+	int			max_interval;
+	int			jitter;
+
+	if (p->fd >= 0)
+	{
+		close(p->fd);
+		p->fd = -1;
+	}
+
+	nstats->probe_count++;
+
+	if (ok)
+	{
+		if (p->failed)
+		{
+			ereport(LOG,
+					(errmsg("health check probe on node %d succeeded", node)));
+			wakeup = quarantined;
+		}
+		p->failed = false;
+		p->interval = pool_config->health_check_probe_interval;
+	}
+	else
+	{
+		nstats->probe_fail_count++;
+		nstats->last_failed_probe = time(NULL);
+
+		if (!p->failed)
+		{
+			ereport(LOG,
+					(errmsg("health check probe failed on node %d", node),
+					 errdetail("%s", reason)));
+			wakeup = !quarantined;
+		}
+		p->failed = true;
+
+		max_interval = pool_config->health_check_params[node].health_check_period * 1000;
+		p->interval = Min((int64) p->interval * 2, Max(max_interval, pool_config->health_check_probe_interval));
+	}
+
+	if (wakeup && nstats->pid > 0)
+		kill(nstats->pid, SIGUSR2);
+
+	/* Spread the probes by up to 10% of the interval */
+	jitter = p->interval / 10;
+	p->next_probe = now + (p->interval - jitter + (jitter > 0 ? random() % (2 * jitter + 1) : 0)) / 1000.0;
+}
+
+/*
+ * Forget the probe state of the node
+ */
+static void
+reset_probe(int node)
+{
+	HealthCheckProbe *p = &probes[node];
+
+	if (p->fd >= 0)
+	{
+		close(p->fd);
+		p->fd = -1;
+	}
+	p->failed = false;
+	p->interval = pool_config->health_check_probe_interval;
+	p->next_probe = 0;
+}
+
+/*
+ * SIGUSR2 handler.  The health check prober asks for a health check now.
+ */
+static RETSIGTYPE check_now_handler(int sig)
+{
+	int			save_errno = errno;
+
+	check_now_request = 1;
+	errno = save_errno;
+}
+
+/*
+ * Sleep until the next health check.  The sleep ends early if the health
+ * check prober sends SIGUSR2.  The signal is blocked while checking
+ * check_now_request so that a wake up just before the sleep is not lost.
+ */
+static void
+health_check_sleep(int seconds)
+{
+	sigset_t	mask;
+	sigset_t	oldmask;
+	struct timespec ts;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGUSR2);
+	sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+	if (!check_now_request)
+	{
+		ts.tv_sec = seconds;
+		ts.tv_nsec = 0;
+		pselect(0, NULL, NULL, NULL, &ts, &oldmask);
+	}
+
+	sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
+
 /*
  * Returns the byte size of health check statistics area
  */
@@ -361,6 +361,13 @@ main(int argc, char **argv)
 
 	pool_semaphore_create(MAX_NUM_SEMAPHORES);
 
+	/*
+	 * Query cache lock is a reader/writer lock. See
+	 * pool_semaphore_lock_shared().
+	 */
+	pool_semaphore_set_value(SHM_CACHE_SEM, SHM_CACHE_MAX_READERS);
+	pool_semaphore_set_value(SHM_CACHE_WRITER_SEM, 0);
+
 	PgpoolMain(discard_status, clear_memcache_oidmaps); /* this is an infinate
 														 * loop */
 
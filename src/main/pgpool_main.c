@@ -49,6 +49,7 @@
 #include "utils/memutils.h"
 #include "utils/statistics.h"
 #include "utils/pool_ipc.h"
+#include "utils/pool_relcache.h"
 #include "context/pool_process_context.h"
 #include "protocol/pool_process_query.h"
 #include "protocol/pool_pg_utils.h"
@@ -109,15 +110,24 @@ typedef struct User1SignalSlot
 			reload_config(); \
 			reload_config_request = 0; \
 		} \
+		if (snapshot_and_exit_request) \
+		{ \
+			save_snapshot_and_exit(); \
+		} \
     } while (0)
 
 #define PGPOOLMAXLITSENQUEUELENGTH 10000
 
 static void signal_user1_to_parent_with_reason(User1SignalReason reason);
+static void save_snapshot_and_exit(void);
 
 static void FileUnlink(int code, Datum path);
 static pid_t pcp_fork_a_child(int unix_fd, int inet_fd, char *pcp_conf_file);
 static pid_t fork_a_child(int *fds, int id);
+static pid_t fork_a_spare_child(int *fds, int spare_id);
+static pid_t respawn_child(int id);
+static bool respawn_allowed(void);
+static bool respawn_pending_children(void);
 static pid_t worker_fork_a_child(ProcessType type, void (*func) (), void *params);
 static int	create_unix_domain_socket(struct sockaddr_un un_addr_tmp);
 static int	create_inet_domain_socket(const char *hostname, const int port);
@@ -175,6 +185,18 @@ BACKEND_STATUS private_backend_status[MAX_NUM_BACKENDS];
  */
 ConnectionInfo *con_info;
 
+/*
+ * shmem frontend cancel key table used in transaction pooling mode
+ * frontend_cancel_keys[pool_config->num_init_children][pool_config->max_pool]
+ */
+FrontendCancelKey *frontend_cancel_keys;
+
+/*
+ * shmem connection pool statistics table
+ * connection_pool_stats[pool_config->num_init_children][pool_config->max_pool]
+ */
+ConnectionPoolStats *connection_pool_stats;
+
 static int *fds = NULL;				/* listening file descriptors (UNIX socket,
 								 * inet domain sockets) */
 
@@ -193,14 +215,31 @@ volatile sig_atomic_t reload_config_request = 0;
 static volatile sig_atomic_t sigusr1_request = 0;
 static volatile sig_atomic_t sigchld_request = 0;
 static volatile sig_atomic_t wakeup_request = 0;
+static volatile sig_atomic_t snapshot_and_exit_request = 0;
+static bool main_loop_started = false;	/* true once the main loop runs */
 
 static int	pipe_fds[2];		/* for delivering signals */
 
 int			my_proc_id;
+int			my_spare_id = -1;
+
+/*
+ * Pre-forked spare children (spare_children).  spare_child_slots[] on shmem
+ * holds the process_info[] slot handed over to each spare child, or -1
+ * while it is waiting for one.  Children exited are replaced by spare
+ * children first, and forked at most child_respawn_rate per second.
+ */
+volatile sig_atomic_t *spare_child_slots = NULL;
+static pid_t *spare_child_pids = NULL;	/* 0 if the spare is to be forked */
+static bool *respawn_pending = NULL;	/* true if the process_info[] slot is
+										 * waiting for a new child */
+static double next_respawn_time = 0;	/* time when next fork is allowed */
 
 static BackendStatusRecord backend_rec; /* Backend status record */
 
 static pid_t worker_pid = 0;	/* pid of worker process */
+static pid_t accept_dispatcher_pid = 0;	/* pid of accept dispatcher process */
+static pid_t health_check_prober_pid = 0;	/* pid of health check prober */
 static pid_t follow_pid = 0;	/* pid for child process handling follow
 								 * command */
 static pid_t pcp_pid = 0;		/* pid for child process handling PCP */
@@ -280,6 +319,9 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 
 	initialize_shared_mem_objects(clear_memcache_oidmaps);
 
+	/* Restore query cache from the snapshot file if any */
+	pool_load_memqcache_snapshot();
+
 	/* setup signal handlers */
 	pool_signal(SIGCHLD, reap_handler);
 	pool_signal(SIGUSR1, sigusr1_handler);
@@ -400,6 +442,11 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 	 * is harmless.
 	 */
 	POOL_SETMASK(&BlockSig);
+
+	/* create socket pair to hand accepted connections to the children */
+	if (pool_config->accept_dispatcher)
+		create_accept_dispatch_socket();
+
 	/* fork the children */
 	for (i = 0; i < pool_config->num_init_children; i++)
 	{
@@ -407,6 +454,21 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 		process_info[i].start_time = time(NULL);
 	}
 
+	/* fork the spare children */
+	respawn_pending = MemoryContextAllocZero(TopMemoryContext,
+											 sizeof(bool) * pool_config->num_init_children);
+	if (pool_config->spare_children > 0)
+	{
+		spare_child_pids = MemoryContextAllocZero(TopMemoryContext,
+												  sizeof(pid_t) * pool_config->spare_children);
+		for (i = 0; i < pool_config->spare_children; i++)
+			spare_child_pids[i] = fork_a_spare_child(fds, i);
+	}
+
+	/* fork accept dispatcher process */
+	if (pool_config->accept_dispatcher)
+		accept_dispatcher_pid = worker_fork_a_child(PT_ACCEPT_DISPATCHER, do_accept_dispatcher, fds);
+
 	/* create pipe for delivering event */
 	if (pipe(pipe_fds) < 0)
 	{
@@ -446,6 +508,10 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 			health_check_pids[i] = worker_fork_a_child(PT_HEALTH_CHECK, do_health_check_child, &i);
 	}
 
+	/* Fork health check prober process */
+	if (pool_config->health_check_probe_interval > 0)
+		health_check_prober_pid = worker_fork_a_child(PT_HEALTH_CHECK, do_health_check_prober, NULL);
+
 	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
 	{
 		/* Since not using PG_TRY, must reset error stack by hand */
@@ -463,6 +529,8 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 	/* Create or write status file */
 	(void) write_status_file();
 
+	main_loop_started = true;
+
 	/* This is the main loop */
 	for (;;)
 	{
@@ -513,6 +581,13 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 			int			r;
 			struct timeval t = {3, 0};
 
+			/* wake up soon to fork the rest of children if any */
+			if (respawn_pending_children())
+			{
+				t.tv_sec = 0;
+				t.tv_usec = 100000;
+			}
+
 			POOL_SETMASK(&UnBlockSig);
 			r = pool_pause(&t);
 			POOL_SETMASK(&BlockSig);
@@ -684,6 +759,142 @@ fork_a_child(int *fds, int id)
 	return pid;
 }
 
+/*
+ * fork a spare child.  It initializes itself and waits until it takes over
+ * a process_info[] slot in respawn_child().
+ */
+static pid_t
+fork_a_spare_child(int *fds, int spare_id)
+{
+	pid_t		pid;
+
+	spare_child_slots[spare_id] = -1;
+	my_spare_id = spare_id;
+	pid = fork_a_child(fds, -1);
+	my_spare_id = -1;
+
+	return pid;
+}
+
+/*
+ * Replace the exited child of process_info[id].  A spare child takes over
+ * the slot if any.  Otherwise a new child is forked unless it exceeds
+ * child_respawn_rate, in which case the slot is left to
+ * respawn_pending_children().  Returns the pid of the child or 0.
+ */
+static pid_t
+respawn_child(int id)
+{
+	int			i;
+
+	respawn_pending[id] = false;
+
+	for (i = 0; i < pool_config->spare_children; i++)
+	{
+		if (spare_child_pids[i] > 0)
+		{
+			process_info[id].pid = spare_child_pids[i];
+			process_info[id].start_time = time(NULL);
+			process_info[id].need_to_restart = 0;
+			spare_child_slots[i] = id;
+			kill(spare_child_pids[i], SIGUSR2);
+
+			/* the spare is forked again by respawn_pending_children() */
+			spare_child_pids[i] = 0;
+
+			ereport(DEBUG1,
+					(errmsg("spare child with pid: %d took over process slot %d",
+							process_info[id].pid, id)));
+			return process_info[id].pid;
+		}
+	}
+
+	if (!respawn_allowed())
+	{
+		process_info[id].pid = 0;
+		respawn_pending[id] = true;
+		return 0;
+	}
+
+	process_info[id].pid = fork_a_child(fds, id);
+	process_info[id].start_time = time(NULL);
+	return process_info[id].pid;
+}
+
+/*
+ * Returns true if another child may be forked now under child_respawn_rate.
+ * Up to child_respawn_rate forks accumulated while idle are allowed at once.
+ */
+static bool
+respawn_allowed(void)
+{
+	struct timeval tv;
+	double		now;
+
+	if (pool_config->child_respawn_rate <= 0)
+		return true;
+
+	gettimeofday(&tv, NULL);
+	now = tv.tv_sec + tv.tv_usec / 1000000.0;
+	if (now < next_respawn_time)
+		return false;
+
+	next_respawn_time = Max(next_respawn_time, now - 1.0) +
+		1.0 / pool_config->child_respawn_rate;
+	return true;
+}
+
+/*
+ * Fork the children left by respawn_child() and the spare children as far
+ * as child_respawn_rate allows.  Returns true if any of them is left.
+ */
+static bool
+respawn_pending_children(void)
+{
+	bool		left = false;
+	int			i;
+
+	if (exiting || switching)
+		return false;
+
+	for (i = 0; i < pool_config->num_init_children; i++)
+	{
+		if (!respawn_pending[i])
+			continue;
+
+		if (!respawn_allowed())
+			return true;
+
+		respawn_pending[i] = false;
+		process_info[i].pid = fork_a_child(fds, i);
+		process_info[i].start_time = time(NULL);
+		ereport(LOG,
+				(errmsg("fork a new child process with pid: %d", process_info[i].pid)));
+	}
+
+	for (i = 0; i < pool_config->spare_children; i++)
+	{
+		if (spare_child_pids[i] > 0)
+			continue;
+
+		/* the former spare has not taken over the slot yet */
+		if (spare_child_slots[i] >= 0)
+		{
+			left = true;
+			continue;
+		}
+
+		if (!respawn_allowed())
+		{
+			left = true;
+			break;
+		}
+		spare_child_pids[i] = fork_a_spare_child(fds, i);
+	}
+
+	return left;
+}
+
 /*
 * fork worker child process
 */
@@ -1046,6 +1257,16 @@ terminate_all_childrens(int sig)
 		}
 	}
 
+	for (i = 0; spare_child_pids && i < pool_config->spare_children; i++)
+	{
+		if (spare_child_pids[i] > 0)
+		{
+			kill(spare_child_pids[i], sig);
+			spare_child_pids[i] = 0;
+			killed_count++;
+		}
+	}
+
 	if (pcp_pid != 0)
 	{
 		kill(pcp_pid, sig);
@@ -1060,6 +1281,20 @@ terminate_all_childrens(int sig)
 	}
 	worker_pid = 0;
 
+	if (accept_dispatcher_pid != 0)
+	{
+		kill(accept_dispatcher_pid, sig);
+		killed_count++;
+	}
+	accept_dispatcher_pid = 0;
+
+	if (health_check_prober_pid != 0)
+	{
+		kill(health_check_prober_pid, sig);
+		killed_count++;
+	}
+	health_check_prober_pid = 0;
+
 	if (pool_config->use_watchdog)
 	{
 		if (pool_config->use_watchdog)
@@ -1147,6 +1382,21 @@ static RETSIGTYPE exit_handler(int sig)
 			(errmsg("terminating all child processes")));
 	terminate_all_childrens(sig);
 
+	/*
+	 * Save query cache unless immediate shutdown is requested.  Saving the
+	 * snapshot may connect to a backend and write a file, which is not safe
+	 * in a signal handler, thus it is left to the main loop, which exits
+	 * after that.
+	 */
+	if (sig != SIGQUIT && main_loop_started && pool_config->memory_cache_enabled &&
+		pool_is_shmem_cache() && *pool_config->memqcache_snapshot_file != '\0')
+	{
+		snapshot_and_exit_request = 1;
+		dummy_status = write(pipe_fds[1], "\0", 1);
+		POOL_SETMASK(&UnBlockSig);
+		errno = save_errno;
+		return;
+	}
 
 	POOL_SETMASK(&UnBlockSig);
 	ereport(LOG,
@@ -1155,6 +1405,30 @@ static RETSIGTYPE exit_handler(int sig)
 	exit(0);
 }
 
+/*
+ * Save the query cache snapshot and exit.  Called from the main loop after
+ * exit_handler() has terminated all child processes.
+ */
+static void
+save_snapshot_and_exit(void)
+{
+	PG_TRY();
+	{
+		pool_save_memqcache_snapshot();
+	}
+	PG_CATCH();
+	{
+		EmitErrorReport();
+		FlushErrorState();
+	}
+	PG_END_TRY();
+
+	ereport(LOG,
+			(errmsg("Pgpool-II system is shutdown")));
+	process_info = NULL;
+	exit(0);
+}
+
 /*
  * Calculate next valid main node id.
  * If no valid node found, returns -1.
@@ -1334,6 +1608,7 @@ failover(void)
 	bool		need_to_restart_pcp = false;
 	bool		all_backend_down = true;
 	bool		sync_required = false;
+	bool		sessions_kept = false;
 
 	ereport(DEBUG1,
 			(errmsg("failover handler called")));
@@ -1385,6 +1660,7 @@ failover(void)
 		int			node_count;
 		unsigned char request_details;
 		bool		search_primary = true;
+		bool		keep_sessions = false;
 
 		pool_semaphore_lock(REQUEST_INFO_SEM);
 
@@ -1671,6 +1947,28 @@ failover(void)
 			}
 		}
 
+		/*
+		 * If failover_keep_sessions is on and standby nodes are going down
+		 * while the primary node survives, we don't restart children at all.
+		 * Each child detaches the connections to the nodes by itself between
+		 * queries, and only the sessions in a transaction on them are
+		 * terminated.
+		 */
+		else if (STREAM && pool_config->failover_keep_sessions &&
+				 (reqkind == NODE_DOWN_REQUEST || reqkind == NODE_QUARANTINE_REQUEST) &&
+				 Req_info->primary_node_id >= 0 && !nodes[Req_info->primary_node_id] &&
+				 VALID_BACKEND_RAW(Req_info->primary_node_id))
+		{
+			ereport(LOG,
+					(errmsg("Do not restart children because we are failing over standby node id %d host: %s port: %d and failover_keep_sessions is on", node_id,
+							BACKEND_INFO(node_id).backend_hostname,
+							BACKEND_INFO(node_id).backend_port)));
+
+			need_to_restart_children = false;
+			partial_restart = false;
+			keep_sessions = sessions_kept = true;
+		}
+
 		/*
 		 * If the mode is streaming replication and the request is
 		 * NODE_DOWN_REQUEST and it's actually a switch over request, we don't
@@ -1953,9 +2251,7 @@ failover(void)
 					if (process_info[i].pid)
 					{
 						kill(process_info[i].pid, SIGQUIT);
-
-						process_info[i].pid = fork_a_child(fds, i);
-						process_info[i].start_time = time(NULL);
+						respawn_child(i);
 					}
 				}
 				else
@@ -1963,7 +2259,7 @@ failover(void)
 			}
 		}
 
-		else
+		else if (!keep_sessions)
 		{
 			/*
 			 * Set restart request to each child. Children will exit(1)
@@ -2038,6 +2334,13 @@ failover(void)
 	 */
 	kill(pcp_pid, SIGUSR2);
 
+	/*
+	 * Wake up children waiting for their clients so that they detach the
+	 * failed nodes from the sessions kept over failover.
+	 */
+	if (sessions_kept)
+		kill_all_children(SIGUSR2);
+
 	if (need_to_restart_pcp)
 	{
 		sleep(1);
@@ -2227,6 +2530,10 @@ process_name_from_pid(pid_t pid)
 		return "PCP child";
 	if (pid == worker_pid)
 		return "worker child";
+	if (pid == accept_dispatcher_pid)
+		return "accept dispatcher";
+	if (pid == health_check_prober_pid)
+		return "health check prober";
 	if (pool_config->use_watchdog)
 	{
 		if (pid == watchdog_pid)
@@ -2260,7 +2567,8 @@ reaper(void)
 {
 	pid_t		pid;
 	int			status;
-	int			i;
+	int			i,
+				j;
 
 	ereport(DEBUG1,
 			(errmsg("reaper handler")));
@@ -2288,6 +2596,7 @@ reaper(void)
 		bool		shutdown_system = false;
 		bool		restart_child = true;
 		bool		found = false;
+		bool		respawn_later = false;
 		char	   *exiting_process_name = process_name_from_pid(pid);
 
 		/*
@@ -2358,6 +2667,37 @@ reaper(void)
 			else
 				worker_pid = 0;
 		}
+
+		/* exiting process was accept dispatcher process */
+		else if (pid == accept_dispatcher_pid)
+		{
+			found = true;
+			if (restart_child)
+			{
+				accept_dispatcher_pid = worker_fork_a_child(PT_ACCEPT_DISPATCHER, do_accept_dispatcher, fds);
+				new_pid = accept_dispatcher_pid;
+			}
+			else
+				accept_dispatcher_pid = 0;
+		}
+
+		/* exiting process was health check prober */
+		else if (pid == health_check_prober_pid)
+		{
+			found = true;
+
+			/*
+			 * The prober exits without restart when it is disabled, but it
+			 * may have been enabled again meanwhile.
+			 */
+			if (restart_child || pool_config->health_check_probe_interval > 0)
+			{
+				health_check_prober_pid = worker_fork_a_child(PT_HEALTH_CHECK, do_health_check_prober, NULL);
+				new_pid = health_check_prober_pid;
+			}
+			else
+				health_check_prober_pid = 0;
+		}
 		else if (pid == pgpool_logger_pid)
 		{
 			if (restart_child)
@@ -2407,12 +2747,18 @@ reaper(void)
 				if (pid == process_info[i].pid)
 				{
 					found = true;
+					/* the spare child exited before taking over the slot */
+					for (j = 0; j < pool_config->spare_children; j++)
+					{
+						if (spare_child_slots[j] == i && spare_child_pids[j] == 0)
+							spare_child_slots[j] = -1;
+					}
+
 					/* if found, fork a new child */
 					if (!switching && !exiting && restart_child)
 					{
-						process_info[i].pid = fork_a_child(fds, i);
-						process_info[i].start_time = time(NULL);
-						new_pid = process_info[i].pid;
+						new_pid = respawn_child(i);
+						respawn_later = (new_pid == 0);
 					}
 					else
 						process_info[i].pid = 0;
@@ -2421,6 +2767,22 @@ reaper(void)
 			}
 		}
 
+		/* Check spare children */
+		if (found == false && spare_child_pids)
+		{
+			for (i = 0; i < pool_config->spare_children; i++)
+			{
+				if (pid == spare_child_pids[i])
+				{
+					/* forked again by respawn_pending_children() */
+					found = true;
+					spare_child_pids[i] = 0;
+					respawn_later = restart_child;
+					break;
+				}
+			}
+		}
+
 		/* Check health check process */
 		if (found == false)
 		{
@@ -2451,6 +2813,12 @@ reaper(void)
 			ereport(LOG,
 					(errmsg("fork a new %s process with pid: %d", exiting_process_name, new_pid)));
 		}
+		else if (respawn_later)
+		{
+			/* Report if the child is to be restarted later */
+			ereport(LOG,
+					(errmsg("%s process with pid: %d exited and will be restarted later", exiting_process_name, pid)));
+		}
 		else
 		{
 			/* And the child was not restarted */
@@ -2588,6 +2956,16 @@ kill_all_children(int sig)
 			}
 		}
 	}
+	/* make spare children reload as well */
+	if (sig == SIGHUP && spare_child_pids)
+	{
+		for (i = 0; i < pool_config->spare_children; i++)
+		{
+			if (spare_child_pids[i] > 0)
+				kill(spare_child_pids[i], sig);
+		}
+	}
+
 	/* make PCP process reload as well */
 	if (sig == SIGHUP && pcp_pid > 0)
 		kill(pcp_pid, sig);
@@ -2600,6 +2978,8 @@ kill_all_children(int sig)
 			if (health_check_pids[i] > 0)
 				kill(health_check_pids[i], sig);
 		}
+		if (health_check_prober_pid > 0)
+			kill(health_check_prober_pid, sig);
 	}
 }
 
@@ -3309,12 +3689,17 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 	size = 256;/* let us have some extra space */
 	size += MAXALIGN(sizeof(BackendDesc));
 	size += MAXALIGN(pool_coninfo_size());
+	if (pool_config->transaction_pooling)
+		size += MAXALIGN(pool_frontend_cancel_key_size());
+	size += MAXALIGN(pool_connection_pool_stats_size());
 	size += MAXALIGN(pool_config->num_init_children * (sizeof(ProcessInfo)));
+	size += MAXALIGN(pool_config->spare_children * (sizeof(sig_atomic_t)));
 	size += MAXALIGN(sizeof(User1SignalSlot));
 	size += MAXALIGN(sizeof(POOL_REQUEST_INFO));
 	size += MAXALIGN(sizeof(int)); /* for InRecovery */
 	size += MAXALIGN(stat_shared_memory_size());
 	size += MAXALIGN(health_check_stats_shared_memory_size());
+	size += MAXALIGN(sr_lag_history_shared_memory_size());
 	/* Snapshot Isolation manage area */
 	size += MAXALIGN(sizeof(SI_ManageInfo));
 	size += MAXALIGN(pool_config->num_init_children * sizeof(pid_t));
@@ -3325,9 +3710,13 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 		size += MAXALIGN(pool_shared_memory_cache_size());
 		size += MAXALIGN(pool_shared_memory_fsmm_size());
 		size += MAXALIGN(pool_hash_size(pool_config->memqcache_max_num_cache));
+		size += MAXALIGN(pool_oid_map_size(pool_config->memqcache_max_num_cache));
 	}
 	if (pool_config->memory_cache_enabled || pool_config->enable_shared_relcache)
 		size += MAXALIGN(sizeof(POOL_QUERY_CACHE_STATS));
+	if (pool_config->memory_cache_enabled)
+		size += MAXALIGN(pool_admission_stats_size());
+	size += MAXALIGN(pool_shared_relcache_size());
 
 	if (pool_config->use_watchdog)
 	{
@@ -3346,11 +3735,21 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 
 	/* get the shared memory from main segment*/
 	con_info = (ConnectionInfo *)pool_shared_memory_segment_get_chunk(pool_coninfo_size());
+	if (pool_config->transaction_pooling)
+	{
+		frontend_cancel_keys = (FrontendCancelKey *)pool_shared_memory_segment_get_chunk(pool_frontend_cancel_key_size());
+		memset(frontend_cancel_keys, 0, pool_frontend_cancel_key_size());
+	}
+	connection_pool_stats = (ConnectionPoolStats *)pool_shared_memory_segment_get_chunk(pool_connection_pool_stats_size());
+	memset(connection_pool_stats, 0, pool_connection_pool_stats_size());
 
 	process_info = (ProcessInfo *)pool_shared_memory_segment_get_chunk(pool_config->num_init_children * (sizeof(ProcessInfo)));
 	for (i = 0; i < pool_config->num_init_children; i++)
 		process_info[i].connection_info = pool_coninfo(i, 0, 0);
 
+	if (pool_config->spare_children > 0)
+		spare_child_slots = (sig_atomic_t *)pool_shared_memory_segment_get_chunk(pool_config->spare_children * (sizeof(sig_atomic_t)));
+
 	user1SignalSlot = (User1SignalSlot *)pool_shared_memory_segment_get_chunk(sizeof(User1SignalSlot));
 
 	Req_info = (POOL_REQUEST_INFO *)pool_shared_memory_segment_get_chunk(sizeof(POOL_REQUEST_INFO));
@@ -3364,6 +3763,9 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 	/* Initialize health check statistics area */
 	health_check_stats_init(pool_shared_memory_segment_get_chunk(health_check_stats_shared_memory_size()));
 
+	/* Initialize replication lag history area */
+	sr_lag_history_init(pool_shared_memory_segment_get_chunk(sr_lag_history_shared_memory_size()));
+
 	/* Initialize Snapshot Isolation manage area */
 	si_manage_info = (SI_ManageInfo*)pool_shared_memory_segment_get_chunk(sizeof(SI_ManageInfo));
 
@@ -3391,6 +3793,9 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 	Req_info->primary_node_id = -2;
 	*InRecovery = RECOVERY_INIT;
 
+	/* Initialize shared relation cache */
+	pool_shared_relcache_init();
+
 	/*
 	 * Initialize shared memory cache
 	 */
@@ -3413,10 +3818,7 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 
 			pool_allocate_fsmm_clock_hand();
 
-			pool_discard_oid_maps();
-
-			ereport(LOG,
-					(errmsg("pool_discard_oid_maps: discarded memqcache oid maps")));
+			pool_oid_map_init(pool_config->memqcache_max_num_cache);
 
 			pool_hash_init(pool_config->memqcache_max_num_cache);
 		}
@@ -3439,6 +3841,8 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 #endif
 
 		pool_init_memqcache_stats();
+		if (pool_config->memory_cache_enabled)
+			pool_init_admission_stats();
 	}
 
 	/* initialize watchdog IPC unix domain socket address */
@@ -3735,6 +4139,13 @@ reload_config(void)
 
 	if (worker_pid)
 		kill(worker_pid, SIGHUP);
+
+	/*
+	 * Start the health check prober if it has been enabled.  The prober
+	 * exits by itself when it is disabled.
+	 */
+	if (pool_config->health_check_probe_interval > 0 && health_check_prober_pid == 0)
+		health_check_prober_pid = worker_fork_a_child(PT_HEALTH_CHECK, do_health_check_prober, NULL);
 }
 
 /* Call back function to unlink the file */
@@ -4088,9 +4499,7 @@ sync_backend_from_watchdog(void)
 				if (process_info[i].pid)
 				{
 					kill(process_info[i].pid, SIGQUIT);
-
-					process_info[i].pid = fork_a_child(fds, i);
-					process_info[i].start_time = time(NULL);
+					respawn_child(i);
 				}
 			}
 			else
@@ -49,7 +49,9 @@ char	*application_names[] = {"main",
 								"watchdog_utility",
 								"pcp_main",
 								"pcp_child",
-								"health_check"
+								"health_check",
+								"logger",
+								"accept_dispatcher"
 };
 
 char *
@@ -56,6 +56,7 @@
 #include "watchdog/wd_json_data.h"
 #include "watchdog/wd_internal_commands.h"
 #include "main/pool_internal_comms.h"
+#include "query_cache/pool_memqcache.h"
 
 #define MAX_FILE_LINE_LEN    512
 
@@ -83,6 +84,7 @@ static void inform_node_info(PCP_CONNECTION * frontend, char *buf);
 static void inform_node_count(PCP_CONNECTION * frontend);
 static void process_reload_config(PCP_CONNECTION * frontend,char scope);
 static void inform_health_check_stats(PCP_CONNECTION *frontend, char *buf);
+static void inform_backend_stats(PCP_CONNECTION *frontend, char *buf);
 static void process_detach_node(PCP_CONNECTION * frontend, char *buf, char tos);
 static void process_attach_node(PCP_CONNECTION * frontend, char *buf);
 static void process_recovery_request(PCP_CONNECTION * frontend, char *buf);
@@ -90,6 +92,7 @@ static void process_status_request(PCP_CONNECTION * frontend);
 static void process_promote_node(PCP_CONNECTION * frontend, char *buf, char tos);
 static void process_shutown_request(PCP_CONNECTION * frontend, char mode, char tos);
 static void process_set_configration_parameter(PCP_CONNECTION * frontend, char *buf, int len);
+static void process_snapshot_query_cache(PCP_CONNECTION * frontend);
 
 static void pcp_worker_will_go_down(int code, Datum arg);
 
@@ -273,6 +276,11 @@ pcp_process_command(char tos, char *buf, int buf_len)
 			inform_health_check_stats(pcp_frontend, buf);
 			break;
 
+		case 'S':				/* backend stats */
+			set_ps_display("PCP: processing backend stats request", false);
+			inform_backend_stats(pcp_frontend, buf);
+			break;
+
 		case 'I':				/* node info */
 			set_ps_display("PCP: processing node info request", false);
 			inform_node_info(pcp_frontend, buf);
@@ -325,6 +333,11 @@ pcp_process_command(char tos, char *buf, int buf_len)
 			process_reload_config(pcp_frontend, buf[0]);
 			break;
 
+		case 'Q':				/* snapshot query cache */
+			set_ps_display("PCP: processing snapshot query cache request", false);
+			process_snapshot_query_cache(pcp_frontend);
+			break;
+
 		case 'J':				/* promote node */
 		case 'j':				/* promote node gracefully */
 			set_ps_display("PCP: processing promote node request", false);
@@ -988,6 +1001,84 @@ inform_health_check_stats(PCP_CONNECTION *frontend, char *buf)
 	do_pcp_flush(frontend);
 }
 
+/*
+ * Send out backend stats data to pcp client.  node id is provided as a
+ * string in buf parameter.
+ *
+ * The protocol starts with 's', followed by 4-byte packet length integer in
+ * network byte order including self.  Each data is represented as a null
+ * terminted string. The order of each data is defined in
+ * POOL_BACKEND_STATS struct.
+ */
+static void
+inform_backend_stats(PCP_CONNECTION *frontend, char *buf)
+{
+	POOL_BACKEND_STATS *stats;
+	POOL_BACKEND_STATS *s;
+	int		*offsets;
+	int		n;
+	int		nrows;
+	int		i;
+	int		node_id;
+	bool	node_id_ok = false;
+	int		wsize;
+	char	code[] = "CommandComplete";
+
+	node_id = atoi(buf);
+
+	if (node_id < 0 || node_id > NUM_BACKENDS)
+	{
+		ereport(ERROR,
+				(errmsg("informing backend stats info failed"),
+				 errdetail("invalid node ID %d", node_id)));
+	}
+
+	stats = get_backend_stats(&nrows);
+
+	for (i = 0; i < nrows; i++)
+	{
+		if (atoi(stats[i].node_id) == node_id)
+		{
+			node_id_ok = true;
+			s = &stats[i];
+			break;
+		}
+	}
+
+	if (!node_id_ok)
+	{
+		ereport(ERROR,
+				(errmsg("informing backend stats info failed"),
+				 errdetail("stats data for node ID %d does not exist", node_id)));
+	}
+
+	pcp_write(frontend, "s", 1);	/* indicate that this is a reply to backend stats request */
+
+	wsize = sizeof(code) + sizeof(int);
+
+	/* Calculate total packet length */
+	offsets = pool_backend_stats_offsets(&n);
+
+	for (i = 0; i < n; i++)
+	{
+		wsize += strlen((char *)s + offsets[i]) + 1;
+	}
+	wsize = htonl(wsize);	/* convert to network byte order */
+
+	/* send packet length to frontend */
+	pcp_write(frontend, &wsize, sizeof(int));
+	/* send "Command Complete" to frontend */
+	pcp_write(frontend, code, sizeof(code));
+
+	/* send each backend stats data to frontend */
+	for (i = 0; i < n; i++)
+	{
+		pcp_write(frontend, (char *)s + offsets[i], strlen((char *)s + offsets[i]) + 1);
+	}
+	pfree(stats);
+	do_pcp_flush(frontend);
+}
+
 static void
 inform_node_count(PCP_CONNECTION * frontend)
 {
@@ -1042,6 +1133,21 @@ process_reload_config(PCP_CONNECTION * frontend, char scope)
 	do_pcp_flush(frontend);
 }
 
+static void
+process_snapshot_query_cache(PCP_CONNECTION * frontend)
+{
+	char		code[] = "CommandComplete";
+	int			wsize;
+
+	pool_save_memqcache_snapshot();
+
+	pcp_write(frontend, "q", 1);
+	wsize = htonl(sizeof(code) + sizeof(int));
+	pcp_write(frontend, &wsize, sizeof(int));
+	pcp_write(frontend, code, sizeof(code));
+	do_pcp_flush(frontend);
+}
+
 static void
 process_detach_node(PCP_CONNECTION * frontend, char *buf, char tos)
 {
@@ -238,7 +238,9 @@ fi
 %{_bindir}/pcp_recovery_node
 %{_bindir}/pcp_watchdog_info
 %{_bindir}/pcp_reload_config
+%{_bindir}/pcp_snapshot_query_cache
 %{_bindir}/pcp_health_check_stats
+%{_bindir}/pcp_backend_stats
 %{_bindir}/pg_md5
 %{_bindir}/pg_enc
 %{_bindir}/pgpool_setup
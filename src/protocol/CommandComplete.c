@@ -297,9 +297,25 @@ handle_query_context(POOL_CONNECTION_POOL * backend)
 		else if (stmt->target == DISCARD_ALL)
 		{
 			pool_clear_sent_message_list();
+
+			/* the backend session is as good as new */
+			if (pool_config->transaction_pooling)
+				pool_unset_pin_backend(false);
 		}
 	}
 
+	/*
+	 * RESET ALL restores the run time parameters changed by SET.  Inside a
+	 * transaction block it may be rolled back, so the connection is kept.
+	 */
+	else if (IsA(node, VariableSetStmt))
+	{
+		if (((VariableSetStmt *) node)->kind == VAR_RESET_ALL &&
+			pool_config->transaction_pooling &&
+			TSTATE(backend, MAIN_NODE_ID) == 'I')
+			pool_unset_pin_backend(true);
+	}
+
 	/*
 	 * JDBC driver sends "BEGIN" query internally if setAutoCommit(false).
 	 * But it does not send Sync message after "BEGIN" query.  In extended
@@ -35,6 +35,7 @@
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif
+#include <poll.h>
 
 #include <signal.h>
 #include <stdio.h>
@@ -43,6 +44,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include "pool.h"
 #include "pool_config.h"
@@ -57,6 +59,7 @@
 #include "utils/elog.h"
 #include "utils/ps_status.h"
 #include "utils/timestamp.h"
+#include "utils/statistics.h"
 
 #include "context/pool_process_context.h"
 #include "context/pool_session_context.h"
@@ -85,6 +88,9 @@ static void check_restart_request(void);
 static void enable_authentication_timeout(void);
 static void disable_authentication_timeout(void);
 static int	wait_for_new_connections(int *fds, struct timeval *timeout, SockAddr *saddr);
+static int	accept_connection(int *fds, int fd, SockAddr *saddr);
+static int	receive_dispatched_connection(struct timeval *timeout, SockAddr *saddr, int flags);
+static RETSIGTYPE accept_dispatcher_exit(int sig);
 static void check_config_reload(void);
 static void get_backends_status(unsigned int *valid_backends, unsigned int *down_backends);
 static void validate_backend_connectivity(int front_end_fd);
@@ -97,6 +103,75 @@ static bool backend_cleanup(POOL_CONNECTION * volatile *frontend, POOL_CONNECTIO
 
 static void child_will_go_down(int code, Datum arg);
 static int opt_sort(const void *a, const void *b);
+static int	wait_for_session_events(int *fds, SockAddr *saddr, int *session, bool accept_new);
+static void park_session(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
+static POOL_CONNECTION_POOL * resume_session(int session, bool *idle_expired);
+static bool client_idle_limit_reached(time_t idle_since, time_t now);
+static void report_client_idle_limit(void);
+static void set_frontend_cancel_key(bool set);
+static void wait_for_child_slot(void);
+
+/*
+ * Return code of wait_for_session_events() asking to resume a parked
+ * session.
+ */
+#define RESUME_SESSION	(-10)
+
+/*
+ * Idle frontend session parked in multiplexed child mode
+ * (sessions_per_child > 1).  Process wide state belonging to the session
+ * is saved here while other sessions are served.
+ */
+typedef struct
+{
+	POOL_CONNECTION *frontend;
+	POOL_CONNECTION_POOL *backend;
+	POOL_SESSION_CONTEXT session_context;
+	int			pool_index;
+	int			local_session_id;
+	MemoryContext loop_context; /* ProcessLoopContext of the session */
+	MemoryContext query_context;	/* QueryContext of the session */
+	struct timeval start_time;
+	char		remote_host[NI_MAXHOST];
+	char		remote_port[NI_MAXSERV];
+	char		remote_ps_data[NI_MAXHOST + NI_MAXSERV + 2];
+	time_t		idle_since;		/* when the session was parked */
+	bool		idle_expired;	/* client idle limit is reached */
+	bool		released;		/* backend connection is released in
+								 * transaction pooling mode */
+	bool		reacquired;		/* backend connection is acquired again */
+	bool		waiting;		/* waiting for a backend connection */
+	int			first_pfd;		/* first entry of the session in
+								 * session_pfds */
+	int			num_pfds;		/* number of entries of the session */
+}			POOL_PARKED_SESSION;
+
+static POOL_PARKED_SESSION * parked_sessions = NULL;
+static int	num_parked_sessions = 0;
+static int	max_child_sessions = 1; /* effective sessions_per_child */
+
+/*
+ * Descriptors watched by wait_for_session_events(), grown as sessions are
+ * parked.
+ */
+static struct pollfd *session_pfds = NULL;
+static int	session_pfds_size = 0;
+
+static bool reacquire_backend(POOL_PARKED_SESSION * s);
+
+/*
+ * Per loop iteration memory context of the child main loop.  In
+ * multiplexed child mode, ProcessLoopContext points to a memory context
+ * created for each session instead while the session is active.
+ */
+static MemoryContext ChildLoopContext = NULL;
+
+/*
+ * Unix domain datagram socket pair used to hand accepted connections from
+ * accept dispatcher process to children. [0] is used by the dispatcher to
+ * send and [1] is used by children to receive.
+ */
+int			accept_dispatch_fds[2] = {-1, -1};
 
 /*
  * Non 0 means SIGTERM (smart shutdown) or SIGINT (fast shutdown) has arrived
@@ -195,13 +270,21 @@ do_child(int *fds)
 											   ALLOCSET_DEFAULT_INITSIZE,
 											   ALLOCSET_DEFAULT_MAXSIZE);
 
-	MemoryContextSwitchTo(TopMemoryContext);
+	ChildLoopContext = ProcessLoopContext;
 
-	/* Initialize my backend status */
-	pool_initialize_private_backend_status();
+	MemoryContextSwitchTo(TopMemoryContext);
 
-	/* Initialize per process context */
-	pool_init_process_context();
+	/*
+	 * Multiplexed child mode.  Each session needs its own connection pool
+	 * slot unless sessions share them in transaction pooling mode, where
+	 * the number of sessions is only limited by the socket descriptors.
+	 */
+	if (pool_config->transaction_pooling)
+		max_child_sessions = Min(pool_config->sessions_per_child, MAX_SESSIONS_PER_CHILD);
+	else
+		max_child_sessions = Max(Min(pool_config->sessions_per_child, pool_config->max_pool), 1);
+	if (max_child_sessions > 1)
+		parked_sessions = palloc0(sizeof(POOL_PARKED_SESSION) * max_child_sessions);
 
 	/* initialize random seed */
 	gettimeofday(&now, &tz);
@@ -212,12 +295,6 @@ do_child(int *fds)
 	srandom((unsigned int) now.tv_usec);
 #endif
 
-	/* initialize connection pool */
-	if (pool_init_cp())
-	{
-		child_exit(POOL_EXIT_AND_RESTART);
-	}
-
 	/*
 	 * Open pool_passwd in child process.  This is necessary to avoid the file
 	 * descriptor race condition reported in [pgpool-general: 1141].
@@ -227,6 +304,25 @@ do_child(int *fds)
 		pool_reopen_passwd_file();
 	}
 
+	/* Spare child waits here until it takes over a process table slot */
+	if (my_spare_id >= 0)
+		wait_for_child_slot();
+
+	/* Initialize my backend status */
+	pool_initialize_private_backend_status();
+
+	/* Initialize per process context */
+	pool_init_process_context();
+
+	/* Forget queries in progress left over by the previous child */
+	stat_reset_queries_in_progress();
+
+	/* initialize connection pool */
+	if (pool_init_cp())
+	{
+		child_exit(POOL_EXIT_AND_RESTART);
+	}
+
 
 	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
 	{
@@ -263,6 +359,7 @@ do_child(int *fds)
 		}
 
 		backend_cleanup(&child_frontend, backend, frontend_invalid);
+		stat_reset_queries_in_progress();
 
 		session = pool_get_process_context();
 
@@ -272,7 +369,11 @@ do_child(int *fds)
 			pool_session_context_destroy();
 
 			/* Mark this connection pool is not connected from frontend */
-			pool_coninfo_unset_frontend_connected(pool_get_process_context()->proc_id, pool_pool_index());
+			if (pool_pool_index() >= 0)
+			{
+				set_frontend_cancel_key(false);
+				pool_coninfo_unset_frontend_connected(pool_get_process_context()->proc_id, pool_pool_index());
+			}
 
 			/* increment queries counter if necessary */
 			if (pool_config->child_max_connections > 0)
@@ -280,7 +381,8 @@ do_child(int *fds)
 
 			/* check if maximum connections count for this child reached */
 			if ((pool_config->child_max_connections > 0) &&
-				(connections_count >= pool_config->child_max_connections))
+				(connections_count >= pool_config->child_max_connections) &&
+				num_parked_sessions == 0)
 			{
 				ereport(LOG,
 						(errmsg("child exiting, %d connections reached", pool_config->child_max_connections)));
@@ -310,6 +412,18 @@ do_child(int *fds)
 		int			front_end_fd;
 		SockAddr	saddr;
 		int			con_count;
+		int			session;
+		bool		idle_expired;
+		bool		resumed;
+		POOL_STATUS status;
+
+		/* discard the memory of the session ended in multiplexed child mode */
+		if (ProcessLoopContext != ChildLoopContext)
+		{
+			MemoryContextSwitchTo(TopMemoryContext);
+			MemoryContextDelete(ProcessLoopContext);
+			ProcessLoopContext = ChildLoopContext;
+		}
 
 		/* reset per iteration memory context */
 		MemoryContextSwitchTo(ProcessLoopContext);
@@ -318,14 +432,49 @@ do_child(int *fds)
 		backend = NULL;
 		idle = 1;
 
-		/* pgpool stop request already sent? */
-		check_stop_request();
-		check_restart_request();
+		/*
+		 * pgpool stop request already sent?  Parked sessions are served until
+		 * they end.
+		 */
+		if (num_parked_sessions == 0)
+		{
+			check_stop_request();
+			check_restart_request();
+		}
 		accepted = 0;
 		/* Destroy session context for just in case... */
 		pool_session_context_destroy();
 
-		front_end_fd = wait_for_new_connections(fds, &timeout, &saddr);
+		if (num_parked_sessions > 0)
+		{
+			/*
+			 * Do not accept new connections if this child is going to exit
+			 * once the parked sessions end, or if no connection pool slot is
+			 * left for them in transaction pooling mode.
+			 */
+			bool		accept_new = (num_parked_sessions < max_child_sessions &&
+									  pool_has_free_cp() &&
+									  !exit_request &&
+									  !pool_get_my_process_info()->need_to_restart &&
+									  !(pool_config->child_max_connections > 0 &&
+										connections_count >= pool_config->child_max_connections));
+
+			front_end_fd = wait_for_session_events(fds, &saddr, &session, accept_new);
+		}
+		else
+			front_end_fd = wait_for_new_connections(fds, &timeout, &saddr);
+
+		if (front_end_fd == RESUME_SESSION)
+		{
+			backend = resume_session(session, &idle_expired);
+			resumed = true;
+			idle = 0;
+			if (idle_expired)
+				report_client_idle_limit();
+			sp = MAIN_CONNECTION(backend)->sp;
+			goto process_query;
+		}
+
 		if (front_end_fd == OPERATION_TIMEOUT)
 		{
 			if (pool_config->child_life_time > 0 && connected)
@@ -340,11 +489,26 @@ do_child(int *fds)
 		if (front_end_fd == RETRY)
 			continue;
 
+		/*
+		 * In multiplexed child mode, allocate the memory of the session in
+		 * its own memory context so that it survives while the session is
+		 * parked.
+		 */
+		if (max_child_sessions > 1)
+		{
+			ProcessLoopContext = AllocSetContextCreate(TopMemoryContext,
+													   "pgpool_child_session",
+													   ALLOCSET_DEFAULT_MINSIZE,
+													   ALLOCSET_DEFAULT_INITSIZE,
+													   ALLOCSET_DEFAULT_MAXSIZE);
+			MemoryContextSwitchTo(ProcessLoopContext);
+		}
+
 		/*
 		 * Check if max connections from clients execeeded.
 		 */
 		con_count = connection_count_up();
-		if (con_count > (pool_config->num_init_children - pool_config->reserved_connections))
+		if (con_count > (pool_config->num_init_children * max_child_sessions - pool_config->reserved_connections))
 		{
 			POOL_CONNECTION * cp;
 			cp = pool_open(front_end_fd, false);
@@ -410,6 +574,16 @@ do_child(int *fds)
 		 */
 		pool_init_session_context(child_frontend, backend);
 
+		/* remember the startup packet to get a connection again later */
+		if (pool_config->transaction_pooling)
+		{
+			POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
+			MemoryContext oldContext = MemoryContextSwitchTo(session_context->memory_context);
+
+			session_context->startup_packet = StartupPacketCopy(sp);
+			MemoryContextSwitchTo(oldContext);
+		}
+
 		/*
 		 * Set protocol versions
 		 */
@@ -420,6 +594,7 @@ do_child(int *fds)
 		 * Mark this connection pool is connected from frontend
 		 */
 		pool_coninfo_set_frontend_connected(pool_get_process_context()->proc_id, pool_pool_index());
+		set_frontend_cancel_key(true);
 
 		/* create memory context for query processing */
 		QueryContext = AllocSetContextCreate(ProcessLoopContext,
@@ -427,16 +602,23 @@ do_child(int *fds)
 											 ALLOCSET_DEFAULT_MINSIZE,
 											 ALLOCSET_DEFAULT_INITSIZE,
 											 ALLOCSET_DEFAULT_MAXSIZE);
+		resumed = false;
+process_query:
 		/* query process loop */
 		for (;;)
 		{
-			POOL_STATUS status;
-
-			/* Reset the query process memory context */
+			/*
+			 * Reset the query process memory context.  Query contexts of a
+			 * resumed session live there.
+			 */
 			MemoryContextSwitchTo(QueryContext);
-			MemoryContextResetAndDeleteChildren(QueryContext);
+			if (!resumed)
+				MemoryContextResetAndDeleteChildren(QueryContext);
+			resumed = false;
 
 			status = pool_process_query(child_frontend, backend, 0);
+			if (status == POOL_IDLE)
+				break;
 			if (status != POOL_CONTINUE)
 			{
 				backend_cleanup(&child_frontend, backend, false);
@@ -444,10 +626,23 @@ do_child(int *fds)
 			}
 		}
 
+		/*
+		 * In multiplexed child mode, park the idle session and serve other
+		 * sessions until the frontend sends something.
+		 */
+		if (status == POOL_IDLE)
+		{
+			park_session(child_frontend, backend);
+			child_frontend = NULL;
+			accepted = 0;
+			continue;
+		}
+
 		/* Destroy session context */
 		pool_session_context_destroy();
 
 		/* Mark this connection pool is not connected from frontend */
+		set_frontend_cancel_key(false);
 		pool_coninfo_unset_frontend_connected(pool_get_process_context()->proc_id, pool_pool_index());
 
 		accepted = 0;
@@ -464,7 +659,8 @@ do_child(int *fds)
 
 		/* check if maximum connections count for this child reached */
 		if ((pool_config->child_max_connections > 0) &&
-			(connections_count >= pool_config->child_max_connections))
+			(connections_count >= pool_config->child_max_connections) &&
+			num_parked_sessions == 0)
 		{
 			ereport(LOG,
 					(errmsg("child exiting, %d connections reached", pool_config->child_max_connections)));
@@ -496,9 +692,11 @@ backend_cleanup(POOL_CONNECTION * volatile *frontend, POOL_CONNECTION_POOL * vol
 
 	/*
 	 * cach connection if connection cache configuration parameter is enabled
-	 * and frontend connection is not invalid
+	 * and frontend connection is not invalid.  In transaction pooling mode,
+	 * try to keep the connection other sessions count on anyway.
 	 */
-	if (sp && pool_config->connection_cache != 0 && frontend_invalid == false)
+	if (sp && pool_config->connection_cache != 0 &&
+		(frontend_invalid == false || backend->released_sessions > 0))
 	{
 		if (*frontend)
 		{
@@ -526,16 +724,18 @@ backend_cleanup(POOL_CONNECTION * volatile *frontend, POOL_CONNECTION_POOL * vol
 	{
 		/*
 		 * For those special databases, and when frontend client exits
-		 * abnormally, we don't cache connection to backend.
+		 * abnormally, we don't cache connection to backend unless other
+		 * sessions count on it in transaction pooling mode.
 		 */
-		if ((sp &&
-			 (!strcmp(sp->database, "template0") ||
-			  !strcmp(sp->database, "template1") ||
-			  !strcmp(sp->database, "postgres") ||
-			  !strcmp(sp->database, "regression"))) ||
-			(*frontend != NULL &&
-			 ((*frontend)->socket_state == POOL_SOCKET_EOF ||
-			  (*frontend)->socket_state == POOL_SOCKET_ERROR)))
+		if (backend->released_sessions == 0 &&
+			((sp &&
+			  (!strcmp(sp->database, "template0") ||
+			   !strcmp(sp->database, "template1") ||
+			   !strcmp(sp->database, "postgres") ||
+			   !strcmp(sp->database, "regression"))) ||
+			 (*frontend != NULL &&
+			  ((*frontend)->socket_state == POOL_SOCKET_EOF ||
+			   (*frontend)->socket_state == POOL_SOCKET_ERROR))))
 			cache_connection = false;
 	}
 
@@ -867,6 +1067,34 @@ cancel_request(CancelPacket * sp)
 	ereport(DEBUG1,
 			(errmsg("Cancel request received")));
 
+	/*
+	 * In transaction pooling mode, the frontend may be using a connection
+	 * other than the one it received the cancel key from.  Look for the
+	 * connection it is using now.  If there's none, the frontend is idle.
+	 */
+	if (pool_config->transaction_pooling)
+	{
+		for (i = 0; i < pool_config->num_init_children; i++)
+		{
+			for (j = 0; j < pool_config->max_pool; j++)
+			{
+				FrontendCancelKey *key = pool_frontend_cancel_key(i, j);
+
+				if (key && key->pid == sp->pid && key->key == sp->key)
+				{
+					c = pool_coninfo(i, j, 0);
+					found = true;
+					goto found;
+				}
+			}
+		}
+		ereport(DEBUG1,
+				(errmsg("processing cancel request"),
+				 errdetail("no backend connection is used by the frontend pid:%d key:%d",
+						   ntohl(sp->pid), ntohl(sp->key))));
+		return;
+	}
+
 	/* look for cancel key from shmem info */
 	for (i = 0; i < pool_config->num_init_children; i++)
 	{
@@ -1029,6 +1257,9 @@ static POOL_CONNECTION_POOL * connect_backend(StartupPacket *sp, POOL_CONNECTION
 			}
 		}
 
+		/* make the connection visible to pool_get_cp() */
+		pool_register_cp(backend);
+
 		/*
 		 * do authentication stuff
 		 */
@@ -1151,7 +1382,8 @@ static RETSIGTYPE close_idle_connection(int sig)
 		if (MAIN_CONNECTION(p)->sp->user == NULL)
 			continue;
 
-		if (MAIN_CONNECTION(p)->closetime > 0)	/* idle connection? */
+		/* idle connection no session counts on? */
+		if (MAIN_CONNECTION(p)->closetime > 0 && p->released_sessions == 0)
 		{
 #ifdef NOT_USED
 			ereport(DEBUG1,
@@ -1182,6 +1414,7 @@ static RETSIGTYPE close_idle_connection(int sig)
 			memset(p, 0, sizeof(POOL_CONNECTION_POOL));
 			p->info = info;
 			memset(p->info, 0, sizeof(ConnectionInfo));
+			pool_invalidate_cp_index();
 		}
 	}
 
@@ -1263,6 +1496,10 @@ child_will_go_down(int code, Datum arg)
 		return;
 	}
 
+	/* count down sessions parked in multiplexed child mode */
+	for (; num_parked_sessions > 0; num_parked_sessions--)
+		connection_count_down();
+
 	/* count down global connection counter */
 	if (accepted)
 	{
@@ -1286,6 +1523,18 @@ child_will_go_down(int code, Datum arg)
 	if (pool_connection_pool)
 		close_all_backend_connections();
 }
+
+/*
+ * Return true if this child process parks idle sessions to serve several
+ * sessions at a time, that is, the effective sessions_per_child is more
+ * than 1.
+ */
+bool
+pool_is_multiplexed_child(void)
+{
+	return parked_sessions != NULL;
+}
+
 void
 child_exit(int code)
 {
@@ -1432,6 +1681,39 @@ check_restart_request(void)
 	}
 }
 
+/*
+ * Spare child process (spare_children) waits until pgpool main hands over a
+ * process table slot of an exited child to it.
+ */
+static void
+wait_for_child_slot(void)
+{
+	pool_sigset_t oldmask;
+
+	set_ps_display("spare child", false);
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	while (spare_child_slots[my_spare_id] < 0)
+	{
+		if (exit_request)
+		{
+			POOL_SETMASK(&oldmask);
+			child_exit(POOL_EXIT_NO_RESTART);
+		}
+		sigsuspend(&oldmask);
+	}
+	POOL_SETMASK(&oldmask);
+
+	my_proc_id = spare_child_slots[my_spare_id];
+
+	/* let pgpool main fork another spare child in place of me */
+	spare_child_slots[my_spare_id] = -1;
+	my_spare_id = -1;
+
+	ereport(DEBUG1,
+			(errmsg("spare child took over process slot %d", my_proc_id)));
+}
+
 /*
  * wait_for_new_connections()
  * functions calls select on sockets and wait for new client
@@ -1447,22 +1729,17 @@ wait_for_new_connections(int *fds, struct timeval *timeout, SockAddr *saddr)
 	int			save_errno;
 
 	int			fd = 0;
-	int			afd;
 	int		   *walk;
-	int			on;
-
-#ifdef ACCEPT_PERFORMANCE
-	struct timeval now1,
-				now2;
-	static long atime;
-	static int	cnt;
-#endif
 
 	struct timeval *timeoutval;
 	struct timeval tv1,
 				tv2,
 				tmback = {0, 0};
 
+	/* Connections are accepted by the dispatcher process */
+	if (pool_config->accept_dispatcher)
+		return receive_dispatched_connection(timeout, saddr, 0);
+
 	for (walk = fds; *walk != -1; walk++)
 		socket_set_nonblock(*walk);
 
@@ -1623,6 +1900,28 @@ wait_for_new_connections(int *fds, struct timeval *timeout, SockAddr *saddr)
 		}
 	}
 
+	return accept_connection(fds, fd, saddr);
+}
+
+/*
+ * accept_connection()
+ * Accept a new connection on listen socket "fd" which is one of "fds".
+ * Returns the socket descriptor, RETRY or -1.
+ */
+static int
+accept_connection(int *fds, int fd, SockAddr *saddr)
+{
+	int			afd;
+	int			on;
+	int			save_errno;
+
+#ifdef ACCEPT_PERFORMANCE
+	struct timeval now1,
+				now2;
+	static long atime;
+	static int	cnt;
+#endif
+
 	/*
 	 * Note that some SysV systems do not work here. For those systems, we
 	 * need some locking mechanism for the fd.
@@ -1673,7 +1972,7 @@ retry_accept:
 	 * Set no delay if AF_INET socket. Not sure if this is really necessary
 	 * but PostgreSQL does this.
 	 */
-	if (!FD_ISSET(fds[0], &rmask))	/* fds[0] is UNIX domain socket */
+	if (fd != fds[0])			/* fds[0] is UNIX domain socket */
 	{
 		on = 1;
 		if (setsockopt(afd, IPPROTO_TCP, TCP_NODELAY,
@@ -1704,6 +2003,676 @@ retry_accept:
 	return afd;
 }
 
+/*
+ * wait_for_session_events()
+ * Wait for data arrival on sessions parked in multiplexed child mode and,
+ * if "accept_new" is true, for a new connection.  Data arrival from
+ * backends is also watched so that asynchronous messages and backend
+ * terminations are processed.  Returns RESUME_SESSION with "session" set
+ * to the parked session to be resumed, the socket descriptor of a new
+ * connection, or RETRY.
+ */
+static int
+wait_for_session_events(int *fds, SockAddr *saddr, int *session, bool accept_new)
+{
+	static int	next_session = 0;
+	int			numfds;
+	int			npfds = 0;
+	int			naccept;
+	int		   *walk;
+	time_t		now;
+	int			i,
+				j,
+				k;
+
+	/*
+	 * Sessions waiting for a backend connection in transaction pooling mode
+	 * may proceed if other sessions have released or closed their
+	 * connections since the last time.
+	 */
+	for (i = 0; i < num_parked_sessions; i++)
+	{
+		if (parked_sessions[i].waiting && reacquire_backend(&parked_sessions[i]))
+		{
+			*session = i;
+			return RESUME_SESSION;
+		}
+	}
+
+	set_ps_display("wait for connection request or parked sessions", false);
+
+	if (session_pfds_size < nsocks + 1 + num_parked_sessions * (1 + NUM_BACKENDS))
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+		if (session_pfds)
+			pfree(session_pfds);
+		session_pfds_size = nsocks + 1 + max_child_sessions * (1 + NUM_BACKENDS);
+		session_pfds = palloc(sizeof(struct pollfd) * session_pfds_size);
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	/* listening sockets come first */
+	if (accept_new)
+	{
+		if (pool_config->accept_dispatcher)
+		{
+			session_pfds[npfds].fd = accept_dispatch_fds[1];
+			session_pfds[npfds++].events = POLLIN;
+		}
+		else
+		{
+			for (walk = fds; *walk != -1; walk++)
+			{
+				socket_set_nonblock(*walk);
+				session_pfds[npfds].fd = *walk;
+				session_pfds[npfds++].events = POLLIN;
+			}
+		}
+	}
+	naccept = npfds;
+
+	for (i = 0; i < num_parked_sessions; i++)
+	{
+		POOL_PARKED_SESSION *s = &parked_sessions[i];
+
+		s->first_pfd = npfds;
+
+		/* data from the frontend is left unread while waiting */
+		if (!s->waiting)
+		{
+			session_pfds[npfds].fd = s->frontend->fd;
+			session_pfds[npfds++].events = POLLIN;
+		}
+
+		/* the released backend connection is not watched */
+		for (j = 0; j < NUM_BACKENDS && s->backend; j++)
+		{
+			if (CONNECTION_SLOT(s->backend, j) == NULL)
+				continue;
+			session_pfds[npfds].fd = CONNECTION(s->backend, j)->fd;
+			session_pfds[npfds++].events = POLLIN;
+		}
+
+		s->num_pfds = npfds - s->first_pfd;
+	}
+
+	for (i = 0; i < npfds; i++)
+		session_pfds[i].revents = 0;
+
+	/* wake up every second to check client idle limits */
+	numfds = poll(session_pfds, npfds, 1000);
+
+	/* check backend timer is expired */
+	if (backend_timer_expired)
+	{
+		pool_backend_timer();
+		backend_timer_expired = 0;
+	}
+
+	if (numfds == -1)
+	{
+		if (errno == EAGAIN || errno == EINTR)
+			return RETRY;
+		ereport(ERROR,
+				(errmsg("failed to wait for parked sessions"),
+				 errdetail("poll on socket failed with error : \"%m\"")));
+	}
+
+	now = time(NULL);
+
+	/*
+	 * Serve parked sessions first.  Start from the session next to the one
+	 * resumed last time so that no session starves.
+	 */
+	for (k = 0; k < num_parked_sessions; k++)
+	{
+		POOL_PARKED_SESSION *s;
+		bool		ready = false;
+
+		i = (next_session + k) % num_parked_sessions;
+		s = &parked_sessions[i];
+
+		if (s->waiting)
+			continue;
+
+		for (j = 0; j < s->num_pfds && numfds > 0 && !ready; j++)
+		{
+			if (session_pfds[s->first_pfd + j].revents != 0)
+				ready = true;
+		}
+
+		if (!ready && client_idle_limit_reached(s->idle_since, now))
+		{
+			s->idle_expired = true;
+			ready = true;
+		}
+
+		/* wait until a backend connection becomes available */
+		if (ready && s->released && !reacquire_backend(s))
+			continue;
+
+		if (ready)
+		{
+			next_session = i + 1;
+			*session = i;
+			return RESUME_SESSION;
+		}
+	}
+
+	if (numfds <= 0 || !accept_new)
+		return RETRY;
+
+	for (i = 0; i < naccept; i++)
+	{
+		if (session_pfds[i].revents == 0)
+			continue;
+
+		if (pool_config->accept_dispatcher)
+		{
+			struct timeval notimeout = {0, 0};
+
+			return receive_dispatched_connection(&notimeout, saddr, MSG_DONTWAIT);
+		}
+		return accept_connection(fds, session_pfds[i].fd, saddr);
+	}
+	return RETRY;
+}
+
+/*
+ * Park the idle session so that other sessions can be served.  Process
+ * wide state of the session is saved and reset.
+ */
+static void
+park_session(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
+{
+	POOL_PARKED_SESSION *s = &parked_sessions[num_parked_sessions];
+
+	s->frontend = frontend;
+	s->backend = backend;
+	s->released = false;
+	s->reacquired = false;
+	s->waiting = false;
+
+	/*
+	 * In transaction pooling mode, let other sessions use the backend
+	 * connection while this session is idle.
+	 */
+	if (pool_config->transaction_pooling && pool_can_release_backend())
+	{
+		set_frontend_cancel_key(false);
+		pool_release_cp(backend);
+		s->backend = NULL;
+		s->released = true;
+	}
+
+	pool_session_context_save(&s->session_context);
+	s->pool_index = pool_pool_index();
+	s->local_session_id = pool_get_process_context()->local_session_id;
+	s->loop_context = ProcessLoopContext;
+	s->query_context = QueryContext;
+	s->start_time = startTime;
+	StrNCpy(s->remote_host, remote_host, sizeof(s->remote_host));
+	StrNCpy(s->remote_port, remote_port, sizeof(s->remote_port));
+	StrNCpy(s->remote_ps_data, remote_ps_data, sizeof(s->remote_ps_data));
+	s->idle_since = time(NULL);
+	s->idle_expired = false;
+	num_parked_sessions++;
+
+	pool_set_pool_index(-1);
+	ProcessLoopContext = ChildLoopContext;
+	QueryContext = NULL;
+	MemoryContextSwitchTo(ProcessLoopContext);
+}
+
+/*
+ * Resume the parked session.  Restores the process wide state saved by
+ * park_session() and returns the backend connection of the session.
+ * "idle_expired" is set to true if the session has reached client idle
+ * limit.
+ */
+static POOL_CONNECTION_POOL *
+resume_session(int session, bool *idle_expired)
+{
+	POOL_PARKED_SESSION *s = &parked_sessions[session];
+	POOL_CONNECTION_POOL *backend = s->backend;
+	StartupPacket *sp;
+	char		psbuf[NI_MAXHOST + 128];
+
+	child_frontend = s->frontend;
+	pool_session_context_restore(&s->session_context);
+	pool_set_pool_index(s->pool_index);
+	pool_get_process_context()->local_session_id = s->local_session_id;
+	ProcessLoopContext = s->loop_context;
+	QueryContext = s->query_context;
+	startTime = s->start_time;
+	StrNCpy(remote_host, s->remote_host, sizeof(remote_host));
+	StrNCpy(remote_port, s->remote_port, sizeof(remote_port));
+	StrNCpy(remote_ps_data, s->remote_ps_data, sizeof(remote_ps_data));
+	*idle_expired = s->idle_expired;
+
+	if (s->reacquired && backend)
+	{
+		POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
+		int			i;
+
+		session_context->backend = backend;
+		pool_coninfo_set_frontend_connected(pool_get_process_context()->proc_id, pool_pool_index());
+		for (i = 0; i < NUM_BACKENDS; i++)
+			backend->info[i].load_balancing_node = session_context->load_balance_node_id;
+		set_frontend_cancel_key(true);
+	}
+
+	/* fill the hole with the last one */
+	parked_sessions[session] = parked_sessions[--num_parked_sessions];
+
+	accepted = 1;
+	MemoryContextSwitchTo(ProcessLoopContext);
+
+	if (backend == NULL)
+		ereport(ERROR,
+				(errmsg("unable to get backend connection"),
+				 errdetail("the connection shared in transaction pooling mode has been closed")));
+
+	sp = MAIN_CONNECTION(backend)->sp;
+	snprintf(psbuf, sizeof(psbuf), "%s %s %s idle",
+			 sp->user, sp->database, remote_ps_data);
+	set_ps_display(psbuf, false);
+
+	return backend;
+}
+
+/*
+ * Get a backend connection again for the parked session which released
+ * its connection in transaction pooling mode.  Returns false and marks the
+ * session waiting if all connections it can use are used by other
+ * sessions.  If no connection is left at all, the session is resumed
+ * without a connection and terminated.
+ */
+static bool
+reacquire_backend(POOL_PARKED_SESSION * s)
+{
+	POOL_CONNECTION_POOL *backend;
+	bool		busy;
+
+	backend = pool_acquire_cp(s->session_context.startup_packet, &busy);
+	if (backend == NULL && busy)
+	{
+		s->waiting = true;
+		return false;
+	}
+
+	s->backend = backend;
+	s->pool_index = backend ? pool_pool_index() : -1;
+	pool_set_pool_index(-1);
+	s->released = false;
+	s->reacquired = true;
+	s->waiting = false;
+	return true;
+}
+
+/*
+ * Record the cancel key of the frontend of the current session to the
+ * connection pool slot in use, or clear it if "set" is false, so that
+ * cancel requests are forwarded to the backend the frontend is using in
+ * transaction pooling mode.
+ */
+static void
+set_frontend_cancel_key(bool set)
+{
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(true);
+	FrontendCancelKey *key;
+
+	if (!pool_config->transaction_pooling || pool_pool_index() < 0)
+		return;
+
+	key = pool_frontend_cancel_key(pool_get_process_context()->proc_id, pool_pool_index());
+	if (key == NULL)
+		return;
+
+	if (set && session_context)
+	{
+		key->pid = session_context->frontend->cancel_pid;
+		key->key = session_context->frontend->cancel_key;
+	}
+	else
+	{
+		key->pid = 0;
+		key->key = 0;
+	}
+}
+
+/*
+ * Return true if the session parked since "idle_since" has reached
+ * client_idle_limit or client_idle_limit_in_recovery.
+ */
+static bool
+client_idle_limit_reached(time_t idle_since, time_t now)
+{
+	if (*InRecovery == RECOVERY_INIT)
+		return pool_config->client_idle_limit > 0 &&
+			now - idle_since > pool_config->client_idle_limit;
+
+	if (pool_config->client_idle_limit_in_recovery == -1)
+		return true;
+
+	return pool_config->client_idle_limit_in_recovery > 0 &&
+		now - idle_since > pool_config->client_idle_limit_in_recovery;
+}
+
+/*
+ * Terminate the resumed session which has reached client idle limit.
+ * This never returns.
+ */
+static void
+report_client_idle_limit(void)
+{
+	if (*InRecovery == RECOVERY_INIT)
+		ereport(FRONTEND_ERROR,
+				(pool_error_code("57000"),
+				 errmsg("unable to read data"),
+				 errdetail("child connection forced to terminate due to client_idle_limit:%d is reached",
+						   pool_config->client_idle_limit)));
+	else if (pool_config->client_idle_limit_in_recovery == -1)
+		ereport(FRONTEND_ERROR,
+				(pool_error_code("57000"),
+				 errmsg("connection terminated due to online recovery"),
+				 errdetail("child connection forced to terminate due to client_idle_limitis:-1")));
+	else
+		ereport(FRONTEND_ERROR,
+				(pool_error_code("57000"),
+				 errmsg("unable to read data"),
+				 errdetail("child connection forced to terminate due to client_idle_limit_in_recovery:%d is reached",
+						   pool_config->client_idle_limit_in_recovery)));
+}
+
+/*
+ * receive_dispatched_connection()
+ * Receive a connection accepted by the accept dispatcher process.  All
+ * idle children block in recvmsg() on the same socket, and the kernel
+ * wakes up only one of them per datagram, thus no thundering herd nor
+ * semaphore convoy happens.  The receive timeout of the socket is short
+ * (see create_accept_dispatch_socket()) so that we can check the child
+ * life time and requests from the parent periodically.  "flags" is
+ * passed to recvmsg().  Returns the socket descriptor, RETRY or
+ * OPERATION_TIMEOUT.
+ */
+static int
+receive_dispatched_connection(struct timeval *timeout, SockAddr *saddr, int flags)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union
+	{
+		struct cmsghdr cm;
+		char		control[CMSG_SPACE(sizeof(int))];
+	}			cmsgbuf;
+	struct timeval tv1,
+				tv2;
+	int			afd = -1;
+	int			n;
+	int			save_errno;
+
+	set_ps_display("wait for connection request", false);
+
+	memset(saddr, 0, sizeof(*saddr));
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = saddr;
+	iov.iov_len = sizeof(*saddr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsgbuf.control;
+	msg.msg_controllen = sizeof(cmsgbuf.control);
+
+	gettimeofday(&tv1, NULL);
+	n = recvmsg(accept_dispatch_fds[1], &msg, flags);
+	save_errno = errno;
+	gettimeofday(&tv2, NULL);
+
+	/* check backend timer is expired */
+	if (backend_timer_expired)
+	{
+		pool_backend_timer();
+		backend_timer_expired = 0;
+	}
+
+	if (n < 0)
+	{
+		if (save_errno != EAGAIN && save_errno != EWOULDBLOCK && save_errno != EINTR)
+		{
+			errno = save_errno;
+			ereport(ERROR,
+					(errmsg("failed to receive dispatched connection"),
+					 errdetail("recvmsg on socket failed with error : \"%m\"")));
+		}
+
+		/* compute remaining timeout */
+		if (timeout->tv_sec != 0 || timeout->tv_usec != 0)
+		{
+			timeout->tv_sec -= tv2.tv_sec - tv1.tv_sec;
+			timeout->tv_usec -= tv2.tv_usec - tv1.tv_usec;
+			if (timeout->tv_usec < 0)
+			{
+				timeout->tv_sec--;
+				timeout->tv_usec += 1000000;
+			}
+			if (timeout->tv_sec < 0 || (timeout->tv_sec == 0 && timeout->tv_usec == 0))
+			{
+				timeout->tv_sec = 0;
+				timeout->tv_usec = 0;
+				return OPERATION_TIMEOUT;
+			}
+		}
+		return RETRY;
+	}
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+			memcpy(&afd, CMSG_DATA(cmsg), sizeof(int));
+	}
+
+	if (afd < 0 || n != sizeof(*saddr))
+	{
+		ereport(WARNING,
+				(errmsg("failed to receive dispatched connection"),
+				 errdetail("invalid message from accept dispatcher")));
+		if (afd >= 0)
+			close(afd);
+		return RETRY;
+	}
+
+	/* wait if recovery is started */
+	while (*InRecovery == 1)
+	{
+		pause();
+	}
+
+	/*
+	 * Make sure that the socket is non blocking.
+	 */
+	socket_unset_nonblock(afd);
+
+	return afd;
+}
+
+/*
+ * Create the socket pair used to hand accepted connections to children.
+ * This is called by pgpool main process before forking children.
+ */
+void
+create_accept_dispatch_socket(void)
+{
+	struct timeval tv;
+
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, accept_dispatch_fds) < 0)
+		ereport(FATAL,
+				(errmsg("failed to create accept dispatcher socket"),
+				 errdetail("socketpair() failed with error \"%m\"")));
+
+	/*
+	 * Children wake up every second to check child life time and requests
+	 * from the parent.
+	 */
+	tv.tv_sec = 1;
+	tv.tv_usec = 0;
+	if (setsockopt(accept_dispatch_fds[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+		ereport(FATAL,
+				(errmsg("failed to create accept dispatcher socket"),
+				 errdetail("setsockopt() failed with error \"%m\"")));
+}
+
+/*
+ * accept dispatcher main loop.  Accepts connections on the listen sockets
+ * and hands them to idle children.  If no child is idle, sendmsg() blocks
+ * once the socket buffer is full and new connections are left in the
+ * listen queue just like when all children are busy.
+ */
+void
+do_accept_dispatcher(int *fds)
+{
+	fd_set		rmask;
+	int			nfds = 0;
+	int		   *walk;
+
+	ereport(DEBUG1,
+			(errmsg("I am accept dispatcher process with pid: %d", getpid())));
+
+	/* Identify myself via ps */
+	init_ps_display("", "", "", "");
+	set_ps_display("accept dispatcher", false);
+
+	/* set up signal handlers */
+	signal(SIGALRM, SIG_DFL);
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGTERM, accept_dispatcher_exit);
+	signal(SIGINT, accept_dispatcher_exit);
+	signal(SIGQUIT, accept_dispatcher_exit);
+	signal(SIGHUP, SIG_IGN);
+	signal(SIGUSR1, SIG_IGN);
+	signal(SIGUSR2, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+
+	/* children's end of the socket pair is not used */
+	close(accept_dispatch_fds[1]);
+
+	for (walk = fds; *walk != -1; walk++)
+	{
+		socket_set_nonblock(*walk);
+		if (*walk > nfds)
+			nfds = *walk;
+	}
+	nfds++;
+
+	for (;;)
+	{
+		FD_ZERO(&rmask);
+		for (walk = fds; *walk != -1; walk++)
+			FD_SET(*walk, &rmask);
+
+		if (select(nfds, &rmask, NULL, NULL, NULL) < 0)
+		{
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			ereport(FATAL,
+					(errmsg("accept dispatcher failed"),
+					 errdetail("select on socket failed with error : \"%m\"")));
+		}
+
+		for (walk = fds; *walk != -1; walk++)
+		{
+			if (!FD_ISSET(*walk, &rmask))
+				continue;
+
+			/* accept as many connections as possible */
+			for (;;)
+			{
+				SockAddr	saddr;
+				struct msghdr msg;
+				struct iovec iov;
+				struct cmsghdr *cmsg;
+				union
+				{
+					struct cmsghdr cm;
+					char		control[CMSG_SPACE(sizeof(int))];
+				}			cmsgbuf;
+				int			afd;
+				int			on;
+
+				/* wait if recovery is started */
+				while (*InRecovery == 1)
+					sleep(1);
+
+				memset(&saddr, 0, sizeof(saddr));
+				saddr.salen = sizeof(saddr.addr);
+				afd = accept(*walk, (struct sockaddr *) &saddr.addr, &saddr.salen);
+				if (afd < 0)
+				{
+					if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+						ereport(LOG,
+								(errmsg("failed to accept user connection"),
+								 errdetail("accept on socket failed with error : \"%m\"")));
+					break;
+				}
+
+				/*
+				 * Set no delay if AF_INET socket. fds[0] is UNIX domain
+				 * socket.
+				 */
+				if (*walk != fds[0])
+				{
+					on = 1;
+					if (setsockopt(afd, IPPROTO_TCP, TCP_NODELAY,
+								   (char *) &on,
+								   sizeof(on)) < 0)
+					{
+						ereport(WARNING,
+								(errmsg("accept dispatcher: setsockopt failed with error \"%m\"")));
+						close(afd);
+						continue;
+					}
+				}
+
+				memset(&msg, 0, sizeof(msg));
+				iov.iov_base = &saddr;
+				iov.iov_len = sizeof(saddr);
+				msg.msg_iov = &iov;
+				msg.msg_iovlen = 1;
+				msg.msg_control = cmsgbuf.control;
+				msg.msg_controllen = sizeof(cmsgbuf.control);
+				cmsg = CMSG_FIRSTHDR(&msg);
+				cmsg->cmsg_level = SOL_SOCKET;
+				cmsg->cmsg_type = SCM_RIGHTS;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+				memcpy(CMSG_DATA(cmsg), &afd, sizeof(int));
+
+				while (sendmsg(accept_dispatch_fds[0], &msg, 0) < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					ereport(WARNING,
+							(errmsg("accept dispatcher failed to hand over connection"),
+							 errdetail("sendmsg failed with error \"%m\"")));
+					break;
+				}
+
+				/* the child owns the connection now */
+				close(afd);
+			}
+		}
+	}
+}
+
+/*
+ * signal handler for SIGTERM, SIGINT and SIGQUIT of accept dispatcher
+ */
+static RETSIGTYPE accept_dispatcher_exit(int sig)
+{
+	POOL_SETMASK(&BlockSig);
+	exit(0);
+}
+
 static void
 check_config_reload(void)
 {
@@ -1963,6 +2932,14 @@ retry_startup:
 		close_idle_connection(0);
 		pool_initialize_private_backend_status();
 	}
+	else
+	{
+		/*
+		 * Standby nodes failed over while keeping the sessions are just
+		 * detached from the existing connections.
+		 */
+		pool_detach_down_backends(NULL);
+	}
 
 	/*
 	 * if there's no connection associated with user and database, we need to
@@ -2003,9 +2980,11 @@ retry_startup:
 		{
 			/*
 			 * we need to discard existing connection since startup packet is
-			 * different
+			 * different, unless other sessions count on it in transaction
+			 * pooling mode
 			 */
-			pool_discard_cp(sp->user, sp->database, sp->major);
+			if (backend->released_sessions == 0)
+				pool_discard_cp(sp->user, sp->database, sp->major);
 			backend = NULL;
 		}
 	}
@@ -58,6 +58,34 @@
 
 static int	pool_index;			/* Active pool index */
 POOL_CONNECTION_POOL *pool_connection_pool; /* connection pool */
+
+/*
+ * Lookup index of the connection pool.  Slots holding a connection are
+ * chained in hash buckets keyed by (user, database, protocol major
+ * version), and all slots are linked in an LRU list whose head is the
+ * slot to be reused first: empty slots, then the least recently used
+ * connection.  Slots are cleared at several places, so the index may
+ * have stale entries.  They are validated on lookup and dropped lazily.
+ */
+typedef struct
+{
+	uint32		hash;			/* hash value of the key */
+	bool		hashed;			/* true if linked in a hash bucket */
+	int			hash_prev;		/* previous slot in the bucket or -1 */
+	int			hash_next;		/* next slot in the bucket or -1 */
+	int			lru_prev;		/* less recently used slot or -1 */
+	int			lru_next;		/* more recently used slot or -1 */
+}			POOL_CP_INDEX_ENTRY;
+
+static POOL_CP_INDEX_ENTRY * cp_index;	/* one entry per slot */
+static int *cp_buckets;			/* first slot in each bucket or -1 */
+static int	cp_nbuckets;		/* number of buckets, power of 2 */
+static int	cp_lru_head;		/* slot to be reused first */
+static int	cp_lru_tail;		/* most recently used slot */
+static volatile sig_atomic_t cp_index_stale = 0;	/* non 0 if slots were
+													 * cleared outside of
+													 * this module */
+
 volatile sig_atomic_t backend_timer_expired = 0;	/* flag for connection
 													 * closed timer is expired */
 volatile sig_atomic_t health_check_timer_expired;	/* non 0 if health check
@@ -66,6 +94,17 @@ static POOL_CONNECTION_POOL_SLOT * create_cp(POOL_CONNECTION_POOL_SLOT * cp, int
 static POOL_CONNECTION_POOL * new_connection(POOL_CONNECTION_POOL * p);
 static int	check_socket_status(int fd);
 static bool connect_with_timeout(int fd, struct addrinfo *walk, char *host, int port, bool retry);
+static bool is_connection_in_use(POOL_CONNECTION_POOL * p);
+static bool has_empty_slot(void);
+static uint32 cp_hash(char *user, char *database, int protoMajor);
+static bool cp_match(POOL_CONNECTION_POOL * p, char *user, char *database, int protoMajor);
+static void cp_hash_link(int slot, uint32 hash);
+static void cp_hash_unlink(int slot);
+static void cp_lru_unlink(int slot);
+static void cp_touch(int slot);
+static void cp_retire(int slot);
+static void cp_sweep(void);
+static void count_hit(int slot);
 
 /*
 * initialize connection pools. this should be called once at the startup.
@@ -74,6 +113,7 @@ int
 pool_init_cp(void)
 {
 	int			i;
+	ConnectionPoolStats *stats;
 	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
 
 	pool_connection_pool = (POOL_CONNECTION_POOL *) palloc(sizeof(POOL_CONNECTION_POOL) * pool_config->max_pool);
@@ -83,7 +123,29 @@ pool_init_cp(void)
 	{
 		pool_connection_pool[i].info = pool_coninfo(pool_get_process_context()->proc_id, i, 0);
 		memset(pool_connection_pool[i].info, 0, sizeof(ConnectionInfo) * MAX_NUM_BACKENDS);
+
+		stats = pool_connection_pool_stats(pool_get_process_context()->proc_id, i);
+		if (stats)
+			memset(stats, 0, sizeof(ConnectionPoolStats));
+	}
+
+	/* initialize lookup index. all slots are empty. */
+	for (cp_nbuckets = 1; cp_nbuckets < pool_config->max_pool * 2; cp_nbuckets <<= 1)
+		;
+	cp_buckets = palloc(sizeof(int) * cp_nbuckets);
+	for (i = 0; i < cp_nbuckets; i++)
+		cp_buckets[i] = -1;
+
+	cp_index = palloc0(sizeof(POOL_CP_INDEX_ENTRY) * pool_config->max_pool);
+	for (i = 0; i < pool_config->max_pool; i++)
+	{
+		cp_index[i].hash_prev = cp_index[i].hash_next = -1;
+		cp_index[i].lru_prev = i - 1;
+		cp_index[i].lru_next = (i == pool_config->max_pool - 1) ? -1 : i + 1;
 	}
+	cp_lru_head = 0;
+	cp_lru_tail = pool_config->max_pool - 1;
+
 	MemoryContextSwitchTo(oldContext);
 	return 0;
 }
@@ -97,8 +159,11 @@ pool_get_cp(char *user, char *database, int protoMajor, int check_socket)
 	pool_sigset_t oldmask;
 
 	int			i,
+				next,
 				freed = 0;
+	uint32		hash;
 	ConnectionInfo *info;
+	bool		share;
 
 	POOL_CONNECTION_POOL *connection_pool = pool_connection_pool;
 
@@ -111,16 +176,42 @@ pool_get_cp(char *user, char *database, int protoMajor, int check_socket)
 				 errdetail("connection pool is not initialized")));
 	}
 
+	/*
+	 * In transaction pooling mode, connections released by other sessions
+	 * are shared only if no new connection can be made so that sessions are
+	 * spread over up to max_pool connections.
+	 */
+	share = !(pool_config->transaction_pooling && check_socket && has_empty_slot());
+
+	hash = cp_hash(user, database, protoMajor);
+
 	POOL_SETMASK2(&BlockSig, &oldmask);
 
-	for (i = 0; i < pool_config->max_pool; i++)
+	for (i = cp_buckets[hash & (cp_nbuckets - 1)]; i >= 0; i = next)
 	{
-		if (MAIN_CONNECTION(connection_pool) &&
-			MAIN_CONNECTION(connection_pool)->sp &&
-			MAIN_CONNECTION(connection_pool)->sp->major == protoMajor &&
-			MAIN_CONNECTION(connection_pool)->sp->user != NULL &&
-			strcmp(MAIN_CONNECTION(connection_pool)->sp->user, user) == 0 &&
-			strcmp(MAIN_CONNECTION(connection_pool)->sp->database, database) == 0)
+		next = cp_index[i].hash_next;
+		connection_pool = &pool_connection_pool[i];
+
+		/* drop the slot cleared since it was indexed */
+		if (MAIN_CONNECTION(connection_pool) == NULL ||
+			MAIN_CONNECTION(connection_pool)->sp == NULL ||
+			MAIN_CONNECTION(connection_pool)->sp->user == NULL)
+		{
+			cp_hash_unlink(i);
+			continue;
+		}
+
+		/*
+		 * In multiplexed child mode, do not hand out a connection used by
+		 * another session of this child.
+		 */
+		if (check_socket &&
+			(is_connection_in_use(connection_pool) ||
+			 (!share && connection_pool->released_sessions > 0)))
+			continue;
+
+		if (cp_index[i].hash == hash &&
+			cp_match(connection_pool, user, database, protoMajor))
 		{
 			int			sock_broken = 0;
 			int			j;
@@ -180,15 +271,18 @@ pool_get_cp(char *user, char *database, int protoMajor, int check_socket)
 					connection_pool->info = info;
 					info->swallow_termination = 0;
 					memset(connection_pool->info, 0, sizeof(ConnectionInfo) * MAX_NUM_BACKENDS);
+					cp_retire(i);
 					POOL_SETMASK(&oldmask);
 					return NULL;
 				}
+
+				count_hit(i);
+				cp_touch(i);
 			}
 			POOL_SETMASK(&oldmask);
 			pool_index = i;
 			return connection_pool;
 		}
-		connection_pool++;
 	}
 
 	POOL_SETMASK(&oldmask);
@@ -201,11 +295,21 @@ pool_get_cp(char *user, char *database, int protoMajor, int check_socket)
 void
 pool_discard_cp(char *user, char *database, int protoMajor)
 {
-	POOL_CONNECTION_POOL *p = pool_get_cp(user, database, protoMajor, 0);
+	POOL_CONNECTION_POOL *p = NULL;
 	ConnectionInfo *info;
 	int			i,
 				freed = 0;
 
+	/*
+	 * The connection to be discarded is the one currently used in most
+	 * cases.  Check it first so that the right one is discarded even if
+	 * other sessions of this child use the same user and database.
+	 */
+	if (pool_index >= 0)
+		p = &pool_connection_pool[pool_index];
+	if (p == NULL || !cp_match(p, user, database, protoMajor))
+		p = pool_get_cp(user, database, protoMajor, 0);
+
 	if (p == NULL)
 	{
 		ereport(LOG,
@@ -232,8 +336,180 @@ pool_discard_cp(char *user, char *database, int protoMajor)
 	memset(p, 0, sizeof(POOL_CONNECTION_POOL));
 	p->info = info;
 	memset(p->info, 0, sizeof(ConnectionInfo) * MAX_NUM_BACKENDS);
+	cp_retire(p - pool_connection_pool);
+}
+
+/*
+ * Close the connections to the backend nodes which have been detached by a
+ * failover keeping the sessions (failover_keep_sessions), and mark them down
+ * in the private backend status.  Connection pools of the other sessions of
+ * this process which are in a transaction on their load balance node being
+ * detached are left alone so that the session itself notices it later on.
+ *
+ * "backend" is the connection pool of the current session, or NULL.  Returns
+ * true if the transaction of the current session has been lost.
+ */
+bool
+pool_detach_down_backends(POOL_CONNECTION_POOL * backend)
+{
+	POOL_CONNECTION_POOL *p;
+	int			i,
+				j;
+	bool		lost_transaction = false;
+
+	if (!pool_config->failover_keep_sessions || !STREAM || !pool_connection_pool)
+		return false;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (BACKEND_INFO(i).backend_status != CON_DOWN)
+			continue;
+
+		if (*(my_backend_status[i]) == CON_DOWN &&
+			(backend == NULL || CONNECTION_SLOT(backend, i) == NULL))
+			continue;
+
+		ereport(LOG,
+				(errmsg("detaching DB node %d from the sessions of this process", i),
+				 errdetail("the node has been detached by failover")));
+
+		for (j = 0, p = pool_connection_pool; j < pool_config->max_pool; j++, p++)
+		{
+			if (CONNECTION_SLOT(p, i) == NULL)
+				continue;
+
+			if (p->info->load_balancing_node == i && TSTATE(p, i) != 'I')
+			{
+				if (p != backend)
+					continue;
+				lost_transaction = true;
+			}
+
+			/* the startup packet is shared with the other slots */
+			CONNECTION_SLOT(p, i)->sp = NULL;
+			pool_close(CONNECTION(p, i));
+			pfree(CONNECTION_SLOT(p, i));
+			p->slots[i] = NULL;
+
+			p->info[i].connected = false;
+			p->info[i].pid = 0;
+			p->info[i].key = 0;
+		}
+
+		*(my_backend_status[i]) = CON_DOWN;
+
+		/*
+		 * If the detached node was my main node, queries would be routed to
+		 * the node whose slot no longer exists.  Pick the main node again
+		 * from the shared status.  The failover may not have set the new
+		 * main node yet, in which case take the first node still up.
+		 */
+		if (my_main_node_id == i)
+		{
+			my_main_node_id = REAL_MAIN_NODE_ID;
+			if (my_main_node_id < 0 || !VALID_BACKEND_RAW(my_main_node_id) ||
+				BACKEND_INFO(my_main_node_id).backend_status == CON_DOWN)
+			{
+				for (j = 0; j < NUM_BACKENDS; j++)
+				{
+					if (VALID_BACKEND_RAW(j) &&
+						BACKEND_INFO(j).backend_status != CON_DOWN)
+						break;
+				}
+				my_main_node_id = j < NUM_BACKENDS ? j : -1;
+			}
+			ereport(LOG,
+					(errmsg("main node of this process changed to %d", my_main_node_id)));
+		}
+	}
+
+	return lost_transaction;
+}
+
+
+/*
+ * Release the connection used by the idle session in transaction pooling
+ * mode so that other sessions of this child can use it.  The connection
+ * is not discarded until the session gets a connection again by
+ * pool_acquire_cp().
+ */
+void
+pool_release_cp(POOL_CONNECTION_POOL * p)
+{
+	int			i;
+
+	p->released_sessions++;
+	for (i = 0; i < NUM_BACKENDS; i++)
+		p->info[i].connected = false;
+	pool_register_cp(p);
+	pool_index = -1;
 }
 
+/*
+ * Get a connection for the session which released its connection by
+ * pool_release_cp().  Any connection made by the identical startup packet
+ * and not used by other sessions will do.  If all of them are in use,
+ * returns NULL with "busy" set to true.  If there's no such connection at
+ * all, returns NULL with "busy" set to false.
+ */
+POOL_CONNECTION_POOL *
+pool_acquire_cp(StartupPacket *sp, bool *busy)
+{
+	POOL_CONNECTION_POOL *p;
+	POOL_CONNECTION_POOL *found = NULL;
+	POOL_CONNECTION_POOL *counted = NULL;
+	int			found_index = -1;
+	int			i,
+				next;
+	uint32		hash;
+
+	*busy = false;
+
+	hash = cp_hash(sp->user, sp->database, sp->major);
+
+	for (i = cp_buckets[hash & (cp_nbuckets - 1)]; i >= 0; i = next)
+	{
+		next = cp_index[i].hash_next;
+		p = &pool_connection_pool[i];
+
+		if (!(cp_index[i].hash == hash &&
+			  MAIN_CONNECTION(p) &&
+			  MAIN_CONNECTION(p)->sp &&
+			  MAIN_CONNECTION(p)->sp->len == sp->len &&
+			  memcmp(MAIN_CONNECTION(p)->sp->startup_packet, sp->startup_packet, sp->len) == 0))
+			continue;
+
+		if (is_connection_in_use(p))
+			*busy = true;
+		else if (found == NULL)
+		{
+			found = p;
+			found_index = i;
+		}
+
+		if (p->released_sessions > 0 && (counted == NULL || p == found))
+			counted = p;
+	}
+
+	if (found == NULL)
+		return NULL;
+
+	*busy = false;
+
+	/* the session does not count on any connection any more */
+	if (counted)
+		counted->released_sessions--;
+
+	/* mark this connection is under use */
+	MAIN_CONNECTION(found)->closetime = 0;
+	for (i = 0; i < NUM_BACKENDS; i++)
+		found->info[i].counter++;
+
+	count_hit(found_index);
+	cp_touch(found_index);
+	pool_index = found_index;
+	return found;
+}
 
 /*
 * create a connection pool by user and database
@@ -242,11 +518,12 @@ POOL_CONNECTION_POOL *
 pool_create_cp(void)
 {
 	int			i,
+				slot,
 				freed = 0;
-	time_t		closetime;
 	POOL_CONNECTION_POOL *oldestp;
 	POOL_CONNECTION_POOL *ret;
 	ConnectionInfo *info;
+	ConnectionPoolStats *stats;
 
 	POOL_CONNECTION_POOL *p = pool_connection_pool;
 
@@ -257,46 +534,51 @@ pool_create_cp(void)
 				 errmsg("unable to create connection"),
 				 errdetail("connection pool is not initialized")));
 
-	for (i = 0; i < pool_config->max_pool; i++)
+	if (cp_index_stale)
+		cp_sweep();
+
+	/*
+	 * Empty slots are at the head of the LRU list.  If there's none, the
+	 * least recently used connection is discarded.  Connections used by
+	 * other sessions of this child in multiplexed child mode, or released
+	 * by them in transaction pooling mode, are not candidates.
+	 */
+	oldestp = NULL;
+
+	for (slot = cp_lru_head; slot >= 0; slot = cp_index[slot].lru_next)
 	{
+		p = &pool_connection_pool[slot];
+
 		if (MAIN_CONNECTION(p) == NULL)
 		{
 			ret = new_connection(p);
 			if (ret)
-				pool_index = i;
+			{
+				pool_index = slot;
+				stats = pool_connection_pool_stats(pool_get_process_context()->proc_id, slot);
+				if (stats)
+					stats->misses++;
+				cp_touch(slot);
+			}
 			return ret;
 		}
-		p++;
+
+		if (is_connection_in_use(p) || p->released_sessions > 0)
+			continue;
+
+		oldestp = p;
+		pool_index = slot;
+		break;
 	}
+
 	ereport(DEBUG1,
 			(errmsg("creating connection pool"),
 			 errdetail("no empty connection slot was found")));
 
-	/*
-	 * no empty connection slot was found. look for the oldest connection and
-	 * discard it.
-	 */
-	oldestp = p = pool_connection_pool;
-	closetime = MAIN_CONNECTION(p)->closetime;
-	pool_index = 0;
-
-	for (i = 0; i < pool_config->max_pool; i++)
-	{
-		ereport(DEBUG1,
-				(errmsg("creating connection pool"),
-				 errdetail("user: %s database: %s closetime: %ld",
-						   MAIN_CONNECTION(p)->sp->user,
-						   MAIN_CONNECTION(p)->sp->database,
-						   MAIN_CONNECTION(p)->closetime)));
-
-		if (MAIN_CONNECTION(p)->closetime < closetime)
-		{
-			closetime = MAIN_CONNECTION(p)->closetime;
-			oldestp = p;
-			pool_index = i;
-		}
-		p++;
-	}
+	if (oldestp == NULL)
+		ereport(ERROR,
+				(errmsg("unable to create connection"),
+				 errdetail("all connection pool slots are in use")));
 
 	p = oldestp;
 	pool_send_frontend_exits(p);
@@ -329,8 +611,18 @@ pool_create_cp(void)
 	memset(p, 0, sizeof(POOL_CONNECTION_POOL));
 	p->info = info;
 	memset(p->info, 0, sizeof(ConnectionInfo) * MAX_NUM_BACKENDS);
+	cp_hash_unlink(slot);
 
 	ret = new_connection(p);
+	if (ret)
+	{
+		stats = pool_connection_pool_stats(pool_get_process_context()->proc_id, slot);
+		if (stats)
+			stats->misses++;
+		cp_touch(slot);
+	}
+	else
+		cp_retire(slot);
 	return ret;
 }
 
@@ -354,6 +646,9 @@ pool_connection_pool_timer(POOL_CONNECTION_POOL * backend)
 			CONNECTION_SLOT(backend, i)->closetime = time(NULL);
 	}
 
+	/* the connection is the most recently used one now */
+	pool_register_cp(backend);
+
 	if (pool_config->connection_life_time == 0)
 		return;
 
@@ -416,8 +711,11 @@ pool_backend_timer(void)
 		if (MAIN_CONNECTION(p)->sp->user == NULL)
 			continue;
 
-		/* timer expire? */
-		if (MAIN_CONNECTION(p)->closetime)
+		/*
+		 * timer expire?  Connections sessions count on in transaction
+		 * pooling mode are kept.
+		 */
+		if (MAIN_CONNECTION(p)->closetime && p->released_sessions == 0)
 		{
 			int			freed = 0;
 
@@ -453,6 +751,7 @@ pool_backend_timer(void)
 				memset(p, 0, sizeof(POOL_CONNECTION_POOL));
 				p->info = info;
 				memset(p->info, 0, sizeof(ConnectionInfo) * MAX_NUM_BACKENDS);
+				cp_retire(i);
 			}
 			else
 			{
@@ -1036,6 +1335,259 @@ pool_pool_index(void)
 	return pool_index;
 }
 
+/*
+ * Set current used index.  Used when multiplexed child mode switches
+ * between sessions.  -1 means that no session is active.
+ */
+void
+pool_set_pool_index(int index)
+{
+	pool_index = index;
+}
+
+/*
+ * Return true if a frontend is connected to the connection.  Only used in
+ * multiplexed child mode, where connections of parked sessions must not be
+ * reused or discarded by other sessions.
+ */
+static bool
+is_connection_in_use(POOL_CONNECTION_POOL * p)
+{
+	int			i;
+
+	if (!pool_is_multiplexed_child())
+		return false;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (p->info[i].connected)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Return true if there's a connection pool slot not used by any session
+ * of this child.
+ */
+bool
+pool_has_free_cp(void)
+{
+	int			i;
+
+	for (i = 0; i < pool_config->max_pool; i++)
+	{
+		if (!is_connection_in_use(&pool_connection_pool[i]))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Add the connection to the lookup index, or move it there if the slot
+ * was reused for another user or database, and mark it as the most
+ * recently used one.  Must be called once the startup packet is set to
+ * the connection.
+ */
+void
+pool_register_cp(POOL_CONNECTION_POOL * p)
+{
+	int			slot = p - pool_connection_pool;
+	uint32		hash;
+
+	if (cp_index == NULL || slot < 0 || slot >= pool_config->max_pool)
+		return;
+
+	if (MAIN_CONNECTION(p) == NULL ||
+		MAIN_CONNECTION(p)->sp == NULL ||
+		MAIN_CONNECTION(p)->sp->user == NULL)
+		return;
+
+	hash = cp_hash(MAIN_CONNECTION(p)->sp->user, MAIN_CONNECTION(p)->sp->database,
+				   MAIN_CONNECTION(p)->sp->major);
+	if (!cp_index[slot].hashed || cp_index[slot].hash != hash)
+	{
+		cp_hash_unlink(slot);
+		cp_hash_link(slot, hash);
+	}
+	cp_touch(slot);
+}
+
+/*
+ * Tell that connection pool slots were cleared without updating the
+ * lookup index.  Safe to call from a signal handler.  The index is fixed
+ * up when a connection is created next time.
+ */
+void
+pool_invalidate_cp_index(void)
+{
+	cp_index_stale = 1;
+}
+
+/*
+ * Hash value of the lookup key of connections.
+ */
+static uint32
+cp_hash(char *user, char *database, int protoMajor)
+{
+	uint32		h = 2166136261U;	/* FNV-1a */
+	unsigned char *p;
+
+	for (p = (unsigned char *) user; *p; p++)
+		h = (h ^ *p) * 16777619U;
+	h *= 16777619U;				/* separator */
+	for (p = (unsigned char *) database; *p; p++)
+		h = (h ^ *p) * 16777619U;
+	h = (h ^ (uint32) protoMajor) * 16777619U;
+
+	return h;
+}
+
+/*
+ * Return true if the connection was made for the user and database.
+ */
+static bool
+cp_match(POOL_CONNECTION_POOL * p, char *user, char *database, int protoMajor)
+{
+	return MAIN_CONNECTION(p) &&
+		MAIN_CONNECTION(p)->sp &&
+		MAIN_CONNECTION(p)->sp->major == protoMajor &&
+		MAIN_CONNECTION(p)->sp->user != NULL &&
+		strcmp(MAIN_CONNECTION(p)->sp->user, user) == 0 &&
+		strcmp(MAIN_CONNECTION(p)->sp->database, database) == 0;
+}
+
+static void
+cp_hash_link(int slot, uint32 hash)
+{
+	POOL_CP_INDEX_ENTRY *e = &cp_index[slot];
+	int			bucket = hash & (cp_nbuckets - 1);
+
+	e->hash = hash;
+	e->hash_prev = -1;
+	e->hash_next = cp_buckets[bucket];
+	if (e->hash_next >= 0)
+		cp_index[e->hash_next].hash_prev = slot;
+	cp_buckets[bucket] = slot;
+	e->hashed = true;
+}
+
+static void
+cp_hash_unlink(int slot)
+{
+	POOL_CP_INDEX_ENTRY *e = &cp_index[slot];
+
+	if (!e->hashed)
+		return;
+
+	if (e->hash_prev >= 0)
+		cp_index[e->hash_prev].hash_next = e->hash_next;
+	else
+		cp_buckets[e->hash & (cp_nbuckets - 1)] = e->hash_next;
+	if (e->hash_next >= 0)
+		cp_index[e->hash_next].hash_prev = e->hash_prev;
+
+	e->hash_prev = e->hash_next = -1;
+	e->hashed = false;
+}
+
+static void
+cp_lru_unlink(int slot)
+{
+	POOL_CP_INDEX_ENTRY *e = &cp_index[slot];
+
+	if (e->lru_prev >= 0)
+		cp_index[e->lru_prev].lru_next = e->lru_next;
+	else
+		cp_lru_head = e->lru_next;
+	if (e->lru_next >= 0)
+		cp_index[e->lru_next].lru_prev = e->lru_prev;
+	else
+		cp_lru_tail = e->lru_prev;
+}
+
+/*
+ * Mark the slot as the most recently used one.
+ */
+static void
+cp_touch(int slot)
+{
+	POOL_CP_INDEX_ENTRY *e = &cp_index[slot];
+
+	if (cp_lru_tail == slot)
+		return;
+
+	cp_lru_unlink(slot);
+	e->lru_prev = cp_lru_tail;
+	e->lru_next = -1;
+	cp_index[cp_lru_tail].lru_next = slot;
+	cp_lru_tail = slot;
+}
+
+/*
+ * Remove the cleared slot from the hash and put it at the head of the LRU
+ * list so that it is used first.
+ */
+static void
+cp_retire(int slot)
+{
+	POOL_CP_INDEX_ENTRY *e = &cp_index[slot];
+
+	cp_hash_unlink(slot);
+
+	if (cp_lru_head == slot)
+		return;
+
+	cp_lru_unlink(slot);
+	e->lru_prev = -1;
+	e->lru_next = cp_lru_head;
+	cp_index[cp_lru_head].lru_prev = slot;
+	cp_lru_head = slot;
+}
+
+/*
+ * Retire slots cleared since pool_invalidate_cp_index() was called.
+ */
+static void
+cp_sweep(void)
+{
+	int			i;
+
+	cp_index_stale = 0;
+
+	for (i = 0; i < pool_config->max_pool; i++)
+	{
+		if (MAIN_CONNECTION(&pool_connection_pool[i]) == NULL)
+			cp_retire(i);
+	}
+}
+
+/*
+ * Count reuse of the connection in the slot.
+ */
+static void
+count_hit(int slot)
+{
+	ConnectionPoolStats *stats;
+
+	stats = pool_connection_pool_stats(pool_get_process_context()->proc_id, slot);
+	if (stats)
+		stats->hits++;
+}
+
+/*
+ * Return true if there's a connection pool slot not used yet.
+ */
+static bool
+has_empty_slot(void)
+{
+	if (cp_index_stale)
+		cp_sweep();
+
+	/* empty slots are at the head of the LRU list */
+	return MAIN_CONNECTION(&pool_connection_pool[cp_lru_head]) == NULL;
+}
+
 /*
  * send frontend exiting messages to all connections.  this is called
  * in any case when child process exits, for example failover, child
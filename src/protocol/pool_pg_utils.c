@@ -33,6 +33,7 @@
 #include "utils/pool_ssl.h"
 #include "utils/elog.h"
 #include "utils/pool_relcache.h"
+#include "utils/statistics.h"
 #include "auth/pool_auth.h"
 #include "context/pool_session_context.h"
 
@@ -40,6 +41,11 @@
 #include "pool_config_variables.h"
 
 static int	choose_db_node_id(char *str);
+static double lb_random(void);
+static bool lb_is_candidate(int node_id, int suggested_node_id, int no_load_balance_node_id);
+static double lb_node_cost(int node_id);
+static int	lb_weighted_random_node(int suggested_node_id, int no_load_balance_node_id, int exclude_node_id);
+static int	select_load_balancing_node_by_policy(int suggested_node_id, int no_load_balance_node_id);
 static void free_persisten_db_connection_memory(POOL_CONNECTION_POOL_SLOT * cp);
 static void si_enter_critical_region(void);
 static void si_leave_critical_region(void);
@@ -416,6 +422,10 @@ select_load_balancing_node(void)
 		}
 	}
 
+	/* Choose a backend by the load of the nodes */
+	if (pool_config->load_balance_policy != LBP_WEIGHTED_RANDOM)
+		return select_load_balancing_node_by_policy(suggested_node_id, no_load_balance_node_id);
+
 	/* Choose a backend in random manner with weight */
 	selected_slot = MAIN_NODE_ID;
 	total_weight = 0.0;
@@ -463,6 +473,176 @@ select_load_balancing_node(void)
 	return selected_slot;
 }
 
+/*
+ * Returns a random number between 0.0 and 1.0
+ */
+static double
+lb_random(void)
+{
+#if defined(sun) || defined(__sun)
+	return ((double) rand()) / RAND_MAX;
+#else
+	return ((double) random()) / RAND_MAX;
+#endif
+}
+
+/*
+ * Returns true if the node can be chosen as the load balance node.  Same
+ * rules as the weighted random choice in select_load_balancing_node().
+ */
+static bool
+lb_is_candidate(int node_id, int suggested_node_id, int no_load_balance_node_id)
+{
+	if ((suggested_node_id == -1 && node_id == PRIMARY_NODE_ID) || node_id == no_load_balance_node_id)
+		return false;
+
+	return VALID_BACKEND_RAW(node_id) && BACKEND_INFO(node_id).backend_weight > 0.0;
+}
+
+/*
+ * Cost of sending a query to the node according to load_balance_policy.
+ * Lower is better.
+ *
+ * least_outstanding: queries in progress on the node per weight.
+ * ewma_latency and power_of_two_choices: moving average latency of the node
+ * times the queries in progress per weight.  A node without latency samples
+ * is cheap so that it gets queries and its latency becomes known.
+ *
+ * In streaming replication mode, the cost of a standby is raised in
+ * proportion to its replication delay relative to delay_threshold, so
+ * that lagging standbys get less queries well before the delay reaches
+ * delay_threshold and queries are sent to the primary.  A standby whose
+ * delay could not be measured in the last check costs as much as one at
+ * delay_threshold.
+ *
+ * When a named statement is bound, nodes on which the statement has not
+ * been parsed yet cost LB_UNPREPARED_PENALTY times more, because a parse
+ * message has to be sent there as well.
+ */
+#define LB_UNPREPARED_PENALTY	2.0
+
+static double
+lb_node_cost(int node_id)
+{
+	POOL_SESSION_CONTEXT *ses = pool_get_session_context(true);
+	double		cost;
+
+	cost = (stat_get_queries_in_progress(node_id) + 1) / BACKEND_INFO(node_id).backend_weight;
+
+	if (pool_config->load_balance_policy != LBP_LEAST_OUTSTANDING)
+		cost *= stat_get_latency_ewma(node_id) + 1.0;
+
+	if (STREAM && pool_config->delay_threshold > 0 && node_id != PRIMARY_NODE_ID)
+	{
+		if (standby_delay_is_unknown(node_id))
+			cost *= 2.0;
+		else
+			cost *= 1.0 + (double) BACKEND_INFO(node_id).standby_delay / pool_config->delay_threshold;
+	}
+
+	if (ses && ses->query_context && ses->query_context->prefer_prepared_nodes &&
+		!ses->query_context->prepared_on[node_id])
+		cost *= LB_UNPREPARED_PENALTY;
+
+	return cost;
+}
+
+/*
+ * Choose a candidate node in random manner with weight, excluding
+ * exclude_node_id.  Returns -1 if there's no candidate.
+ */
+static int
+lb_weighted_random_node(int suggested_node_id, int no_load_balance_node_id, int exclude_node_id)
+{
+	double		total_weight = 0.0;
+	double		r;
+	int			selected = -1;
+	int			i;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (i != exclude_node_id && lb_is_candidate(i, suggested_node_id, no_load_balance_node_id))
+			total_weight += BACKEND_INFO(i).backend_weight;
+	}
+
+	r = lb_random() * total_weight;
+
+	total_weight = 0.0;
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (i == exclude_node_id || !lb_is_candidate(i, suggested_node_id, no_load_balance_node_id))
+			continue;
+
+		if (selected >= 0 && r < total_weight)
+			break;
+		selected = i;
+		total_weight += BACKEND_INFO(i).backend_weight;
+	}
+
+	return selected;
+}
+
+/*
+ * Choose the load balance node by load_balance_policy other than
+ * weighted_random.  least_outstanding and ewma_latency choose the cheapest
+ * of all candidates, breaking ties at random.  power_of_two_choices picks
+ * two candidates in random manner with weight and chooses the cheaper one,
+ * which avoids all children herding to the same node between updates of
+ * its statistics.
+ */
+static int
+select_load_balancing_node_by_policy(int suggested_node_id, int no_load_balance_node_id)
+{
+	int			selected_slot = -1;
+	double		selected_cost = 0.0;
+	double		cost;
+	int			ties = 0;
+	int			i;
+
+	if (pool_config->load_balance_policy == LBP_POWER_OF_TWO_CHOICES)
+	{
+		int			other;
+
+		selected_slot = lb_weighted_random_node(suggested_node_id, no_load_balance_node_id, -1);
+		if (selected_slot >= 0)
+		{
+			selected_cost = lb_node_cost(selected_slot);
+			other = lb_weighted_random_node(suggested_node_id, no_load_balance_node_id, selected_slot);
+			if (other >= 0 && (cost = lb_node_cost(other)) < selected_cost)
+			{
+				selected_slot = other;
+				selected_cost = cost;
+			}
+		}
+	}
+	else
+	{
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			if (!lb_is_candidate(i, suggested_node_id, no_load_balance_node_id))
+				continue;
+
+			cost = lb_node_cost(i);
+			if (selected_slot < 0 || cost < selected_cost)
+			{
+				selected_slot = i;
+				selected_cost = cost;
+				ties = 1;
+			}
+			else if (cost == selected_cost && lb_random() * ++ties < 1.0)
+				selected_slot = i;
+		}
+	}
+
+	if (selected_slot < 0)
+		selected_slot = MAIN_NODE_ID;
+
+	ereport(DEBUG1,
+			(errmsg("selecting load balance node"),
+			 errdetail("selected backend id is %d, cost is %g", selected_slot, selected_cost)));
+	return selected_slot;
+}
+
 /*
  * Returns PostgreSQL version.
  * The returned PgVersion struct is in static memory.
@@ -31,6 +31,7 @@
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif
+#include <poll.h>
 
 
 #include <stdlib.h>
@@ -93,6 +94,7 @@ static POOL_STATUS insert_oid_into_insert_lock(POOL_CONNECTION * frontend, POOL_
 static POOL_STATUS read_packets_and_process(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, int reset_request, int *state, short *num_fields, bool *cont);
 static bool is_all_standbys_command_complete(unsigned char *kind_list, int num_backends, int main_node);
 static bool pool_process_notice_message_from_one_backend(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, int backend_idx, char kind);
+static bool can_forward_data_rows(POOL_CONNECTION_POOL * backend);
 
 /*
  * Main module for query processing
@@ -230,7 +232,7 @@ pool_process_query(POOL_CONNECTION * frontend,
 
 		/*
 		 * If frontend and all backends do not have any pending data in the
-		 * receiving data cache, then issue select(2) to wait for new data
+		 * receiving data cache, then issue poll(2) to wait for new data
 		 * arrival
 		 */
 		else if (is_cache_empty(frontend, backend))
@@ -238,6 +240,13 @@ pool_process_query(POOL_CONNECTION * frontend,
 			bool		cont = true;
 
 			status = read_packets_and_process(frontend, backend, reset_request, &state, &num_fields, &cont);
+			if (status == POOL_IDLE)
+			{
+				/* the session is going to be parked */
+				MemoryContextSwitchTo(QueryContext);
+				MemoryContextDelete(ProcessQueryContext);
+				return status;
+			}
 			if (status != POOL_CONTINUE)
 				return status;
 			else if (!cont)		/* Detected admin shutdown */
@@ -289,6 +298,13 @@ pool_process_query(POOL_CONNECTION * frontend,
 					bool		cont = true;
 
 					status = read_packets_and_process(frontend, backend, reset_request, &state, &num_fields, &cont);
+					if (status == POOL_IDLE)
+					{
+						/* the session is going to be parked */
+						MemoryContextSwitchTo(QueryContext);
+						MemoryContextDelete(ProcessQueryContext);
+						return status;
+					}
 					if (status != POOL_CONTINUE)
 						return status;
 					else if (!cont) /* Detected admin shutdown */
@@ -704,6 +720,20 @@ SimpleForwardToFrontend(char kind, POOL_CONNECTION * frontend,
 	int			sendlen;
 	int			i;
 
+	/*
+	 * Fast path for DataRow messages.  Forward them directly from the read
+	 * buffer of the backend together with following DataRow messages
+	 * already received.
+	 */
+	if (kind == 'D' && can_forward_data_rows(backend))
+	{
+		if (pool_forward_messages(MAIN(backend), frontend, kind) < 0)
+			ereport(ERROR,
+					(errmsg("unable to forward message to frontend"),
+					 errdetail("write to frontend failed")));
+		return POOL_CONTINUE;
+	}
+
 	pool_read(MAIN(backend), &len, sizeof(len));
 
 	len = ntohl(len);
@@ -822,6 +852,28 @@ SimpleForwardToFrontend(char kind, POOL_CONNECTION * frontend,
 	return POOL_CONTINUE;
 }
 
+/*
+ * Return true if DataRow messages can be forwarded by
+ * pool_forward_messages(), that is, only one backend returns the rows and
+ * the rows are not stored into the query cache.
+ */
+static bool
+can_forward_data_rows(POOL_CONNECTION_POOL * backend)
+{
+	int			i;
+
+	if (pool_config->memory_cache_enabled &&
+		pool_is_cache_safe() && !pool_is_cache_exceeded())
+		return false;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (VALID_BACKEND(i) && !IS_MAIN_NODE_ID(i))
+			return false;
+	}
+	return true;
+}
+
 POOL_STATUS
 SimpleForwardToBackend(char kind, POOL_CONNECTION * frontend,
 					   POOL_CONNECTION_POOL * backend,
@@ -4667,43 +4719,71 @@ pool_discard_packet_contents(POOL_CONNECTION_POOL * cp)
 	return POOL_CONTINUE;
 }
 
+/*
+ * Return the events poll() returned for the socket.  Errors and hang ups
+ * are treated as readable so that the following read detects them.
+ */
+static short
+poll_revents(struct pollfd *pfds, int nfds, int fd)
+{
+	int			i;
+
+	for (i = 0; i < nfds; i++)
+	{
+		if (pfds[i].fd == fd)
+			return pfds[i].revents;
+	}
+	return 0;
+}
+
+#define POLL_READABLE(pfds, nfds, fd) \
+	(poll_revents(pfds, nfds, fd) & (POLLIN | POLLERR | POLLHUP | POLLNVAL))
+#define POLL_EXCEPTION(pfds, nfds, fd) \
+	(poll_revents(pfds, nfds, fd) & POLLPRI)
+
 /*
  * Read packet from either frontend or backend and process it.
  */
 static POOL_STATUS read_packets_and_process(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, int reset_request, int *state, short *num_fields, bool *cont)
 {
-	fd_set		readmask;
-	fd_set		writemask;
-	fd_set		exceptmask;
+	struct pollfd pfds[MAX_NUM_BACKENDS + 1];
 	int			fds;
-	struct timeval timeoutdata;
-	struct timeval *timeout;
+	int			timeout;
 	int			num_fds,
 				was_error = 0;
 	POOL_STATUS status;
 	int			i;
+	bool		park;
 
 	/*
-	 * frontend idle counters. depends on the following select(2) call's time
+	 * frontend idle counters. depends on the following poll(2) call's time
 	 * out is 1 second.
 	 */
 	int			idle_count = 0; /* for other than in recovery */
 	int			idle_count_in_recovery = 0; /* for in recovery */
 
-SELECT_RETRY:
-	FD_ZERO(&readmask);
-	FD_ZERO(&writemask);
-	FD_ZERO(&exceptmask);
-
+POLL_RETRY:
 	num_fds = 0;
 
 	if (!reset_request)
 	{
-		FD_SET(frontend->fd, &readmask);
-		FD_SET(frontend->fd, &exceptmask);
-		num_fds = Max(frontend->fd + 1, num_fds);
+		pfds[num_fds].fd = frontend->fd;
+		pfds[num_fds].events = POLLIN | POLLPRI;
+		pfds[num_fds++].revents = 0;
 	}
 
+	/*
+	 * If a standby node has been failed over while keeping the sessions,
+	 * close the connections to it between queries.  Only the session which
+	 * was in a transaction on the node is terminated.
+	 */
+	if (!pool_is_query_in_progress() && !pool_pending_message_exists() &&
+		pool_detach_down_backends(backend))
+		ereport(FRONTEND_ERROR,
+				(pool_error_code("57P01"),
+				 errmsg("terminating connection because load balance node %d was detached in a transaction",
+						backend->info->load_balancing_node)));
+
 	/*
 	 * If we are in load balance mode and the selected node is down, we need
 	 * to re-select load_balancing_node.  Note that we cannnot use
@@ -4719,6 +4799,7 @@ SELECT_RETRY:
 
 		session_context = pool_get_session_context(false);
 		node_id = select_load_balancing_node();
+		session_context->load_balance_node_id = node_id;
 
 		for (i = 0; i < NUM_BACKENDS; i++)
 		{
@@ -4731,9 +4812,9 @@ SELECT_RETRY:
 	{
 		if (VALID_BACKEND(i))
 		{
-			num_fds = Max(CONNECTION(backend, i)->fd + 1, num_fds);
-			FD_SET(CONNECTION(backend, i)->fd, &readmask);
-			FD_SET(CONNECTION(backend, i)->fd, &exceptmask);
+			pfds[num_fds].fd = CONNECTION(backend, i)->fd;
+			pfds[num_fds].events = POLLIN | POLLPRI;
+			pfds[num_fds++].revents = 0;
 		}
 	}
 
@@ -4743,29 +4824,41 @@ SELECT_RETRY:
 	if (pool_config->client_idle_limit > 0 ||
 		pool_config->client_idle_limit_in_recovery > 0 ||
 		pool_config->client_idle_limit_in_recovery == -1)
-	{
-		timeoutdata.tv_sec = 1;
-		timeoutdata.tv_usec = 0;
-		timeout = &timeoutdata;
-	}
+		timeout = 1000;
 	else
-		timeout = NULL;
+		timeout = -1;
+
+	/*
+	 * In multiplexed child mode, do not block waiting for an idle frontend.
+	 * Just poll and return POOL_IDLE if nothing has arrived so that the
+	 * child can serve other sessions meanwhile.  The caller keeps watching
+	 * both the frontend and the backends of the session, and checks client
+	 * idle limits.
+	 */
+	park = (!reset_request && pool_is_multiplexed_child() &&
+			!pool_is_query_in_progress() &&
+			!pool_is_suspend_reading_from_frontend());
+	if (park)
+		timeout = 0;
 
-	fds = select(num_fds, &readmask, &writemask, &exceptmask, timeout);
+	fds = poll(pfds, num_fds, timeout);
 
 	if (fds == -1)
 	{
 		if (errno == EINTR)
-			goto SELECT_RETRY;
+			goto POLL_RETRY;
 
 		ereport(FATAL,
 				(errmsg("unable to read data"),
-				 errdetail("select() system call failed with reason \"%m\"")));
+				 errdetail("poll() system call failed with reason \"%m\"")));
 	}
 
-	/* select timeout */
+	/* poll timeout */
 	if (fds == 0)
 	{
+		if (park)
+			return POOL_IDLE;
+
 		if (*InRecovery == RECOVERY_INIT && pool_config->client_idle_limit > 0)
 		{
 			idle_count++;
@@ -4802,7 +4895,7 @@ SELECT_RETRY:
 					 errmsg("connection terminated due to online recovery"),
 					 errdetail("child connection forced to terminate due to client_idle_limitis:-1")));
 		}
-		goto SELECT_RETRY;
+		goto POLL_RETRY;
 	}
 
 	for (i = 0; i < NUM_BACKENDS; i++)
@@ -4822,7 +4915,7 @@ SELECT_RETRY:
 				break;
 			}
 
-			if (FD_ISSET(CONNECTION(backend, i)->fd, &readmask))
+			if (POLL_READABLE(pfds, num_fds, CONNECTION(backend, i)->fd))
 			{
 				int			r;
 
@@ -4946,12 +5039,12 @@ SELECT_RETRY:
 
 	if (!reset_request)
 	{
-		if (FD_ISSET(frontend->fd, &exceptmask))
+		if (POLL_EXCEPTION(pfds, num_fds, frontend->fd))
 			ereport(ERROR,
 					(errmsg("unable to read from frontend socket"),
 					 errdetail("exception occured on frontend socket")));
 
-		else if (FD_ISSET(frontend->fd, &readmask))
+		else if (POLL_READABLE(pfds, num_fds, frontend->fd))
 		{
 			status = ProcessFrontendResponse(frontend, backend);
 			if (status != POOL_CONTINUE)
@@ -4959,12 +5052,12 @@ SELECT_RETRY:
 		}
 	}
 
-	if (FD_ISSET(MAIN(backend)->fd, &exceptmask))
+	if (POLL_EXCEPTION(pfds, num_fds, MAIN(backend)->fd))
 		ereport(FATAL,
 				(errmsg("unable to read from backend socket"),
 				 errdetail("exception occured on backend socket")));
 
-	else if (FD_ISSET(MAIN(backend)->fd, &readmask))
+	else if (POLL_READABLE(pfds, num_fds, MAIN(backend)->fd))
 	{
 		status = ProcessBackendResponse(frontend, backend, state, num_fields);
 		if (status != POOL_CONTINUE)
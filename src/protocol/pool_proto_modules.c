@@ -49,11 +49,14 @@
 #include "protocol/pool_pg_utils.h"
 #include "pool_config.h"
 #include "parser/pool_string.h"
+#include "parser/pg_class.h"
 #include "context/pool_session_context.h"
 #include "context/pool_query_context.h"
 #include "utils/elog.h"
 #include "utils/pool_select_walker.h"
 #include "utils/pool_relcache.h"
+#include "utils/pool_parse_cache.h"
+#include "utils/statistics.h"
 #include "utils/pool_stream.h"
 #include "utils/ps_status.h"
 #include "utils/pool_signal.h"
@@ -91,6 +94,8 @@ static POOL_STATUS parse_before_bind(POOL_CONNECTION * frontend,
 									 POOL_CONNECTION_POOL * backend,
 									 POOL_SENT_MESSAGE * message,
 									 POOL_SENT_MESSAGE * bind_message);
+static void parse_before_bind_lazily(POOL_SENT_MESSAGE * message,
+									 POOL_QUERY_CONTEXT * query_context);
 static int *find_victim_nodes(int *ntuples, int nmembers, int main_node, int *number_of_nodes);
 static POOL_STATUS close_standby_transactions(POOL_CONNECTION * frontend,
 											  POOL_CONNECTION_POOL * backend);
@@ -101,6 +106,9 @@ static bool
 static void pool_discard_except_sync_and_ready_for_query(POOL_CONNECTION * frontend,
 											 POOL_CONNECTION_POOL * backend);
 static void si_get_snapshot(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, Node *node);
+static void check_session_state_change(List *parse_tree_list);
+static char *query_with_bind_params(MemoryContext context, const char *query,
+									const char *params, int len);
 
 /*
  * This is the workhorse of processing the pg_terminate_backend function to
@@ -255,7 +263,7 @@ SimpleQuery(POOL_CONNECTION * frontend,
 	MemoryContext old_context = MemoryContextSwitchTo(query_context->memory_context);
 
 	/* parse SQL string */
-	parse_tree_list = raw_parser(contents, len, &error, !REPLICATION);
+	parse_tree_list = pool_raw_parser(contents, len, &error, !REPLICATION);
 
 	if (parse_tree_list == NIL)
 	{
@@ -346,6 +354,9 @@ SimpleQuery(POOL_CONNECTION * frontend,
 		 */
 		check_copy_from_stdin(node);
 
+		/* check if the query changes the backend session state */
+		check_session_state_change(parse_tree_list);
+
 		if (IsA(node, PgpoolVariableShowStmt))
 		{
 			VariableShowStmt *vnode = (VariableShowStmt *) node;
@@ -698,11 +709,13 @@ SimpleQuery(POOL_CONNECTION * frontend,
 			/*
 			 * Optimization effort: If there's only one session, we do not
 			 * need to wait for the main node's response, and could execute
-			 * the query concurrently.  In snapshot isolation mode we cannot
-			 * do this optimization because we need to wait for main node's
-			 * response first.
+			 * the query concurrently.  Same thing can be done if the user
+			 * allows it by replicate_write_in_parallel.  In snapshot
+			 * isolation mode we cannot do this optimization because we need
+			 * to wait for main node's response first.
 			 */
-			if (pool_config->num_init_children == 1 &&
+			if ((pool_config->num_init_children == 1 ||
+				 pool_config->replicate_write_in_parallel) &&
 				pool_config->backend_clustering_mode != CM_SNAPSHOT_ISOLATION)
 			{
 				/* Send query to all DB nodes at once */
@@ -857,16 +870,18 @@ Execute(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 		&& pool_is_likely_select(query))
 	{
 		POOL_STATUS status;
-		char	   *search_query = NULL;
-		int			len;
+		char	   *search_query;
+		int32		max_rows;
 
-#define STR_ALLOC_SIZE 1024
 		ereport(DEBUG1, (errmsg("Execute: pool_is_likely_select: true pool_is_writing_transaction: %d TSTATE: %c",
 								pool_is_writing_transaction(),
 								TSTATE(backend, MAIN_REPLICA ? PRIMARY_NODE_ID : REAL_MAIN_NODE_ID))));
 
-		len = strlen(query) + 1;
-		search_query = MemoryContextStrdup(query_context->memory_context, query);
+		search_query = query;
+
+		/* Maximum number of rows to return follows the portal name */
+		memcpy(&max_rows, contents + strlen(contents) + 1, sizeof(max_rows));
+		max_rows = ntohl(max_rows);
 
 		ereport(DEBUG1, (errmsg("Execute: checkig cache fetch condition")));
 
@@ -875,30 +890,16 @@ Execute(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 		 */
 		if (query_context->is_cache_safe && bind_msg->param_offset && bind_msg->contents)
 		{
-			/* Extract binary contents from bind message */
-			char	   *query_in_bind_msg = bind_msg->contents + bind_msg->param_offset;
-			char		hex_str[4]; /* 02X chars + white space + null end */
-			int			i;
-			int			alloc_len;
-
-			alloc_len = (len / STR_ALLOC_SIZE + 1) * STR_ALLOC_SIZE;
-			search_query = repalloc(search_query, alloc_len);
-
-			for (i = 0; i < bind_msg->len - bind_msg->param_offset; i++)
-			{
-				int			hexlen;
-
-				snprintf(hex_str, sizeof(hex_str), (i == 0) ? " %02X" : "%02X", 0xff & query_in_bind_msg[i]);
-				hexlen = strlen(hex_str);
-
-				if ((len + hexlen) >= alloc_len)
-				{
-					alloc_len += STR_ALLOC_SIZE;
-					search_query = repalloc(search_query, alloc_len);
-				}
-				strcat(search_query, hex_str);
-				len += hexlen;
-			}
+			/*
+			 * Extract binary contents from bind message, that is, parameter
+			 * format codes, parameter values and result format codes.  Names
+			 * of the statement and the portal are not included, so the same
+			 * query executed with the same parameters shares the cache entry
+			 * regardless of which prepared statement is used.
+			 */
+			search_query = query_with_bind_params(query_context->memory_context, query,
+												  bind_msg->contents + bind_msg->param_offset,
+												  bind_msg->len - bind_msg->param_offset);
 
 			/*
 			 * If bind message is sent again to an existing prepared statement,
@@ -919,24 +920,42 @@ Execute(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 			 * cache to the one with the hex of bind message. If not, md5 hash
 			 * will be created by the query text without bind message, and it
 			 * will happen to find cache never or to get a wrong result.
-			 *
-			 * However, It is possible that temp_cache does not exist.
-			 * Consider following scenario: - In the previous execute cache is
-			 * overflowed, and temp_cache discarded. - In the subsequent
-			 * bind/execute uses the same portal
 			 */
-			if (query_context->temp_cache)
+			if (query_context->temp_cache && !query_context->temp_cache->is_exceeded)
 			{
 				pfree(query_context->temp_cache->query);
 				query_context->temp_cache->query = MemoryContextStrdup(session_context->memory_context, search_query);
 			}
+			else
+			{
+				/*
+				 * The temp cache has been committed, moved to the query cache
+				 * array or overflowed by the previous execution of the same
+				 * statement, which is common when a named statement is bound
+				 * and executed repeatedly.  Start a new one so that the
+				 * result of this execution is registered too.
+				 */
+				pool_discard_temp_query_cache(query_context->temp_cache);
+				query_context->temp_cache = pool_create_temp_query_cache(search_query);
+			}
+
+			/*
+			 * If the number of rows to return is limited, the portal may be
+			 * suspended and the result is incomplete. Neither fetch nor
+			 * register the result.
+			 */
+			if (max_rows > 0)
+				query_context->temp_cache->is_exceeded = true;
 		}
 
 		/*
 		 * If the query is SELECT from table to cache, try to fetch cached
 		 * result.
 		 */
-		status = pool_fetch_from_memory_cache(frontend, backend, search_query, &foundp);
+		if (max_rows > 0)
+			status = POOL_CONTINUE;
+		else
+			status = pool_fetch_from_memory_cache(frontend, backend, search_query, &foundp);
 
 		if (status != POOL_CONTINUE)
 			return status;
@@ -955,13 +974,18 @@ Execute(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 			if (!SL_MODE || !pool_is_doing_extended_query_message())
 			{
 				pool_set_skip_reading_from_backends();
-				pool_stats_count_up_num_cache_hits();
 				pool_unset_query_in_progress();
 				return POOL_CONTINUE;
 			}
 		}
 		else
+		{
 			query_context->skip_cache_commit = false;
+
+			/* The query is going to be sent to backend from now */
+			if (query_context->temp_cache)
+				gettimeofday(&query_context->temp_cache->start_time, NULL);
+		}
 	}
 
 	/* show ps status */
@@ -985,6 +1009,18 @@ Execute(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 		 */
 		if (!commit)
 		{
+			/*
+			 * If allowed by replicate_write_in_parallel, send the query to
+			 * all nodes at once without waiting for the main node's response
+			 * first.  See SimpleQuery() for more details.
+			 */
+			if (pool_config->replicate_write_in_parallel &&
+				pool_config->backend_clustering_mode != CM_SNAPSHOT_ISOLATION)
+			{
+				pool_extended_send_and_wait(query_context, "E", len, contents, 0, 0, false);
+				return POOL_CONTINUE;
+			}
+
 			/* Send the query to main node */
 			pool_extended_send_and_wait(query_context, "E", len, contents, 1, MAIN_NODE_ID, false);
 
@@ -1136,7 +1172,7 @@ Parse(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 	/* parse SQL string */
 	MemoryContext old_context = MemoryContextSwitchTo(query_context->memory_context);
 
-	parse_tree_list = raw_parser(stmt, strlen(stmt),&error,!REPLICATION);
+	parse_tree_list = pool_raw_parser(stmt, strlen(stmt), &error, !REPLICATION);
 
 	if (parse_tree_list == NIL)
 	{
@@ -1191,6 +1227,9 @@ Parse(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 		if (REPLICATION)
 			insert_stmt_with_lock = need_insert_lock(backend, stmt, node);
 
+		/* check if the query changes the backend session state */
+		check_session_state_change(parse_tree_list);
+
 		/*
 		 * Start query context
 		 */
@@ -1454,6 +1493,8 @@ Parse(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 #endif
 		pool_extended_send_and_wait(query_context, "P", len, contents, 1, MAIN_NODE_ID, true);
 		pool_extended_send_and_wait(query_context, "P", len, contents, -1, MAIN_NODE_ID, true);
+		memcpy(session_context->uncompleted_message->prepared_on, query_context->where_to_send,
+			   sizeof(query_context->where_to_send));
 		pool_add_sent_message(session_context->uncompleted_message);
 
 		/* Add pending message */
@@ -1543,12 +1584,39 @@ Bind(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 
 	session_context->query_context = query_context;
 
+	/*
+	 * In statement level load balancing, choose the load balance node for
+	 * each execution of a named statement, rather than sending all of them
+	 * to the node the statement was parsed on.  The Bind gets its own copy
+	 * of the query context because portals of the same statement may live
+	 * on different nodes.  If the statement has not been parsed on the
+	 * chosen node yet, the Parse is sent along with the Bind.
+	 */
+	if (SL_MODE && pool_config->load_balance_mode &&
+		pool_config->statement_level_load_balance &&
+		pool_config->disable_load_balance_on_write != DLBOW_DML_ADAPTIVE &&
+		parse_msg->kind == 'P' && *pstmt_name != '\0' &&
+		is_select_query(query_context->parse_tree, query_context->original_query))
+	{
+		query_context = pool_query_context_copy(query_context);
+		query_context->prefer_prepared_nodes = true;
+		memcpy(query_context->prepared_on, parse_msg->prepared_on, sizeof(query_context->prepared_on));
+		bind_msg->query_context = query_context;
+		session_context->query_context = query_context;
+
+		pool_where_to_send(query_context, query_context->original_query,
+						   query_context->parse_tree);
+		query_context->prefer_prepared_nodes = false;
+
+		parse_before_bind_lazily(parse_msg, query_context);
+	}
+
 	/*
 	 * Take care the case when the previous parse message has been sent to
 	 * other than primary node. In this case, we send a parse message to the
 	 * primary node.
 	 */
-	if (pool_config->load_balance_mode && pool_is_writing_transaction() &&
+	else if (pool_config->load_balance_mode && pool_is_writing_transaction() &&
 		TSTATE(backend, MAIN_REPLICA ? PRIMARY_NODE_ID : REAL_MAIN_NODE_ID) == 'T' &&
 		pool_config->disable_load_balance_on_write != DLBOW_OFF)
 	{
@@ -1808,17 +1876,30 @@ Close(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 		POOL_PENDING_MESSAGE *pmsg;
 		bool		where_to_send_save[MAX_NUM_BACKENDS];
 
+		/* save where_to_send map */
+		memcpy(where_to_send_save, query_context->where_to_send, sizeof(where_to_send_save));
+
+		/*
+		 * A statement may have been parsed on other nodes than the ones in
+		 * where_to_send by parse_before_bind() or by statement level load
+		 * balancing. Send the close message to all of them.
+		 */
+		if (*contents == 'S' && msg->kind == 'P')
+		{
+			int			i;
+
+			for (i = 0; i < NUM_BACKENDS; i++)
+				query_context->where_to_send[i] = msg->prepared_on[i] && VALID_BACKEND_RAW(i);
+		}
+
 		/*
 		 * Parse_before_bind() may have sent a bind message to the primary
 		 * node id. So send the close message to the primary node as well.
 		 * Even if not, sending a close message for non existing
 		 * statement/portal is harmless. No error will happen.
 		 */
-		if (session_context->load_balance_node_id != PRIMARY_NODE_ID)
+		else if (session_context->load_balance_node_id != PRIMARY_NODE_ID)
 		{
-			/* save where_to_send map */
-			memcpy(where_to_send_save, query_context->where_to_send, sizeof(where_to_send_save));
-
 			query_context->where_to_send[PRIMARY_NODE_ID] = true;
 			query_context->where_to_send[session_context->load_balance_node_id] = true;
 		}
@@ -1833,11 +1914,8 @@ Close(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 		pool_pending_message_add(pmsg);
 		pool_pending_message_free_pending_message(pmsg);
 
-		if (session_context->load_balance_node_id != PRIMARY_NODE_ID)
-		{
-			/* Restore where_to_send map */
-			memcpy(query_context->where_to_send, where_to_send_save, sizeof(where_to_send_save));
-		}
+		/* Restore where_to_send map */
+		memcpy(query_context->where_to_send, where_to_send_save, sizeof(where_to_send_save));
 
 #ifdef NOT_USED
 		dump_pending_message();
@@ -2070,6 +2148,8 @@ ReadyForQuery(POOL_CONNECTION * frontend,
 			if (pool_read(CONNECTION(backend, i), &kind, sizeof(kind)))
 				return POOL_END;
 
+			stat_end_query(i);
+
 			TSTATE(backend, i) = kind;
 			ereport(DEBUG5,
 					(errmsg("processing ReadyForQuery"),
@@ -3578,7 +3658,7 @@ static POOL_STATUS parse_before_bind(POOL_CONNECTION * frontend,
 			{
 				message_len = 1 + strlen(bind_message->contents + offset) + 1;
 				StrNCpy(message_body + 1, bind_message->contents + offset, sizeof(message_body) - 1);
-				pool_extended_send_and_wait(qc, "C", message_len, message_body, 1, PRIMARY_NODE_ID, false);
+				pool_extended_send_and_wait(qc, "C", message_len, message_body, 1, PRIMARY_NODE_ID, true);
 				/* Add pending message */
 				pmsg = pool_pending_message_create('C', message_len, message_body);
 				pmsg->not_forward_to_frontend = true;
@@ -3587,12 +3667,18 @@ static POOL_STATUS parse_before_bind(POOL_CONNECTION * frontend,
 				pool_pending_message_free_pending_message(pmsg);
 			}
 
-			/* Send parse message to primary node */
+			/*
+			 * Send parse message to primary node.  We do not wait for the
+			 * replies of the close and parse messages here.  They are
+			 * processed as pending messages before the reply of the bind
+			 * message, so the bind message is pipelined with them.
+			 */
 			ereport(DEBUG1,
 					(errmsg("parse before bind"),
-					 errdetail("waiting for primary completing parse")));
+					 errdetail("sending parse to primary")));
 
-			pool_extended_send_and_wait(qc, "P", len, contents, 1, PRIMARY_NODE_ID, false);
+			pool_extended_send_and_wait(qc, "P", len, contents, 1, PRIMARY_NODE_ID, true);
+			message->prepared_on[PRIMARY_NODE_ID] = true;
 
 			/* Add pending message */
 			pmsg = pool_pending_message_create('P', len, contents);
@@ -3681,6 +3767,56 @@ static POOL_STATUS parse_before_bind(POOL_CONNECTION * frontend,
 	return POOL_CONTINUE;
 }
 
+/*
+ * Send parse message to the nodes the bind message is going to be sent to
+ * if the statement has not been parsed on them yet.  Used in streaming
+ * replication mode when the load balance node is chosen for each
+ * execution of a named statement.  Unlike parse_before_bind(), the parse
+ * message is sent just before the bind message without waiting for parse
+ * complete, and the statement is never closed first since the nodes the
+ * statement exists on are known from "message".  The parse complete
+ * message is not forwarded to frontend.
+ */
+static void
+parse_before_bind_lazily(POOL_SENT_MESSAGE * message, POOL_QUERY_CONTEXT * query_context)
+{
+	POOL_PENDING_MESSAGE *pmsg;
+	bool		backup[MAX_NUM_BACKENDS];
+	bool		parse_was_sent = false;
+	int			i;
+
+	memcpy(backup, query_context->where_to_send, sizeof(backup));
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (!query_context->where_to_send[i] || message->prepared_on[i])
+		{
+			query_context->where_to_send[i] = false;
+			continue;
+		}
+
+		ereport(DEBUG1,
+				(errmsg("parse before bind"),
+				 errdetail("sending parse of statement \"%s\" to node %d", message->name, i)));
+
+		pool_extended_send_and_wait(query_context, "P", message->len, message->contents, 1, i, true);
+		message->prepared_on[i] = true;
+		parse_was_sent = true;
+	}
+
+	if (parse_was_sent)
+	{
+		/* Add pending message for the nodes the parse message was sent to */
+		pmsg = pool_pending_message_create('P', message->len, message->contents);
+		pmsg->not_forward_to_frontend = true;
+		pool_pending_message_dest_set(pmsg, query_context);
+		pool_pending_message_add(pmsg);
+		pool_pending_message_free_pending_message(pmsg);
+	}
+
+	memcpy(query_context->where_to_send, backup, sizeof(backup));
+}
+
 /*
  * Find victim nodes by "decide by majority" rule and returns array
  * of victim node ids. If no victim is found, return NULL.
@@ -4405,3 +4541,91 @@ si_get_snapshot(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, Node
 		si_snapshot_aquired();
 	}
 }
+
+/*
+ * Check if the statements change the state of the backend session which
+ * survives the end of transaction.  If so, the backend connection cannot
+ * be shared with other sessions any more in transaction pooling mode.
+ * Named prepared statements are not checked here since they are tracked
+ * by the sent message list.
+ */
+static void
+check_session_state_change(List *parse_tree_list)
+{
+	ListCell   *cell;
+
+	if (!pool_config->transaction_pooling)
+		return;
+
+	foreach(cell, parse_tree_list)
+	{
+		Node	   *node = ((RawStmt *) lfirst(cell))->stmt;
+		bool		pin = false;
+
+		if (IsA(node, VariableSetStmt))
+		{
+			VariableSetStmt *vnode = (VariableSetStmt *) node;
+
+			/*
+			 * SET LOCAL and SET TRANSACTION do not outlive the transaction.
+			 * RESET ALL unpins the connection when it completes.
+			 */
+			if (!vnode->is_local && vnode->kind != VAR_RESET_ALL &&
+				!(vnode->kind == VAR_SET_MULTI && !strcmp(vnode->name, "TRANSACTION")))
+				pool_set_pin_backend(true);
+		}
+		else if (IsA(node, ListenStmt) || IsA(node, LoadStmt))
+			pin = true;
+		else if (IsA(node, DeclareCursorStmt))
+			pin = (((DeclareCursorStmt *) node)->options & CURSOR_OPT_HOLD) != 0;
+		else if (IsA(node, CreateStmt))
+			pin = ((CreateStmt *) node)->relation->relpersistence == RELPERSISTENCE_TEMP;
+		else if (IsA(node, SelectStmt) && ((SelectStmt *) node)->intoClause)
+			pin = ((SelectStmt *) node)->intoClause->rel->relpersistence == RELPERSISTENCE_TEMP;
+		else if (IsA(node, CreateTableAsStmt))
+			pin = ((CreateTableAsStmt *) node)->into->rel->relpersistence == RELPERSISTENCE_TEMP;
+		else if (IsA(node, ViewStmt))
+			pin = ((ViewStmt *) node)->view->relpersistence == RELPERSISTENCE_TEMP;
+		else if (IsA(node, CreateSeqStmt))
+			pin = ((CreateSeqStmt *) node)->sequence->relpersistence == RELPERSISTENCE_TEMP;
+
+		/* session level advisory locks are held until released */
+		if (!pin)
+			pin = pool_has_advisory_lock_call(node);
+
+		if (pin)
+		{
+			pool_set_pin_backend(false);
+			return;
+		}
+	}
+}
+
+/*
+ * Build query cache search key of a bound query: the query text followed by
+ * a white space and the hex representation of the bind parameters.  The key
+ * is allocated in the given memory context.
+ */
+static char *
+query_with_bind_params(MemoryContext context, const char *query,
+					   const char *params, int len)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	int			query_len = strlen(query);
+	char	   *key;
+	char	   *p;
+	int			i;
+
+	key = MemoryContextAlloc(context, query_len + 1 + len * 2 + 1);
+	memcpy(key, query, query_len);
+	p = key + query_len;
+	*p++ = ' ';
+	for (i = 0; i < len; i++)
+	{
+		*p++ = hex[(params[i] >> 4) & 0x0f];
+		*p++ = hex[params[i] & 0x0f];
+	}
+	*p = '\0';
+
+	return key;
+}
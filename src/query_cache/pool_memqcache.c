@@ -42,10 +42,16 @@
 #include <libmemcached/memcached.h>
 #endif
 
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+
 #include "auth/md5.h"
+#include "auth/pool_passwd.h"
 #include "pool_config.h"
 #include "protocol/pool_proto_modules.h"
 #include "protocol/pool_process_query.h"
+#include "protocol/pool_pg_utils.h"
 #include "parser/parsenodes.h"
 #include "context/pool_session_context.h"
 #include "query_cache/pool_memqcache.h"
@@ -67,22 +73,28 @@ static char *encode_key(const char *s, char *buf, POOL_CONNECTION_POOL * backend
 #ifdef DEBUG
 static void dump_cache_data(const char *data, size_t len);
 #endif
-static int	pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen, int num_oids, int *oids);
+static int	pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen, int num_oids, int *oids, int expire);
+static char *pool_compress_cache_data(char *data, size_t datalen, size_t *compressed_len);
+static char *pool_decompress_cache_data(char *data, size_t datalen, size_t *len);
 static int	send_cached_messages(POOL_CONNECTION * frontend, const char *qcache, int qcachelen);
 static void send_message(POOL_CONNECTION * conn, char kind, int len, const char *data);
 #ifdef USE_MEMCACHED
 static int	delete_cache_on_memcached(const char *key);
+static void pool_flush_memcached_buffers(void);
 #endif
 static int	pool_get_dml_table_oid(int **oid);
 static int	pool_get_dropdb_table_oids(int **oids, int dboid);
 static void pool_discard_dml_table_oid(void);
 static void pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlink, int dboid);
 static int	pool_get_database_oid(void);
-static void pool_add_table_oid_map(POOL_CACHEKEY * cachkey, int num_table_oids, int *table_oids);
+static int	pool_add_table_oid_map(POOL_CACHEKEY * cachkey, int num_table_oids, int *table_oids);
 static void pool_reset_memqcache_buffer(bool reset_dml_oids);
 static POOL_CACHEID * pool_add_item_shmem_cache(POOL_QUERY_HASH * query_hash, char *data, int size, time_t expire);
-static POOL_CACHEID * pool_find_item_on_shmem_cache(POOL_QUERY_HASH * query_hash);
-static char *pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, int *sts);
+static POOL_CACHEID * pool_find_item_on_shmem_cache(POOL_QUERY_HASH * query_hash, bool allow_stale);
+static char *pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, int *sts, bool allow_stale);
+static bool pool_claim_cache_refresh(POOL_CACHE_ITEM_POINTER * cip, time_t now);
+static int	pool_get_query_cache_expire(SelectContext * ctx, int num_oids);
+static bool pool_is_cache_admitted(POOL_CONNECTION_POOL * backend, char *query, POOL_TEMP_QUERY_CACHE * cache);
 static POOL_QUERY_CACHE_ARRAY * pool_add_query_cache_array(POOL_QUERY_CACHE_ARRAY * cache_array, POOL_TEMP_QUERY_CACHE * cache);
 static void pool_add_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache, char kind, char *data, int data_len);
 static void pool_add_oids_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache, int num_oids, int *oids);
@@ -100,7 +112,8 @@ static void pool_check_and_discard_cache_buffer(int num_oids, int *oids);
 static void pool_set_memqcache_blocks(int num_blocks);
 static int	pool_get_memqcache_blocks(void);
 static void *pool_memory_cache_address(void);
-static void pool_reset_fsmm(size_t size);
+static void pool_reset_fsmm(void);
+static void pool_build_fsmm(void);
 static void *pool_fsmm_address(void);
 static void pool_update_fsmm(POOL_CACHE_BLOCKID blockid, size_t free_space);
 static POOL_CACHE_BLOCKID pool_get_block(size_t free_space);
@@ -113,11 +126,28 @@ static int	pool_delete_item_shmem_cache(POOL_CACHEID * cacheid);
 static char *block_address(int blockid);
 static POOL_CACHE_ITEM_POINTER * item_pointer(char *block, int i);
 static POOL_CACHE_ITEM_HEADER * item_header(char *block, int i);
-static POOL_CACHE_BLOCKID pool_reuse_block(void);
+static POOL_CACHE_BLOCKID pool_reuse_block(bool force);
 #ifdef SHMEMCACHE_DEBUG
 static void dump_shmem_cache(POOL_CACHE_BLOCKID blockid);
 #endif
 
+static void pool_oid_map_reset(void);
+static uint32 pool_oid_map_hash(int dboid, int tableoid);
+static bool pool_oid_map_is_alive(POOL_OID_MAP_ELEMENT * element);
+static void pool_oid_map_free_element(int index);
+static int	pool_oid_map_gc(void);
+static int	pool_oid_map_add(int dboid, int tableoid, POOL_CACHEID * cacheid);
+static int	pool_oid_map_invalidate(int dboid, int tableoid);
+static int	pool_oid_map_get_table_oids(int dboid, int **oids);
+static void pool_oid_map_discard_db(int dboid);
+static POOL_CONNECTION_POOL_SLOT * snapshot_connect(int node_id, char *database);
+static bool fetch_system_identifier(POOL_CONNECTION_POOL_SLOT * *slots, int node_id);
+static int	snapshot_oid_cmp(const void *a, const void *b);
+static int	snapshot_hash_cmp(const void *a, const void *b);
+static void snapshot_validate_tables(POOL_CONNECTION_POOL_SLOT * *slots, int node_id,
+									 POOL_CACHE_SNAPSHOT_OID * oids, int num_oids);
+static void pool_discard_memqcache_snapshot(void);
+
 static int	pool_hash_reset(int nelements);
 static int	pool_hash_insert(POOL_QUERY_HASH * key, POOL_CACHEID * cacheid, bool update);
 static uint32 create_hash_key(POOL_QUERY_HASH * key);
@@ -127,12 +157,16 @@ static bool is_free_hash_element(void);
 static void inject_cached_message(POOL_CONNECTION * backend, char *qcache, int qcachelen);
 
 /*
- * if true, shared memory is locked in this process now.
+ * If non 0, shared memory is locked in this process now. The value is
+ * POOL_MEMQ_LOCK_TYPE of the lock.
  */
 static int is_shmem_locked;
 
 /*
- * Connect to Memcached
+ * Connect to Memcached.  memqcache_memcached_host may be a comma separated
+ * list of "host" or "host:port" and the keys are distributed among the
+ * servers by consistent hashing.  If port is omitted,
+ * memqcache_memcached_port is used.
  */
 int
 memcached_connect(void)
@@ -140,8 +174,11 @@ memcached_connect(void)
 	char	   *memqcache_memcached_host;
 	int			memqcache_memcached_port;
 #ifdef USE_MEMCACHED
-	memcached_server_st *servers;
+	memcached_server_st *servers = NULL;
 	memcached_return rc;
+	char	   *hosts;
+	char	   *host;
+	char	   *saveptr;
 
 	/* Already connected? */
 	if (memc)
@@ -158,10 +195,42 @@ memcached_connect(void)
 
 #ifdef USE_MEMCACHED
 	memc = memcached_create(NULL);
-	servers = memcached_server_list_append(NULL,
-										   memqcache_memcached_host,
-										   memqcache_memcached_port,
-										   &rc);
+
+	hosts = pstrdup(memqcache_memcached_host);
+	for (host = strtok_r(hosts, ",", &saveptr); host; host = strtok_r(NULL, ",", &saveptr))
+	{
+		int			port = memqcache_memcached_port;
+		char	   *p;
+
+		while (isspace((unsigned char) *host))
+			host++;
+		for (p = host + strlen(host); p > host && isspace((unsigned char) p[-1]); p--)
+			p[-1] = '\0';
+		if (*host == '\0')
+			continue;
+
+		p = strrchr(host, ':');
+		if (p && p[1] != '\0' && strspn(p + 1, "0123456789") == strlen(p + 1))
+		{
+			*p = '\0';
+			port = atoi(p + 1);
+		}
+
+		servers = memcached_server_list_append(servers, host, port, &rc);
+		if (servers == NULL)
+		{
+			ereport(WARNING,
+					(errmsg("failed to connect to memcached, invalid server:\"%s:%d\"", host, port)));
+			break;
+		}
+	}
+	pfree(hosts);
+
+	if (servers == NULL)
+	{
+		memc = (memcached_st *) - 1;
+		return -1;
+	}
 
 	rc = memcached_server_push(memc, servers);
 	if (rc != MEMCACHED_SUCCESS)
@@ -172,6 +241,19 @@ memcached_connect(void)
 		return -1;
 	}
 	memcached_server_list_free(servers);
+
+	/* Keys moved by adding or removing servers are kept minimum */
+	memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_KETAMA, 1);
+
+	/*
+	 * Queue stores and deletes without waiting for the replies.  They are
+	 * sent by memcached_flush_buffers().
+	 */
+	if (pool_config->memqcache_memcached_pipelining)
+	{
+		memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_BUFFER_REQUESTS, 1);
+		memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_NOREPLY, 1);
+	}
 #else
 	ereport(WARNING,
 			(errmsg("failed to connect to memcached, memcached support is not enabled")));
@@ -191,6 +273,7 @@ memcached_disconnect(void)
 	{
 		return;
 	}
+	pool_flush_memcached_buffers();
 	memcached_free(memc);
 #else
 	ereport(WARNING,
@@ -224,7 +307,7 @@ memqcache_register(char kind,
 			query_context = session_context->query_context;
 
 			if (query)
-				query_context->temp_cache = pool_create_temp_query_cache(query);
+				cache = query_context->temp_cache = pool_create_temp_query_cache(query);
 		}
 	}
 
@@ -235,7 +318,7 @@ memqcache_register(char kind,
  * Commit SELECT results to cache storage.
  */
 static int
-pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen, int num_oids, int *oids)
+pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen, int num_oids, int *oids, int expire)
 {
 #ifdef USE_MEMCACHED
 	memcached_return rc;
@@ -243,6 +326,9 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 	POOL_CACHEKEY cachekey;
 	char		tmpkey[MAX_KEY];
 	time_t		memqcache_expire;
+	char	   *compressed_data;
+	size_t		compressed_len = 0;
+	size_t		raw_len = datalen;
 
 	/*
 	 * get_buflen() will return -1 if query result exceeds memqcache_maxcache
@@ -264,6 +350,13 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 	dump_cache_data(data, datalen);
 #endif
 
+	compressed_data = pool_compress_cache_data(data, datalen, &compressed_len);
+	if (compressed_data)
+	{
+		data = compressed_data;
+		datalen = compressed_len;
+	}
+
 
 	/* encode md5key for memcached */
 	encode_key(query, tmpkey, backend);
@@ -273,7 +366,7 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 
 	memcpy(cachekey.hashkey, tmpkey, 32);
 
-	memqcache_expire = pool_config->memqcache_expire;
+	memqcache_expire = expire;
 	ereport(DEBUG1,
 			(errmsg("commiting SELECT results to cache storage"),
 			 errdetail("memqcache_expire = %ld", memqcache_expire)));
@@ -285,7 +378,8 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 
 		memcpy(query_hash.query_hash, tmpkey, sizeof(query_hash.query_hash));
 
-		cacheid = pool_hash_search(&query_hash);
+		/* This also removes the item if it has been expired */
+		cacheid = pool_find_item_on_shmem_cache(&query_hash, false);
 
 		if (cacheid != NULL)
 		{
@@ -321,12 +415,13 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 	{
 		rc = memcached_set(memc, tmpkey, 32,
 						   data, datalen, (time_t) memqcache_expire, 0);
-		if (rc != MEMCACHED_SUCCESS)
+		if (rc != MEMCACHED_SUCCESS && rc != MEMCACHED_BUFFERED)
 		{
 			ereport(WARNING,
 					(errmsg("cache commit failed with error:\"%s\"", memcached_strerror(memc, rc))));
 			return -1;
 		}
+		pool_flush_memcached_buffers();
 		ereport(DEBUG1,
 				(errmsg("commiting SELECT results to cache storage"),
 				 errdetail("set cache succeeded")));
@@ -336,11 +431,123 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 /*
  * Register cache id to oid map
  */
-	pool_add_table_oid_map(&cachekey, num_oids, oids);
+	if (pool_add_table_oid_map(&cachekey, num_oids, oids) != 0)
+	{
+		/*
+		 * We could not remember which tables the SELECT uses. To not keep a
+		 * cache entry which could never be invalidated, remove it.
+		 */
+		if (pool_is_shmem_cache())
+			pool_delete_item_shmem_cache(&cachekey.cacheid);
+		return -1;
+	}
+
+	if (compressed_data)
+		pool_stats_count_up_num_compressed_entries(raw_len, compressed_len);
 
 	return 0;
 }
 
+/*
+ * Compress SELECT results to be stored in cache storage if
+ * memqcache_compression is enabled and the results are large enough.
+ * Returns palloc'ed compressed data, or NULL if the data should be stored
+ * as it is.
+ */
+static char *
+pool_compress_cache_data(char *data, size_t datalen, size_t *compressed_len)
+{
+#ifdef USE_LZ4
+	char	   *buf;
+	int			bound;
+	int			len;
+	int32		rawlen;
+
+	if (!pool_config->memqcache_compression ||
+		datalen < pool_config->memqcache_compression_threshold ||
+		datalen > LZ4_MAX_INPUT_SIZE)
+		return NULL;
+
+	bound = LZ4_compressBound(datalen);
+	buf = palloc(POOL_CACHE_COMPRESSED_HEADER_SIZE + bound);
+
+	len = LZ4_compress_default(data, buf + POOL_CACHE_COMPRESSED_HEADER_SIZE,
+							   datalen, bound);
+
+	/* Not worth storing compressed data if it does not get smaller */
+	if (len <= 0 || POOL_CACHE_COMPRESSED_HEADER_SIZE + len >= datalen)
+	{
+		pfree(buf);
+		return NULL;
+	}
+
+	buf[0] = POOL_CACHE_COMPRESSED_MARK;
+	rawlen = datalen;
+	memcpy(buf + 1, &rawlen, sizeof(rawlen));
+	*compressed_len = POOL_CACHE_COMPRESSED_HEADER_SIZE + len;
+
+	ereport(DEBUG1,
+			(errmsg("commiting SELECT results to cache storage"),
+			 errdetail("compressed %zu bytes to %zu bytes", datalen, *compressed_len)));
+
+	return buf;
+#else
+	static bool warned = false;
+
+	if (pool_config->memqcache_compression && !warned)
+	{
+		ereport(LOG,
+				(errmsg("memqcache_compression is ignored"),
+				 errdetail("pgpool-II was not built with LZ4 support (--with-lz4)")));
+		warned = true;
+	}
+	return NULL;
+#endif
+}
+
+/*
+ * If the data fetched from cache storage is compressed, return palloc'ed
+ * uncompressed data. Otherwise return the data as it is.  Returns NULL if
+ * the data cannot be uncompressed.
+ */
+static char *
+pool_decompress_cache_data(char *data, size_t datalen, size_t *len)
+{
+	int32		rawlen;
+
+	if (datalen == 0 || data[0] != POOL_CACHE_COMPRESSED_MARK)
+	{
+		*len = datalen;
+		return data;
+	}
+
+	if (datalen < POOL_CACHE_COMPRESSED_HEADER_SIZE)
+		return NULL;
+
+	memcpy(&rawlen, data + 1, sizeof(rawlen));
+	if (rawlen <= 0)
+		return NULL;
+
+#ifdef USE_LZ4
+	{
+		char	   *buf;
+
+		buf = palloc(rawlen);
+		if (LZ4_decompress_safe(data + POOL_CACHE_COMPRESSED_HEADER_SIZE, buf,
+								datalen - POOL_CACHE_COMPRESSED_HEADER_SIZE,
+								rawlen) != rawlen)
+		{
+			pfree(buf);
+			return NULL;
+		}
+		*len = rawlen;
+		return buf;
+	}
+#else
+	return NULL;
+#endif
+}
+
 /*
  * Commit SELECT system catalog results to cache storage.
  */
@@ -395,7 +602,8 @@ pool_catalog_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *dat
 
 		memcpy(query_hash.query_hash, tmpkey, sizeof(query_hash.query_hash));
 
-		cacheid = pool_hash_search(&query_hash);
+		/* This also removes the item if it has been expired */
+		cacheid = pool_find_item_on_shmem_cache(&query_hash, false);
 
 		if (cacheid != NULL)
 		{
@@ -431,12 +639,13 @@ pool_catalog_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *dat
 	{
 		rc = memcached_set(memc, tmpkey, 32,
 						   data, datalen, (time_t) memqcache_expire, 0);
-		if (rc != MEMCACHED_SUCCESS)
+		if (rc != MEMCACHED_SUCCESS && rc != MEMCACHED_BUFFERED)
 		{
 			ereport(WARNING,
 					(errmsg("cache commit failed with error:\"%s\"", memcached_strerror(memc, rc))));
 			return -1;
 		}
+		pool_flush_memcached_buffers();
 		ereport(DEBUG1,
 				(errmsg("commiting relation cache to cache storage"),
 				 errdetail("set cache succeeded")));
@@ -448,12 +657,14 @@ pool_catalog_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *dat
 
 /*
  * Fetch from memory cache.
+ * If allow_stale is true, an expired shmem cache item may be returned
+ * while another process is refreshing it (memqcache_stale_while_revalidate).
  * Return:
  * 0: fetch success,
  * 1: not found
  */
 int
-pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf, size_t *len)
+pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf, size_t *len, bool allow_stale)
 {
 	char	   *ptr;
 	char		tmpkey[MAX_KEY];
@@ -478,7 +689,7 @@ pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf,
 
 		memcpy(query_hash.query_hash, tmpkey, sizeof(query_hash.query_hash));
 
-		ptr = pool_get_item_shmem_cache(&query_hash, &mylen, &sts);
+		ptr = pool_get_item_shmem_cache(&query_hash, &mylen, &sts, allow_stale);
 		if (ptr == NULL)
 		{
 			ereport(DEBUG1,
@@ -632,10 +843,16 @@ send_cached_messages(POOL_CONNECTION * frontend, const char *qcache, int qcachel
 {
 	int			msg = 0;
 	int			i = 0;
-	int			is_prepared_stmt = 0;
+	int			is_prepared_stmt;
 	int			len;
 	const char *p;
 
+	/*
+	 * In extended query, 'T' is returned by the backend for Describe message
+	 * if the frontend asks for it.
+	 */
+	is_prepared_stmt = pool_is_doing_extended_query_message();
+
 	while (i < qcachelen)
 	{
 		char		tmpkind;
@@ -724,6 +941,19 @@ delete_cache_on_memcached(const char *key)
 }
 #endif
 
+/*
+ * Send stores and deletes queued by memqcache_memcached_pipelining
+ */
+static void
+pool_flush_memcached_buffers(void)
+{
+#ifdef USE_MEMCACHED
+	if (pool_config->memqcache_memcached_pipelining && memc &&
+		memc != (memcached_st *) - 1)
+		memcached_flush_buffers(memc);
+#endif
+}
+
 /*
  * Fetch SELECT data from cache if possible.
  */
@@ -743,11 +973,11 @@ pool_fetch_from_memory_cache(POOL_CONNECTION * frontend,
 	*foundp = false;
 
 	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_shmem_lock();
+	pool_shmem_lock(POOL_MEMQ_SHARED_LOCK);
 
 	PG_TRY();
 	{
-		sts = pool_fetch_cache(backend, contents, &qcache, &qcachelen);
+		sts = pool_fetch_cache(backend, contents, &qcache, &qcachelen, true);
 	}
 	PG_CATCH();
 	{
@@ -764,6 +994,27 @@ pool_fetch_from_memory_cache(POOL_CONNECTION * frontend,
 		/* Cache not found */
 		return POOL_CONTINUE;
 
+	/* Uncompress the cache data if necessary */
+	{
+		char	   *rawdata;
+
+		rawdata = pool_decompress_cache_data(qcache, qcachelen, &qcachelen);
+		if (rawdata == NULL)
+		{
+			ereport(LOG,
+					(errmsg("fetching from cache storage, failed to uncompress cache data"),
+					 errdetail("query: \"%s\"", contents)));
+			pfree(qcache);
+			/* Behave as if cache not found */
+			return POOL_CONTINUE;
+		}
+		if (rawdata != qcache)
+		{
+			pfree(qcache);
+			qcache = rawdata;
+		}
+	}
+
 	/*
 	 * Cache found. If we are doing extended query and in streaming
 	 * replication mode, we need to retrieve any responses from backend and
@@ -1093,6 +1344,51 @@ pool_is_table_in_safe_list(const char *table_name)
 	return false;
 }
 
+/*
+ * Returns the life time in seconds of the cache entry for a SELECT which
+ * accesses the tables in ctx.  Tables matching memqcache_table_expire_list
+ * use the life time given there instead of memqcache_expire.  If several
+ * tables are accessed, the shortest life time wins (0 means no expiry).
+ */
+static int
+pool_get_query_cache_expire(SelectContext * ctx, int num_oids)
+{
+	int			expire = -1;
+	int			i;
+
+	if (pool_config->memqcache_expire_tables == NULL || num_oids <= 0)
+		return pool_config->memqcache_expire;
+
+	for (i = 0; i < num_oids; i++)
+	{
+		int			table_expire = pool_config->memqcache_expire;
+		char		table[POOL_NAMEDATALEN];
+		char	   *p;
+		int			j = 0;
+		int			index;
+
+		/* Table names are double quoted in ctx. Strip them. */
+		for (p = ctx->table_names[i]; *p && j < sizeof(table) - 1; p++)
+		{
+			if (*p != '"')
+				table[j++] = *p;
+		}
+		table[j] = '\0';
+
+		index = regex_array_match(pool_config->memqcache_expire_tables, table);
+		if (index >= 0)
+			table_expire = atoi(pool_config->memqcache_expire_tokens->token[index].right_token);
+
+		if (expire < 0 || (table_expire > 0 && (expire == 0 || table_expire < expire)))
+			expire = table_expire;
+	}
+
+	ereport(DEBUG1,
+			(errmsg("memcache: cache expire is %d seconds", expire)));
+
+	return expire;
+}
+
 /*
  * Extract table oid from INSERT/UPDATE/DELETE/TRUNCATE/
  * DROP TABLE/ALTER TABLE/COPY FROM statement.
@@ -1424,6 +1720,9 @@ pool_get_dropdb_table_oids(int **oids, int dboid)
 	struct dirent *dp;
 	char		path[1024];
 
+	if (pool_is_shmem_cache())
+		return pool_oid_map_get_table_oids(dboid, oids);
+
 	snprintf(path, sizeof(path), "%s/%d", pool_config->memqcache_oiddir, dboid);
 	if ((dir = opendir(path)) == NULL)
 	{
@@ -1468,8 +1767,8 @@ pool_discard_dml_table_oid(void)
 }
 
 /*
- * Management modules for oid map.  When caching SELECT results, we
- * record table oids to file, which has following structure.
+ * Management modules for oid map.  When caching SELECT results on
+ * memcached, we record table oids to file, which has following structure.
  *
  * memqcache_oiddir -+- database_oid -+-table_oid_file1
  *                                    |
@@ -1486,6 +1785,11 @@ pool_discard_dml_table_oid(void)
  * deleted (cache invalidation) (when DROP TABLE, ALTER TABLE is
  * executed, the caches must be deleted as well). When database is
  * dropped, all caches belonging to the database must be deleted.
+ *
+ * When caching on shmem, the oid map is kept on shared memory instead
+ * (see pool_oid_map_add() etc.). Since shmem cache does not survive
+ * pgpool-II restart anyway, there's no point to keep the map in files
+ * and to pay for the file system calls.
  */
 
 /*
@@ -1568,7 +1872,7 @@ pool_get_database_oid_from_dbname(char *dbname)
  * As of pgpool-II 3.2, pool_handle_query_cache is responsible for that.
  * (pool_handle_query_cache -> pool_commit_cache -> pool_add_table_oid_map)
  */
-static void
+static int
 pool_add_table_oid_map(POOL_CACHEKEY * cachekey, int num_table_oids, int *table_oids)
 {
 	char	   *dir;
@@ -1577,6 +1881,31 @@ pool_add_table_oid_map(POOL_CACHEKEY * cachekey, int num_table_oids, int *table_
 	int			i;
 	int			len;
 
+	dboid = pool_get_database_oid();
+	ereport(DEBUG1,
+			(errmsg("memcache: adding table oid maps"),
+			 errdetail("dboid %d", dboid)));
+
+	if (dboid <= 0)
+	{
+		ereport(WARNING,
+				(errmsg("memcache: adding table oid maps, failed to get database OID")));
+		return -1;
+	}
+
+	/*
+	 * Register to table oid map on shared memory
+	 */
+	if (pool_is_shmem_cache())
+	{
+		for (i = 0; i < num_table_oids; i++)
+		{
+			if (pool_oid_map_add(dboid, table_oids[i], &cachekey->cacheid) != 0)
+				return -1;
+		}
+		return 0;
+	}
+
 	/*
 	 * Create memqcache_oiddir
 	 */
@@ -1589,25 +1918,13 @@ pool_add_table_oid_map(POOL_CACHEKEY * cachekey, int num_table_oids, int *table_
 			ereport(WARNING,
 					(errmsg("memcache: adding table oid maps, failed to create directory:\"%s\"", dir),
 					 errdetail("%m")));
-			return;
+			return -1;
 		}
 	}
 
 	/*
 	 * Create memqcache_oiddir/database_oid
 	 */
-	dboid = pool_get_database_oid();
-	ereport(DEBUG1,
-			(errmsg("memcache: adding table oid maps"),
-			 errdetail("dboid %d", dboid)));
-
-	if (dboid <= 0)
-	{
-		ereport(WARNING,
-				(errmsg("memcache: adding table oid maps, failed to get database OID")));
-		return;
-	}
-
 	snprintf(path, sizeof(path), "%s/%d", dir, dboid);
 	if (mkdir(path, S_IREAD | S_IWRITE | S_IEXEC) == -1)
 	{
@@ -1616,18 +1933,11 @@ pool_add_table_oid_map(POOL_CACHEKEY * cachekey, int num_table_oids, int *table_
 			ereport(WARNING,
 					(errmsg("memcache: adding table oid maps, failed to create directory:\"%s\"", path),
 					 errdetail("%m")));
-			return;
+			return -1;
 		}
 	}
 
-	if (pool_is_shmem_cache())
-	{
-		len = sizeof(cachekey->cacheid);
-	}
-	else
-	{
-		len = sizeof(cachekey->hashkey);
-	}
+	len = sizeof(cachekey->hashkey);
 
 	for (i = 0; i < num_table_oids; i++)
 	{
@@ -1645,7 +1955,7 @@ pool_add_table_oid_map(POOL_CACHEKEY * cachekey, int num_table_oids, int *table_
 			ereport(WARNING,
 					(errmsg("memcache: adding table oid maps, failed to open file:\"%s\"", path),
 					 errdetail("%m")));
-			return;
+			return -1;
 		}
 
 		fl.l_type = F_WRLCK;
@@ -1661,7 +1971,7 @@ pool_add_table_oid_map(POOL_CACHEKEY * cachekey, int num_table_oids, int *table_
 					 errdetail("%m")));
 
 			close(fd);
-			return;
+			return -1;
 		}
 
 		/*
@@ -1680,7 +1990,7 @@ pool_add_table_oid_map(POOL_CACHEKEY * cachekey, int num_table_oids, int *table_
 						(errmsg("memcache: adding table oid maps, failed to read file:\"%s\"", path),
 						 errdetail("%m")));
 				close(fd);
-				return;
+				return -1;
 			}
 			else if (sts == len)
 			{
@@ -1688,7 +1998,7 @@ pool_add_table_oid_map(POOL_CACHEKEY * cachekey, int num_table_oids, int *table_
 				{
 					/* Same key found. Skip this */
 					close(fd);
-					return;
+					return 0;
 				}
 				continue;
 			}
@@ -1701,7 +2011,7 @@ pool_add_table_oid_map(POOL_CACHEKEY * cachekey, int num_table_oids, int *table_
 				ereport(WARNING,
 						(errmsg("memcache: adding table oid maps, invalid data length:%d in file:\"%s\". error:\"%s\"", sts, path)));
 				close(fd);
-				return;
+				return -1;
 			}
 			break;
 		}
@@ -1713,7 +2023,7 @@ pool_add_table_oid_map(POOL_CACHEKEY * cachekey, int num_table_oids, int *table_
 					(errmsg("memcache: adding table oid maps, failed seek on file:\"%s\"", path),
 					 errdetail("%m")));
 			close(fd);
-			return;
+			return -1;
 		}
 
 		/*
@@ -1726,21 +2036,28 @@ pool_add_table_oid_map(POOL_CACHEKEY * cachekey, int num_table_oids, int *table_
 					(errmsg("memcache: adding table oid maps, failed to write file:\"%s\"", path),
 					 errdetail("%m")));
 			close(fd);
-			return;
+			return -1;
 		}
 		close(fd);
 	}
+	return 0;
 }
 
 /*
- * Discard all oid maps at pgpool-II startup.
- * This is necessary for shmem case.
+ * Discard all oid maps at pgpool-II startup or when the shmem cache is
+ * cleared.
  */
 void
 pool_discard_oid_maps(void)
 {
 	char		command[1024];
 
+	if (pool_is_shmem_cache())
+	{
+		pool_oid_map_reset();
+		return;
+	}
+
 	snprintf(command, sizeof(command), "/bin/rm -fr %s/[0-9]*",
 			 pool_config->memqcache_oiddir);
 	if (system(command) == -1)
@@ -1751,32 +2068,29 @@ pool_discard_oid_maps(void)
 
 }
 
+/*
+ * Discard oid maps belonging to the database. Caller must hold exclusive
+ * shmem lock.
+ */
 void
 pool_discard_oid_maps_by_db(int dboid)
 {
-	char		command[1024];
-
 	if (pool_is_shmem_cache())
 	{
-		snprintf(command, sizeof(command), "/bin/rm -fr %s/%d/",
-				 pool_config->memqcache_oiddir, dboid);
-
 		ereport(DEBUG1,
 				(errmsg("memcache: discarding oid maps by db"),
-				 errdetail("command: '%s\'", command)));
+				 errdetail("dboid: %d", dboid)));
 
-		if (system(command) == -1)
-			ereport(WARNING,
-					(errmsg("unable to execute command \"%s\"", command),
-					 errdetail("system() command failed with error \"%m\"")));
+		pool_oid_map_discard_db(dboid);
 	}
 }
 
 /*
  * Read cache id (shmem case) or hash key (memcached case) from table
- * oid map file according to table_oids and discard cache entries.  If
- * unlink is true, the file will be unlinked after successful cache
- * removal.
+ * oid map according to table_oids and discard cache entries.  In the
+ * memcached case, if unlink is true, the oid map file will be unlinked
+ * after successful cache removal. In the shmem case, the oid map entries
+ * are always removed.
  */
 static void
 pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlinkp, int dboid)
@@ -1787,6 +2101,36 @@ pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlinkp, in
 	int			len;
 	POOL_CACHEKEY buf;
 
+	if (dboid == 0)
+	{
+		dboid = pool_get_database_oid();
+		ereport(DEBUG1,
+				(errmsg("memcache invalidating query cache"),
+				 errdetail("dboid %d", dboid)));
+
+		if (dboid <= 0)
+		{
+			ereport(WARNING,
+					(errmsg("memcache: invalidating query cache, could not get database OID")));
+			return;
+		}
+	}
+
+	if (pool_is_shmem_cache())
+	{
+		int			removed = 0;
+
+		for (i = 0; i < num_table_oids; i++)
+			removed += pool_oid_map_invalidate(dboid, table_oid[i]);
+
+		if (removed > 0)
+			pool_discard_memqcache_snapshot();
+#ifdef SHMEMCACHE_DEBUG
+		dump_shmem_cache(0);
+#endif
+		return;
+	}
+
 	/*
 	 * Create memqcache_oiddir
 	 */
@@ -1805,21 +2149,6 @@ pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlinkp, in
 	/*
 	 * Create memqcache_oiddir/database_oid
 	 */
-	if (dboid == 0)
-	{
-		dboid = pool_get_database_oid();
-		ereport(DEBUG1,
-				(errmsg("memcache invalidating query cache"),
-				 errdetail("dboid %d", dboid)));
-
-		if (dboid <= 0)
-		{
-			ereport(WARNING,
-					(errmsg("memcache: invalidating query cache, could not get database OID")));
-			return;
-		}
-	}
-
 	snprintf(path, sizeof(path), "%s/%d", dir, dboid);
 	if (mkdir(path, S_IREAD | S_IWRITE | S_IEXEC) == -1)
 	{
@@ -1832,14 +2161,7 @@ pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlinkp, in
 		}
 	}
 
-	if (pool_is_shmem_cache())
-	{
-		len = sizeof(buf.cacheid);
-	}
-	else
-	{
-		len = sizeof(buf.hashkey);
-	}
+	len = sizeof(buf.hashkey);
 
 	for (i = 0; i < num_table_oids; i++)
 	{
@@ -1877,6 +2199,7 @@ pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlinkp, in
 					(errmsg("memcache: invalidating query cache, failed to lock file:\"%s\"", path),
 					 errdetail("%m")));
 			close(fd);
+			pool_flush_memcached_buffers();
 			return;
 		}
 		for (;;)
@@ -1889,31 +2212,21 @@ pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlinkp, in
 						 errdetail("%m")));
 
 				close(fd);
+				pool_flush_memcached_buffers();
 				return;
 			}
 			else if (sts == len)
 			{
-				if (pool_is_shmem_cache())
-				{
-					ereport(DEBUG1,
-							(errmsg("memcache invalidating query cache"),
-							 errdetail("deleting cacheid:%d itemid:%d",
-									   buf.cacheid.blockid, buf.cacheid.itemid)));
-					pool_delete_item_shmem_cache(&buf.cacheid);
-				}
 #ifdef USE_MEMCACHED
-				else
-				{
-					char		delbuf[33];
+				char		delbuf[33];
 
-					memcpy(delbuf, buf.hashkey, 32);
-					delbuf[32] = 0;
-					ereport(DEBUG1,
-							(errmsg("memcache invalidating query cache"),
-							 errdetail("deleting %s", delbuf)));
+				memcpy(delbuf, buf.hashkey, 32);
+				delbuf[32] = 0;
+				ereport(DEBUG1,
+						(errmsg("memcache invalidating query cache"),
+						 errdetail("deleting %s", delbuf)));
 
-					delete_cache_on_memcached(delbuf);
-				}
+				delete_cache_on_memcached(delbuf);
 #endif
 				continue;
 			}
@@ -1926,20 +2239,21 @@ pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlinkp, in
 				ereport(WARNING,
 						(errmsg("memcache: invalidating query cache, invalid data length:%d in file:\"%s\"", sts, path)));
 				close(fd);
+				pool_flush_memcached_buffers();
 				return;
 			}
 			break;
 		}
 
+		/* Send the deletes of this table at once */
+		pool_flush_memcached_buffers();
+
 		if (unlinkp)
 		{
 			unlink(path);
 		}
 		close(fd);
 	}
-#ifdef SHMEMCACHE_DEBUG
-	dump_shmem_cache(0);
-#endif
 }
 
 /*
@@ -2090,19 +2404,20 @@ pool_clear_memory_cache(void)
 	pool_sigset_t oldmask;
 
 	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_shmem_lock();
+	pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
 
 	PG_TRY();
 	{
 		size = pool_shared_memory_cache_size();
 		memset(shmem, 0, size);
 
-		size = pool_shared_memory_fsmm_size();
-		pool_reset_fsmm(size);
+		pool_reset_fsmm();
 
 		pool_discard_oid_maps();
 
 		pool_hash_reset(pool_config->memqcache_max_num_cache);
+
+		pool_discard_memqcache_snapshot();
 	}
 	PG_CATCH();
 	{
@@ -2147,7 +2462,29 @@ pool_memory_cache_address(void)
  * 3     96-127
  * :
  * 255   8160-8192
+ *
+ * The bytes are the leaves of a complete binary tree stored in an array
+ * (the root is at index 1 and children of node n are at 2n and 2n+1).
+ * Each inner node holds the maximum value of its children, so that we
+ * can find a block having enough free space in O(log(number of blocks))
+ * rather than scanning the whole map.
+ */
+
+/*
+ * Number of leaves of the FSMM tree, i.e. number of blocks rounded up to
+ * power of 2.
  */
+static int	fsmm_num_leaves;
+
+static int
+pool_fsmm_num_leaves(void)
+{
+	int			n;
+
+	for (n = 1; n < pool_get_memqcache_blocks(); n <<= 1)
+		;
+	return n;
+}
 
 /*
  * Calculate necessary shared memory size for FSMM. Should be called after
@@ -2158,7 +2495,7 @@ pool_shared_memory_fsmm_size(void)
 {
 	size_t		size;
 
-	size = pool_get_memqcache_blocks() * sizeof(char);
+	size = pool_fsmm_num_leaves() * 2 * sizeof(char);
 	return size;
 }
 
@@ -2171,12 +2508,9 @@ static void *fsmm;
 int
 pool_init_fsmm(size_t size)
 {
-	int			maxblock = pool_get_memqcache_blocks();
-	int			encode_value;
-
 	fsmm = pool_shared_memory_segment_get_chunk(size);
-	encode_value = POOL_MAX_FREE_SPACE / POOL_FSMM_RATIO;
-	memset(fsmm, encode_value, maxblock);
+	fsmm_num_leaves = pool_fsmm_num_leaves();
+	pool_build_fsmm();
 	return 0;
 }
 
@@ -2189,6 +2523,25 @@ pool_fsmm_address(void)
 	return fsmm;
 }
 
+/*
+ * Mark all blocks empty.
+ */
+static void
+pool_build_fsmm(void)
+{
+	unsigned char *p = fsmm;
+	int			maxblock = pool_get_memqcache_blocks();
+	int			encode_value;
+	int			i;
+
+	encode_value = POOL_MAX_FREE_SPACE / POOL_FSMM_RATIO;
+	memset(p, 0, fsmm_num_leaves * 2);
+	memset(p + fsmm_num_leaves, encode_value, maxblock);
+
+	for (i = fsmm_num_leaves - 1; i > 0; i--)
+		p[i] = Max(p[2 * i], p[2 * i + 1]);
+}
+
 /*
  * Clock algorithm shared query cache management modules.
  */
@@ -2212,55 +2565,97 @@ pool_allocate_fsmm_clock_hand(void)
  * Reset FSMM.
  */
 static void
-pool_reset_fsmm(size_t size)
+pool_reset_fsmm(void)
 {
-	int			encode_value;
-
-	encode_value = POOL_MAX_FREE_SPACE / POOL_FSMM_RATIO;
-	memset(fsmm, encode_value, size);
-
+	pool_build_fsmm();
 	*pool_fsmm_clock_hand = 0;
 }
 
 /*
- * Find victim block using clock algorithm and make it free.
- * Returns new free block id.
+ * Find victim block using clock algorithm and make room in it.
+ *
+ * Items in the block pointed to by the clock hand are evicted if their
+ * usage count is zero. Otherwise the usage count is counted down and the
+ * item is kept, so that frequently used items survive while items used
+ * only once are evicted (generalized clock algorithm). If "force" is
+ * true, all items in the block are evicted.  Surviving items are packed
+ * to the bottom of the block to make contiguous free space, and space of
+ * deleted items is reclaimed as well.
+ * Returns the block id.
  */
-static POOL_CACHE_BLOCKID pool_reuse_block(void)
+static POOL_CACHE_BLOCKID pool_reuse_block(bool force)
 {
 	int			maxblock = pool_get_memqcache_blocks();
-	char	   *block = block_address(*pool_fsmm_clock_hand);
-	POOL_CACHE_BLOCK_HEADER *bh = (POOL_CACHE_BLOCK_HEADER *) block;
-	POOL_CACHE_BLOCKID reused_block;
+	POOL_CACHE_BLOCKID reused_block = *pool_fsmm_clock_hand;
+	char	   *p = block_address(reused_block);
+	POOL_CACHE_BLOCK_HEADER *bh = (POOL_CACHE_BLOCK_HEADER *) p;
 	POOL_CACHE_ITEM_POINTER *cip;
-	char	   *p;
+	POOL_CACHEID cacheid;
+	char	   *bottom;
+	int			total_length;
+	int			num_items = 0;
+	int			num_evicted = 0;
 	int			i;
 
-	bh->flags = 0;
-	reused_block = *pool_fsmm_clock_hand;
-	p = block_address(reused_block);
+	bottom = p + pool_config->memqcache_cache_block_size;
 
-	for (i = 0; i < bh->num_items; i++)
+	for (i = 0; (bh->flags & POOL_BLOCK_USED) && i < bh->num_items; i++)
 	{
 		cip = item_pointer(p, i);
 
-		if (!(POOL_ITEM_DELETED & cip->flags))
+		if (POOL_ITEM_DELETED & cip->flags)
+			continue;
+
+		if (force || cip->usage_count == 0)
 		{
 			pool_hash_delete(&cip->query_hash);
+			num_evicted++;
 			ereport(DEBUG1,
 					(errmsg("pool_reuse_block: blockid: %d item: %d", reused_block, i)));
+			continue;
+		}
+
+		/*
+		 * Keep the item. Item bodies are ordered from bottom to top of the
+		 * block, so moving the body towards the bottom never overwrites
+		 * items not processed yet.
+		 */
+		cip->usage_count--;
+		total_length = item_header(p, i)->total_length;
+		bottom -= total_length;
+		memmove(bottom, p + cip->offset, total_length);
+		cip->offset = bottom - p;
+
+		if (num_items != i)
+		{
+			memmove(item_pointer(p, num_items), cip, sizeof(POOL_CACHE_ITEM_POINTER));
+			cacheid.blockid = reused_block;
+			cacheid.itemid = num_items;
+			pool_hash_insert(&item_pointer(p, num_items)->query_hash, &cacheid, true);
 		}
+		num_items++;
 	}
 
-	pool_init_cache_block(reused_block);
-	pool_update_fsmm(reused_block, POOL_MAX_FREE_SPACE);
+	if (num_items == 0)
+	{
+		bh->flags = 0;
+		pool_init_cache_block(reused_block);
+		pool_update_fsmm(reused_block, POOL_MAX_FREE_SPACE);
+	}
+	else
+	{
+		bh->num_items = num_items;
+		bh->free_bytes = bottom - (char *) item_pointer(p, num_items);
+		pool_update_fsmm(reused_block, bh->free_bytes);
+	}
 
 	(*pool_fsmm_clock_hand)++;
 	if (*pool_fsmm_clock_hand >= maxblock)
 		*pool_fsmm_clock_hand = 0;
 
-	ereport(LOG,
-			(errmsg("pool_reuse_block: blockid: %d", reused_block)));
+	ereport(DEBUG1,
+			(errmsg("pool_reuse_block: blockid: %d", reused_block),
+			 errdetail("evicted %d items, kept %d items", num_evicted, num_items)));
 
 	return reused_block;
 }
@@ -2274,6 +2669,7 @@ static POOL_CACHE_BLOCKID pool_get_block(size_t free_space)
 	unsigned char *p = pool_fsmm_address();
 	int			i;
 	int			maxblock = pool_get_memqcache_blocks();
+	POOL_CACHE_BLOCKID blockid;
 	POOL_CACHE_BLOCK_HEADER *bh;
 
 	if (p == NULL)
@@ -2291,28 +2687,44 @@ static POOL_CACHE_BLOCKID pool_get_block(size_t free_space)
 		return -1;
 	}
 
-	encode_value = free_space / POOL_FSMM_RATIO;
+	/*
+	 * Round up so that any block having the encoded value actually has
+	 * enough space, except for requests close to the block size.
+	 */
+	encode_value = (free_space + POOL_FSMM_RATIO - 1) / POOL_FSMM_RATIO;
+	encode_value = Min(encode_value, POOL_MAX_FREE_SPACE / POOL_FSMM_RATIO);
 
-	for (i = 0; i < maxblock; i++)
+	if (p[1] >= encode_value)
 	{
-		if (p[i] >= encode_value)
+		/* Descend to the leftmost block having enough space */
+		for (i = 1; i < fsmm_num_leaves;)
 		{
-			/*
-			 * This block *may" have enough space. We need to make sure it
-			 * actually has enough space.
-			 */
-			bh = (POOL_CACHE_BLOCK_HEADER *) block_address(i);
-			if (bh->free_bytes >= free_space)
-			{
-				return (POOL_CACHE_BLOCKID) i;
-			}
+			i *= 2;
+			if (p[i] < encode_value)
+				i++;
 		}
+		blockid = i - fsmm_num_leaves;
+
+		/* Initialize the block if it has never been used */
+		pool_init_cache_block(blockid);
+
+		bh = (POOL_CACHE_BLOCK_HEADER *) block_address(blockid);
+		if (bh->free_bytes >= free_space)
+			return blockid;
 	}
 
 	/*
-	 * No enough space found. Reuse victim block
+	 * No enough space found. Make room by evicting items in victim blocks.
+	 * If none of the blocks has enough space after one round of the clock
+	 * hand, evict everything in the next victim block.
 	 */
-	return pool_reuse_block();
+	for (i = 0;; i++)
+	{
+		blockid = pool_reuse_block(i >= maxblock);
+		bh = (POOL_CACHE_BLOCK_HEADER *) block_address(blockid);
+		if (bh->free_bytes >= free_space)
+			return blockid;
+	}
 }
 
 /*
@@ -2322,7 +2734,8 @@ static void
 pool_update_fsmm(POOL_CACHE_BLOCKID blockid, size_t free_space)
 {
 	int			encode_value;
-	char	   *p = pool_fsmm_address();
+	unsigned char *p = pool_fsmm_address();
+	int			i;
 
 	if (p == NULL)
 	{
@@ -2349,7 +2762,17 @@ pool_update_fsmm(POOL_CACHE_BLOCKID blockid, size_t free_space)
 
 	encode_value = free_space / POOL_FSMM_RATIO;
 
-	p[blockid] = encode_value;
+	i = fsmm_num_leaves + blockid;
+	p[i] = encode_value;
+
+	/* Propagate to the root as long as the maximum changes */
+	for (i /= 2; i > 0; i /= 2)
+	{
+		encode_value = Max(p[2 * i], p[2 * i + 1]);
+		if (p[i] == encode_value)
+			break;
+		p[i] = encode_value;
+	}
 
 	return;
 }
@@ -2423,13 +2846,19 @@ static POOL_CACHEID * pool_add_item_shmem_cache(POOL_QUERY_HASH * query_hash, ch
 	pool_init_cache_block(blockid);
 
 	/*
-	 * Make sure that we have at least one free hash element.
+	 * Make sure that we have at least one free hash element.  If not, evict
+	 * items in victim blocks.  This only increases free space of the block
+	 * we got above, even if it is chosen as a victim.
 	 */
-	while (!is_free_hash_element())
+	for (i = 0; !is_free_hash_element(); i++)
 	{
-		/* If not, reuse next victim block */
-		blockid = pool_reuse_block();
-		pool_init_cache_block(blockid);
+		if (i >= pool_get_memqcache_blocks() * 2)
+		{
+			ereport(LOG,
+					(errmsg("error while adding item to shmem cache, no free hash element")));
+			return NULL;
+		}
+		pool_reuse_block(i >= pool_get_memqcache_blocks());
 	}
 
 	/* Get block address on shmem */
@@ -2598,6 +3027,8 @@ static POOL_CACHEID * pool_add_item_shmem_cache(POOL_QUERY_HASH * query_hash, ch
 	memset(&cip_body.next, 0, sizeof(POOL_CACHEID));
 	cip_body.offset = item - p;
 	cip_body.flags = POOL_ITEM_USED;
+	cip_body.usage_count = 0;
+	cip_body.refresh_time = 0;
 	memcpy(item_pointer(p, bh->num_items), &cip_body, sizeof(POOL_CACHE_ITEM_POINTER));
 	bh->free_bytes -= sizeof(POOL_CACHE_ITEM_POINTER);
 
@@ -2644,10 +3075,11 @@ static POOL_CACHEID * pool_add_item_shmem_cache(POOL_QUERY_HASH * query_hash, ch
  * Detail is set to *sts. (0: success, 1: not found, -1: error)
  */
 static char *
-pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, int *sts)
+pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, int *sts, bool allow_stale)
 {
 	POOL_CACHEID *cacheid;
 	POOL_CACHE_ITEM_HEADER *cih;
+	POOL_CACHE_ITEM_POINTER *cip;
 
 	if (sts == NULL)
 	{
@@ -2675,7 +3107,7 @@ pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, int *sts)
 	/*
 	 * Find cache header by using hash table
 	 */
-	cacheid = pool_find_item_on_shmem_cache(query_hash);
+	cacheid = pool_find_item_on_shmem_cache(query_hash, allow_stale);
 	if (cacheid == NULL)
 	{
 		/* Not found */
@@ -2685,6 +3117,14 @@ pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, int *sts)
 
 	cih = pool_cache_item_header(cacheid);
 
+	/*
+	 * Count up the usage count of the item.  We may hold only shared lock
+	 * here, so concurrent updates could be lost, which is harmless.
+	 */
+	cip = item_pointer(block_address(cacheid->blockid), cacheid->itemid);
+	if (cip->usage_count < POOL_ITEM_MAX_USAGE_COUNT)
+		cip->usage_count++;
+
 	*size = cih->total_length - sizeof(POOL_CACHE_ITEM_HEADER);
 	return (char *) cih + sizeof(POOL_CACHE_ITEM_HEADER);
 }
@@ -2693,8 +3133,13 @@ pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, int *sts)
  * Find data on shared memory cache specified query hash.
  * On success returns cache id.
  * The cache id is overwritten by the subsequent call to this function.
+ *
+ * If allow_stale is true and the item has expired no longer than
+ * memqcache_stale_while_revalidate seconds ago, the first caller gets NULL
+ * so that it fetches and registers the fresh result, and the other callers
+ * get the stale item in the mean time.
  */
-static POOL_CACHEID * pool_find_item_on_shmem_cache(POOL_QUERY_HASH * query_hash)
+static POOL_CACHEID * pool_find_item_on_shmem_cache(POOL_QUERY_HASH * query_hash, bool allow_stale)
 {
 	static POOL_CACHEID cacheid;
 	POOL_CACHEID *c;
@@ -2719,8 +3164,33 @@ static POOL_CACHEID * pool_find_item_on_shmem_cache(POOL_QUERY_HASH * query_hash
 					(errmsg("memcache finding item"),
 					 errdetail("cache expired: now: %ld timestamp: %ld",
 							   now, cih->timestamp + cih->expire)));
-			pool_delete_item_shmem_cache(c);
-			return NULL;
+
+			/*
+			 * We can only remove the expired item if we hold exclusive
+			 * lock. Otherwise leave it to the process which registers the
+			 * fresh result.
+			 */
+			if (pool_is_shmem_exclusive_lock())
+			{
+				pool_delete_item_shmem_cache(c);
+				return NULL;
+			}
+
+			if (!allow_stale || pool_config->memqcache_stale_while_revalidate <= 0 ||
+				now > (cih->timestamp + cih->expire + pool_config->memqcache_stale_while_revalidate))
+				return NULL;
+
+			if (pool_claim_cache_refresh(item_pointer(block_address(c->blockid), c->itemid), now))
+			{
+				ereport(DEBUG1,
+						(errmsg("memcache finding item"),
+						 errdetail("refreshing stale cache item")));
+				return NULL;
+			}
+
+			ereport(DEBUG1,
+					(errmsg("memcache finding item"),
+					 errdetail("using stale cache item while it is being refreshed")));
 		}
 	}
 
@@ -2729,6 +3199,29 @@ static POOL_CACHEID * pool_find_item_on_shmem_cache(POOL_QUERY_HASH * query_hash
 	return &cacheid;
 }
 
+/*
+ * Try to become the process which refreshes the expired item.  Returns
+ * true if the caller should fetch the fresh result.  The caller holds
+ * only shared lock, thus concurrent callers are serialized by
+ * SHM_CACHE_REFRESH_SEM.
+ */
+static bool
+pool_claim_cache_refresh(POOL_CACHE_ITEM_POINTER * cip, time_t now)
+{
+	bool		claimed = false;
+
+	pool_semaphore_lock(SHM_CACHE_REFRESH_SEM);
+	if (cip->refresh_time == 0 ||
+		now - cip->refresh_time >= POOL_CACHE_REFRESH_TIMEOUT)
+	{
+		cip->refresh_time = now;
+		claimed = true;
+	}
+	pool_semaphore_unlock(SHM_CACHE_REFRESH_SEM);
+
+	return claimed;
+}
+
 /*
  * Delete item data specified cache id from shmem.
  * On successful deletion, returns 0.
@@ -2937,16 +3430,31 @@ pool_wipe_out_cache_block(POOL_CACHE_BLOCKID blockid)
 #endif
 
 /*
- * Acquire lock: XXX giant lock
+ * Acquire lock. Searching cache only needs shared lock. Modifying cache
+ * requires exclusive lock.  If we already hold the lock, this is a no-op.
+ * Upgrading shared lock to exclusive lock is not allowed because it could
+ * cause a deadlock with other readers.
  */
 void
-pool_shmem_lock(void)
+pool_shmem_lock(POOL_MEMQ_LOCK_TYPE type)
 {
-	if (pool_is_shmem_cache() && !is_shmem_locked)
+	if (!pool_is_shmem_cache())
+		return;
+
+	if (is_shmem_locked)
 	{
-		pool_semaphore_lock(SHM_CACHE_SEM);
-		is_shmem_locked = true;
+		if (is_shmem_locked == POOL_MEMQ_SHARED_LOCK && type == POOL_MEMQ_EXCLUSIVE_LOCK)
+			ereport(ERROR,
+					(errmsg("memcache: cannot upgrade shared lock to exclusive lock")));
+		return;
 	}
+
+	if (type == POOL_MEMQ_SHARED_LOCK)
+		pool_semaphore_lock_shared(SHM_CACHE_SEM, SHM_CACHE_WRITER_SEM);
+	else
+		pool_semaphore_lock_exclusive(SHM_CACHE_SEM, SHM_CACHE_WRITER_SEM,
+									  SHM_CACHE_MAX_READERS);
+	is_shmem_locked = type;
 }
 
 /*
@@ -2957,8 +3465,12 @@ pool_shmem_unlock(void)
 {
 	if (pool_is_shmem_cache() && is_shmem_locked)
 	{
-		pool_semaphore_unlock(SHM_CACHE_SEM);
-		is_shmem_locked = false;
+		if (is_shmem_locked == POOL_MEMQ_SHARED_LOCK)
+			pool_semaphore_unlock_shared(SHM_CACHE_SEM);
+		else
+			pool_semaphore_unlock_exclusive(SHM_CACHE_SEM, SHM_CACHE_WRITER_SEM,
+											SHM_CACHE_MAX_READERS);
+		is_shmem_locked = 0;
 	}
 }
 
@@ -2968,7 +3480,16 @@ pool_shmem_unlock(void)
 bool
 pool_is_shmem_lock(void)
 {
-	return is_shmem_locked;
+	return is_shmem_locked != 0;
+}
+
+/*
+ * Return true if we hold exclusive lock
+ */
+bool
+pool_is_shmem_exclusive_lock(void)
+{
+	return is_shmem_locked == POOL_MEMQ_EXCLUSIVE_LOCK;
 }
 
 /*
@@ -3124,6 +3645,8 @@ pool_create_temp_query_cache(char *query)
 	p->buffer = pool_create_buffer();
 	p->oids = pool_create_buffer();
 	p->num_oids = 0;
+	p->expire = pool_config->memqcache_expire;
+	gettimeofday(&p->start_time, NULL);
 	p->is_exceeded = false;
 	p->is_discarded = false;
 
@@ -3464,6 +3987,7 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 	size_t		len;
 	int			num_oids;
 	int		   *oids;
+	int			expire;
 	int			i;
 
 	session_context = pool_get_session_context(true);
@@ -3478,6 +4002,7 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 		num_oids = pool_extract_table_oids_from_select_stmt(node, &ctx);
 		MemoryContextSwitchTo(old_context);
 		oids = ctx.table_oids;
+		expire = pool_get_query_cache_expire(&ctx, num_oids);
 		ereport(DEBUG2,
 				(errmsg("query cache handler for ReadyForQuery"),
 				 errdetail("num_oids: %d oid: %d", num_oids, *oids)));
@@ -3490,6 +4015,11 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 			if (!pool_is_cache_exceeded())
 			{
 				POOL_TEMP_QUERY_CACHE *cache;
+				bool		admitted = true;
+
+				cache = pool_get_current_cache();
+				if (cache && session_context->query_context->skip_cache_commit == false)
+					admitted = pool_is_cache_admitted(backend, query, cache);
 
 				/*
 				 * If we are not inside a transaction, we can immediately
@@ -3497,14 +4027,14 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 				 */
 				/* Register to memcached or shmem */
 				POOL_SETMASK2(&BlockSig, &oldmask);
-				pool_shmem_lock();
+				pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
 
 				cache_buffer = pool_get_current_cache_buffer(&len);
 				if (cache_buffer)
 				{
-					if (session_context->query_context->skip_cache_commit == false)
+					if (session_context->query_context->skip_cache_commit == false && admitted)
 					{
-						if (pool_commit_cache(backend, query, cache_buffer, len, num_oids, oids) != 0)
+						if (pool_commit_cache(backend, query, cache_buffer, len, num_oids, oids, expire) != 0)
 						{
 							ereport(WARNING,
 									(errmsg("ReadyForQuery: pool_commit_cache failed")));
@@ -3548,6 +4078,8 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 
 			/* In transaction. Keep to temp query cache array */
 			pool_add_oids_temp_query_cache(cache, num_oids, oids);
+			if (cache)
+				cache->expire = expire;
 
 			/*
 			 * If temp cache has been overflowed, just trash the half baked
@@ -3573,6 +4105,11 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 			 */
 			else
 			{
+				/* Do not register the result at commit if not admitted */
+				if (cache && session_context->query_context->skip_cache_commit == false &&
+					!pool_is_cache_admitted(backend, cache->query, cache))
+					cache->is_discarded = true;
+
 				session_context->query_cache_array =
 					pool_add_query_cache_array(session_context->query_cache_array, cache);
 
@@ -3601,7 +4138,7 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 		int			num_caches;
 
 		POOL_SETMASK2(&BlockSig, &oldmask);
-		pool_shmem_lock();
+		pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
 
 		/* Invalidate query cache */
 		if (pool_config->memqcache_auto_cache_invalidation)
@@ -3630,7 +4167,7 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 			oids = pool_get_buffer(cache->oids, &len);
 			cache_buffer = pool_get_buffer(cache->buffer, &len);
 
-			if (pool_commit_cache(backend, cache->query, cache_buffer, len, num_oids, oids) != 0)
+			if (pool_commit_cache(backend, cache->query, cache_buffer, len, num_oids, oids, cache->expire) != 0)
 			{
 				ereport(WARNING,
 						(errmsg("ReadyForQuery: pool_commit_cache failed")));
@@ -3665,7 +4202,7 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 				if (num_oids > 0 && pool_config->memqcache_auto_cache_invalidation)
 				{
 					POOL_SETMASK2(&BlockSig, &oldmask);
-					pool_shmem_lock();
+					pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
 					pool_invalidate_query_cache(num_oids, oids, true, 0);
 					pool_shmem_unlock();
 					POOL_SETMASK(&oldmask);
@@ -3701,14 +4238,17 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 		{
 			int			dboid = session_context->query_context->dboid;
 
+			POOL_SETMASK2(&BlockSig, &oldmask);
+			pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+
 			num_oids = pool_get_dropdb_table_oids(&oids, dboid);
 
 			if (num_oids > 0 && pool_config->memqcache_auto_cache_invalidation)
 			{
-				pool_shmem_lock();
 				pool_invalidate_query_cache(num_oids, oids, true, dboid);
 				pool_discard_oid_maps_by_db(dboid);
 				pool_shmem_unlock();
+				POOL_SETMASK(&oldmask);
 				pool_reset_memqcache_buffer(true);
 
 				pfree(oids);
@@ -3716,6 +4256,11 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 						(errmsg("query cache handler for ReadyForQuery"),
 						 errdetail("deleted all cache files for the DROPped DB")));
 			}
+			else
+			{
+				pool_shmem_unlock();
+				POOL_SETMASK(&oldmask);
+			}
 		}
 		else
 		{
@@ -3734,7 +4279,7 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 				if (state == 'I')
 				{
 					POOL_SETMASK2(&BlockSig, &oldmask);
-					pool_shmem_lock();
+					pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
 					pool_invalidate_query_cache(num_oids, oids, true, 0);
 					pool_shmem_unlock();
 					POOL_SETMASK(&oldmask);
@@ -3882,6 +4427,139 @@ pool_stats_count_up_num_cache_hits(void)
 	return stats->num_cache_hits;
 }
 
+/*
+ * Count up number of cache entries stored compressed and their sizes.
+ * Returns the number of compressed entries.
+ * QUERY_CACHE_STATS_SEM lock is acquired in this function.
+ */
+long long int
+pool_stats_count_up_num_compressed_entries(size_t raw_size, size_t compressed_size)
+{
+	pool_sigset_t oldmask;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(QUERY_CACHE_STATS_SEM);
+	stats->num_compressed_entries++;
+	stats->compressed_raw_size += raw_size;
+	stats->compressed_size += compressed_size;
+	pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
+	POOL_SETMASK(&oldmask);
+	return stats->num_compressed_entries;
+}
+
+/*
+ * Per query execution stats for cache admission policy
+ */
+static POOL_ADMISSION_STATS * admission_stats;
+
+/*
+ * Returns shared memory size for the cache admission stats.
+ */
+size_t
+pool_admission_stats_size(void)
+{
+	return sizeof(POOL_ADMISSION_STATS) * POOL_ADMISSION_STATS_SETS * POOL_ADMISSION_STATS_WAYS;
+}
+
+/*
+ * Create and initialize the cache admission stats
+ */
+void
+pool_init_admission_stats(void)
+{
+	admission_stats = pool_shared_memory_segment_get_chunk(pool_admission_stats_size());
+	memset(admission_stats, 0, pool_admission_stats_size());
+}
+
+/*
+ * Record the execution of the SELECT in the per query stats and decide
+ * whether its result is worth caching.  The result is admitted if the
+ * execution took memqcache_admission_min_duration or longer, or the query
+ * has been executed memqcache_admission_min_count times or more.  If
+ * neither is set, every result is admitted without recording anything.
+ * QUERY_CACHE_STATS_SEM lock is acquired in this function.
+ */
+static bool
+pool_is_cache_admitted(POOL_CONNECTION_POOL * backend, char *query, POOL_TEMP_QUERY_CACHE * cache)
+{
+	POOL_QUERY_HASH query_hash;
+	POOL_ADMISSION_STATS *set;
+	POOL_ADMISSION_STATS *entry = NULL;
+	char		tmpkey[MAX_KEY];
+	char		hashkey[9];
+	struct timeval now;
+	long long int elapsed;
+	long long int num_executions;
+	bool		admitted;
+	pool_sigset_t oldmask;
+	int			i;
+
+	if ((pool_config->memqcache_admission_min_duration <= 0 &&
+		 pool_config->memqcache_admission_min_count <= 0) ||
+		admission_stats == NULL)
+		return true;
+
+	gettimeofday(&now, NULL);
+	elapsed = (now.tv_sec - cache->start_time.tv_sec) * 1000000LL +
+		(now.tv_usec - cache->start_time.tv_usec);
+
+	encode_key(query, tmpkey, backend);
+	memcpy(query_hash.query_hash, tmpkey, sizeof(query_hash.query_hash));
+
+	/* Use the first 8 chars of md5 hash key to choose a set */
+	memcpy(hashkey, tmpkey, sizeof(hashkey) - 1);
+	hashkey[sizeof(hashkey) - 1] = '\0';
+	set = &admission_stats[(strtoul(hashkey, NULL, 16) % POOL_ADMISSION_STATS_SETS) * POOL_ADMISSION_STATS_WAYS];
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(QUERY_CACHE_STATS_SEM);
+
+	for (i = 0; i < POOL_ADMISSION_STATS_WAYS; i++)
+	{
+		if (memcmp(&set[i].query_hash, &query_hash, sizeof(POOL_QUERY_HASH)) == 0)
+		{
+			entry = &set[i];
+			break;
+		}
+	}
+
+	if (entry == NULL)
+	{
+		/* Replace the least recently used entry */
+		entry = &set[0];
+		for (i = 1; i < POOL_ADMISSION_STATS_WAYS; i++)
+		{
+			if (set[i].last_used < entry->last_used)
+				entry = &set[i];
+		}
+		memset(entry, 0, sizeof(POOL_ADMISSION_STATS));
+		memcpy(&entry->query_hash, &query_hash, sizeof(POOL_QUERY_HASH));
+	}
+
+	entry->num_executions++;
+	entry->total_time += elapsed;
+	entry->last_used = now.tv_sec;
+	num_executions = entry->num_executions;
+
+	admitted = (pool_config->memqcache_admission_min_duration > 0 &&
+				elapsed >= pool_config->memqcache_admission_min_duration * 1000LL) ||
+		(pool_config->memqcache_admission_min_count > 0 &&
+		 num_executions >= pool_config->memqcache_admission_min_count);
+
+	if (!admitted)
+		stats->num_admission_rejects++;
+
+	pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
+	POOL_SETMASK(&oldmask);
+
+	ereport(DEBUG1,
+			(errmsg("memcache: checking cache admission"),
+			 errdetail("execution time: %lld us executions: %lld admitted: %d",
+					   elapsed, num_executions, admitted)));
+
+	return admitted;
+}
+
 /*
  * On shared memory hash table implementation.  We use sub part of md5
  * hash key as hash function.  The experiment has shown that has_any()
@@ -4310,54 +4988,987 @@ is_free_hash_element(void)
 }
 
 /*
- * Returns shared memory cache stats.
- * Subsequent call to this function will break return value
- * because its in static memory.
- * Caller must hold shmem_lock before calling this function.
- * If in memory query cache is not enabled, all stats are 0.
+ * On shared memory table oid map implementation.  This is used instead
+ * of oid map files when memqcache_method is shmem.  Each element records
+ * the query hash of a cache item and the (database oid, table oid) pair
+ * the cached SELECT uses. Elements are chained in the hash bucket of their
+ * (database oid, table oid) pair, so cache invalidation triggered by DML
+ * only needs to look into a single bucket.  Cache items are looked up by
+ * the query hash rather than by the cache id, because items are moved
+ * within the block when the block is reused (see pool_reuse_block()).
+ *
+ * The number of elements is fixed at startup. Elements pointing to cache
+ * items which have been already removed (expired, reused block etc.)
+ * are garbage collected when we run out of free elements. If we still
+ * cannot find a free element, the SELECT result is not cached since it
+ * could not be invalidated.
+ *
+ * Caller must hold exclusive shmem lock.
  */
-POOL_SHMEM_STATS *
-pool_get_shmem_storage_stats(void)
+
+static POOL_OID_MAP_HEADER *oid_map_header;
+static POOL_OID_MAP_ELEMENT *oid_map_elements;
+
+/*
+ * Calculate shared memory size of table oid map having "nelements"
+ * elements. Number of hash buckets is rounded up to power of 2.
+ */
+size_t
+pool_oid_map_size(int nelements)
 {
-	static POOL_SHMEM_STATS mystats;
-	POOL_HASH_ELEMENT *element;
-	int			nblocks;
-	int			i;
+	size_t		size;
+	int			nbuckets;
 
-	memset(&mystats, 0, sizeof(POOL_SHMEM_STATS));
+	nbuckets = 1;
+	while (nbuckets < nelements)
+		nbuckets <<= 1;
 
-	if (!pool_config->memory_cache_enabled)
-		return &mystats;
+	size = offsetof(POOL_OID_MAP_HEADER, buckets) + sizeof(int) * nbuckets;
+	size = MAXALIGN(size);
+	size += sizeof(POOL_OID_MAP_ELEMENT) * nelements;
 
-	/*
-	 * Copy cache hit data
-	 */
-	mystats.cache_stats.num_selects = stats->num_selects;
-	mystats.cache_stats.num_cache_hits = stats->num_cache_hits;
+	return size;
+}
 
-	if (pool_config->memqcache_method != SHMEM_CACHE)
-		return &mystats;
+/*
+ * Acquire and initialize table oid map on shared memory. This should be
+ * called only once from pgpool main process at the process staring up
+ * time.
+ */
+int
+pool_oid_map_init(int nelements)
+{
+	size_t		size;
+	int			nbuckets;
 
-	/* number of total hash entries */
-	mystats.num_hash_entries = hash_header->nhash;
+	if (nelements <= 0)
+		ereport(ERROR,
+				(errmsg("initializing table oid map on shared memory, invalid number of elements: %d", nelements)));
 
-	/* number of used hash entries */
-	for (i = 0; i < hash_header->nhash; i++)
-	{
-		element = hash_header->elements[i].element;
-		while (element)
-		{
-			mystats.used_hash_entries++;
-			element = element->next;
-		}
-	}
+	nbuckets = 1;
+	while (nbuckets < nelements)
+		nbuckets <<= 1;
 
-	nblocks = pool_get_memqcache_blocks();
+	oid_map_header = pool_shared_memory_segment_get_chunk(pool_oid_map_size(nelements));
+	oid_map_header->nbuckets = nbuckets;
+	oid_map_header->mask = nbuckets - 1;
+	oid_map_header->nelements = nelements;
+	oid_map_header->snapshot_saved = false;
+	oid_map_header->invalidations = 0;
 
-	for (i = 0; i < nblocks; i++)
-	{
-		POOL_CACHE_BLOCK_HEADER *bh;
-		POOL_CACHE_ITEM_POINTER *cip;
+	size = MAXALIGN(offsetof(POOL_OID_MAP_HEADER, buckets) + sizeof(int) * nbuckets);
+	oid_map_elements = (POOL_OID_MAP_ELEMENT *) ((char *) oid_map_header + size);
+
+	pool_oid_map_reset();
+
+	ereport(LOG,
+			(errmsg("memory cache table oid map initialized"),
+			 errdetail("number of elements: %d number of buckets: %d", nelements, nbuckets)));
+	return 0;
+}
+
+/*
+ * Remove all elements from table oid map.
+ */
+static void
+pool_oid_map_reset(void)
+{
+	int			i;
+
+	if (oid_map_header == NULL)
+		return;
+
+	for (i = 0; i < oid_map_header->nbuckets; i++)
+		oid_map_header->buckets[i] = POOL_OID_MAP_NONE;
+
+	for (i = 0; i < oid_map_header->nelements - 1; i++)
+		oid_map_elements[i].next = i + 1;
+	oid_map_elements[oid_map_header->nelements - 1].next = POOL_OID_MAP_NONE;
+
+	oid_map_header->free_list = 0;
+	oid_map_header->used_elements = 0;
+}
+
+/*
+ * Calculate hash bucket of (database oid, table oid).
+ */
+static uint32
+pool_oid_map_hash(int dboid, int tableoid)
+{
+	uint32		h;
+
+	h = (uint32) tableoid * 2654435761U;
+	h ^= (uint32) dboid * 2246822519U;
+	h ^= h >> 16;
+	return h & oid_map_header->mask;
+}
+
+/*
+ * Return true if the cache item pointed to by the element still exists.
+ */
+static bool
+pool_oid_map_is_alive(POOL_OID_MAP_ELEMENT * element)
+{
+	return pool_hash_search(&element->query_hash) != NULL;
+}
+
+/*
+ * Put back the element to free list.
+ */
+static void
+pool_oid_map_free_element(int index)
+{
+	oid_map_elements[index].next = oid_map_header->free_list;
+	oid_map_header->free_list = index;
+	oid_map_header->used_elements--;
+}
+
+/*
+ * Remove elements pointing to cache items which do not exist anymore.
+ * Returns the number of freed elements.
+ */
+static int
+pool_oid_map_gc(void)
+{
+	int			i;
+	int			freed = 0;
+
+	for (i = 0; i < oid_map_header->nbuckets; i++)
+	{
+		int		   *link = &oid_map_header->buckets[i];
+
+		while (*link != POOL_OID_MAP_NONE)
+		{
+			int			index = *link;
+
+			if (!pool_oid_map_is_alive(&oid_map_elements[index]))
+			{
+				*link = oid_map_elements[index].next;
+				pool_oid_map_free_element(index);
+				freed++;
+			}
+			else
+				link = &oid_map_elements[index].next;
+		}
+	}
+
+	ereport(DEBUG1,
+			(errmsg("memcache: garbage collecting table oid map"),
+			 errdetail("freed %d elements", freed)));
+
+	return freed;
+}
+
+/*
+ * Register cache id to the table oid map. Returns 0 on success, -1 if
+ * there is no room in the map.
+ */
+static int
+pool_oid_map_add(int dboid, int tableoid, POOL_CACHEID * cacheid)
+{
+	POOL_OID_MAP_ELEMENT *element;
+	POOL_CACHE_ITEM_POINTER *cip;
+	uint32		bucket;
+	int			index;
+
+	if (oid_map_header->free_list == POOL_OID_MAP_NONE &&
+		pool_oid_map_gc() == 0)
+	{
+		ereport(LOG,
+				(errmsg("memcache: adding table oid map, no free element"),
+				 errhint("increase memqcache_max_num_cache")));
+		return -1;
+	}
+
+	index = oid_map_header->free_list;
+	element = &oid_map_elements[index];
+	oid_map_header->free_list = element->next;
+	oid_map_header->used_elements++;
+
+	cip = item_pointer(block_address(cacheid->blockid), cacheid->itemid);
+
+	element->dboid = dboid;
+	element->tableoid = tableoid;
+	memcpy(&element->query_hash, &cip->query_hash, sizeof(POOL_QUERY_HASH));
+
+	bucket = pool_oid_map_hash(dboid, tableoid);
+	element->next = oid_map_header->buckets[bucket];
+	oid_map_header->buckets[bucket] = index;
+
+	ereport(DEBUG1,
+			(errmsg("memcache: adding table oid map"),
+			 errdetail("dboid: %d table oid: %d blockid: %d itemid: %d",
+					   dboid, tableoid, cacheid->blockid, cacheid->itemid)));
+	return 0;
+}
+
+/*
+ * Delete all cache items using the table and remove them from the map.
+ * Returns the number of removed elements.
+ */
+static int
+pool_oid_map_invalidate(int dboid, int tableoid)
+{
+	int		   *link;
+	POOL_CACHEID *c;
+	int			removed = 0;
+
+	link = &oid_map_header->buckets[pool_oid_map_hash(dboid, tableoid)];
+
+	while (*link != POOL_OID_MAP_NONE)
+	{
+		int			index = *link;
+		POOL_OID_MAP_ELEMENT *element = &oid_map_elements[index];
+
+		if (element->dboid != dboid || element->tableoid != tableoid)
+		{
+			link = &element->next;
+			continue;
+		}
+
+		c = pool_hash_search(&element->query_hash);
+		if (c)
+		{
+			POOL_CACHEID cacheid = *c;
+
+			ereport(DEBUG1,
+					(errmsg("memcache invalidating query cache"),
+					 errdetail("deleting cacheid:%d itemid:%d",
+							   cacheid.blockid, cacheid.itemid)));
+			pool_delete_item_shmem_cache(&cacheid);
+		}
+
+		*link = element->next;
+		pool_oid_map_free_element(index);
+		removed++;
+	}
+
+	return removed;
+}
+
+/*
+ * Collect table oids belonging to the database. The result is palloc'ed.
+ * Returns the number of table oids.
+ */
+static int
+pool_oid_map_get_table_oids(int dboid, int **oids)
+{
+	int		   *rtn = NULL;
+	int			oids_size = 0;
+	int			num_oids = 0;
+	int			i,
+				j;
+
+	for (i = 0; i < oid_map_header->nbuckets; i++)
+	{
+		int			index;
+
+		for (index = oid_map_header->buckets[i]; index != POOL_OID_MAP_NONE;
+			 index = oid_map_elements[index].next)
+		{
+			POOL_OID_MAP_ELEMENT *element = &oid_map_elements[index];
+
+			if (element->dboid != dboid)
+				continue;
+
+			for (j = 0; j < num_oids; j++)
+			{
+				if (rtn[j] == element->tableoid)
+					break;
+			}
+			if (j < num_oids)
+				continue;
+
+			if (num_oids >= oids_size)
+			{
+				oids_size += POOL_OIDBUF_SIZE;
+				if (rtn == NULL)
+					rtn = palloc(sizeof(int) * oids_size);
+				else
+					rtn = repalloc(rtn, sizeof(int) * oids_size);
+			}
+			rtn[num_oids++] = element->tableoid;
+		}
+	}
+
+	*oids = rtn;
+	return num_oids;
+}
+
+/*
+ * Remove all elements belonging to the database from the map.
+ */
+static void
+pool_oid_map_discard_db(int dboid)
+{
+	int			i;
+
+	for (i = 0; i < oid_map_header->nbuckets; i++)
+	{
+		int		   *link = &oid_map_header->buckets[i];
+
+		while (*link != POOL_OID_MAP_NONE)
+		{
+			int			index = *link;
+
+			if (oid_map_elements[index].dboid == dboid)
+			{
+				*link = oid_map_elements[index].next;
+				pool_oid_map_free_element(index);
+			}
+			else
+				link = &oid_map_elements[index].next;
+		}
+	}
+}
+
+/*
+ * Query cache snapshot
+ *
+ * The shmem query cache can be saved to memqcache_snapshot_file by
+ * pcp_snapshot_query_cache or at shutdown, and is reloaded at the next
+ * startup.  Only cache items registered to the table oid map are saved,
+ * since they are the only ones whose validity can be checked at reload.
+ * Nothing is reloaded if the main node belongs to another database
+ * cluster than the one the snapshot was taken on, and items using tables
+ * which do not exist anymore are dropped.  Once any of the saved items is
+ * invalidated, the snapshot file is removed.
+ */
+
+/* Up to this number of table oids are checked by one query */
+#define SNAPSHOT_OIDS_PER_QUERY 100
+
+/* System identifier of the main node. Empty if not known yet. */
+static char system_identifier[POOL_SYSTEM_IDENTIFIER_LEN];
+
+/*
+ * Connect to the database on the node as sr_check_user. Returns NULL on
+ * failure.
+ */
+static POOL_CONNECTION_POOL_SLOT *
+snapshot_connect(int node_id, char *database)
+{
+	BackendInfo *bkinfo;
+	POOL_CONNECTION_POOL_SLOT *slot;
+	char	   *password;
+
+	bkinfo = pool_get_node_info(node_id);
+	password = get_pgpool_config_user_password(pool_config->sr_check_user,
+											   pool_config->sr_check_password);
+
+	slot = make_persistent_db_connection_noerror(node_id, bkinfo->backend_hostname,
+												 bkinfo->backend_port,
+												 database,
+												 pool_config->sr_check_user,
+												 password ? password : "", false);
+	if (password)
+		pfree(password);
+
+	if (slot == NULL)
+		ereport(LOG,
+				(errmsg("memcache snapshot: could not connect to database \"%s\" on node %d",
+						database, node_id)));
+	return slot;
+}
+
+/*
+ * Fetch the system identifier of the node into system_identifier. Returns
+ * false on failure.
+ */
+static bool
+fetch_system_identifier(POOL_CONNECTION_POOL_SLOT * *slots, int node_id)
+{
+	POOL_SELECT_RESULT *res;
+
+	if (slots[node_id] == NULL ||
+		get_query_result(slots, node_id,
+						 "SELECT system_identifier FROM pg_catalog.pg_control_system()",
+						 &res) != 0)
+		return false;
+
+	if (res->nullflags[0] == -1)
+	{
+		free_select_result(res);
+		return false;
+	}
+
+	strlcpy(system_identifier, res->data[0], sizeof(system_identifier));
+	free_select_result(res);
+	return true;
+}
+
+/*
+ * qsort comparator sorting snapshot oid entries by database and table.
+ */
+static int
+snapshot_oid_cmp(const void *a, const void *b)
+{
+	const POOL_CACHE_SNAPSHOT_OID *o1 = a;
+	const POOL_CACHE_SNAPSHOT_OID *o2 = b;
+
+	if (o1->dboid != o2->dboid)
+		return o1->dboid < o2->dboid ? -1 : 1;
+	if (o1->tableoid != o2->tableoid)
+		return o1->tableoid < o2->tableoid ? -1 : 1;
+	return 0;
+}
+
+/*
+ * qsort and bsearch comparator sorting snapshot oid entries by query hash.
+ */
+static int
+snapshot_hash_cmp(const void *a, const void *b)
+{
+	return memcmp(&((const POOL_CACHE_SNAPSHOT_OID *) a)->query_hash,
+				  &((const POOL_CACHE_SNAPSHOT_OID *) b)->query_hash,
+				  sizeof(POOL_QUERY_HASH));
+}
+
+/*
+ * Check that the tables of the snapshot oid entries still exist. Entries
+ * whose table does not exist or could not be checked get dboid 0. The
+ * entries are sorted by database and table as a side effect.
+ */
+static void
+snapshot_validate_tables(POOL_CONNECTION_POOL_SLOT * *slots, int node_id,
+						 POOL_CACHE_SNAPSHOT_OID * oids, int num_oids)
+{
+	char		query[128 + SNAPSHOT_OIDS_PER_QUERY * 12];
+	int			start;
+	int			end;
+
+	qsort(oids, num_oids, sizeof(POOL_CACHE_SNAPSHOT_OID), snapshot_oid_cmp);
+
+	for (start = 0; start < num_oids; start = end)
+	{
+		POOL_CONNECTION_POOL_SLOT *db_slots[MAX_NUM_BACKENDS];
+		POOL_SELECT_RESULT *res;
+		int			dboid = oids[start].dboid;
+		int			i;
+		int			j;
+		int			k;
+
+		for (end = start; end < num_oids && oids[end].dboid == dboid; end++)
+			;
+
+		/* Connect to the database the tables belong to */
+		memset(db_slots, 0, sizeof(db_slots));
+		snprintf(query, sizeof(query),
+				 "SELECT datname FROM pg_catalog.pg_database WHERE oid = %u", (unsigned int) dboid);
+		if (get_query_result(slots, node_id, query, &res) == 0)
+		{
+			db_slots[node_id] = snapshot_connect(node_id, res->data[0]);
+			free_select_result(res);
+		}
+
+		for (i = start; i < end; i = j)
+		{
+			int			found[SNAPSHOT_OIDS_PER_QUERY];
+			int			num_found = 0;
+			int			n = 0;
+			char	   *p;
+
+			p = query + snprintf(query, sizeof(query),
+								 "SELECT oid FROM pg_catalog.pg_class WHERE oid IN (");
+			for (j = i; j < end && n < SNAPSHOT_OIDS_PER_QUERY; j++)
+			{
+				if (j > i && oids[j].tableoid == oids[j - 1].tableoid)
+					continue;
+				p += sprintf(p, "%s%u", n > 0 ? "," : "", (unsigned int) oids[j].tableoid);
+				n++;
+			}
+			strcpy(p, ")");
+
+			if (db_slots[node_id] &&
+				get_query_result(db_slots, node_id, query, &res) == 0)
+			{
+				for (k = 0; k < res->numrows && num_found < SNAPSHOT_OIDS_PER_QUERY; k++)
+					found[num_found++] = (int) strtoul(res->data[k], NULL, 10);
+				free_select_result(res);
+			}
+
+			for (; i < j; i++)
+			{
+				for (k = 0; k < num_found; k++)
+				{
+					if (found[k] == oids[i].tableoid)
+						break;
+				}
+				if (k == num_found)
+				{
+					ereport(DEBUG1,
+							(errmsg("memcache snapshot: table does not exist"),
+							 errdetail("dboid: %d table oid: %d", dboid, oids[i].tableoid)));
+					oids[i].dboid = 0;
+				}
+			}
+		}
+
+		if (db_slots[node_id])
+			discard_persistent_db_connection(db_slots[node_id]);
+	}
+}
+
+/*
+ * Save the shmem query cache to memqcache_snapshot_file.  The snapshot is
+ * written to a temporary file first and then renamed, so that a crash in
+ * the middle does not leave a broken snapshot.  Cache items are copied
+ * while holding the shmem lock, and the file is written after releasing
+ * it, so that children are not blocked by the disk I/O.
+ */
+void
+pool_save_memqcache_snapshot(void)
+{
+	char	   *path = pool_config->memqcache_snapshot_file;
+	char		tmppath[POOLMAXPATHLEN + 1];
+	FILE	   *volatile fp = NULL;
+	POOL_CACHE_SNAPSHOT_HEADER header;
+	POOL_CACHE_SNAPSHOT_OID *oids;
+	char	  **items;
+	pool_sigset_t oldmask;
+	time_t		now;
+	uint32		invalidations;
+	bool		outdated;
+	int			i;
+
+	if (!pool_config->memory_cache_enabled || !pool_is_shmem_cache())
+		ereport(ERROR,
+				(errmsg("memcache snapshot: query cache on shared memory is not enabled")));
+
+	if (*path == '\0')
+		ereport(ERROR,
+				(errmsg("memcache snapshot: memqcache_snapshot_file is not set")));
+
+	if (system_identifier[0] == '\0')
+	{
+		POOL_CONNECTION_POOL_SLOT *slots[MAX_NUM_BACKENDS];
+		int			node_id = REAL_MAIN_NODE_ID;
+		bool		found = false;
+
+		if (node_id >= 0)
+		{
+			memset(slots, 0, sizeof(slots));
+			slots[node_id] = snapshot_connect(node_id, pool_config->sr_check_database);
+			found = fetch_system_identifier(slots, node_id);
+			if (slots[node_id])
+				discard_persistent_db_connection(slots[node_id]);
+		}
+
+		if (!found)
+			ereport(ERROR,
+					(errmsg("memcache snapshot: could not get system identifier of main node %d", node_id)));
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, POOL_CACHE_SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = POOL_CACHE_SNAPSHOT_VERSION;
+	strlcpy(header.system_identifier, system_identifier, sizeof(header.system_identifier));
+	header.created = now = time(NULL);
+
+	/*
+	 * Copy the oid map and the cache items under the lock.  Each item is
+	 * stored as its query hash followed by the item itself, in the same
+	 * layout as the snapshot file.
+	 */
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_shmem_lock(POOL_MEMQ_SHARED_LOCK);
+
+	PG_TRY();
+	{
+		invalidations = oid_map_header->invalidations;
+		oids = palloc(sizeof(POOL_CACHE_SNAPSHOT_OID) * (oid_map_header->used_elements + 1));
+
+		for (i = 0; i < oid_map_header->nbuckets; i++)
+		{
+			int			index;
+
+			for (index = oid_map_header->buckets[i]; index != POOL_OID_MAP_NONE;
+				 index = oid_map_elements[index].next)
+			{
+				POOL_OID_MAP_ELEMENT *element = &oid_map_elements[index];
+				POOL_CACHE_SNAPSHOT_OID *o = &oids[header.num_oids];
+
+				if (!pool_oid_map_is_alive(element))
+					continue;
+
+				o->dboid = element->dboid;
+				o->tableoid = element->tableoid;
+				memcpy(&o->query_hash, &element->query_hash, sizeof(POOL_QUERY_HASH));
+				header.num_oids++;
+			}
+		}
+
+		/* Copy each cache item once even if it uses several tables */
+		qsort(oids, header.num_oids, sizeof(POOL_CACHE_SNAPSHOT_OID), snapshot_hash_cmp);
+		items = palloc(sizeof(char *) * (header.num_oids + 1));
+		for (i = 0; i < header.num_oids; i++)
+		{
+			POOL_CACHEID *c;
+			POOL_CACHE_ITEM_HEADER *cih;
+			char	   *item;
+
+			items[i] = NULL;
+			if (i > 0 && snapshot_hash_cmp(&oids[i - 1], &oids[i]) == 0)
+				continue;
+
+			c = pool_hash_search(&oids[i].query_hash);
+			if (c == NULL)
+				continue;
+			cih = item_header(block_address(c->blockid), c->itemid);
+			if (cih->expire > 0 && now > cih->timestamp + cih->expire)
+				continue;
+
+			item = palloc(sizeof(POOL_QUERY_HASH) + cih->total_length);
+			memcpy(item, &oids[i].query_hash, sizeof(POOL_QUERY_HASH));
+			memcpy(item + sizeof(POOL_QUERY_HASH), cih, cih->total_length);
+			items[i] = item;
+		}
+	}
+	PG_CATCH();
+	{
+		pool_shmem_unlock();
+		POOL_SETMASK(&oldmask);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	pool_shmem_unlock();
+	POOL_SETMASK(&oldmask);
+
+	snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+
+	PG_TRY();
+	{
+		fp = fopen(tmppath, "w");
+		if (fp == NULL)
+			ereport(ERROR,
+					(errmsg("memcache snapshot: could not open file \"%s\"", tmppath),
+					 errdetail("%m")));
+
+		fwrite(&header, sizeof(header), 1, fp);
+		fwrite(oids, sizeof(POOL_CACHE_SNAPSHOT_OID), header.num_oids, fp);
+
+		for (i = 0; i < header.num_oids; i++)
+		{
+			POOL_CACHE_ITEM_HEADER *cih;
+
+			if (items[i] == NULL)
+				continue;
+
+			cih = (POOL_CACHE_ITEM_HEADER *) (items[i] + sizeof(POOL_QUERY_HASH));
+			fwrite(items[i], sizeof(POOL_QUERY_HASH) + cih->total_length, 1, fp);
+			header.num_items++;
+			pfree(items[i]);
+		}
+		pfree(items);
+		pfree(oids);
+
+		/* Fill in the number of items */
+		if (fseek(fp, 0, SEEK_SET) == 0)
+			fwrite(&header, sizeof(header), 1, fp);
+
+		if (fflush(fp) != 0 || ferror(fp) || fsync(fileno(fp)) != 0)
+			ereport(ERROR,
+					(errmsg("memcache snapshot: could not write file \"%s\"", tmppath),
+					 errdetail("%m")));
+
+		fclose(fp);
+		fp = NULL;
+
+		if (rename(tmppath, path) != 0)
+			ereport(ERROR,
+					(errmsg("memcache snapshot: could not rename file \"%s\" to \"%s\"", tmppath, path),
+					 errdetail("%m")));
+	}
+	PG_CATCH();
+	{
+		if (fp)
+			fclose(fp);
+		unlink(tmppath);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	/*
+	 * If a cache invalidation happened while the file was being written,
+	 * the snapshot may contain stale items.  Remove it rather than loading
+	 * them at the next start up.
+	 */
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+	outdated = (oid_map_header->invalidations != invalidations);
+	if (outdated)
+		unlink(path);
+	else
+		oid_map_header->snapshot_saved = true;
+	pool_shmem_unlock();
+	POOL_SETMASK(&oldmask);
+
+	if (outdated)
+		ereport(LOG,
+				(errmsg("memcache snapshot: discarded snapshot \"%s\" because the query cache was invalidated while saving it", path)));
+	else
+		ereport(LOG,
+				(errmsg("memcache snapshot: saved %d cache items to \"%s\"", header.num_items, path)));
+}
+
+/*
+ * Load memqcache_snapshot_file into the shmem query cache. This should be
+ * called only once from pgpool main process at starting up time, before
+ * forking child processes. Since a missing snapshot only means a cold
+ * cache, failures are just logged.
+ */
+void
+pool_load_memqcache_snapshot(void)
+{
+	char	   *path = pool_config->memqcache_snapshot_file;
+	POOL_CONNECTION_POOL_SLOT *slots[MAX_NUM_BACKENDS];
+	POOL_CACHE_SNAPSHOT_HEADER header;
+	POOL_CACHE_SNAPSHOT_OID *oids = NULL;
+	char	   *data = NULL;
+	size_t		data_size = 0;
+	FILE	   *fp = NULL;
+	int			node_id = REAL_MAIN_NODE_ID;
+	int			num_loaded = 0;
+	int			num_dropped = 0;
+	time_t		now;
+	int			i;
+
+	if (!pool_config->memory_cache_enabled || !pool_is_shmem_cache() ||
+		*path == '\0' || node_id < 0)
+		return;
+
+	memset(slots, 0, sizeof(slots));
+	slots[node_id] = snapshot_connect(node_id, pool_config->sr_check_database);
+	if (!fetch_system_identifier(slots, node_id))
+	{
+		ereport(LOG,
+				(errmsg("memcache snapshot: could not get system identifier of main node %d", node_id),
+				 errdetail("query cache snapshot is not loaded")));
+		goto cleanup;
+	}
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+	{
+		if (errno != ENOENT)
+			ereport(LOG,
+					(errmsg("memcache snapshot: could not open file \"%s\"", path),
+					 errdetail("%m")));
+		goto cleanup;
+	}
+
+	if (fread(&header, sizeof(header), 1, fp) != 1 ||
+		memcmp(header.magic, POOL_CACHE_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != POOL_CACHE_SNAPSHOT_VERSION ||
+		header.num_oids < 0 || header.num_items < 0)
+	{
+		ereport(LOG,
+				(errmsg("memcache snapshot: invalid snapshot file \"%s\"", path)));
+		goto cleanup;
+	}
+
+	if (strncmp(header.system_identifier, system_identifier, sizeof(header.system_identifier)) != 0)
+	{
+		ereport(LOG,
+				(errmsg("memcache snapshot: snapshot file \"%s\" was taken on another database cluster", path),
+				 errdetail("system identifier of snapshot: %.*s main node: %s",
+						   (int) sizeof(header.system_identifier), header.system_identifier,
+						   system_identifier)));
+		goto cleanup;
+	}
+
+	oids = palloc(sizeof(POOL_CACHE_SNAPSHOT_OID) * (header.num_oids + 1));
+	if (fread(oids, sizeof(POOL_CACHE_SNAPSHOT_OID), header.num_oids, fp) != header.num_oids)
+	{
+		ereport(LOG,
+				(errmsg("memcache snapshot: invalid snapshot file \"%s\"", path)));
+		goto cleanup;
+	}
+
+	snapshot_validate_tables(slots, node_id, oids, header.num_oids);
+	qsort(oids, header.num_oids, sizeof(POOL_CACHE_SNAPSHOT_OID), snapshot_hash_cmp);
+
+	now = time(NULL);
+	pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+
+	for (i = 0; i < header.num_items; i++)
+	{
+		POOL_CACHE_SNAPSHOT_OID key;
+		POOL_CACHE_SNAPSHOT_OID *first;
+		POOL_CACHE_SNAPSHOT_OID *last;
+		POOL_CACHE_ITEM_HEADER cih;
+		POOL_CACHEID *cacheid;
+		size_t		size;
+		bool		valid = true;
+
+		if (fread(&key.query_hash, sizeof(POOL_QUERY_HASH), 1, fp) != 1 ||
+			fread(&cih, sizeof(cih), 1, fp) != 1 ||
+			cih.total_length <= sizeof(cih) || cih.total_length > MaxAllocSize)
+		{
+			ereport(LOG,
+					(errmsg("memcache snapshot: invalid snapshot file \"%s\"", path)));
+			break;
+		}
+
+		size = cih.total_length - sizeof(cih);
+		if (size > data_size)
+		{
+			if (data)
+				pfree(data);
+			data = palloc(size);
+			data_size = size;
+		}
+		if (fread(data, size, 1, fp) != 1)
+		{
+			ereport(LOG,
+					(errmsg("memcache snapshot: invalid snapshot file \"%s\"", path)));
+			break;
+		}
+
+		if (cih.expire > 0 && now > cih.timestamp + cih.expire)
+		{
+			num_dropped++;
+			continue;
+		}
+
+		/* All the tables used by the item must be still there */
+		first = bsearch(&key, oids, header.num_oids, sizeof(POOL_CACHE_SNAPSHOT_OID), snapshot_hash_cmp);
+		if (first == NULL)
+		{
+			num_dropped++;
+			continue;
+		}
+		while (first > oids && snapshot_hash_cmp(first - 1, &key) == 0)
+			first--;
+		for (last = first; last < oids + header.num_oids && snapshot_hash_cmp(last, &key) == 0; last++)
+		{
+			if (last->dboid == 0)
+				valid = false;
+		}
+		if (!valid)
+		{
+			num_dropped++;
+			continue;
+		}
+
+		cacheid = pool_add_item_shmem_cache(&key.query_hash, data, size, cih.expire);
+		if (cacheid == NULL)
+		{
+			num_dropped++;
+			continue;
+		}
+
+		/* Keep the creation time so that the item expires as before */
+		pool_cache_item_header(cacheid)->timestamp = cih.timestamp;
+
+		for (; first < last; first++)
+			pool_oid_map_add(first->dboid, first->tableoid, cacheid);
+		num_loaded++;
+	}
+
+	/*
+	 * The snapshot file is kept until any of the items is invalidated, so
+	 * that it can be loaded again if pgpool is restarted before that.
+	 */
+	oid_map_header->snapshot_saved = true;
+	pool_shmem_unlock();
+
+	ereport(LOG,
+			(errmsg("memcache snapshot: loaded %d cache items from \"%s\"", num_loaded, path),
+			 errdetail("%d cache items were dropped", num_dropped)));
+
+cleanup:
+	if (fp)
+		fclose(fp);
+	if (oids)
+		pfree(oids);
+	if (data)
+		pfree(data);
+	if (slots[node_id])
+		discard_persistent_db_connection(slots[node_id]);
+}
+
+/*
+ * Remove the snapshot file if it may contain cache items which have been
+ * invalidated. Caller must hold exclusive shmem lock.
+ */
+static void
+pool_discard_memqcache_snapshot(void)
+{
+	if (oid_map_header == NULL)
+		return;
+
+	oid_map_header->invalidations++;
+	if (!oid_map_header->snapshot_saved)
+		return;
+
+	oid_map_header->snapshot_saved = false;
+
+	if (unlink(pool_config->memqcache_snapshot_file) == -1 && errno != ENOENT)
+		ereport(LOG,
+				(errmsg("memcache snapshot: could not remove file \"%s\"",
+						pool_config->memqcache_snapshot_file),
+				 errdetail("%m")));
+	else
+		ereport(DEBUG1,
+				(errmsg("memcache snapshot: removed outdated snapshot file \"%s\"",
+						pool_config->memqcache_snapshot_file)));
+}
+
+/*
+ * Returns shared memory cache stats.
+ * Subsequent call to this function will break return value
+ * because its in static memory.
+ * Caller must hold shmem_lock before calling this function.
+ * If in memory query cache is not enabled, all stats are 0.
+ */
+POOL_SHMEM_STATS *
+pool_get_shmem_storage_stats(void)
+{
+	static POOL_SHMEM_STATS mystats;
+	POOL_HASH_ELEMENT *element;
+	int			nblocks;
+	int			i;
+
+	memset(&mystats, 0, sizeof(POOL_SHMEM_STATS));
+
+	if (!pool_config->memory_cache_enabled)
+		return &mystats;
+
+	/*
+	 * Copy cache hit data
+	 */
+	mystats.cache_stats.num_selects = stats->num_selects;
+	mystats.cache_stats.num_cache_hits = stats->num_cache_hits;
+	mystats.cache_stats.num_compressed_entries = stats->num_compressed_entries;
+	mystats.cache_stats.compressed_raw_size = stats->compressed_raw_size;
+	mystats.cache_stats.compressed_size = stats->compressed_size;
+	mystats.cache_stats.num_admission_rejects = stats->num_admission_rejects;
+
+	if (pool_config->memqcache_method != SHMEM_CACHE)
+		return &mystats;
+
+	/* number of total hash entries */
+	mystats.num_hash_entries = hash_header->nhash;
+
+	/* number of used hash entries */
+	for (i = 0; i < hash_header->nhash; i++)
+	{
+		element = hash_header->elements[i].element;
+		while (element)
+		{
+			mystats.used_hash_entries++;
+			element = element->next;
+		}
+	}
+
+	nblocks = pool_get_memqcache_blocks();
+
+	for (i = 0; i < nblocks; i++)
+	{
+		POOL_CACHE_BLOCK_HEADER *bh;
+		POOL_CACHE_ITEM_POINTER *cip;
 		char	   *p = block_address(i);
 
 		bh = (POOL_CACHE_BLOCK_HEADER *) p;
@@ -4419,6 +6030,12 @@ inject_cached_message(POOL_CONNECTION * backend, char *qcache, int qcachelen)
 	query_context = session_context->query_context;
 	msg = pool_pending_message_find_lastest_by_query_context(query_context);
 
+	/*
+	 * In extended query, 'T' is returned by the backend for Describe message
+	 * if the frontend asks for it.
+	 */
+	is_prepared_stmt = pool_is_doing_extended_query_message();
+
 	if (msg)
 	{
 		/*
@@ -4535,11 +6152,11 @@ InvalidateQueryCache(int tableoid, int dboid)
 	pool_sigset_t oldmask;
 
 	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_shmem_lock();
+	pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
 
 	/* Invalidate query cache */
 	pool_invalidate_query_cache(1, &tableoid, true, dboid);
 
-	pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
+	pool_shmem_unlock();
 	POOL_SETMASK(&oldmask);
 }
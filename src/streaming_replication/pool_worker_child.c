@@ -43,6 +43,8 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <poll.h>
+#include <time.h>
 
 #ifdef HAVE_CRYPT_H
 #include <crypt.h>
@@ -57,22 +59,50 @@
 #include "utils/pool_ip.h"
 #include "utils/ps_status.h"
 #include "utils/pool_stream.h"
+#include "utils/pool_ssl.h"
+#include "utils/statistics.h"
 
 #include "context/pool_process_context.h"
 #include "context/pool_session_context.h"
 #include "protocol/pool_process_query.h"
 #include "protocol/pool_pg_utils.h"
+#include "protocol/pool_proto_modules.h"
 #include "main/pool_internal_comms.h"
 #include "auth/md5.h"
 #include "auth/pool_hba.h"
 
+/*
+ * State of the replication lag queries sent to a node
+ */
+typedef struct
+{
+	int			nqueries;		/* number of queries sent */
+	int			nreceived;		/* number of queries completed */
+	bool		error;			/* current query got an error */
+	POOL_SELECT_RESULT *res[2];	/* results. NULL if failed */
+	char	   *buf;			/* data read but not processed yet */
+	int			buflen;			/* length of data in buf */
+	int			bufsize;		/* allocated size of buf */
+}			LagQueryState;
+
 static POOL_CONNECTION_POOL_SLOT * slots[MAX_NUM_BACKENDS];
 static volatile sig_atomic_t reload_config_request = 0;
 static volatile sig_atomic_t restart_request = 0;
 
+volatile SR_LAG_HISTORY *sr_lag_history = NULL;
+
 static void establish_persistent_connection(void);
 static void discard_persistent_connection(void);
-static void check_replication_time_lag(void);
+static void check_replication_time_lag(bool full);
+static void send_lag_queries(int node, LagQueryState *st, char *query1, char *query2);
+static void collect_lag_queries(LagQueryState *state);
+static void read_lag_query_messages(int node, LagQueryState *st);
+static void process_lag_query_message(int node, LagQueryState *st, char kind, char *p);
+static void fail_lag_queries(int node, LagQueryState *st, char *reason);
+static int64 lag_query_lsn(LagQueryState *st);
+static void record_standby_delay(int node, int64 primary_lsn, int64 standby_lsn);
+static int64 time_in_ms(void);
+static void worker_sleep(int64 next_full_check);
 static void CheckReplicationTimeLagErrorCb(void *arg);
 static unsigned long long int text_to_lsn(char *text);
 static RETSIGTYPE my_signal_handler(int sig);
@@ -104,6 +134,7 @@ do_worker_child(void)
 {
 	sigjmp_buf	local_sigjmp_buf;
 	MemoryContext WorkerMemoryContext;
+	static int64 next_full_check = 0;
 
 	ereport(DEBUG1,
 			(errmsg("I am %d", getpid())));
@@ -152,6 +183,8 @@ do_worker_child(void)
 
 	for (;;)
 	{
+		bool		full_check;
+
 		MemoryContextSwitchTo(WorkerMemoryContext);
 		MemoryContextResetAndDeleteChildren(WorkerMemoryContext);
 
@@ -168,32 +201,49 @@ do_worker_child(void)
 
 		if (pool_config->sr_check_period > 0 && STREAM)
 		{
-			establish_persistent_connection();
+			/*
+			 * Between the full checks, only the replication delay is checked
+			 * every sr_check_lag_interval.
+			 */
+			full_check = time_in_ms() >= next_full_check;
+			if (full_check)
+				next_full_check = time_in_ms() + pool_config->sr_check_period * 1000LL;
+
+			/*
+			 * Connections are (re)made by the full checks only, so that an
+			 * unreachable node does not block the delay only checks of the
+			 * other nodes.
+			 */
+			if (full_check)
+				establish_persistent_connection();
 			PG_TRY();
 			{
 				POOL_NODE_STATUS *node_status;
 				int			i;
 
 				/* Do replication time lag checking */
-				check_replication_time_lag();
+				check_replication_time_lag(full_check);
 
-				/* Check node status */
-				node_status = verify_backend_node_status(slots);
-				for (i = 0; i < NUM_BACKENDS; i++)
+				/* Check node status on full checks only */
+				if (full_check)
 				{
-					ereport(DEBUG1,
-							(errmsg("node status[%d]: %d", i, node_status[i])));
-
-					if (node_status[i] == POOL_NODE_STATUS_INVALID)
+					node_status = verify_backend_node_status(slots);
+					for (i = 0; i < NUM_BACKENDS; i++)
 					{
-						int			n;
+						ereport(DEBUG1,
+								(errmsg("node status[%d]: %d", i, node_status[i])));
 
-						ereport(LOG,
-								(errmsg("pgpool_worker_child: invalid node found %d", i)));
-						if (pool_config->detach_false_primary)
+						if (node_status[i] == POOL_NODE_STATUS_INVALID)
 						{
-							n = i;
-							degenerate_backend_set(&n, 1, REQ_DETAIL_SWITCHOVER | REQ_DETAIL_CONFIRMED);
+							int			n;
+
+							ereport(LOG,
+									(errmsg("pgpool_worker_child: invalid node found %d", i)));
+							if (pool_config->detach_false_primary)
+							{
+								n = i;
+								degenerate_backend_set(&n, 1, REQ_DETAIL_SWITCHOVER | REQ_DETAIL_CONFIRMED);
+							}
 						}
 					}
 				}
@@ -201,19 +251,49 @@ do_worker_child(void)
 			PG_CATCH();
 			{
 				discard_persistent_connection();
+				next_full_check = 0;
 				sleep(pool_config->sr_check_period);
 				PG_RE_THROW();
 			}
 			PG_END_TRY();
 
-			/* Discard persistent connections */
-			discard_persistent_connection();
+			/*
+			 * Discard persistent connections unless they are used by the
+			 * delay only checks until the next full check.
+			 */
+			if (full_check && pool_config->sr_check_lag_interval <= 0)
+				discard_persistent_connection();
 		}
-		sleep(pool_config->sr_check_period);
+		worker_sleep(next_full_check);
 	}
 	exit(0);
 }
 
+/*
+ * Sleep until the next check.  If sr_check_lag_interval is set, wake up
+ * every sr_check_lag_interval milliseconds but not later than the next full
+ * check.
+ */
+static void
+worker_sleep(int64 next_full_check)
+{
+	struct timespec ts;
+	int64		ms;
+
+	if (pool_config->sr_check_lag_interval <= 0 || pool_config->sr_check_period <= 0 || !STREAM)
+	{
+		sleep(pool_config->sr_check_period);
+		return;
+	}
+
+	ms = Min(pool_config->sr_check_lag_interval, next_full_check - time_in_ms());
+	if (ms <= 0)
+		return;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	nanosleep(&ts, NULL);
+}
+
 /*
  * Establish persistent connection to backend
  */
@@ -222,10 +302,17 @@ establish_persistent_connection(void)
 {
 	int			i;
 	BackendInfo *bkinfo;
+	MemoryContext oldContext;
 
 	char	   *password = get_pgpool_config_user_password(pool_config->sr_check_user,
 														   pool_config->sr_check_password);
 
+	/*
+	 * The connections are kept across the delay only checks, so they must
+	 * survive the reset of the per loop memory context.
+	 */
+	oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
 	for (i = 0; i < NUM_BACKENDS; i++)
 	{
 		if (!VALID_BACKEND(i))
@@ -242,6 +329,8 @@ establish_persistent_connection(void)
 		}
 	}
 
+	MemoryContextSwitchTo(oldContext);
+
 	if (password)
 		pfree(password);
 }
@@ -265,10 +354,13 @@ discard_persistent_connection(void)
 }
 
 /*
- * Check replication time lag
+ * Check replication time lag.  The WAL position queries are sent to all
+ * nodes at once and the answers are collected as they arrive, so a slow
+ * standby does not delay the others.  If "full" is true,
+ * pg_stat_replication is also queried on the primary.
  */
 static void
-check_replication_time_lag(void)
+check_replication_time_lag(bool full)
 {
 	/* backend server version cache */
 	static int	server_version[MAX_NUM_BACKENDS];
@@ -276,16 +368,15 @@ check_replication_time_lag(void)
 	int			i;
 	POOL_SELECT_RESULT *res;
 	POOL_SELECT_RESULT *res_rep;	/* query results of pg_stat_replication */
-	unsigned long long int lsn[MAX_NUM_BACKENDS];
+	LagQueryState state[MAX_NUM_BACKENDS];
 	char	   *query;
 	char	   *stat_rep_query;
 	BackendInfo *bkinfo;
-	unsigned long long int lag;
 	ErrorContextCallback callback;
 	int		active_standby_node;
 
 	/* clear replication state */
-	for (i = 0; i < NUM_BACKENDS; i++)
+	for (i = 0; full && i < NUM_BACKENDS; i++)
 	{
 		bkinfo = pool_get_node_info(i);
 
@@ -314,14 +405,20 @@ check_replication_time_lag(void)
 	error_context_stack = &callback;
 	stat_rep_query = NULL;
 	active_standby_node = 0;
+	memset(state, 0, sizeof(state));
 
 	for (i = 0; i < NUM_BACKENDS; i++)
 	{
-		lsn[i] = 0;
-
 		if (!VALID_BACKEND(i))
 			continue;
 
+		/*
+		 * A connection lost by a delay only check is made again by the next
+		 * full check.  Until then the delay of the node is unknown.
+		 */
+		if (!slots[i] && !full)
+			continue;
+
 		if (!slots[i])
 		{
 			ereport(ERROR,
@@ -355,7 +452,9 @@ check_replication_time_lag(void)
 			else
 				query = "SELECT pg_current_xlog_location()";
 
-			if (server_version[i] == PG91_SERVER_VERSION)
+			if (!full)
+				;
+			else if (server_version[i] == PG91_SERVER_VERSION)
 				stat_rep_query = "SELECT application_name, state, '' AS sync_state FROM pg_stat_replication";
 			else if (server_version[i] > PG91_SERVER_VERSION)
 				stat_rep_query = "SELECT application_name, state, sync_state FROM pg_stat_replication";
@@ -370,21 +469,29 @@ check_replication_time_lag(void)
 			active_standby_node++;
 		}
 
-		if (get_query_result(slots, i, query, &res) == 0 && res->nullflags[0] != -1)
-		{
-			lsn[i] = text_to_lsn(res->data[0]);
-			free_select_result(res);
-		}
+		send_lag_queries(i, &state[i], query, PRIMARY_NODE_ID == i ? stat_rep_query : NULL);
 	}
 
+	collect_lag_queries(state);
+
+	/* The primary is never behind itself */
+	pool_get_node_info(PRIMARY_NODE_ID)->standby_delay = 0;
+
 	/*
 	 * Call pg_stat_replication and fill the replication status.
 	 */
-	if (slots[PRIMARY_NODE_ID] && stat_rep_query != NULL)
+	if (stat_rep_query != NULL)
 	{
 		int		status;
 
-		status = get_query_result(slots, PRIMARY_NODE_ID, stat_rep_query, &res_rep);
+		res_rep = state[PRIMARY_NODE_ID].res[1];
+
+		if (res_rep == NULL)
+			status = -1;
+		else if (res_rep->numrows <= 0)
+			status = -2;
+		else
+			status = 0;
 
 		if (status == -1 || (status == -2 && active_standby_node > 0))
 		{
@@ -425,41 +532,422 @@ check_replication_time_lag(void)
 				}
 			}
 		}
-		if (status == 0)
-			free_select_result(res_rep);
 	}
 
 	for (i = 0; i < NUM_BACKENDS; i++)
 	{
-		if (!VALID_BACKEND(i))
-			continue;
+		free_select_result(state[i].res[0]);
+		free_select_result(state[i].res[1]);
+		if (state[i].buf)
+			pfree(state[i].buf);
+	}
 
-		/* Set standby delay value */
-		bkinfo = pool_get_node_info(i);
-		lag = (lsn[PRIMARY_NODE_ID] > lsn[i]) ? lsn[PRIMARY_NODE_ID] - lsn[i] : 0;
+	error_context_stack = callback.previous;
+}
 
-		if (PRIMARY_NODE_ID == i)
+/*
+ * Send the replication lag queries to the node without waiting for the
+ * results.  query2 may be NULL.
+ */
+static void
+send_lag_queries(int node, LagQueryState *st, char *query1, char *query2)
+{
+	char	   *queries[2];
+	int			i;
+	MemoryContext oldContext = CurrentMemoryContext;
+
+	queries[0] = query1;
+	queries[1] = query2;
+
+	PG_TRY();
+	{
+		for (i = 0; i < 2 && queries[i]; i++)
 		{
-			bkinfo->standby_delay = 0;
+			send_simplequery_message(slots[node]->con, strlen(queries[i]) + 1, queries[i], PROTO_MAJOR_V3);
+			st->res[i] = palloc0(sizeof(POOL_SELECT_RESULT));
+			st->res[i]->rowdesc = palloc0(sizeof(RowDesc));
+			st->nqueries++;
+		}
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(oldContext);
+		FlushErrorState();
+		fail_lag_queries(node, st, "sending query failed");
+	}
+	PG_END_TRY();
+}
+
+/*
+ * Wait for the results of the replication lag queries on all nodes.  Each
+ * node must answer within sr_check_period.  The delay of a standby is
+ * recorded as soon as both its WAL position and the primary's are known.
+ */
+static void
+collect_lag_queries(LagQueryState *state)
+{
+	struct pollfd pfds[MAX_NUM_BACKENDS];
+	int			pfd_nodes[MAX_NUM_BACKENDS];
+	bool		recorded[MAX_NUM_BACKENDS];
+	int64		deadline;
+	int			i;
+
+	deadline = time_in_ms() + pool_config->sr_check_period * 1000LL;
+	memset(recorded, 0, sizeof(recorded));
+
+	for (;;)
+	{
+		int			nfds = 0;
+		int			timeout;
+		bool		buffered = false;
+		int			rc;
+
+		/* record the delays which can be computed by now */
+		if (state[PRIMARY_NODE_ID].nqueries > 0 && state[PRIMARY_NODE_ID].nreceived > 0)
+		{
+			for (i = 0; i < NUM_BACKENDS; i++)
+			{
+				if (!recorded[i] && i != PRIMARY_NODE_ID &&
+					state[i].nqueries > 0 && state[i].nreceived > 0)
+				{
+					record_standby_delay(i, lag_query_lsn(&state[PRIMARY_NODE_ID]),
+										 lag_query_lsn(&state[i]));
+					recorded[i] = true;
+				}
+			}
+		}
+
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			if (state[i].nreceived >= state[i].nqueries)
+				continue;
+
+			/* data already read into the buffer can be processed at once */
+			if (slots[i]->con->len > 0 || pool_ssl_pending(slots[i]->con))
+				buffered = true;
+
+			pfds[nfds].fd = slots[i]->con->fd;
+			pfds[nfds].events = POLLIN;
+			pfds[nfds].revents = 0;
+			pfd_nodes[nfds++] = i;
+		}
+
+		timeout = buffered ? 0 : deadline - time_in_ms();
+		if (nfds == 0 || timeout < 0)
+			break;
+
+		rc = poll(pfds, nfds, timeout);
+		if (rc < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			ereport(LOG,
+					(errmsg("check replication time lag: poll() failed with error \"%m\"")));
+			break;
+		}
+
+		for (i = 0; i < nfds; i++)
+		{
+			int			node = pfd_nodes[i];
+			POOL_CONNECTION *con = slots[node]->con;
+			MemoryContext oldContext = CurrentMemoryContext;
+
+			if (pfds[i].revents == 0 && con->len == 0 && !pool_ssl_pending(con))
+				continue;
+
+			PG_TRY();
+			{
+				read_lag_query_messages(node, &state[node]);
+			}
+			PG_CATCH();
+			{
+				MemoryContextSwitchTo(oldContext);
+				FlushErrorState();
+				fail_lag_queries(node, &state[node], "reading result failed");
+			}
+			PG_END_TRY();
 		}
+	}
+
+	/* The nodes which did not answer in time */
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (state[i].nreceived < state[i].nqueries)
+			fail_lag_queries(i, &state[i], "timed out");
+	}
+
+	/* Standbys whose delay could not be measured */
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (!recorded[i] && i != PRIMARY_NODE_ID && VALID_BACKEND(i))
+			record_standby_delay(i, 0, -1);
+	}
+}
+
+/*
+ * Read the data available on the connection to the node without blocking,
+ * and process the complete messages of the lag query results in it.  An
+ * incomplete message is kept in the buffer until the rest arrives, so that a
+ * slow node does not stall the check of the other nodes.
+ */
+static void
+read_lag_query_messages(int node, LagQueryState *st)
+{
+	POOL_CONNECTION *con = slots[node]->con;
+	int			readlen;
+	int			len;
+
+	if (st->bufsize - st->buflen < READBUFSZ)
+	{
+		st->bufsize = st->buflen + READBUFSZ;
+		st->buf = st->buf ? repalloc(st->buf, st->bufsize) : palloc(st->bufsize);
+	}
+
+	if (con->len > 0)
+	{
+		/* data left in the connection buffer can be consumed at once */
+		readlen = Min(con->len, st->bufsize - st->buflen);
+		pool_read(con, st->buf + st->buflen, readlen);
+	}
+	else
+	{
+		if (con->ssl_active > 0)
+			readlen = pool_ssl_read(con, st->buf + st->buflen, st->bufsize - st->buflen);
 		else
+			readlen = read(con->fd, st->buf + st->buflen, st->bufsize - st->buflen);
+
+		if (readlen < 0)
 		{
-			bkinfo->standby_delay = lag;
+			if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+				return;
+			ereport(ERROR,
+					(errmsg("check replication time lag failed"),
+					 errdetail("read on socket failed with error \"%m\"")));
+		}
+		else if (readlen == 0)
+			ereport(ERROR,
+					(errmsg("check replication time lag failed"),
+					 errdetail("EOF read on socket")));
+
+		stat_count_bytes_in(node, readlen);
+	}
+	st->buflen += readlen;
+
+	/* Process the complete messages */
+	while (st->nreceived < st->nqueries && st->buflen >= 5)
+	{
+		char	   *msg = st->buf;
+
+		memcpy(&len, msg + 1, sizeof(len));
+		len = ntohl(len);
+		if (len < 4)
+			ereport(ERROR,
+					(errmsg("check replication time lag failed"),
+					 errdetail("invalid message length %d", len)));
+		if (st->buflen < len + 1)
+			break;
+
+		process_lag_query_message(node, st, msg[0], msg + 5);
+
+		st->buflen -= len + 1;
+		memmove(st->buf, st->buf + len + 1, st->buflen);
+	}
+}
+
+/*
+ * Process a message of the results of the replication lag queries
+ */
+static void
+process_lag_query_message(int node, LagQueryState *st, char kind, char *p)
+{
+	POOL_SELECT_RESULT *res = st->res[st->nreceived];
+	short		shortval;
+	int			num_fields;
+	int			i;
+
+	switch (kind)
+	{
+		case 'T':				/* Row Description */
+			memcpy(&shortval, p, sizeof(shortval));
+			num_fields = ntohs(shortval);
+			res->rowdesc->num_attrs = num_fields;
+			res->rowdesc->attrinfo = palloc0(sizeof(AttrInfo) * Max(num_fields, 1));
+			break;
+
+		case 'D':				/* Data Row */
+			num_fields = res->rowdesc->num_attrs;
+			res->data = res->data ?
+				repalloc(res->data, sizeof(char *) * num_fields * (res->numrows + 1)) :
+				palloc(sizeof(char *) * num_fields);
+			res->nullflags = res->nullflags ?
+				repalloc(res->nullflags, sizeof(int) * num_fields * (res->numrows + 1)) :
+				palloc(sizeof(int) * num_fields);
+			p += sizeof(shortval);
+			for (i = 0; i < num_fields; i++)
+			{
+				int			idx = res->numrows * num_fields + i;
+				int			flen;
+
+				memcpy(&flen, p, sizeof(flen));
+				flen = ntohl(flen);
+				p += sizeof(flen);
+
+				res->nullflags[idx] = flen;
+				if (flen < 0)
+					res->data[idx] = NULL;
+				else
+				{
+					res->data[idx] = palloc(flen + 1);
+					memcpy(res->data[idx], p, flen);
+					res->data[idx][flen] = '\0';
+					p += flen;
+				}
+			}
+			res->numrows++;
+			break;
+
+		case 'E':				/* Error Response */
+			ereport(LOG,
+					(errmsg("check replication time lag: query failed on node %d", node)));
+			st->error = true;
+			break;
 
-			/* Log delay if necessary */
-			if ((pool_config->log_standby_delay == LSD_ALWAYS && lag > 0) ||
-				(pool_config->delay_threshold &&
-				 pool_config->log_standby_delay == LSD_OVER_THRESHOLD &&
-				 lag > pool_config->delay_threshold))
+		case 'Z':				/* Ready for query */
+			if (st->error)
 			{
-				ereport(LOG,
-						(errmsg("Replication of node:%d is behind %llu bytes from the primary server (node:%d)",
-								i, lsn[PRIMARY_NODE_ID] - lsn[i], PRIMARY_NODE_ID)));
+				free_select_result(res);
+				st->res[st->nreceived] = NULL;
+				st->error = false;
 			}
+			st->nreceived++;
+			break;
+
+		default:
+			break;
+	}
+}
+
+/*
+ * Give up the replication lag queries on the node.  The connection is out of
+ * sync and is discarded.
+ */
+static void
+fail_lag_queries(int node, LagQueryState *st, char *reason)
+{
+	ereport(LOG,
+			(errmsg("check replication time lag: %s on node %d", reason, node)));
+
+	free_select_result(st->res[0]);
+	free_select_result(st->res[1]);
+	st->res[0] = st->res[1] = NULL;
+	st->nreceived = st->nqueries;
+
+	if (slots[node])
+	{
+		discard_persistent_db_connection(slots[node]);
+		slots[node] = NULL;
+	}
+}
+
+/*
+ * Returns the WAL position in the result of the first lag query, or -1
+ */
+static int64
+lag_query_lsn(LagQueryState *st)
+{
+	POOL_SELECT_RESULT *res = st->res[0];
+
+	if (res == NULL || res->numrows <= 0 || res->nullflags[0] == -1)
+		return -1;
+	return text_to_lsn(res->data[0]);
+}
+
+/*
+ * Set the standby delay of the node and add it to the lag history.  If
+ * either WAL position is unknown, the delay is recorded as unknown and the
+ * previous standby_delay is left as is.
+ */
+static void
+record_standby_delay(int node, int64 primary_lsn, int64 standby_lsn)
+{
+	BackendInfo *bkinfo = pool_get_node_info(node);
+	volatile SR_LAG_HISTORY *h = &sr_lag_history[node];
+	volatile SR_LAG_SAMPLE *sample;
+	int64		lag;
+
+	if (primary_lsn < 0 || standby_lsn < 0)
+		lag = -1;
+	else
+	{
+		lag = (primary_lsn > standby_lsn) ? primary_lsn - standby_lsn : 0;
+		bkinfo->standby_delay = lag;
+
+		/* Log delay if necessary */
+		if ((pool_config->log_standby_delay == LSD_ALWAYS && lag > 0) ||
+			(pool_config->delay_threshold &&
+			 pool_config->log_standby_delay == LSD_OVER_THRESHOLD &&
+			 lag > pool_config->delay_threshold))
+		{
+			ereport(LOG,
+					(errmsg("Replication of node:%d is behind " INT64_FORMAT " bytes from the primary server (node:%d)",
+							node, lag, PRIMARY_NODE_ID)));
 		}
 	}
 
-	error_context_stack = callback.previous;
+	sample = &h->samples[h->count % SR_LAG_HISTORY_SIZE];
+	sample->time = time_in_ms();
+	sample->lag = lag;
+	h->count++;
+}
+
+/*
+ * Returns true if the replication delay of the standby could not be measured
+ * in the last check.
+ */
+bool
+standby_delay_is_unknown(int node_id)
+{
+	volatile SR_LAG_HISTORY *h;
+
+	if (sr_lag_history == NULL || node_id == PRIMARY_NODE_ID)
+		return false;
+
+	h = &sr_lag_history[node_id];
+	if (h->count == 0)
+		return false;
+
+	return h->samples[(h->count - 1) % SR_LAG_HISTORY_SIZE].lag < 0;
+}
+
+/*
+ * Returns the byte size of replication lag history area
+ */
+size_t
+sr_lag_history_shared_memory_size(void)
+{
+	return MAXALIGN(sizeof(SR_LAG_HISTORY) * MAX_NUM_BACKENDS);
+}
+
+/*
+ * Initialize replication lag history area
+ */
+void
+sr_lag_history_init(SR_LAG_HISTORY *addr)
+{
+	sr_lag_history = addr;
+	memset((void *) sr_lag_history, 0, sr_lag_history_shared_memory_size());
+}
+
+/*
+ * Returns current time in milliseconds
+ */
+static int64
+time_in_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (int64) tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
 static void
@@ -0,0 +1,104 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for failover_keep_sessions.
+#
+# Detach a standby node while sessions are open, and make sure that the
+# sessions survive.  The detached standby is made node 0 so that it is
+# the main node of the child processes, which used to crash them when
+# they ran the next query.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+PG_CTL=$PGBIN/pg_ctl
+export PGDATABASE=test
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+echo "failover_keep_sessions = on" >> etc/pgpool.conf
+
+./startall
+
+export PGPORT=$PGPOOL_PORT
+
+wait_for_pgpool_startup
+
+# make node 1 the primary and node 0 a standby
+$PG_CTL -D data0 -m f stop
+wait_for_pgpool_startup
+$PGPOOL_INSTALL_DIR/bin/pcp_recovery_node -w -h localhost -p $PCP_PORT -n 0
+wait_for_pgpool_startup
+
+$PSQL -c "show pool_nodes" postgres > show_pool_nodes
+primary_node=`grep primary show_pool_nodes|awk '{print $1}'`
+if [ "$primary_node" != 1 ];then
+	echo "primary node is not 1"
+	./shutdownall
+	exit 1
+fi
+
+# open sessions and detach the standby while they are idle
+for i in 1 2 3 4
+do
+	$PSQL > session$i.out 2>&1 <<EOF2 &
+SELECT 1 AS before_detach;
+SELECT pg_sleep(5);
+SELECT 2 AS after_detach;
+EOF2
+done
+
+sleep 2
+$PGPOOL_INSTALL_DIR/bin/pcp_detach_node -w -h localhost -p $PCP_PORT -n 0
+if [ $? != 0 ];then
+	echo "pcp_detach_node failed"
+	./shutdownall
+	exit 1
+fi
+
+wait
+
+for i in 1 2 3 4
+do
+	grep after_detach session$i.out > /dev/null
+	if [ $? != 0 ];then
+		echo "session $i did not survive the detach"
+		cat session$i.out
+		./shutdownall
+		exit 1
+	fi
+done
+
+grep "Do not restart children because we are failing over standby node id 0" log/pgpool.log > /dev/null
+if [ $? != 0 ];then
+	echo "children were restarted"
+	./shutdownall
+	exit 1
+fi
+
+grep "terminated by segmentation fault" log/pgpool.log > /dev/null
+if [ $? = 0 ];then
+	echo "child process crashed"
+	./shutdownall
+	exit 1
+fi
+
+# new sessions must work too
+$PSQL -c "SELECT 3" > /dev/null
+if [ $? != 0 ];then
+	echo "new session failed"
+	./shutdownall
+	exit 1
+fi
+
+./shutdownall
+
+exit 0
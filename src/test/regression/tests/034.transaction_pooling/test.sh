@@ -0,0 +1,140 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for transaction_pooling.
+#
+# Two sessions of one child process share a single backend connection.
+# The second session must be able to run its query while the first one
+# is idle between transactions, unless the first one has changed the
+# state of the backend session, including session level advisory locks.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+export PGDATABASE=test
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m n -n 1 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+echo "num_init_children = 1" >> etc/pgpool.conf
+echo "sessions_per_child = 4" >> etc/pgpool.conf
+echo "max_pool = 1" >> etc/pgpool.conf
+echo "transaction_pooling = on" >> etc/pgpool.conf
+
+./startall
+
+export PGPORT=$PGPOOL_PORT
+
+wait_for_pgpool_startup
+
+# run_sessions name statements
+#
+# The first session runs the statements and stays idle for a while.  The
+# second session connects meanwhile and runs a query.  Prints "shared" if
+# the second session got the connection while the first one was idle.
+function run_sessions
+{
+	rm -f second_done
+	$PSQL -t -A > $1-first.out 2>&1 <<EOF2 &
+SELECT pg_backend_pid();
+$2
+\! sleep 4
+\! test -f second_done && echo shared
+SELECT pg_backend_pid();
+EOF2
+	sleep 2
+	$PSQL -t -A > $1-second.out 2>&1 <<EOF2 &
+SELECT pg_backend_pid();
+\! touch second_done
+EOF2
+	wait
+}
+
+# check_sessions name expected
+function check_sessions
+{
+	grep shared $1-first.out > /dev/null
+	if [ $? = 0 ];then
+		result=shared
+	else
+		result=kept
+	fi
+	if [ $result != $2 ];then
+		echo "$1: connection was $result, expected $2"
+		cat $1-first.out $1-second.out
+		./shutdownall
+		exit 1
+	fi
+	echo "$1: ok"
+}
+
+# idle sessions share the connection
+run_sessions idle ""
+check_sessions idle shared
+
+pids=`cat idle-first.out idle-second.out | grep -E "^[0-9]+$" | sort -u | wc -l`
+if [ $pids != 1 ];then
+	echo "sessions did not use the same backend connection"
+	cat idle-first.out idle-second.out
+	./shutdownall
+	exit 1
+fi
+
+# transactions release the connection at commit
+run_sessions transaction "BEGIN; SELECT 1; COMMIT;"
+check_sessions transaction shared
+
+# SET LOCAL does not outlive the transaction
+run_sessions set_local "BEGIN; SET LOCAL work_mem TO '8MB'; COMMIT;"
+check_sessions set_local shared
+
+# SET keeps the connection
+run_sessions set "SET work_mem TO '8MB';"
+check_sessions set kept
+
+# until RESET ALL
+run_sessions reset_all "SET work_mem TO '8MB'; RESET ALL;"
+check_sessions reset_all shared
+
+# a reported parameter changed by set_config() keeps the connection
+run_sessions set_config "SELECT set_config('TimeZone', 'Asia/Tokyo', false);"
+check_sessions set_config kept
+
+# until it is changed back to the start up value
+tz=`$PSQL -t -A -c "SHOW TimeZone"`
+run_sessions set_config_back "SELECT set_config('TimeZone', 'Asia/Tokyo', false); SELECT set_config('TimeZone', '$tz', false);"
+check_sessions set_config_back shared
+
+# LISTEN keeps the connection even after RESET ALL
+run_sessions listen "LISTEN foo; RESET ALL;"
+check_sessions listen kept
+
+# until DISCARD ALL
+run_sessions discard_all "LISTEN foo; DISCARD ALL;"
+check_sessions discard_all shared
+
+# a session level advisory lock keeps the connection
+run_sessions advisory_lock "SELECT pg_advisory_lock(1);"
+check_sessions advisory_lock kept
+
+run_sessions try_advisory_lock "SELECT pg_try_advisory_lock_shared(2);"
+check_sessions try_advisory_lock kept
+
+# until DISCARD ALL
+run_sessions advisory_discard_all "SELECT pg_advisory_lock(3); DISCARD ALL;"
+check_sessions advisory_discard_all shared
+
+# a transaction level advisory lock does not
+run_sessions advisory_xact_lock "BEGIN; SELECT pg_advisory_xact_lock(4); COMMIT;"
+check_sessions advisory_xact_lock shared
+
+./shutdownall
+
+exit 0
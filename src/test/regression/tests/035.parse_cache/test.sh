@@ -0,0 +1,63 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for parse_cache_size.
+#
+# The parse tree of the same query string differs by
+# standard_conforming_strings.  Run the same INSERT, which is rewritten
+# from its parse tree in native replication mode, in two sessions of one
+# child process with standard_conforming_strings on and off.  The second
+# session must not use the parse tree cached by the first one.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+export PGDATABASE=test
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m r -n 2 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+echo "num_init_children = 1" >> etc/pgpool.conf
+echo "parse_cache_size = 16" >> etc/pgpool.conf
+
+./startall
+
+export PGPORT=$PGPOOL_PORT
+
+wait_for_pgpool_startup
+
+$PSQL <<EOF
+CREATE TABLE t1(s text, t timestamptz);
+EOF
+
+# first session, standard_conforming_strings = on
+$PSQL <<'EOF'
+SET standard_conforming_strings TO on;
+INSERT INTO t1 VALUES('a\\b', now());
+EOF
+
+# second session, standard_conforming_strings = off
+$PSQL <<'EOF'
+SET standard_conforming_strings TO off;
+SET escape_string_warning TO off;
+INSERT INTO t1 VALUES('a\\b', now());
+EOF
+
+# 'a\\b' is a\\b with standard_conforming_strings on, a\b with off
+result=`$PSQL -t -A -c "SELECT string_agg(length(s)::text, ',' ORDER BY length(s)) FROM t1"`
+if [ "$result" != "3,4" ];then
+	echo "lengths of inserted strings are $result, expected 3,4"
+	./shutdownall
+	exit 1
+fi
+
+./shutdownall
+
+exit 0
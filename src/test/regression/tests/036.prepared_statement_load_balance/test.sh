@@ -0,0 +1,90 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for statement level load balancing of named statements.
+#
+# With statement_level_load_balance, each Bind of a named SELECT
+# statement chooses the load balance node again, and the statement is
+# parsed on a node just before the first Bind sent to it.  Check that:
+#
+# - the Binds of one statement are sent to both nodes
+# - the statement is parsed at most once on each node
+# - Close and SQL DEALLOCATE of the statement are sent to all the nodes
+#   it has been parsed on
+#
+source $TESTLIBS
+TESTDIR=testdir
+PGPROTO=$PGPOOL_INSTALL_DIR/bin/pgproto
+export PGDATABASE=test
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+echo "statement_level_load_balance = on" >> etc/pgpool.conf
+echo "backend_weight0 = 1" >> etc/pgpool.conf
+echo "backend_weight1 = 1" >> etc/pgpool.conf
+
+./startall
+
+export PGPORT=$PGPOOL_PORT
+
+wait_for_pgpool_startup
+
+# check_statement statement query last_command
+check_statement()
+{
+	for node in 0 1
+	do
+		binds=`grep "DB node id: $node .*Bind: $2" log/pgpool.log | wc -l`
+		if [ $binds -eq 0 ];then
+			echo "no Bind of $1 was sent to node $node"
+			return 1
+		fi
+
+		parses=`grep "DB node id: $node .*Parse: $2" log/pgpool.log | wc -l`
+		if [ $parses -ne 1 ];then
+			echo "$1 was parsed $parses times on node $node"
+			return 1
+		fi
+
+		grep "DB node id: $node .*statement: $3" log/pgpool.log > /dev/null
+		if [ $? -ne 0 ];then
+			echo "$3 was not sent to node $node"
+			return 1
+		fi
+	done
+	return 0
+}
+
+ok=true
+
+# Close message
+timeout 60 $PGPROTO -d $PGDATABASE -p $PGPOOL_PORT -f ../close.data
+if [ $? -ne 0 ];then
+	echo "pgproto for close failed"
+	ok=false
+fi
+check_statement s1 "SELECT 1" "C message" || ok=false
+
+# SQL DEALLOCATE
+timeout 60 $PGPROTO -d $PGDATABASE -p $PGPOOL_PORT -f ../deallocate.data
+if [ $? -ne 0 ];then
+	echo "pgproto for deallocate failed"
+	ok=false
+fi
+check_statement s2 "SELECT 2" "DEALLOCATE s2" || ok=false
+
+./shutdownall
+
+if [ $ok != "true" ];then
+	exit 1
+fi
+
+exit 0
@@ -0,0 +1,82 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for query cache of prepared statements.
+#
+# Execute a named statement with different bind values and check that
+# each bind value gets its own cache entry, and that an Execute with a
+# row limit is neither served from nor stored into the cache.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+PGPROTO=$PGPOOL_INSTALL_DIR/bin/pgproto
+export PGDATABASE=test
+
+for mode in s r
+do
+	rm -fr $TESTDIR
+	mkdir $TESTDIR
+	cd $TESTDIR
+
+	# create test environment
+	echo -n "creating test environment..."
+	$PGPOOL_SETUP -m $mode -n 2 || exit 1
+	echo "done."
+
+	source ./bashrc.ports
+
+	echo "memory_cache_enabled = on" >> etc/pgpool.conf
+
+	./startall
+
+	export PGPORT=$PGPOOL_PORT
+
+	wait_for_pgpool_startup
+
+	$PSQL <<EOF
+CREATE TABLE t1(i int);
+INSERT INTO t1 VALUES(1),(2);
+EOF
+	# wait for the table to be replicated
+	sleep 1
+
+	timeout 60 $PGPROTO -d $PGDATABASE -p $PGPOOL_PORT -f ../bind.data > result.txt 2>&1
+	if [ $? -ne 0 ];then
+		echo "pgproto failed in mode $mode"
+		./shutdownall
+		exit 1
+	fi
+
+	# the rows returned by each Execute
+	grep "CommandComplete\|PortalSuspended" result.txt | sed 's/.*<= BE //' > results
+	cat > expected <<EOF
+CommandComplete(SELECT 1)
+CommandComplete(SELECT 2)
+CommandComplete(SELECT 1)
+CommandComplete(SELECT 2)
+PortalSuspended
+PortalSuspended
+CommandComplete(SELECT 2)
+CommandComplete(SELECT 2)
+EOF
+	cmp expected results
+	if [ $? -ne 0 ];then
+		echo "unexpected results in mode $mode"
+		diff expected results
+		./shutdownall
+		exit 1
+	fi
+
+	hits=`grep "query result fetched from cache" log/pgpool.log | wc -l`
+	if [ $hits -ne 3 ];then
+		echo "$hits results are fetched from cache in mode $mode, expected 3"
+		./shutdownall
+		exit 1
+	fi
+
+	./shutdownall
+
+	cd ..
+done
+
+exit 0
@@ -0,0 +1,127 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for memqcache with multiple memcached servers.
+# need to configure --with-memcached=/usr.
+# requires memcached command.
+#
+# Start two memcached servers and check that the cache entries are
+# distributed over both of them, and that with
+# memqcache_memcached_pipelining stores and invalidations are flushed to
+# the servers.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+export PGDATABASE=test
+MEMCACHED=memcached
+MEMCACHED_PORT0=11311
+MEMCACHED_PORT1=11312
+NUM_QUERIES=40
+
+# memcached_items port
+# print number of items stored in the memcached server
+function memcached_items
+{
+	timeout 5 bash -c "exec 3<>/dev/tcp/127.0.0.1/$1; printf 'stats\r\nquit\r\n' >&3; cat <&3" |
+		tr -d '\r' | awk '$2 == "curr_items" {print $3}'
+}
+
+# run_queries
+# run NUM_QUERIES different SELECTs
+function run_queries
+{
+	for i in `seq 1 $NUM_QUERIES`
+	do
+		echo "SELECT * FROM t1 WHERE i = $i;"
+	done | $PSQL > /dev/null
+}
+
+function cache_hits
+{
+	grep "query result fetched from cache" log/pgpool.log | wc -l
+}
+
+function stop_memcached
+{
+	for port in $MEMCACHED_PORT0 $MEMCACHED_PORT1
+	do
+		test -f memcached.$port.pid && kill `cat memcached.$port.pid`
+	done
+}
+
+function fail
+{
+	echo "$1"
+	./shutdownall
+	stop_memcached
+	exit 1
+}
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+for port in $MEMCACHED_PORT0 $MEMCACHED_PORT1
+do
+	$MEMCACHED -d -l 127.0.0.1 -p $port -U 0 -P $PWD/memcached.$port.pid || exit 1
+done
+
+echo "memory_cache_enabled = on" >> etc/pgpool.conf
+echo "memqcache_method = 'memcached'" >> etc/pgpool.conf
+echo "memqcache_memcached_host = '127.0.0.1:$MEMCACHED_PORT0, 127.0.0.1:$MEMCACHED_PORT1'" >> etc/pgpool.conf
+echo "memqcache_memcached_pipelining = on" >> etc/pgpool.conf
+
+./startall
+
+export PGPORT=$PGPOOL_PORT
+
+wait_for_pgpool_startup
+
+$PSQL <<EOF
+CREATE TABLE t1 (i int);
+INSERT INTO t1 SELECT generate_series(1, $NUM_QUERIES);
+SELECT pg_sleep(2);	-- Sleep for a while to make sure object creations are replicated
+EOF
+
+# store the results, then fetch them from the cache
+run_queries
+run_queries
+
+hits=`cache_hits`
+if [ $hits -ne $NUM_QUERIES ];then
+	fail "$hits results are fetched from cache, expected $NUM_QUERIES"
+fi
+
+# the entries are distributed over the servers
+items0=`memcached_items $MEMCACHED_PORT0`
+items1=`memcached_items $MEMCACHED_PORT1`
+echo "items in memcached: $items0 $items1"
+if [ -z "$items0" -o -z "$items1" ];then
+	fail "could not get stats from memcached"
+fi
+if [ $items0 -eq 0 -o $items1 -eq 0 ];then
+	fail "cache entries are not distributed over memcached servers"
+fi
+
+# invalidate the cache entries of t1
+$PSQL -c "INSERT INTO t1 VALUES(0)"
+
+# none of the results are fetched from cache
+run_queries
+
+hits=`cache_hits`
+if [ $hits -ne $NUM_QUERIES ];then
+	fail "results are fetched from cache after invalidation"
+fi
+
+./shutdownall
+stop_memcached
+
+exit 0
@@ -0,0 +1,65 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for connection pool reuse and eviction.
+#
+# With one child process and max_pool = 2, connect to three databases
+# in turn and check by SHOW pool_pools that connections are reused, that
+# the least recently used one is discarded to make room, and that the
+# pool_hits and pool_misses columns count them.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m n -n 1 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+echo "num_init_children = 1" >> etc/pgpool.conf
+echo "max_pool = 2" >> etc/pgpool.conf
+
+./startall
+
+export PGPORT=$PGPOOL_PORT
+
+# connects to "test" database, which creates the first pool
+wait_for_pgpool_startup
+
+# reuse the first pool.  Connections to postgres and template1
+# databases are not cached, so use databases of our own.
+$PSQL test <<EOF
+CREATE DATABASE test2;
+CREATE DATABASE test3;
+EOF
+# create the second pool
+$PSQL -c "SELECT 1" test2 > /dev/null
+# discard the first pool, which is least recently used
+$PSQL -c "SELECT 1" test3 > /dev/null
+
+# reuse the second pool and show the pools.
+# print pool_id, database, pool_hits and pool_misses.
+$PSQL -t -A -F, -c "SHOW pool_pools" test2 | awk -F, '{print $3, $5, $13, $14}' > result.txt
+
+cat > expected.txt <<EOF
+0 test3 1 2
+1 test2 1 1
+EOF
+
+cmp expected.txt result.txt
+if [ $? -ne 0 ];then
+	echo "unexpected SHOW pool_pools result"
+	diff expected.txt result.txt
+	./shutdownall
+	exit 1
+fi
+
+./shutdownall
+
+exit 0
@@ -0,0 +1,103 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for query cache admission policy.
+#
+# Check that with memqcache_admission_min_count a result is cached after
+# the query has been executed the number of times, and that with
+# memqcache_admission_min_duration only the result of a slow query is
+# cached.  The rejected results are counted in num_admission_rejects
+# column of SHOW pool_cache.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+export PGDATABASE=test
+
+# cache_hits table
+# print number of results of the table fetched from cache
+function cache_hits
+{
+	grep "query result fetched from cache" log/pgpool.log | grep "$1" | wc -l
+}
+
+function fail
+{
+	echo "$1"
+	./shutdownall
+	exit 1
+}
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+echo "memory_cache_enabled = on" >> etc/pgpool.conf
+echo "memqcache_admission_min_count = 3" >> etc/pgpool.conf
+
+./startall
+
+export PGPORT=$PGPOOL_PORT
+
+wait_for_pgpool_startup
+
+$PSQL <<EOF
+CREATE TABLE t1 (i int);
+CREATE TABLE t2 (i int);
+CREATE FUNCTION slow_func(INTEGER) returns INTEGER AS 'SELECT \$1 FROM pg_sleep(1)' LANGUAGE SQL IMMUTABLE;
+SELECT pg_sleep(2);	-- Sleep for a while to make sure object creations are replicated
+EOF
+
+# the result is cached by the third execution
+$PSQL <<EOF
+SELECT * FROM t1;
+SELECT * FROM t1;
+SELECT * FROM t1;
+SELECT * FROM t1;
+SELECT * FROM t1;
+EOF
+
+hits=`cache_hits t1`
+if [ $hits -ne 2 ];then
+	fail "$hits results of t1 are fetched from cache, expected 2"
+fi
+
+echo "memqcache_admission_min_count = 0" >> etc/pgpool.conf
+echo "memqcache_admission_min_duration = 500" >> etc/pgpool.conf
+./pgpool_reload
+sleep 1
+
+# results of fast queries are not cached, while slow ones are
+$PSQL <<EOF
+SELECT * FROM t2;
+SELECT * FROM t2;
+SELECT * FROM t2;
+SELECT slow_func(1);
+SELECT slow_func(1);
+EOF
+
+hits=`cache_hits t2`
+if [ $hits -ne 0 ];then
+	fail "$hits results of t2 are fetched from cache, expected 0"
+fi
+
+hits=`cache_hits slow_func`
+if [ $hits -ne 1 ];then
+	fail "$hits results of slow_func are fetched from cache, expected 1"
+fi
+
+# 2 executions of t1 and 3 executions of t2 are rejected
+rejects=`$PSQL -t -A -F, -c "SHOW pool_cache" | awk -F, '{print $12}'`
+if [ "$rejects" != "5" ];then
+	fail "num_admission_rejects is $rejects, expected 5"
+fi
+
+./shutdownall
+
+exit 0
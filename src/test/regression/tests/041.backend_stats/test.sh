@@ -0,0 +1,116 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for per node statistics.
+#
+# Run queries on the primary node and check the bytes_in, bytes_out and
+# latency columns of SHOW pool_backend_stats, and that pcp_backend_stats
+# shows the same counters.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+export PGDATABASE=test
+
+# backend_stats
+# print SHOW pool_backend_stats result of node 0, separated by commas
+function backend_stats
+{
+	$PSQL -t -A -F, -c "SHOW pool_backend_stats" | awk -F, '$1 == 0'
+}
+
+function fail
+{
+	echo "$1"
+	./shutdownall
+	exit 1
+}
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+# send all queries to the primary node
+echo "backend_weight1 = 0" >> etc/pgpool.conf
+
+./startall
+
+export PGPORT=$PGPOOL_PORT
+
+wait_for_pgpool_startup
+
+$PSQL -c "CREATE TABLE t1 (i int)"
+
+before=`backend_stats`
+echo "before: $before"
+
+$PSQL <<EOF
+INSERT INTO t1 VALUES(1);
+INSERT INTO t1 VALUES(2);
+INSERT INTO t1 VALUES(3);
+SELECT * FROM t1;
+SELECT * FROM t1;
+SELECT pg_sleep(1);
+EOF
+
+after=`backend_stats`
+echo "after: $after"
+
+# column numbers of SHOW pool_backend_stats
+SELECT_CNT=6
+INSERT_CNT=7
+BYTES_IN=15
+BYTES_OUT=16
+SELECT_P99=20
+
+# stat_diff column
+# print increase of the column
+function stat_diff
+{
+	echo "$before $after" | awk -v col=$1 '{split($1, b, ","); split($2, a, ","); print a[col] - b[col]}'
+}
+
+n=`stat_diff $SELECT_CNT`
+if [ $n -ne 3 ];then
+	fail "select_cnt increased by $n, expected 3"
+fi
+
+n=`stat_diff $INSERT_CNT`
+if [ $n -ne 3 ];then
+	fail "insert_cnt increased by $n, expected 3"
+fi
+
+for col in $BYTES_IN $BYTES_OUT
+do
+	n=`stat_diff $col`
+	if [ $n -le 0 ];then
+		fail "column $col of SHOW pool_backend_stats did not increase"
+	fi
+done
+
+# pg_sleep(1) takes at least 1000 milliseconds
+p99=`echo "$after" | awk -F, -v col=$SELECT_P99 '{print $col}'`
+if [ `echo "$p99" | awk '{print ($1 >= 1000)}'` -ne 1 ];then
+	fail "select_p99 is $p99, expected at least 1000"
+fi
+
+# pcp_backend_stats shows the same counters.  Compare the columns up to
+# error_cnt, which are not changed by the connection reset queries.
+pcp=`$PGPOOL_INSTALL_DIR/bin/pcp_backend_stats -w -h localhost -p $PCP_PORT 0`
+echo "pcp_backend_stats: $pcp"
+show=`backend_stats`
+result=`echo "$pcp" | awk '{for (i = 6; i <= 10; i++) printf "%s ", $i}'`
+expected=`echo "$show" | awk -F, '{for (i = 6; i <= 10; i++) printf "%s ", $i}'`
+if [ "$result" != "$expected" ];then
+	fail "pcp_backend_stats shows \"$result\", expected \"$expected\""
+fi
+
+./shutdownall
+
+exit 0
@@ -0,0 +1,67 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for latency aware load balance policies.
+#
+# With statement_level_load_balance, run a slow query which is load
+# balanced to one of the nodes.  Then with ewma_latency and
+# power_of_two_choices policies, following fast queries must be sent to
+# the other node, whose latency is lower.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+export PGDATABASE=test
+NUM_QUERIES=10
+
+for policy in ewma_latency power_of_two_choices
+do
+	rm -fr $TESTDIR
+	mkdir $TESTDIR
+	cd $TESTDIR
+
+	# create test environment
+	echo -n "creating test environment..."
+	$PGPOOL_SETUP -m s -n 2 || exit 1
+	echo "done."
+
+	source ./bashrc.ports
+
+	echo "load_balance_policy = '$policy'" >> etc/pgpool.conf
+	echo "statement_level_load_balance = on" >> etc/pgpool.conf
+	echo "log_per_node_statement = on" >> etc/pgpool.conf
+
+	./startall
+
+	export PGPORT=$PGPOOL_PORT
+
+	wait_for_pgpool_startup
+
+	(
+		echo "SELECT pg_sleep(1);"
+		for i in `seq 1 $NUM_QUERIES`
+		do
+			echo "SELECT 'fast query';"
+		done
+	) | $PSQL > /dev/null
+
+	slow_node=`grep "statement: SELECT pg_sleep(1)" log/pgpool.log | sed 's/.*DB node id: \([0-9]\).*/\1/'`
+	if [ "$slow_node" = 0 ];then
+		fast_node=1
+	else
+		fast_node=0
+	fi
+
+	n=`grep "DB node id: $fast_node .*statement: SELECT 'fast query'" log/pgpool.log | wc -l`
+	echo "$policy: slow query was sent to node $slow_node, $n fast queries were sent to node $fast_node"
+	if [ $n -ne $NUM_QUERIES ];then
+		echo "fast queries are not sent to node $fast_node with $policy"
+		./shutdownall
+		exit 1
+	fi
+
+	./shutdownall
+
+	cd ..
+done
+
+exit 0
@@ -0,0 +1,134 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for spare_children and child_respawn_rate.
+#
+# Check that a child process exited is replaced by a spare child forked
+# in advance, and that with child_respawn_rate children killed at once
+# are forked again gradually.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+export PGDATABASE=test
+
+# proc_count
+# print pids of the child processes, one per line.  0 means that the
+# process slot is waiting for a new child.
+function proc_count
+{
+	$PGPOOL_INSTALL_DIR/bin/pcp_proc_count -w -h localhost -p $PCP_PORT | tr ' ' '\n' | grep -v '^$'
+}
+
+function fail
+{
+	echo "$1"
+	./shutdownall
+	exit 1
+}
+
+#
+# spare_children
+#
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 1 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+echo "num_init_children = 2" >> etc/pgpool.conf
+echo "child_max_connections = 1" >> etc/pgpool.conf
+echo "spare_children = 2" >> etc/pgpool.conf
+
+./startall
+
+export PGPORT=$PGPOOL_PORT
+
+wait_for_pgpool_startup
+
+# wait for the child used by wait_for_pgpool_startup to be replaced
+sleep 1
+
+proc_count | sort > children_before
+main_pid=`ps -o ppid= -p \`head -1 children_before\` | tr -d ' '`
+ps -o pid= --ppid $main_pid | tr -d ' ' | sort > processes_before
+
+# the child exits after this session because of child_max_connections
+$PSQL -c "SELECT 1" > /dev/null
+sleep 1
+
+proc_count | sort > children_after
+new_pid=`comm -13 children_before children_after`
+echo "new child: $new_pid"
+if [ `echo "$new_pid" | wc -w` -ne 1 ];then
+	fail "exited child was not replaced"
+fi
+
+# the new child must have been forked before the session
+grep -qx "$new_pid" processes_before
+if [ $? -ne 0 ];then
+	fail "exited child was not replaced by a spare child"
+fi
+
+# the spare child accepts connections in the slot
+$PSQL -c "SELECT 1" > /dev/null || fail "could not connect to the spare child"
+
+./shutdownall
+cd ..
+
+#
+# child_respawn_rate
+#
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 1 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+echo "num_init_children = 4" >> etc/pgpool.conf
+echo "child_respawn_rate = 1" >> etc/pgpool.conf
+
+./startall
+
+export PGPORT=$PGPOOL_PORT
+
+wait_for_pgpool_startup
+
+# kill all children at once
+kill -9 `proc_count`
+
+# some of the children are not forked immediately
+sleep 1
+grep -q "exited and will be restarted later" log/pgpool.log
+if [ $? -ne 0 ];then
+	fail "children were not restarted later"
+fi
+
+# all of the children are forked again in a few seconds
+for i in `seq 1 10`
+do
+	pending=`proc_count | grep -cx 0`
+	if [ $pending -eq 0 ];then
+		break
+	fi
+	sleep 1
+done
+
+if [ $pending -ne 0 ];then
+	fail "$pending children are not forked again"
+fi
+
+$PSQL -c "SELECT 1" > /dev/null || fail "could not connect after children were forked again"
+
+./shutdownall
+
+exit 0
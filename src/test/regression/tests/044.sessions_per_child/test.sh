@@ -0,0 +1,145 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for sessions_per_child.
+#
+# Check that a child process serves concurrent sessions, and that
+# pgpool refuses to start if the descriptors of the sessions of a child
+# process may exceed FD_SETSIZE.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+export PGDATABASE=test
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+cp etc/pgpool.conf etc/pgpool.conf.orig
+
+echo "num_init_children = 1" >> etc/pgpool.conf
+echo "sessions_per_child = 8" >> etc/pgpool.conf
+echo "max_pool = 8" >> etc/pgpool.conf
+
+./startall
+
+export PGPORT=$PGPOOL_PORT
+
+wait_for_pgpool_startup
+
+# sessions stay connected to the only child process at the same time
+for i in 1 2 3 4 5 6 7 8
+do
+	$PSQL -t -A > session$i.out 2>&1 <<EOF2 &
+SELECT pg_sleep(2);
+SELECT 'done';
+EOF2
+done
+wait
+
+for i in 1 2 3 4 5 6 7 8
+do
+	grep done session$i.out > /dev/null
+	if [ $? != 0 ];then
+		echo "session $i failed"
+		cat session$i.out
+		./shutdownall
+		exit 1
+	fi
+done
+echo "concurrent sessions: ok"
+
+./shutdownall
+
+# with max_pool = 1 the child serves one session at a time and must not
+# park an idle session
+cp etc/pgpool.conf.orig etc/pgpool.conf
+echo "num_init_children = 1" >> etc/pgpool.conf
+echo "sessions_per_child = 4" >> etc/pgpool.conf
+echo "max_pool = 1" >> etc/pgpool.conf
+
+./startall
+
+wait_for_pgpool_startup
+
+$PSQL -t -A > max_pool.out 2>&1 <<EOF2
+SELECT 'first';
+\! sleep 2
+SELECT 'second';
+EOF2
+grep second max_pool.out > /dev/null
+if [ $? != 0 ];then
+	echo "idle session failed with max_pool = 1"
+	cat max_pool.out
+	./shutdownall
+	exit 1
+fi
+echo "max_pool = 1: ok"
+
+./shutdownall
+
+# 400 sessions with 2 backends need 1200 descriptors
+cp etc/pgpool.conf.orig etc/pgpool.conf
+echo "num_init_children = 1" >> etc/pgpool.conf
+echo "sessions_per_child = 400" >> etc/pgpool.conf
+echo "max_pool = 400" >> etc/pgpool.conf
+
+./startall
+
+wait_for_pgpool_startup
+
+$PSQL -c "SELECT 1" > /dev/null 2>&1
+if [ $? = 0 ];then
+	echo "pgpool started with too large sessions_per_child"
+	./shutdownall
+	exit 1
+fi
+
+grep "sessions_per_child is too large" log/pgpool.log > /dev/null
+if [ $? != 0 ];then
+	echo "too large sessions_per_child was not reported"
+	./shutdownall
+	exit 1
+fi
+echo "too large sessions_per_child: ok"
+
+./shutdownall
+
+# in transaction pooling mode, 900 sessions and 40 connections to each
+# of 2 backends need 980 descriptors
+cp etc/pgpool.conf.orig etc/pgpool.conf
+echo "num_init_children = 1" >> etc/pgpool.conf
+echo "sessions_per_child = 900" >> etc/pgpool.conf
+echo "max_pool = 40" >> etc/pgpool.conf
+echo "transaction_pooling = on" >> etc/pgpool.conf
+rm -f log/pgpool.log
+
+./startall
+
+wait_for_pgpool_startup
+
+$PSQL -c "SELECT 1" > /dev/null 2>&1
+if [ $? = 0 ];then
+	echo "pgpool started with too large sessions_per_child in transaction pooling mode"
+	./shutdownall
+	exit 1
+fi
+
+grep "sessions_per_child is too large" log/pgpool.log > /dev/null
+if [ $? != 0 ];then
+	echo "too large sessions_per_child was not reported in transaction pooling mode"
+	./shutdownall
+	exit 1
+fi
+echo "too large sessions_per_child in transaction pooling mode: ok"
+
+./shutdownall
+
+exit 0
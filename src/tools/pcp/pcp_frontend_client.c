@@ -50,6 +50,7 @@ static void output_proccount_result(PCPResultInfo * pcpResInfo, bool verbose);
 static void output_poolstatus_result(PCPResultInfo * pcpResInfo, bool verbose);
 static void output_nodeinfo_result(PCPResultInfo * pcpResInfo, bool verbose);
 static void output_health_check_stats_result(PCPResultInfo * pcpResInfo, bool verbose);
+static void output_backend_stats_result(PCPResultInfo * pcpResInfo, bool verbose);
 static void output_nodecount_result(PCPResultInfo * pcpResInfo, bool verbose);
 static char *backend_status_to_string(BackendInfo * bi);
 static char *format_titles(const char **titles, const char **types, int ntitles);
@@ -61,6 +62,7 @@ typedef enum
 	PCP_NODE_COUNT,
 	PCP_NODE_INFO,
 	PCP_HEALTH_CHECK_STATS,
+	PCP_BACKEND_STATS,
 	PCP_POOL_STATUS,
 	PCP_PROC_COUNT,
 	PCP_PROC_INFO,
@@ -69,6 +71,7 @@ typedef enum
 	PCP_STOP_PGPOOL,
 	PCP_WATCHDOG_INFO,
 	PCP_RELOAD_CONFIG,
+	PCP_SNAPSHOT_QUERY_CACHE,
 	UNKNOWN,
 }			PCP_UTILITIES;
 
@@ -87,6 +90,7 @@ struct AppTypes AllAppTypes[] =
 	{"pcp_node_count", PCP_NODE_COUNT, "h:p:U:wWvd", "display the total number of nodes under pgpool-II's control"},
 	{"pcp_node_info", PCP_NODE_INFO, "n:h:p:U:wWvd", "display a pgpool-II node's information"},
 	{"pcp_health_check_stats", PCP_HEALTH_CHECK_STATS, "n:h:p:U:wWvd", "display a pgpool-II health check stats data"},
+	{"pcp_backend_stats", PCP_BACKEND_STATS, "n:h:p:U:wWvd", "display a pgpool-II backend node's query statistics"},
 	{"pcp_pool_status", PCP_POOL_STATUS, "h:p:U:wWvd", "display pgpool configuration and status"},
 	{"pcp_proc_count", PCP_PROC_COUNT, "h:p:U:wWvd", "display the list of pgpool-II child process PIDs"},
 	{"pcp_proc_info", PCP_PROC_INFO, "h:p:P:U:awWvd", "display a pgpool-II child process' information"},
@@ -95,6 +99,7 @@ struct AppTypes AllAppTypes[] =
 	{"pcp_stop_pgpool", PCP_STOP_PGPOOL, "m:h:p:U:s:wWvda", "terminate pgpool-II"},
 	{"pcp_watchdog_info", PCP_WATCHDOG_INFO, "n:h:p:U:wWvd", "display a pgpool-II watchdog's information"},
 	{"pcp_reload_config",PCP_RELOAD_CONFIG,"h:p:U:s:wWvd", "reload a pgpool-II config file"},
+	{"pcp_snapshot_query_cache", PCP_SNAPSHOT_QUERY_CACHE, "h:p:U:wWvd", "save pgpool-II query cache to the snapshot file"},
 	{NULL, UNKNOWN, NULL, NULL},
 };
 struct AppTypes *current_app_type;
@@ -399,6 +404,11 @@ main(int argc, char **argv)
 		pcpResInfo = pcp_health_check_stats(pcpConn, nodeID);
 	}
 
+	else if (current_app_type->app_type == PCP_BACKEND_STATS)
+	{
+		pcpResInfo = pcp_backend_stats(pcpConn, nodeID);
+	}
+
 	else if (current_app_type->app_type == PCP_POOL_STATUS)
 	{
 		pcpResInfo = pcp_pool_status(pcpConn);
@@ -442,6 +452,11 @@ main(int argc, char **argv)
 		pcpResInfo = pcp_reload_config(pcpConn,command_scope);
 	}
 
+	else if (current_app_type->app_type == PCP_SNAPSHOT_QUERY_CACHE)
+	{
+		pcpResInfo = pcp_snapshot_query_cache(pcpConn);
+	}
+
 	else
 	{
 		/* should never happen */
@@ -470,6 +485,9 @@ main(int argc, char **argv)
 		if (current_app_type->app_type == PCP_HEALTH_CHECK_STATS)
 			output_health_check_stats_result(pcpResInfo, verbose);
 
+		if (current_app_type->app_type == PCP_BACKEND_STATS)
+			output_backend_stats_result(pcpResInfo, verbose);
+
 		if (current_app_type->app_type == PCP_POOL_STATUS)
 			output_poolstatus_result(pcpResInfo, verbose);
 
@@ -564,9 +582,11 @@ output_health_check_stats_result(PCPResultInfo * pcpResInfo, bool verbose)
 								"Average Retry Count", "Max Retry Count", "Max Health Check Duration",
 								"Minimum Health Check Duration", "Average Health Check Duration",
 								"Last Health Check", "Last Successful Health Check",
-								"Last Skip Health Check", "Last Failed Health Check"};
+								"Last Skip Health Check", "Last Failed Health Check",
+								"Probe Count", "Probe Fail Count", "Last Failed Probe"};
 		const char *types[] = {"s", "s", "s", "s", "s", "s", "s", "s", "s", "s",
-							   "s", "s", "s", "s", "s", "s", "s", "s", "s", "s"};
+							   "s", "s", "s", "s", "s", "s", "s", "s", "s", "s",
+							   "s", "s", "s"};
 		char *format_string;
 
 		format_string = format_titles(titles, types, sizeof(titles)/sizeof(char *));
@@ -590,11 +610,14 @@ output_health_check_stats_result(PCPResultInfo * pcpResInfo, bool verbose)
 			   stats->last_health_check,
 			   stats->last_successful_health_check,
 			   stats->last_skip_health_check,
-			   stats->last_failed_health_check);
+			   stats->last_failed_health_check,
+			   stats->probe_count,
+			   stats->probe_fail_count,
+			   stats->last_failed_probe);
 	}
 	else
 	{
-		printf("%s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s\n",
+		printf("%s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s\n",
 			   stats->node_id,
 			   stats->hostname,
 			   stats->port,
@@ -614,7 +637,107 @@ output_health_check_stats_result(PCPResultInfo * pcpResInfo, bool verbose)
 			   stats->last_health_check,
 			   stats->last_successful_health_check,
 			   stats->last_skip_health_check,
-			   stats->last_failed_health_check);
+			   stats->last_failed_health_check,
+			   stats->probe_count,
+			   stats->probe_fail_count,
+			   stats->last_failed_probe);
+	}
+}
+
+/*
+ * Format and output backend stats
+ */
+static void
+output_backend_stats_result(PCPResultInfo * pcpResInfo, bool verbose)
+{
+	POOL_BACKEND_STATS *stats = (POOL_BACKEND_STATS *)pcp_get_binary_data(pcpResInfo, 0);
+
+	if (verbose)
+	{
+		const char *titles[] = {"Node Id", "Host Name", "Port", "Status",
+								"Role", "Select Count", "Insert Count",
+								"Update Count", "Delete Count", "DDL Count",
+								"Other Count", "Panic Count", "Fatal Count",
+								"Error Count", "Bytes In", "Bytes Out",
+								"Latency 50th Percentile (ms)",
+								"Latency 90th Percentile (ms)",
+								"Latency 99th Percentile (ms)",
+								"Select Latency 99th Percentile (ms)",
+								"Insert Latency 99th Percentile (ms)",
+								"Update Latency 99th Percentile (ms)",
+								"Delete Latency 99th Percentile (ms)",
+								"DDL Latency 99th Percentile (ms)",
+								"Other Latency 99th Percentile (ms)",
+								"Replication Lag", "Last Lag Check",
+								"Replication Lag History"};
+		const char *types[] = {"s", "s", "s", "s", "s", "s", "s", "s", "s",
+							   "s", "s", "s", "s", "s", "s", "s", "s", "s",
+							   "s", "s", "s", "s", "s", "s", "s", "s", "s",
+							   "s"};
+		char *format_string;
+
+		format_string = format_titles(titles, types, sizeof(titles)/sizeof(char *));
+		printf(format_string,
+			   stats->node_id,
+			   stats->hostname,
+			   stats->port,
+			   stats->status,
+			   stats->role,
+			   stats->select_cnt,
+			   stats->insert_cnt,
+			   stats->update_cnt,
+			   stats->delete_cnt,
+			   stats->ddl_cnt,
+			   stats->other_cnt,
+			   stats->panic_cnt,
+			   stats->fatal_cnt,
+			   stats->error_cnt,
+			   stats->bytes_in,
+			   stats->bytes_out,
+			   stats->latency_p50,
+			   stats->latency_p90,
+			   stats->latency_p99,
+			   stats->select_p99,
+			   stats->insert_p99,
+			   stats->update_p99,
+			   stats->delete_p99,
+			   stats->ddl_p99,
+			   stats->other_p99,
+			   stats->replication_lag,
+			   stats->last_lag_check,
+			   stats->replication_lag_history);
+	}
+	else
+	{
+		printf("%s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s\n",
+			   stats->node_id,
+			   stats->hostname,
+			   stats->port,
+			   stats->status,
+			   stats->role,
+			   stats->select_cnt,
+			   stats->insert_cnt,
+			   stats->update_cnt,
+			   stats->delete_cnt,
+			   stats->ddl_cnt,
+			   stats->other_cnt,
+			   stats->panic_cnt,
+			   stats->fatal_cnt,
+			   stats->error_cnt,
+			   stats->bytes_in,
+			   stats->bytes_out,
+			   stats->latency_p50,
+			   stats->latency_p90,
+			   stats->latency_p99,
+			   stats->select_p99,
+			   stats->insert_p99,
+			   stats->update_p99,
+			   stats->delete_p99,
+			   stats->ddl_p99,
+			   stats->other_p99,
+			   stats->replication_lag,
+			   stats->last_lag_check,
+			   stats->replication_lag_history);
 	}
 }
 
@@ -812,6 +935,7 @@ app_require_nodeID(void)
 			current_app_type->app_type == PCP_DETACH_NODE ||
 			current_app_type->app_type == PCP_NODE_INFO ||
 			current_app_type->app_type == PCP_HEALTH_CHECK_STATS ||
+			current_app_type->app_type == PCP_BACKEND_STATS ||
 			current_app_type->app_type == PCP_PROMOTE_NODE ||
 			current_app_type->app_type == PCP_RECOVERY_NODE);
 }
@@ -167,7 +167,7 @@ process_bind(char *buf, PGconn *conn)
 	}
 
 	nparams = buffer_read_int(buf, &bufp);
-	len += sizeof(short) + sizeof(short) * nparams;
+	len += sizeof(short);
 	buf = bufp;
 	SKIP_TABS(buf);
 
@@ -181,10 +181,11 @@ process_bind(char *buf, PGconn *conn)
 	{
 		paramlens[i] = buffer_read_int(buf, &bufp);
 		len += sizeof(int);
+		buf = bufp;
+		SKIP_TABS(buf);
 
 		if (paramlens[i] > 0)
 		{
-			buf = bufp;
 			paramvals[i] = buffer_read_string(buf, &bufp);
 			buf = bufp;
 			SKIP_TABS(buf);
@@ -199,7 +200,7 @@ process_bind(char *buf, PGconn *conn)
 	len += sizeof(short) + sizeof(short) * nresult_formatcodes;
 	SKIP_TABS(buf);
 
-	if (nresult_formatcodes >= 2)
+	if (nresult_formatcodes > 0)
 	{
 		for (i = 0; i < nresult_formatcodes; i++)
 		{
@@ -225,11 +226,14 @@ process_bind(char *buf, PGconn *conn)
 	send_int16(nparams, conn);
 	for (i = 0; i < nparams; i++)
 	{
+		send_int(paramlens[i], conn);	/* parameter length */
+
+		/* NULL? */
 		if (paramlens[i] != -1)
 		{
-			if (ncodes == 0 || codes[i] == 0)
+			if (ncodes == 0 || codes[ncodes == 1 ? 0 : i] == 0)
 			{
-				send_string(paramvals[i], conn);
+				send_byte(paramvals[i], paramlens[i], conn);
 			}
 			else
 			{
@@ -2484,6 +2484,9 @@ process_name(void)
 		case PT_FOLLOWCHILD:
 			prefix = _("UTILITY");
 			break;
+		case PT_ACCEPT_DISPATCHER:
+			prefix = _("ACCEPT DISPATCHER");
+			break;
 		default:
 			prefix = "";
 			break;
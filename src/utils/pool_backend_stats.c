@@ -0,0 +1,66 @@
+/*
+ * $Header$
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2020	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ */
+
+#include <stddef.h>
+#include "pool.h"
+#include "pcp/libpcp_ext.h"
+
+/*
+ * Returns an array consisting of POOL_BACKEND_STATS struct member offsets.
+ * The table data needs to be shared by both PCP server and clients.
+ * Number of struct members will be stored in *n.
+ */
+int * pool_backend_stats_offsets(int *n)
+{
+	static 	int	offsettbl[] = {
+		offsetof(POOL_BACKEND_STATS, node_id),
+		offsetof(POOL_BACKEND_STATS, hostname),
+		offsetof(POOL_BACKEND_STATS, port),
+		offsetof(POOL_BACKEND_STATS, status),
+		offsetof(POOL_BACKEND_STATS, role),
+		offsetof(POOL_BACKEND_STATS, select_cnt),
+		offsetof(POOL_BACKEND_STATS, insert_cnt),
+		offsetof(POOL_BACKEND_STATS, update_cnt),
+		offsetof(POOL_BACKEND_STATS, delete_cnt),
+		offsetof(POOL_BACKEND_STATS, ddl_cnt),
+		offsetof(POOL_BACKEND_STATS, other_cnt),
+		offsetof(POOL_BACKEND_STATS, panic_cnt),
+		offsetof(POOL_BACKEND_STATS, fatal_cnt),
+		offsetof(POOL_BACKEND_STATS, error_cnt),
+		offsetof(POOL_BACKEND_STATS, bytes_in),
+		offsetof(POOL_BACKEND_STATS, bytes_out),
+		offsetof(POOL_BACKEND_STATS, latency_p50),
+		offsetof(POOL_BACKEND_STATS, latency_p90),
+		offsetof(POOL_BACKEND_STATS, latency_p99),
+		offsetof(POOL_BACKEND_STATS, select_p99),
+		offsetof(POOL_BACKEND_STATS, insert_p99),
+		offsetof(POOL_BACKEND_STATS, update_p99),
+		offsetof(POOL_BACKEND_STATS, delete_p99),
+		offsetof(POOL_BACKEND_STATS, ddl_p99),
+		offsetof(POOL_BACKEND_STATS, other_p99),
+		offsetof(POOL_BACKEND_STATS, replication_lag),
+		offsetof(POOL_BACKEND_STATS, last_lag_check),
+		offsetof(POOL_BACKEND_STATS, replication_lag_history),
+	};
+
+	*n = sizeof(offsettbl)/sizeof(int);
+	return offsettbl;
+}
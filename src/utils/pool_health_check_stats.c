@@ -52,6 +52,9 @@ int * pool_health_check_stats_offsets(int *n)
 		offsetof(POOL_HEALTH_CHECK_STATS, last_successful_health_check),
 		offsetof(POOL_HEALTH_CHECK_STATS, last_skip_health_check),
 		offsetof(POOL_HEALTH_CHECK_STATS, last_failed_health_check),
+		offsetof(POOL_HEALTH_CHECK_STATS, probe_count),
+		offsetof(POOL_HEALTH_CHECK_STATS, probe_fail_count),
+		offsetof(POOL_HEALTH_CHECK_STATS, last_failed_probe),
 	};
 
 	*n = sizeof(offsettbl)/sizeof(int);
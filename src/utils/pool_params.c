@@ -151,6 +151,49 @@ pool_add_param(ParamStatus * params, char *name, char *value)
 	return 0;
 }
 
+/*
+ * copy name/value pairs of src to dst.  Unlike pool_add_param(), the parser
+ * settings are not touched.
+ */
+void
+pool_copy_params(ParamStatus * dst, ParamStatus * src)
+{
+	int			i;
+	MemoryContext oldContext;
+
+	pool_discard_params(dst);
+	pool_init_params(dst);
+
+	oldContext = MemoryContextSwitchTo(TopMemoryContext);
+	for (i = 0; i < src->num; i++)
+	{
+		dst->names[i] = pstrdup(src->names[i]);
+		dst->values[i] = pstrdup(src->values[i]);
+	}
+	dst->num = src->num;
+	MemoryContextSwitchTo(oldContext);
+}
+
+/*
+ * returns true if any parameter in params has a value different from the
+ * one in base, or is missing in base.
+ */
+bool
+pool_params_changed(ParamStatus * params, ParamStatus * base)
+{
+	int			i;
+	int			pos;
+	char	   *value;
+
+	for (i = 0; i < params->num; i++)
+	{
+		value = pool_find_name(base, params->names[i], &pos);
+		if (value == NULL || strcmp(value, params->values[i]))
+			return true;
+	}
+	return false;
+}
+
 void
 pool_param_debug_print(ParamStatus * params)
 {
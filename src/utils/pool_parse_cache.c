@@ -0,0 +1,318 @@
+/* -*-pgsql-c-*- */
+/*
+ * $Header$
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2020	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_parse_cache.c: Per process parse tree cache
+ *
+ * Applications tend to send the same query strings over and over again.
+ * To save the cost of raw_parser(), parse trees of successfully parsed
+ * queries are kept in child local memory keyed by the query string.  On
+ * cache hit a copy of the cached parse tree is returned, so callers may
+ * scribble on it just like on a freshly parsed one.  Since the result of
+ * parsing depends on the parser settings taken from the parameter status
+ * of the backend (standard_conforming_strings etc.), they are part of the
+ * cache key as well.
+ */
+#include "config.h"
+#include <string.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "utils/pool_parse_cache.h"
+#include "utils/palloc.h"
+#include "utils/memutils.h"
+#include "utils/elog.h"
+#include "parser/nodes.h"
+#include "parser/parser.h"
+#include "parser/pg_wchar.h"
+
+typedef struct
+{
+	uint32		hashval;		/* hash value of the query string */
+	int			len;			/* length of the query string */
+	bool		use_minimal;	/* parsed by the minimal parser? */
+	uint32		settings;		/* parser settings at the time of parsing */
+	char	   *query;			/* query string. NULL if unused */
+	List	   *parse_tree_list;	/* cached parse tree */
+	MemoryContext context;		/* memory context holding the above */
+	int			next;			/* next entry in the hash chain. -1 if none */
+	int			lru_prev;		/* less recently used entry. -1 if none */
+	int			lru_next;		/* more recently used entry. -1 if none */
+}			ParseCacheEntry;
+
+typedef struct
+{
+	int			num;			/* number of cache entries */
+	int			nbuckets;		/* number of hash buckets, power of 2 */
+	int		   *buckets;		/* first entry of each hash chain */
+	int			lru_head;		/* entry to be replaced next */
+	int			lru_tail;		/* most recently used entry */
+	MemoryContext context;		/* parent of per entry memory contexts */
+	ParseCacheEntry *entries;
+}			ParseCache;
+
+static ParseCache * parse_cache;
+
+static void init_parse_cache(void);
+static uint32 parser_settings(void);
+static uint32 parse_cache_hash(const char *str, int len, bool use_minimal, uint32 settings);
+static int	search_parse_cache(const char *str, int len, bool use_minimal, uint32 settings, uint32 hashval);
+static void add_parse_cache(const char *str, int len, bool use_minimal, uint32 settings, uint32 hashval, List *parse_tree_list);
+static void unlink_hash_chain(int index);
+static void touch_entry(int index);
+
+/*
+ * Same as raw_parser() but looks up the parse tree cache first.  Parse
+ * errors are never cached.
+ */
+List *
+pool_raw_parser(const char *str, int len, bool *error, bool use_minimal)
+{
+	List	   *parse_tree_list;
+	uint32		settings;
+	uint32		hashval;
+	int			index;
+
+	if (pool_config->parse_cache_size <= 0 || len > PARSE_CACHE_MAX_QUERY_LEN)
+		return raw_parser(str, len, error, use_minimal);
+
+	if (parse_cache == NULL)
+		init_parse_cache();
+
+	settings = parser_settings();
+	hashval = parse_cache_hash(str, len, use_minimal, settings);
+	index = search_parse_cache(str, len, use_minimal, settings, hashval);
+	if (index >= 0)
+	{
+		touch_entry(index);
+		*error = false;
+		return copyObject(parse_cache->entries[index].parse_tree_list);
+	}
+
+	parse_tree_list = raw_parser(str, len, error, use_minimal);
+	if (parse_tree_list != NIL)
+		add_parse_cache(str, len, use_minimal, settings, hashval, parse_tree_list);
+
+	return parse_tree_list;
+}
+
+/*
+ * Allocate the cache on the first use.
+ */
+static void
+init_parse_cache(void)
+{
+	MemoryContext oldContext;
+	int			i;
+
+	oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+	parse_cache = palloc0(sizeof(ParseCache));
+	parse_cache->num = pool_config->parse_cache_size;
+
+	/* Number of hash buckets is rounded up to power of 2 */
+	for (parse_cache->nbuckets = 1; parse_cache->nbuckets < parse_cache->num;
+		 parse_cache->nbuckets <<= 1)
+		;
+	parse_cache->buckets = palloc(sizeof(int) * parse_cache->nbuckets);
+	for (i = 0; i < parse_cache->nbuckets; i++)
+		parse_cache->buckets[i] = -1;
+
+	parse_cache->entries = palloc0(sizeof(ParseCacheEntry) * parse_cache->num);
+	for (i = 0; i < parse_cache->num; i++)
+	{
+		parse_cache->entries[i].next = -1;
+		parse_cache->entries[i].lru_prev = i - 1;
+		parse_cache->entries[i].lru_next = (i == parse_cache->num - 1) ? -1 : i + 1;
+	}
+	parse_cache->lru_head = 0;
+	parse_cache->lru_tail = parse_cache->num - 1;
+
+	parse_cache->context = AllocSetContextCreate(TopMemoryContext,
+												 "parse cache",
+												 ALLOCSET_DEFAULT_SIZES);
+	MemoryContextSwitchTo(oldContext);
+}
+
+/*
+ * Returns the parser settings which change the parse tree of the same
+ * query string, packed into an integer.  See parser_set_param().
+ */
+static uint32
+parser_settings(void)
+{
+	return (uint32) standard_conforming_strings |
+		((uint32) backslash_quote << 1) |
+		((uint32) GetDatabaseEncoding() << 8);
+}
+
+/*
+ * Calculate hash value of a query string.
+ */
+static uint32
+parse_cache_hash(const char *str, int len, bool use_minimal, uint32 settings)
+{
+	uint32		h = 2166136261U;	/* FNV-1a */
+	int			i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ (unsigned char) str[i]) * 16777619U;
+	h = (h ^ (uint32) use_minimal) * 16777619U;
+	h = (h ^ settings) * 16777619U;
+
+	return h;
+}
+
+/*
+ * Search the cache entry for the query string.  Returns index of the
+ * entry or -1 if not found.
+ */
+static int
+search_parse_cache(const char *str, int len, bool use_minimal, uint32 settings, uint32 hashval)
+{
+	ParseCacheEntry *e;
+	int			i;
+
+	for (i = parse_cache->buckets[hashval & (parse_cache->nbuckets - 1)]; i >= 0; i = e->next)
+	{
+		e = &parse_cache->entries[i];
+
+		if (e->hashval == hashval && e->len == len &&
+			e->use_minimal == use_minimal && e->settings == settings &&
+			memcmp(e->query, str, len) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Register a copy of the parse tree, replacing the least recently used
+ * entry.  If the parse tree cannot be copied, it is just not cached.
+ */
+static void
+add_parse_cache(const char *str, int len, bool use_minimal, uint32 settings, uint32 hashval, List *parse_tree_list)
+{
+	ParseCacheEntry *e;
+	MemoryContext oldContext = CurrentMemoryContext;
+	MemoryContext context;
+	int			index;
+	int			bucket;
+	bool		copied = true;
+
+	index = parse_cache->lru_head;
+	e = &parse_cache->entries[index];
+
+	/* Remove the old entry */
+	if (e->query)
+	{
+		unlink_hash_chain(index);
+		MemoryContextDelete(e->context);
+		e->query = NULL;
+		e->context = NULL;
+	}
+
+	context = AllocSetContextCreate(parse_cache->context,
+									"parse cache entry",
+									ALLOCSET_SMALL_SIZES);
+	MemoryContextSwitchTo(context);
+
+	PG_TRY();
+	{
+		e->parse_tree_list = copyObject(parse_tree_list);
+	}
+	PG_CATCH();
+	{
+		FlushErrorState();
+		copied = false;
+	}
+	PG_END_TRY();
+
+	if (!copied)
+	{
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextDelete(context);
+		ereport(DEBUG1,
+				(errmsg("unable to cache parse tree"),
+				 errdetail("query: \"%s\"", str)));
+		return;
+	}
+
+	e->query = palloc(len + 1);
+	memcpy(e->query, str, len);
+	e->query[len] = '\0';
+	MemoryContextSwitchTo(oldContext);
+
+	e->context = context;
+	e->hashval = hashval;
+	e->len = len;
+	e->use_minimal = use_minimal;
+	e->settings = settings;
+
+	bucket = hashval & (parse_cache->nbuckets - 1);
+	e->next = parse_cache->buckets[bucket];
+	parse_cache->buckets[bucket] = index;
+
+	touch_entry(index);
+}
+
+/*
+ * Remove a cache entry from hash chain.
+ */
+static void
+unlink_hash_chain(int index)
+{
+	int		   *link;
+
+	link = &parse_cache->buckets[parse_cache->entries[index].hashval & (parse_cache->nbuckets - 1)];
+	while (*link >= 0)
+	{
+		if (*link == index)
+		{
+			*link = parse_cache->entries[index].next;
+			break;
+		}
+		link = &parse_cache->entries[*link].next;
+	}
+	parse_cache->entries[index].next = -1;
+}
+
+/*
+ * Mark the entry as the most recently used one.
+ */
+static void
+touch_entry(int index)
+{
+	ParseCacheEntry *e = &parse_cache->entries[index];
+
+	if (parse_cache->lru_tail == index)
+		return;
+
+	/* unlink */
+	if (e->lru_prev >= 0)
+		parse_cache->entries[e->lru_prev].lru_next = e->lru_next;
+	else
+		parse_cache->lru_head = e->lru_next;
+	parse_cache->entries[e->lru_next].lru_prev = e->lru_prev;
+
+	/* append to the tail */
+	e->lru_prev = parse_cache->lru_tail;
+	e->lru_next = -1;
+	parse_cache->entries[parse_cache->lru_tail].lru_next = index;
+	parse_cache->lru_tail = index;
+}
@@ -40,6 +40,7 @@ static void send_row_description_and_data_rows(POOL_CONNECTION * frontend, POOL_
 											   char *data, int row_size, int nrows);
 static void write_one_field(POOL_CONNECTION * frontend, char *field);
 static void write_one_field_v2(POOL_CONNECTION * frontend, char *field);
+static void get_replication_lag_stats(int node_id, POOL_BACKEND_STATS *stats);
 
 void
 send_row_description(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
@@ -305,6 +306,11 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "whether to serialize accept() call", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "accept_dispatcher", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->accept_dispatcher);
+	StrNCpy(status[i].desc, "accept connections in a dedicated process", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "reserved_connections", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->reserved_connections);
 	StrNCpy(status[i].desc, "number of reserved connections", POOLCONFIG_MAXDESCLEN);
@@ -315,6 +321,16 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "max # of connection pool per child", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "sessions_per_child", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->sessions_per_child);
+	StrNCpy(status[i].desc, "max # of concurrent sessions per child", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "transaction_pooling", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->transaction_pooling);
+	StrNCpy(status[i].desc, "if true, share backend connections between transactions", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	/* - Life time - */
 	StrNCpy(status[i].name, "child_life_time", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->child_life_time);
@@ -326,6 +342,16 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "if max_connections received, child exits", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "spare_children", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->spare_children);
+	StrNCpy(status[i].desc, "number of pre-forked spare children", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "child_respawn_rate", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->child_respawn_rate);
+	StrNCpy(status[i].desc, "max children forked per second, 0 means no limit", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "connection_life_time", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->connection_life_time);
 	StrNCpy(status[i].desc, "if idle for this seconds, connection closes", POOLCONFIG_MAXDESCLEN);
@@ -455,6 +481,11 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "non 0 if SELECT statement is replicated", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "replicate_write_in_parallel", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->replicate_write_in_parallel);
+	StrNCpy(status[i].desc, "non 0 if write queries are sent to all nodes at once", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "insert_lock", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->insert_lock);
 	StrNCpy(status[i].desc, "insert lock", POOLCONFIG_MAXDESCLEN);
@@ -542,12 +573,22 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "statement level load balancing", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "load_balance_policy", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->load_balance_policy);
+	StrNCpy(status[i].desc, "how to choose the load balance node", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	/* - Streaming - */
 	StrNCpy(status[i].name, "sr_check_period", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->sr_check_period);
 	StrNCpy(status[i].desc, "sr check period", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "sr_check_lag_interval", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->sr_check_lag_interval);
+	StrNCpy(status[i].desc, "sr check lag interval", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "sr_check_user", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->sr_check_user);
 	StrNCpy(status[i].desc, "sr check user", POOLCONFIG_MAXDESCLEN);
@@ -631,6 +672,11 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "connect timeout", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "health_check_probe_interval", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->health_check_probe_interval);
+	StrNCpy(status[i].desc, "health check probe interval", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	/* FAILOVER AND FAILBACK */
 
 	StrNCpy(status[i].name, "failover_command", POOLCONFIG_MAXNAMELEN);
@@ -653,6 +699,11 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "detach false primary", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "failover_keep_sessions", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->failover_keep_sessions);
+	StrNCpy(status[i].desc, "keep sessions over standby failover", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "auto_failback", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->auto_failback);
 	StrNCpy(status[i].desc, "auto_failback", POOLCONFIG_MAXDESCLEN);
@@ -722,11 +773,21 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "If true, relation cache stored in memory cache", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "shared_relcache_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->shared_relcache_size);
+	StrNCpy(status[i].desc, "number of relation cache entry on shared memory", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "relcache_query_target", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->relcache_query_target);
 	StrNCpy(status[i].desc, "Target node to send relcache queries", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "parse_cache_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->parse_cache_size);
+	StrNCpy(status[i].desc, "number of parse tree cache entry", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	/*
 	 * add for watchdog
 	 */
@@ -887,6 +948,11 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "Memcached port number. Mondatory if memqcache_method=memcached", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "memqcache_memcached_pipelining", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_memcached_pipelining);
+	StrNCpy(status[i].desc, "If true, send stores and deletes to memcached without waiting for replies", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "memqcache_total_size", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%ld", pool_config->memqcache_total_size);
 	StrNCpy(status[i].desc, "Total memory size in bytes for storing memory cache. Mandatory if memqcache_method=shmem", POOLCONFIG_MAXDESCLEN);
@@ -902,6 +968,26 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "Memory cache entry life time specified in seconds. 60 by default", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "memqcache_stale_while_revalidate", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_stale_while_revalidate);
+	StrNCpy(status[i].desc, "Seconds an expired memory cache entry may still be used while it is refreshed", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_admission_min_duration", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_admission_min_duration);
+	StrNCpy(status[i].desc, "Minimum execution time of SELECT in milliseconds to cache the result", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_admission_min_count", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_admission_min_count);
+	StrNCpy(status[i].desc, "Minimum number of executions of SELECT to cache the result", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_table_expire_list", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->memqcache_table_expire_list ? pool_config->memqcache_table_expire_list : "");
+	StrNCpy(status[i].desc, "Per table life time of memory cache entries", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "memqcache_auto_cache_invalidation", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_auto_cache_invalidation);
 	StrNCpy(status[i].desc, "If true, invalidation of query cache is triggered by corresponding DDL/DML/DCL(and memqcache_expire).  If false, it is only triggered  by memqcache_expire.  True by default.", POOLCONFIG_MAXDESCLEN);
@@ -917,11 +1003,26 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "Cache block size in bytes. 8192 by default", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "memqcache_compression", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_compression);
+	StrNCpy(status[i].desc, "If true, compress query cache entries", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_compression_threshold", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_compression_threshold);
+	StrNCpy(status[i].desc, "Minimum SELECT result size in bytes to be compressed", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "memqcache_cache_oiddir", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->memqcache_oiddir);
 	StrNCpy(status[i].desc, "Tempory work directory to record table oids", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "memqcache_snapshot_file", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->memqcache_snapshot_file);
+	StrNCpy(status[i].desc, "File to save the shmem query cache across restarts", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "memqcache_stats_start_time", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", ctime(&pool_get_memqcache_stats()->start_time));
 	StrNCpy(status[i].desc, "Start time of query cache stats", POOLCONFIG_MAXDESCLEN);
@@ -1367,6 +1468,7 @@ get_pools(int *nrows)
 				backend_id;
 
 	ProcessInfo *pi = NULL;
+	ConnectionPoolStats *stats;
 	int			proc_id;
 
 	int			lines = 0;
@@ -1382,6 +1484,8 @@ get_pools(int *nrows)
 
 		for (pool = 0; pool < pool_config->max_pool; pool++)
 		{
+			stats = pool_connection_pool_stats(child, pool);
+
 			for (backend_id = 0; backend_id < NUM_BACKENDS; backend_id++)
 			{
 				poolBE = pool * MAX_NUM_BACKENDS + backend_id;
@@ -1408,6 +1512,8 @@ get_pools(int *nrows)
 				pools[lines].pool_counter = pi->connection_info[poolBE].counter;
 				pools[lines].pool_backendpid = ntohl(pi->connection_info[poolBE].pid);
 				pools[lines].pool_connected = pi->connection_info[poolBE].connected;
+				pools[lines].pool_hits = stats ? stats->hits : 0;
+				pools[lines].pool_misses = stats ? stats->misses : 0;
 				lines++;
 			}
 		}
@@ -1420,9 +1526,9 @@ get_pools(int *nrows)
 void
 pools_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 {
-	static short num_fields = 12;
+	static short num_fields = 14;
 	static char *field_names[] = {"pool_pid", "start_time", "pool_id", "backend_id", "database", "username", "create_time",
-	"majorversion", "minorversion", "pool_counter", "pool_backendpid", "pool_connected"};
+	"majorversion", "minorversion", "pool_counter", "pool_backendpid", "pool_connected", "pool_hits", "pool_misses"};
 	short		s;
 	int			len;
 	int			i;
@@ -1441,6 +1547,8 @@ pools_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 	char		backend_id[16];
 	char		backend_pid[16];
 	char		connected[2];
+	char		hits[16];
+	char		misses[16];
 
 	POOL_REPORT_POOLS *pools = get_pools(&nrows);
 
@@ -1470,6 +1578,8 @@ pools_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 		snprintf(backend_id, sizeof(backend_pid), "%d", pools[i].backend_id);
 		snprintf(backend_pid, sizeof(backend_pid), "%d", pools[i].pool_backendpid);
 		snprintf(connected, sizeof(connected), "%d", pools[i].pool_connected);
+		snprintf(hits, sizeof(hits), "%d", pools[i].pool_hits);
+		snprintf(misses, sizeof(misses), "%d", pools[i].pool_misses);
 
 		if (MAJOR(backend) == PROTO_MAJOR_V2)
 		{
@@ -1492,6 +1602,8 @@ pools_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 			len += 4 + strlen(pool_counter);	/* int32 + data */
 			len += 4 + strlen(backend_pid); /* int32 + data */
 			len += 4 + strlen(connected);	/* int32 + data */
+			len += 4 + strlen(hits);	/* int32 + data */
+			len += 4 + strlen(misses);	/* int32 + data */
 
 			len = htonl(len);
 			pool_write(frontend, &len, sizeof(len));
@@ -1558,6 +1670,16 @@ pools_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 		size = htonl(len + hsize);
 		pool_write(frontend, &size, sizeof(size));
 		pool_write(frontend, connected, len);
+
+		len = strlen(hits);
+		size = htonl(len + hsize);
+		pool_write(frontend, &size, sizeof(size));
+		pool_write(frontend, hits, len);
+
+		len = strlen(misses);
+		size = htonl(len + hsize);
+		pool_write(frontend, &size, sizeof(size));
+		pool_write(frontend, misses, len);
 	}
 
 	send_complete_and_ready(frontend, backend, "SELECT", nrows);
@@ -1680,7 +1802,7 @@ version_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 void
 cache_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 {
-	static char *field_names[] = {"num_cache_hits", "num_selects", "cache_hit_ratio", "num_hash_entries", "used_hash_entries", "num_cache_entries", "used_cache_entries_size", "free_cache_entries_size", "fragment_cache_entries_size"};
+	static char *field_names[] = {"num_cache_hits", "num_selects", "cache_hit_ratio", "num_hash_entries", "used_hash_entries", "num_cache_entries", "used_cache_entries_size", "free_cache_entries_size", "fragment_cache_entries_size", "num_compressed_entries", "compression_ratio", "num_admission_rejects"};
 	short		num_fields = sizeof(field_names) / sizeof(char *);
 	int			i;
 	short		s;
@@ -1708,7 +1830,7 @@ cache_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 	 * Get raw cache stat data
 	 */
 	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_shmem_lock();
+	pool_shmem_lock(POOL_MEMQ_SHARED_LOCK);
 
 	PG_TRY();
 	{
@@ -1745,6 +1867,17 @@ cache_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%ld", mystats->used_cache_entries_size);
 	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%ld", mystats->free_cache_entries_size);
 	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%ld", mystats->fragment_cache_entries_size);
+	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%lld", mystats->cache_stats.num_compressed_entries);
+	if (mystats->cache_stats.compressed_size == 0)
+	{
+		ratio = 0.0;
+	}
+	else
+	{
+		ratio = (double) mystats->cache_stats.compressed_raw_size / mystats->cache_stats.compressed_size;
+	}
+	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%.2f", ratio);
+	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%lld", mystats->cache_stats.num_admission_rejects);
 
 	/*
 	 * Calculate total data length
@@ -1882,6 +2015,13 @@ get_health_check_stats(int *nrows)
 		t = health_check_stats[i].last_failed_health_check;
 		if (t > 0)
 			strftime(stats[i].last_failed_health_check, POOLCONFIG_MAXDATELEN, "%F %T", localtime(&t));
+
+		snprintf(stats[i].probe_count, POOLCONFIG_MAXLONGCOUNTLEN, UINT64_FORMAT, health_check_stats[i].probe_count);
+		snprintf(stats[i].probe_fail_count, POOLCONFIG_MAXLONGCOUNTLEN, UINT64_FORMAT, health_check_stats[i].probe_fail_count);
+
+		t = health_check_stats[i].last_failed_probe;
+		if (t > 0)
+			strftime(stats[i].last_failed_probe, POOLCONFIG_MAXDATELEN, "%F %T", localtime(&t));
 	}
 
 	*nrows = i;
@@ -1899,7 +2039,8 @@ show_health_check_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backe
 								  "total_count", "success_count", "fail_count", "skip_count", "retry_count",
 								  "average_retry_count", "max_retry_count", "max_duration", "min_duration",
 								  "average_duration", "last_health_check", "last_successful_health_check",
-								  "last_skip_health_check", "last_failed_health_check"};
+								  "last_skip_health_check", "last_failed_health_check",
+								  "probe_count", "probe_fail_count", "last_failed_probe"};
 	static int offsettbl[] = {
 		offsetof(POOL_HEALTH_CHECK_STATS, node_id),
 		offsetof(POOL_HEALTH_CHECK_STATS, hostname),
@@ -1921,6 +2062,9 @@ show_health_check_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backe
 		offsetof(POOL_HEALTH_CHECK_STATS, last_successful_health_check),
 		offsetof(POOL_HEALTH_CHECK_STATS, last_skip_health_check),
 		offsetof(POOL_HEALTH_CHECK_STATS, last_failed_health_check),
+		offsetof(POOL_HEALTH_CHECK_STATS, probe_count),
+		offsetof(POOL_HEALTH_CHECK_STATS, probe_fail_count),
+		offsetof(POOL_HEALTH_CHECK_STATS, last_failed_probe),
 	};
 
 	int	nrows;
@@ -1936,6 +2080,55 @@ show_health_check_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backe
 	pfree(stats);
 }
 
+/*
+ * Fill the replication lag columns of backend_stats from the lag history
+ * of the node.  The history is listed newest first, "-" meaning that the
+ * lag could not be measured.
+ */
+static void
+get_replication_lag_stats(int node_id, POOL_BACKEND_STATS *stats)
+{
+	volatile SR_LAG_HISTORY *h;
+	volatile SR_LAG_SAMPLE *sample;
+	uint32		count;
+	int			n;
+	size_t		len = 0;
+	time_t		t;
+
+	*stats->replication_lag = '\0';
+	*stats->last_lag_check = '\0';
+	*stats->replication_lag_history = '\0';
+
+	if (sr_lag_history == NULL)
+		return;
+
+	h = &sr_lag_history[node_id];
+	count = h->count;
+	if (count == 0)
+		return;
+
+	sample = &h->samples[(count - 1) % SR_LAG_HISTORY_SIZE];
+	if (sample->lag < 0)
+		snprintf(stats->replication_lag, POOLCONFIG_MAXLONGCOUNTLEN, "-");
+	else
+		snprintf(stats->replication_lag, POOLCONFIG_MAXLONGCOUNTLEN, INT64_FORMAT, sample->lag);
+	t = sample->time / 1000;
+	strftime(stats->last_lag_check, POOLCONFIG_MAXDATELEN, "%F %T", localtime(&t));
+
+	for (n = 0; n < SR_LAG_HISTORY_SIZE && n < count; n++)
+	{
+		sample = &h->samples[(count - 1 - n) % SR_LAG_HISTORY_SIZE];
+		if (sample->lag < 0)
+			len += snprintf(stats->replication_lag_history + len, POOLCONFIG_MAXLAGHISTORYLEN - len,
+							"%s-", n > 0 ? "," : "");
+		else
+			len += snprintf(stats->replication_lag_history + len, POOLCONFIG_MAXLAGHISTORYLEN - len,
+							"%s" INT64_FORMAT, n > 0 ? "," : "", sample->lag);
+		if (len >= POOLCONFIG_MAXLAGHISTORYLEN)
+			break;
+	}
+}
+
 /*
  * for SHOW backend_stats
  */
@@ -1946,8 +2139,6 @@ get_backend_stats(int *nrows)
 	POOL_BACKEND_STATS *backend_stats = palloc(NUM_BACKENDS * sizeof(POOL_BACKEND_STATS));
 	BackendInfo *bi = NULL;
 
-	pool_get_session_context(false);
-
 	for (i = 0; i < NUM_BACKENDS; i++)
 	{
 		bi = pool_get_node_info(i);
@@ -1965,6 +2156,30 @@ get_backend_stats(int *nrows)
 		snprintf(backend_stats[i].panic_cnt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stat_get_panic_count(i));
 		snprintf(backend_stats[i].fatal_cnt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stat_get_fatal_count(i));
 		snprintf(backend_stats[i].error_cnt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stat_get_error_count(i));
+		snprintf(backend_stats[i].bytes_in, POOLCONFIG_MAXLONGCOUNTLEN, UINT64_FORMAT, stat_get_bytes_in(i));
+		snprintf(backend_stats[i].bytes_out, POOLCONFIG_MAXLONGCOUNTLEN, UINT64_FORMAT, stat_get_bytes_out(i));
+
+		/* latencies are shown in milliseconds */
+		snprintf(backend_stats[i].latency_p50, POOLCONFIG_MAXLONGCOUNTLEN, "%.3f",
+				 stat_get_latency_percentile(i, STAT_NUM_STATEMENT_TYPES, 50) / 1000.0);
+		snprintf(backend_stats[i].latency_p90, POOLCONFIG_MAXLONGCOUNTLEN, "%.3f",
+				 stat_get_latency_percentile(i, STAT_NUM_STATEMENT_TYPES, 90) / 1000.0);
+		snprintf(backend_stats[i].latency_p99, POOLCONFIG_MAXLONGCOUNTLEN, "%.3f",
+				 stat_get_latency_percentile(i, STAT_NUM_STATEMENT_TYPES, 99) / 1000.0);
+		snprintf(backend_stats[i].select_p99, POOLCONFIG_MAXLONGCOUNTLEN, "%.3f",
+				 stat_get_latency_percentile(i, STAT_SELECT, 99) / 1000.0);
+		snprintf(backend_stats[i].insert_p99, POOLCONFIG_MAXLONGCOUNTLEN, "%.3f",
+				 stat_get_latency_percentile(i, STAT_INSERT, 99) / 1000.0);
+		snprintf(backend_stats[i].update_p99, POOLCONFIG_MAXLONGCOUNTLEN, "%.3f",
+				 stat_get_latency_percentile(i, STAT_UPDATE, 99) / 1000.0);
+		snprintf(backend_stats[i].delete_p99, POOLCONFIG_MAXLONGCOUNTLEN, "%.3f",
+				 stat_get_latency_percentile(i, STAT_DELETE, 99) / 1000.0);
+		snprintf(backend_stats[i].ddl_p99, POOLCONFIG_MAXLONGCOUNTLEN, "%.3f",
+				 stat_get_latency_percentile(i, STAT_DDL, 99) / 1000.0);
+		snprintf(backend_stats[i].other_p99, POOLCONFIG_MAXLONGCOUNTLEN, "%.3f",
+				 stat_get_latency_percentile(i, STAT_OTHER, 99) / 1000.0);
+
+		get_replication_lag_stats(i, &backend_stats[i]);
 
 		if (STREAM)
 		{
@@ -1999,7 +2214,10 @@ show_backend_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 {
 	static char *field_names[] = {"node_id", "hostname", "port", "status", "role",
 								  "select_cnt", "insert_cnt", "update_cnt", "delete_cnt", "ddl_cnt", "other_cnt",
-								  "panic_cnt", "fatal_cnt", "error_cnt"};
+								  "panic_cnt", "fatal_cnt", "error_cnt", "bytes_in", "bytes_out",
+								  "latency_p50", "latency_p90", "latency_p99",
+								  "select_p99", "insert_p99", "update_p99", "delete_p99", "ddl_p99", "other_p99",
+								  "replication_lag", "last_lag_check", "replication_lag_history"};
 
 	static int offsettbl[] = {
 		offsetof(POOL_BACKEND_STATS, node_id),
@@ -2016,6 +2234,20 @@ show_backend_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 		offsetof(POOL_BACKEND_STATS, panic_cnt),
 		offsetof(POOL_BACKEND_STATS, fatal_cnt),
 		offsetof(POOL_BACKEND_STATS, error_cnt),
+		offsetof(POOL_BACKEND_STATS, bytes_in),
+		offsetof(POOL_BACKEND_STATS, bytes_out),
+		offsetof(POOL_BACKEND_STATS, latency_p50),
+		offsetof(POOL_BACKEND_STATS, latency_p90),
+		offsetof(POOL_BACKEND_STATS, latency_p99),
+		offsetof(POOL_BACKEND_STATS, select_p99),
+		offsetof(POOL_BACKEND_STATS, insert_p99),
+		offsetof(POOL_BACKEND_STATS, update_p99),
+		offsetof(POOL_BACKEND_STATS, delete_p99),
+		offsetof(POOL_BACKEND_STATS, ddl_p99),
+		offsetof(POOL_BACKEND_STATS, other_p99),
+		offsetof(POOL_BACKEND_STATS, replication_lag),
+		offsetof(POOL_BACKEND_STATS, last_lag_check),
+		offsetof(POOL_BACKEND_STATS, replication_lag_history),
 	};
 
 	int	nrows;
@@ -18,12 +18,14 @@
  * suitability of this software for any purpose.  It is provided "as
  * is" without express or implied warranty.
  *
- * pool_relcache.c: Per process relation cache modules
+ * pool_relcache.c: Per process relation cache modules and relation cache
+ * on shared memory
  */
 #include "config.h"
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <ctype.h>
 #include <limits.h>
 #include <time.h>
 
@@ -37,10 +39,50 @@
 #include "utils/memutils.h"
 #include "utils/elog.h"
 #include "parser/scansup.h"
+#include "auth/md5.h"
+#include "utils/pool_ipc.h"
+
+/*
+ * Relation cache on shared memory.  Each entry holds a relcache query
+ * result serialized in the same format as the one stored in the query
+ * cache (see relation_cache_to_query_cache()), keyed by md5 hash of the
+ * database name and the query string. Results larger than
+ * SHARED_RELCACHE_DATA_SIZE are not stored.  Entries are replaced in
+ * round robin manner once all of them are used.
+ */
+#define SHARED_RELCACHE_DATA_SIZE	512
+
+typedef struct
+{
+	char		key[POOL_MD5_HASHKEYLEN];	/* md5 of database name and query */
+	int			next;			/* next entry in the hash chain. -1 if none */
+	int			len;			/* length of data. -1 if unused */
+	time_t		expire;			/* cache expiration absolute time in seconds */
+	char		data[SHARED_RELCACHE_DATA_SIZE];	/* serialized query result */
+}			SharedRelCacheEntry;
+
+typedef struct
+{
+	uint32		mask;			/* number of hash buckets - 1 */
+	int			nentries;		/* number of entries */
+	int			next_victim;	/* next entry to be replaced */
+	int			buckets[1];		/* hash buckets pointing to entry */
+}			SharedRelCacheHeader;
+
+static SharedRelCacheHeader * shared_relcache;
+static SharedRelCacheEntry * shared_relcache_entries;
 
 static void SearchRelCacheErrorCb(void *arg);
 static POOL_SELECT_RESULT *query_cache_to_relation_cache(char *data, size_t size);
 static char *relation_cache_to_query_cache(POOL_SELECT_RESULT *res,size_t *size);
+static uint32 relcache_hash(char *dbname, char *relname, int session_id);
+static void relcache_unlink(POOL_RELCACHE * relcache, int index);
+static int	shared_relcache_nbuckets(void);
+static void shared_relcache_key(char *user, char *dbname, char *query, char *key);
+static int *shared_relcache_bucket(char *key);
+static int	shared_relcache_lookup(char *key);
+static POOL_SELECT_RESULT *shared_relcache_search(char *key, time_t now);
+static void shared_relcache_store(char *key, POOL_SELECT_RESULT *res, time_t now);
 
 
 /*
@@ -54,6 +96,9 @@ pool_create_relcache(int cachesize, char *sql,
 	POOL_RELCACHE *p;
 	PoolRelCache *ip;
 	MemoryContext old_context;
+	int			nbuckets;
+	int		   *buckets;
+	int			i;
 
 	if (cachesize < 0)
 	{
@@ -71,8 +116,17 @@ pool_create_relcache(int cachesize, char *sql,
 	ip = (PoolRelCache *) palloc0(sizeof(PoolRelCache) * cachesize);
 	p = (POOL_RELCACHE *) palloc(sizeof(POOL_RELCACHE));
 
+	/* Number of hash buckets is rounded up to power of 2 */
+	nbuckets = 1;
+	while (nbuckets < cachesize)
+		nbuckets <<= 1;
+	buckets = (int *) palloc(sizeof(int) * nbuckets);
+
 	MemoryContextSwitchTo(old_context);
 
+	for (i = 0; i < nbuckets; i++)
+		buckets[i] = -1;
+
 	p->num = cachesize;
 	strlcpy(p->sql, sql, sizeof(p->sql));
 	p->register_func = register_func;
@@ -80,6 +134,8 @@ pool_create_relcache(int cachesize, char *sql,
 	p->cache_is_session_local = issessionlocal;
 	p->no_cache_if_zero = false;
 	p->cache = ip;
+	p->nbuckets = nbuckets;
+	p->buckets = buckets;
 
 	return p;
 }
@@ -97,9 +153,52 @@ pool_discard_relcache(POOL_RELCACHE * relcache)
 		(*relcache->unregister_func) (relcache->cache[i].data);
 	}
 	pfree(relcache->cache);
+	pfree(relcache->buckets);
 	pfree(relcache);
 }
 
+/*
+ * Calculate hash value of a relcache entry. Since database name and
+ * relation name are compared case insensitively, the hash value is
+ * calculated from lower cased names. session_id should be 0 if the cache
+ * is not session local.
+ */
+static uint32
+relcache_hash(char *dbname, char *relname, int session_id)
+{
+	uint32		h = 2166136261U;	/* FNV-1a */
+	unsigned char *p;
+
+	for (p = (unsigned char *) dbname; *p; p++)
+		h = (h ^ tolower(*p)) * 16777619U;
+	h *= 16777619U;				/* separator */
+	for (p = (unsigned char *) relname; *p; p++)
+		h = (h ^ tolower(*p)) * 16777619U;
+	h = (h ^ (uint32) session_id) * 16777619U;
+
+	return h;
+}
+
+/*
+ * Remove a relcache entry from hash chain.
+ */
+static void
+relcache_unlink(POOL_RELCACHE * relcache, int index)
+{
+	int		   *link;
+
+	link = &relcache->buckets[relcache->cache[index].hashval & (relcache->nbuckets - 1)];
+	while (*link >= 0)
+	{
+		if (*link == index)
+		{
+			*link = relcache->cache[index].next;
+			return;
+		}
+		link = &relcache->cache[*link].next;
+	}
+}
+
 /*
  * Search relcache. If found, return user data. Otherwise return 0.
  * If not found in cache, do the query and store the result into cache and return it.
@@ -115,6 +214,11 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 	int			index = 0;
 	int			local_session_id;
 	time_t		now;
+	uint32		hashval;
+	int			expired = -1;
+	char		shared_key[POOL_MD5_HASHKEYLEN + 1];
+	bool		use_shared_relcache;
+	bool		shared_relcache_hit = false;
 	void		*result;
 	ErrorContextCallback callback;
     pool_sigset_t oldmask;
@@ -167,8 +271,15 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 	now = time(NULL);
 
 	/* Look for cache first */
-	for (i = 0; i < relcache->num; i++)
+	hashval = relcache_hash(dbname, table,
+							relcache->cache_is_session_local ? local_session_id : 0);
+
+	for (i = relcache->buckets[hashval & (relcache->nbuckets - 1)]; i >= 0;
+		 i = relcache->cache[i].next)
 	{
+		if (relcache->cache[i].hashval != hashval)
+			continue;
+
 		/*
 		 * If cache is session local, we need to check session id
 		 */
@@ -190,6 +301,7 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 							 errdetail("relcache for database:%s table:%s expired. now:%ld expiration time:%ld", dbname, table, now, relcache->cache[i].expire)));
 
 					relcache->cache[i].refcnt = 0;
+					expired = i;
 					break;
 				}
 			}
@@ -219,33 +331,74 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 	callback.previous = error_context_stack;
 	error_context_stack = &callback;
 
+	/*
+	 * Search relation cache on shared memory if enabled. Session local
+	 * cache is never shared.
+	 */
+	use_shared_relcache = shared_relcache != NULL && !relcache->cache_is_session_local;
+	if (use_shared_relcache)
+	{
+		shared_relcache_key(backend->info->user, dbname, query, shared_key);
+		res = shared_relcache_search(shared_key, now);
+		shared_relcache_hit = (res != NULL);
+	}
+
 	locked = pool_is_shmem_lock();
 	/*
 	 * if enable_shared_relcache is true, search query cache.
 	 */
-    if (pool_config->enable_shared_relcache)
+	if (shared_relcache_hit)
+	{
+		ereport(DEBUG1,
+				(errmsg("hit shared relation cache"),
+				errdetail("query:%s", query)));
+
+		result = (*relcache->register_func) (res);
+	}
+	else if (pool_config->enable_shared_relcache)
 	{
-		/* if shmem is not locked by this process, get the lock */
+		/*
+		 * if shmem is not locked by this process, get the lock. Searching
+		 * query cache only requires shared lock.
+		 */
 		if (!locked)
 		{
 			POOL_SETMASK2(&BlockSig, &oldmask);
-			pool_shmem_lock();
+			pool_shmem_lock(POOL_MEMQ_SHARED_LOCK);
 		}
 	    PG_TRY();
 		{
 			/* search catalog cache in query cache */
-			query_cache_not_found = pool_fetch_cache(backend, query, &query_cache_data, &query_cache_len);
+			query_cache_not_found = pool_fetch_cache(backend, query, &query_cache_data, &query_cache_len, false);
 		}
 	    PG_CATCH();
 		{
-			pool_shmem_unlock();
-			POOL_SETMASK(&oldmask);
+			if (!locked)
+			{
+				pool_shmem_unlock();
+				POOL_SETMASK(&oldmask);
+			}
 	        PG_RE_THROW();
 		}
 		PG_END_TRY();
+
+		/*
+		 * Do not hold the lock while sending query to backend. We will
+		 * acquire exclusive lock later on if we need to register the
+		 * result.
+		 */
+		if (!locked)
+		{
+			pool_shmem_unlock();
+			POOL_SETMASK(&oldmask);
+		}
 	}
 	/* If not in query cache or not used, send query for backend. */
-	if (query_cache_not_found)
+	if (shared_relcache_hit)
+	{
+		/* already registered above */
+	}
+	else if (query_cache_not_found)
 	{
 		ereport(DEBUG1,
 				(errmsg("not hit local relation cache and query cache"),
@@ -254,11 +407,45 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 		do_query(CONNECTION(backend, node_id), query, &res, MAJOR(backend));
 		/* Register cache */
 		result = (*relcache->register_func) (res);
-		/* save local catalog cache in query cache */
-	    if (pool_config->enable_shared_relcache)
+		/*
+		 * Save local catalog cache in query cache.  Registering needs
+		 * exclusive lock, thus it is skipped if the caller holds only
+		 * shared lock.
+		 */
+		if (pool_config->enable_shared_relcache && locked && !pool_is_shmem_exclusive_lock())
+		{
+			ereport(DEBUG1,
+					(errmsg("not saving relation cache in query cache"),
+					 errdetail("shared lock is held by caller")));
+		}
+		else if (pool_config->enable_shared_relcache)
 		{
 			query_cache_data = relation_cache_to_query_cache(res, &query_cache_len);
-			pool_catalog_commit_cache(backend, query, query_cache_data, query_cache_len);
+
+			if (!locked)
+			{
+				POOL_SETMASK2(&BlockSig, &oldmask);
+				pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+			}
+			PG_TRY();
+			{
+				pool_catalog_commit_cache(backend, query, query_cache_data, query_cache_len);
+			}
+			PG_CATCH();
+			{
+				if (!locked)
+				{
+					pool_shmem_unlock();
+					POOL_SETMASK(&oldmask);
+				}
+				PG_RE_THROW();
+			}
+			PG_END_TRY();
+			if (!locked)
+			{
+				pool_shmem_unlock();
+				POOL_SETMASK(&oldmask);
+			}
 		}
 	}
 	else
@@ -271,19 +458,21 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 		res = query_cache_to_relation_cache(query_cache_data,query_cache_len);
 		result = (*relcache->register_func) (res);
 	}
-	/* if shmem is locked by this function, unlock it */
-	if (pool_config->enable_shared_relcache && !locked)
+	error_context_stack = callback.previous;
+
+	if (relcache->num <= 0)
 	{
-		pool_shmem_unlock();
-		POOL_SETMASK(&oldmask);
+		free_select_result(res);
+		if (query_cache_data)
+			pfree(query_cache_data);
+		return result;
 	}
 
-	error_context_stack = callback.previous;
-
 	/*
-	 * Look for replacement in cache
+	 * Look for replacement in cache. The expired entry for the same
+	 * relation is reused if any.
 	 */
-	for (i = 0; i < relcache->num; i++)
+	for (i = 0; expired < 0 && i < relcache->num; i++)
 	{
 		/*
 		 * If cache is session local, we can discard old cache immediately
@@ -311,6 +500,9 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 		}
 	}
 
+	if (expired >= 0)
+		index = expired;
+
 	if (relcache->cache[index].refcnt != 0)
 	{
 		ereport(LOG,
@@ -320,6 +512,17 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 
 	if (!pool_is_ignore_till_sync() && (!relcache->no_cache_if_zero || result))
 	{
+		if (use_shared_relcache && !shared_relcache_hit)
+			shared_relcache_store(shared_key, res, now);
+
+		/* Remove the old entry from hash chain if it was used */
+		if (relcache->cache[index].dbname[0] != '\0')
+			relcache_unlink(relcache, index);
+
+		relcache->cache[index].hashval = hashval;
+		relcache->cache[index].next = relcache->buckets[hashval & (relcache->nbuckets - 1)];
+		relcache->buckets[hashval & (relcache->nbuckets - 1)] = index;
+
 		strlcpy(relcache->cache[index].dbname, dbname, MAX_ITEM_LENGTH);
 		strlcpy(relcache->cache[index].relname, table, MAX_ITEM_LENGTH);
 		relcache->cache[index].refcnt = 1;
@@ -345,6 +548,216 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 	return result;
 }
 
+/*
+ * Calculate number of hash buckets of shared relation cache.
+ */
+static int
+shared_relcache_nbuckets(void)
+{
+	int			nbuckets = 1;
+
+	while (nbuckets < pool_config->shared_relcache_size)
+		nbuckets <<= 1;
+	return nbuckets;
+}
+
+/*
+ * Returns the size of shared memory required by shared relation cache.
+ */
+size_t
+pool_shared_relcache_size(void)
+{
+	size_t		size;
+
+	if (pool_config->shared_relcache_size <= 0)
+		return 0;
+
+	size = MAXALIGN(offsetof(SharedRelCacheHeader, buckets) +
+					sizeof(int) * shared_relcache_nbuckets());
+	size += sizeof(SharedRelCacheEntry) * pool_config->shared_relcache_size;
+	return size;
+}
+
+/*
+ * Acquire and initialize shared relation cache. This should be called
+ * only once from pgpool main process at the process staring up time.
+ */
+void
+pool_shared_relcache_init(void)
+{
+	int			nbuckets;
+	int			i;
+
+	if (pool_config->shared_relcache_size <= 0)
+		return;
+
+	nbuckets = shared_relcache_nbuckets();
+
+	shared_relcache = pool_shared_memory_segment_get_chunk(pool_shared_relcache_size());
+	shared_relcache->mask = nbuckets - 1;
+	shared_relcache->nentries = pool_config->shared_relcache_size;
+	shared_relcache->next_victim = 0;
+	for (i = 0; i < nbuckets; i++)
+		shared_relcache->buckets[i] = -1;
+
+	shared_relcache_entries = (SharedRelCacheEntry *)
+		((char *) shared_relcache + MAXALIGN(offsetof(SharedRelCacheHeader, buckets) +
+											 sizeof(int) * nbuckets));
+	for (i = 0; i < shared_relcache->nentries; i++)
+	{
+		shared_relcache_entries[i].next = -1;
+		shared_relcache_entries[i].len = -1;
+	}
+
+	ereport(LOG,
+			(errmsg("shared relation cache initialized"),
+			 errdetail("number of entries: %d", shared_relcache->nentries)));
+}
+
+/*
+ * Create shared relation cache key from user name, database name and
+ * query.  The user name is included because catalog lookups are subject
+ * to privileges and search_path, as encode_key() of the query cache does.
+ */
+static void
+shared_relcache_key(char *user, char *dbname, char *query, char *key)
+{
+	char	   *buf;
+	int			ulen = strlen(user);
+	int			dblen = strlen(dbname);
+	int			qlen = strlen(query);
+
+	buf = palloc(ulen + dblen + qlen + 2);
+	memcpy(buf, user, ulen + 1);
+	memcpy(buf + ulen + 1, dbname, dblen + 1);
+	memcpy(buf + ulen + dblen + 2, query, qlen);
+	pool_md5_hash(buf, ulen + dblen + qlen + 2, key);
+	pfree(buf);
+}
+
+/*
+ * Returns hash bucket of the key.
+ */
+static int *
+shared_relcache_bucket(char *key)
+{
+	uint32		h = 0;
+	int			i;
+
+	/* key is md5 hex string, so the first 8 bytes are random enough */
+	for (i = 0; i < 8; i++)
+		h = (h << 4) | (isdigit((unsigned char) key[i]) ? key[i] - '0' : key[i] - 'a' + 10);
+
+	return &shared_relcache->buckets[h & shared_relcache->mask];
+}
+
+/*
+ * Look for the entry having the key. Returns entry index or -1 if not
+ * found. Caller must hold SHARED_RELCACHE_SEM.
+ */
+static int
+shared_relcache_lookup(char *key)
+{
+	int			i;
+
+	for (i = *shared_relcache_bucket(key); i >= 0; i = shared_relcache_entries[i].next)
+	{
+		if (memcmp(shared_relcache_entries[i].key, key, POOL_MD5_HASHKEYLEN) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Search shared relation cache. If found and not expired, returns the
+ * query result in palloc'ed memory. Otherwise returns NULL.
+ */
+static POOL_SELECT_RESULT *
+shared_relcache_search(char *key, time_t now)
+{
+	char		data[SHARED_RELCACHE_DATA_SIZE];
+	int			len = -1;
+	int			i;
+	pool_sigset_t oldmask;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(SHARED_RELCACHE_SEM);
+
+	i = shared_relcache_lookup(key);
+	if (i >= 0 && (shared_relcache_entries[i].expire == 0 ||
+				   now <= shared_relcache_entries[i].expire))
+	{
+		len = shared_relcache_entries[i].len;
+		memcpy(data, shared_relcache_entries[i].data, len);
+	}
+
+	pool_semaphore_unlock(SHARED_RELCACHE_SEM);
+	POOL_SETMASK(&oldmask);
+
+	if (len < 0)
+		return NULL;
+	return query_cache_to_relation_cache(data, len);
+}
+
+/*
+ * Store query result into shared relation cache.
+ */
+static void
+shared_relcache_store(char *key, POOL_SELECT_RESULT *res, time_t now)
+{
+	char	   *data;
+	size_t		len;
+	int			i;
+	int		   *link;
+	pool_sigset_t oldmask;
+
+	data = relation_cache_to_query_cache(res, &len);
+	if (len > SHARED_RELCACHE_DATA_SIZE)
+	{
+		ereport(DEBUG1,
+				(errmsg("not storing relation cache into shared memory"),
+				 errdetail("data length %zu exceeds %d", len, SHARED_RELCACHE_DATA_SIZE)));
+		pfree(data);
+		return;
+	}
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(SHARED_RELCACHE_SEM);
+
+	i = shared_relcache_lookup(key);
+	if (i < 0)
+	{
+		/* Take the next victim and remove it from its hash chain */
+		i = shared_relcache->next_victim;
+		shared_relcache->next_victim = (i + 1) % shared_relcache->nentries;
+
+		if (shared_relcache_entries[i].len >= 0)
+		{
+			link = shared_relcache_bucket(shared_relcache_entries[i].key);
+			while (*link != i)
+				link = &shared_relcache_entries[*link].next;
+			*link = shared_relcache_entries[i].next;
+		}
+
+		memcpy(shared_relcache_entries[i].key, key, POOL_MD5_HASHKEYLEN);
+		link = shared_relcache_bucket(key);
+		shared_relcache_entries[i].next = *link;
+		*link = i;
+	}
+
+	memcpy(shared_relcache_entries[i].data, data, len);
+	shared_relcache_entries[i].len = len;
+	if (pool_config->relcache_expire > 0)
+		shared_relcache_entries[i].expire = now + pool_config->relcache_expire;
+	else
+		shared_relcache_entries[i].expire = 0;
+
+	pool_semaphore_unlock(SHARED_RELCACHE_SEM);
+	POOL_SETMASK(&oldmask);
+
+	pfree(data);
+}
+
 static void
 SearchRelCacheErrorCb(void *arg)
 {
@@ -51,6 +51,7 @@ static bool insertinto_or_locking_clause_walker(Node *node, void *context);
 static bool is_immutable_function(char *fname);
 static bool select_table_walker(Node *node, void *context);
 static bool non_immutable_function_call_walker(Node *node, void *context);
+static bool advisory_lock_walker(Node *node, void *context);
 static char *strip_quote(char *str);
 static bool function_volatile_property(char *fname, FUNC_VOLATILE_PROPERTY property);
 
@@ -973,6 +974,51 @@ insertinto_or_locking_clause_walker(Node *node, void *context)
 	return raw_expression_tree_walker(node, insertinto_or_locking_clause_walker, ctx);
 }
 
+/*
+ * Return true if the statement calls a function acquiring a session level
+ * advisory lock, which outlives the transaction.  The transaction level
+ * (pg_advisory_xact_lock etc.) and the unlock functions are not counted.
+ */
+bool
+pool_has_advisory_lock_call(Node *node)
+{
+	bool		found = false;
+
+	raw_expression_tree_walker(node, advisory_lock_walker, &found);
+
+	return found;
+}
+
+/*
+ * Walker function to find session level advisory lock function call.
+ */
+static bool
+advisory_lock_walker(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
+
+	if (IsA(node, FuncCall) && list_length(((FuncCall *) node)->funcname) > 0)
+	{
+		char	   *fname = strVal(llast(((FuncCall *) node)->funcname));
+
+		/* pg_advisory_lock, pg_try_advisory_lock and their _shared variants */
+		if (strncmp(fname, "pg_try_", 7) == 0)
+			fname += 7;
+		else if (strncmp(fname, "pg_", 3) == 0)
+			fname += 3;
+		else
+			fname = NULL;
+
+		if (fname && strncmp(fname, "advisory_lock", 13) == 0)
+		{
+			*(bool *) context = true;
+			return false;
+		}
+	}
+	return raw_expression_tree_walker(node, advisory_lock_walker, context);
+}
+
 /*
  * Return true if this SELECT has non immutable function calls.
  */
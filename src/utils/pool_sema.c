@@ -203,3 +203,123 @@ pool_semaphore_unlock(int semNum)
 				(errmsg("failed to unlock semaphore"),
 				 errdetail("%m")));
 }
+
+/*
+ * Set the value of a semaphore.  This is used to initialize semaphores
+ * which are not simple mutexes, and should be called only from the pgpool
+ * main process before any child is forked.
+ */
+void
+pool_semaphore_set_value(int semNum, int value)
+{
+	union semun semun;
+
+	semun.val = value;
+	if (semctl(semId, semNum, SETVAL, semun) < 0)
+		ereport(FATAL,
+				(errmsg("Unable to set semaphore value error:\"%m\""),
+				 errdetail("semctl(%d, %d, SETVAL, %d) failed", semId, semNum, semun.val)));
+}
+
+/*
+ * Perform semop(), retrying if interrupted by a signal.
+ */
+static void
+semaphore_op(struct sembuf *sops, int nsops, const char *what)
+{
+	int			errStatus;
+
+	do
+	{
+		errStatus = semop(semId, sops, nsops);
+	} while (errStatus < 0 && errno == EINTR);
+
+	if (errStatus < 0)
+		ereport(WARNING,
+				(errmsg("failed to %s semaphore", what),
+				 errdetail("%m")));
+}
+
+/*
+ * Reader/writer lock built on top of two semaphores.
+ *
+ * "semNum" holds the number of available reader slots and must be
+ * initialized to "nreaders".  A reader takes one slot, a writer takes all
+ * of them, so readers run concurrently while a writer excludes everybody.
+ * "writerSemNum" must be initialized to 0 and counts the writers waiting
+ * for or holding the lock.  Readers wait until it becomes zero in the same
+ * atomic semop(), so that a steady stream of readers does not starve
+ * writers.
+ *
+ * Acquire the reader/writer lock in shared mode.
+ */
+void
+pool_semaphore_lock_shared(int semNum, int writerSemNum)
+{
+	struct sembuf sops[2];
+
+	sops[0].sem_op = 0;			/* wait until no writer is around */
+	sops[0].sem_flg = 0;
+	sops[0].sem_num = writerSemNum;
+
+	sops[1].sem_op = -1;		/* take one reader slot */
+	sops[1].sem_flg = SEM_UNDO;
+	sops[1].sem_num = semNum;
+
+	semaphore_op(sops, 2, "lock");
+}
+
+/*
+ * Release the reader/writer lock acquired in shared mode
+ */
+void
+pool_semaphore_unlock_shared(int semNum)
+{
+	struct sembuf sops;
+
+	sops.sem_op = 1;
+	sops.sem_flg = SEM_UNDO;
+	sops.sem_num = semNum;
+
+	semaphore_op(&sops, 1, "unlock");
+}
+
+/*
+ * Acquire the reader/writer lock in exclusive mode
+ */
+void
+pool_semaphore_lock_exclusive(int semNum, int writerSemNum, int nreaders)
+{
+	struct sembuf sops;
+
+	/* Announce that a writer is waiting. This blocks new readers. */
+	sops.sem_op = 1;
+	sops.sem_flg = SEM_UNDO;
+	sops.sem_num = writerSemNum;
+	semaphore_op(&sops, 1, "lock");
+
+	/* Wait for existing readers and writers to go away */
+	sops.sem_op = -nreaders;
+	sops.sem_flg = SEM_UNDO;
+	sops.sem_num = semNum;
+	semaphore_op(&sops, 1, "lock");
+}
+
+/*
+ * Release the reader/writer lock acquired in exclusive mode
+ */
+void
+pool_semaphore_unlock_exclusive(int semNum, int writerSemNum, int nreaders)
+{
+	struct sembuf sops[2];
+
+	sops[0].sem_op = nreaders;
+	sops[0].sem_flg = SEM_UNDO;
+	sops[0].sem_num = semNum;
+
+	sops[1].sem_op = -1;
+	sops[1].sem_flg = SEM_UNDO;
+	sops[1].sem_num = writerSemNum;
+
+	semaphore_op(sops, 2, "unlock");
+}
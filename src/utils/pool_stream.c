@@ -31,6 +31,8 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
 
 
 #include "pool.h"
@@ -41,12 +43,15 @@
 #include "utils/socket_stream.h"
 #include "utils/pool_stream.h"
 #include "utils/pool_ssl.h"
+#include "utils/statistics.h"
 #include "main/pool_internal_comms.h"
 
 static int	mystrlen(char *str, int upper, int *flag);
 static int	mystrlinelen(char *str, int upper, int *flag);
 static int	save_pending_data(POOL_CONNECTION * cp, void *data, int len);
 static int	consume_pending_data(POOL_CONNECTION * cp, void *data, int len);
+static void fill_pending_data(POOL_CONNECTION * cp, int len);
+static int	pool_writev_flush(POOL_CONNECTION * cp, char *buf, int len);
 static MemoryContext SwitchToConnectionContext(bool backend_connection);
 #ifdef DEBUG
 static void dump_buffer(char *buf, int len);
@@ -130,6 +135,7 @@ pool_close(POOL_CONNECTION * cp)
 	if (cp->buf3)
 		pfree(cp->buf3);
 	pool_discard_params(&cp->params);
+	pool_discard_params(&cp->startup_params);
 
 	pool_ssl_close(cp);
 
@@ -287,6 +293,9 @@ pool_read(POOL_CONNECTION * cp, void *buf, int len)
 			}
 		}
 
+		if (cp->isbackend)
+			stat_count_bytes_in(cp->db_node_id, readlen);
+
 		if (len < readlen)
 		{
 			/* overrun. we need to save remaining data to pending buffer */
@@ -438,6 +447,9 @@ pool_read2(POOL_CONNECTION * cp, int len)
 			}
 		}
 
+		if (cp->isbackend)
+			stat_count_bytes_in(cp->db_node_id, readlen);
+
 		buf += readlen;
 		len -= readlen;
 	}
@@ -543,6 +555,123 @@ pool_write(POOL_CONNECTION * cp, void *buf, int len)
 	return 0;
 }
 
+/*
+ * Forward messages of "kind" received from "src" to "dst" as they are.
+ * The kind byte of the first message must have been already read from
+ * "src".  Following messages of the same kind are forwarded as well, as
+ * long as they are complete in the read buffer of "src".  The messages
+ * are written from the read buffer of "src" without being copied or
+ * re-encoded one by one.  Returns the number of forwarded messages, or -1
+ * if writing to "dst" failed.  Used to forward long runs of DataRow
+ * messages.
+ */
+int
+pool_forward_messages(POOL_CONNECTION * src, POOL_CONNECTION * dst, char kind)
+{
+	int			msglen;
+	int			runlen;
+	int			nmsgs;
+	int			sts;
+
+	/* the first message must be in the read buffer as a whole */
+	fill_pending_data(src, sizeof(msglen));
+	memcpy(&msglen, src->hp + src->po, sizeof(msglen));
+	msglen = ntohl(msglen);
+	if (msglen < 4)
+		ereport(ERROR,
+				(errmsg("unable to forward message"),
+				 errdetail("invalid message length %d kind:%c", msglen, kind)));
+	fill_pending_data(src, msglen);
+
+	/* look for following complete messages of the same kind */
+	runlen = msglen;
+	nmsgs = 1;
+	while (src->len - runlen > (int) sizeof(msglen) &&
+		   src->hp[src->po + runlen] == kind)
+	{
+		memcpy(&msglen, src->hp + src->po + runlen + 1, sizeof(msglen));
+		msglen = ntohl(msglen);
+		if (msglen < 4 || src->len - runlen - 1 < msglen)
+			break;
+		runlen += 1 + msglen;
+		nmsgs++;
+	}
+
+	ereport(DEBUG5,
+			(errmsg("pool_forward_messages: kind:%c messages:%d length:%d",
+					kind, nmsgs, runlen)));
+
+	if (pool_write_noerror(dst, &kind, 1))
+		return -1;
+
+	if (dst->no_forward)
+		sts = 0;
+	else if (dst->ssl_active > 0 || runlen <= WRITEBUFSZ - dst->wbufpo)
+		sts = pool_write_noerror(dst, src->hp + src->po, runlen);
+	else
+		sts = pool_writev_flush(dst, src->hp + src->po, runlen);
+
+	/* consume forwarded messages */
+	src->len -= runlen;
+	if (src->len <= 0)
+		src->po = 0;
+	else
+		src->po += runlen;
+
+	return sts < 0 ? -1 : nmsgs;
+}
+
+/*
+ * Write the write buffer and "buf" together by one system call if
+ * possible.  Not usable for SSL connections.
+ * This function does not throws an ereport in case of an error
+ */
+static int
+pool_writev_flush(POOL_CONNECTION * cp, char *buf, int len)
+{
+	struct iovec iov[2];
+	int			iovcnt;
+	ssize_t		sts;
+
+	iov[0].iov_base = cp->wbuf;
+	iov[0].iov_len = cp->wbufpo;
+	iov[1].iov_base = buf;
+	iov[1].iov_len = len;
+	iovcnt = 2;
+
+	while (iovcnt > 0)
+	{
+		errno = 0;
+		sts = writev(cp->fd, &iov[2 - iovcnt], iovcnt);
+
+		if (sts < 0)
+		{
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+
+			ereport(DEBUG5,
+					(errmsg("write on frontend failed with error :\"%m\""),
+					 errdetail("while trying to write data length: %d", cp->wbufpo + len)));
+			cp->wbufpo = 0;
+			return -1;
+		}
+
+		/* skip written data */
+		while (iovcnt > 0 && sts >= iov[2 - iovcnt].iov_len)
+		{
+			sts -= iov[2 - iovcnt].iov_len;
+			iovcnt--;
+		}
+		if (iovcnt > 0)
+		{
+			iov[2 - iovcnt].iov_base = (char *) iov[2 - iovcnt].iov_base + sts;
+			iov[2 - iovcnt].iov_len -= sts;
+		}
+	}
+
+	cp->wbufpo = 0;
+	return 0;
+}
 
 /*
  * Direct write.
@@ -582,6 +711,9 @@ pool_write_flush(POOL_CONNECTION * cp, void *buf, int len)
 
 		if (sts >= 0)
 		{
+			if (cp->isbackend)
+				stat_count_bytes_out(cp->db_node_id, sts);
+
 			wlen -= sts;
 
 			if (wlen == 0)
@@ -672,6 +804,9 @@ pool_flush_it(POOL_CONNECTION * cp)
 
 		if (sts >= 0)
 		{
+			if (cp->isbackend)
+				stat_count_bytes_out(cp->db_node_id, sts);
+
 			wlen -= sts;
 
 			if (wlen == 0)
@@ -1007,6 +1142,9 @@ pool_read_string(POOL_CONNECTION * cp, int *len, int line)
 
 		}
 
+		if (cp->isbackend)
+			stat_count_bytes_in(cp->db_node_id, readlen);
+
 		/* check overrun */
 		if (line)
 			strlength = mystrlinelen(cp->sbuf + readp, readlen, &flag);
@@ -1157,6 +1295,92 @@ save_pending_data(POOL_CONNECTION * cp, void *data, int len)
 	return 0;
 }
 
+/*
+ * Read from the socket until at least len bytes are in the pending data
+ * buffer.  Reads as much as available up to BULK_READBUFSZ bytes at once
+ * so that following messages are likely to be in the buffer as well.
+ */
+static void
+fill_pending_data(POOL_CONNECTION * cp, int len)
+{
+	int			readlen;
+	int			space;
+
+	while (cp->len < len)
+	{
+		/* make room to read into */
+		if (cp->len == 0)
+			cp->po = 0;
+		else if (cp->po > 0)
+		{
+			memmove(cp->hp, cp->hp + cp->po, cp->len);
+			cp->po = 0;
+		}
+		space = Max(len - cp->len, BULK_READBUFSZ);
+		if (cp->len + space > cp->bufsz)
+		{
+			MemoryContext oldContext = SwitchToConnectionContext(cp->isbackend);
+
+			cp->bufsz = ((cp->len + space) / READBUFSZ + 1) * READBUFSZ;
+			cp->hp = repalloc(cp->hp, cp->bufsz);
+			MemoryContextSwitchTo(oldContext);
+		}
+		space = cp->bufsz - cp->len;
+
+		if (pool_get_timeout() >= 0 && pool_check_fd(cp))
+			ereport(ERROR,
+					(errmsg("unable to read data from DB node %d", cp->db_node_id),
+					 errdetail("pool_check_fd call failed with error \"%m\"")));
+
+		if (cp->ssl_active > 0)
+			readlen = pool_ssl_read(cp, cp->hp + cp->len, space);
+		else
+			readlen = read(cp->fd, cp->hp + cp->len, space);
+
+		if (readlen == -1)
+		{
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+
+			cp->socket_state = POOL_SOCKET_ERROR;
+			if (cp->isbackend)
+			{
+				if (cp->con_info && cp->con_info->swallow_termination == 1)
+				{
+					cp->con_info->swallow_termination = 0;
+					ereport(FATAL,
+							(errmsg("unable to read data from DB node %d", cp->db_node_id),
+							 errdetail("pg_terminate_backend was called on the backend")));
+				}
+
+				if (pool_config->failover_on_backend_error)
+				{
+					notice_backend_error(cp->db_node_id, REQ_DETAIL_SWITCHOVER);
+					child_exit(POOL_EXIT_AND_RESTART);
+				}
+				ereport(ERROR,
+						(errmsg("unable to read data from DB node %d", cp->db_node_id),
+						 errdetail("socket read failed with error \"%m\"")));
+			}
+			ereport(ERROR,
+					(errmsg("unable to read data from frontend"),
+					 errdetail("socket read failed with error \"%m\"")));
+		}
+		else if (readlen == 0)
+		{
+			cp->socket_state = POOL_SOCKET_EOF;
+			ereport(ERROR,
+					(errmsg("unable to read data from %s", cp->isbackend ? "backend" : "frontend"),
+					 errdetail("EOF read on socket")));
+		}
+
+		if (cp->isbackend)
+			stat_count_bytes_in(cp->db_node_id, readlen);
+
+		cp->len += readlen;
+	}
+}
+
 /*
  * consume pending data. returns actually consumed data length.
  */
@@ -18,28 +18,155 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <sys/time.h>
+#include <time.h>
 
 #include "pool.h"
+#include "pool_config.h"
 #include "utils/statistics.h"
 #include "parser/nodes.h"
 
 /*
- * Per backend node stat area in shared memory
+ * Per backend node stat counters.
+ *
+ * Counters are sharded by child process: each child has its own
+ * PER_NODE_STAT array in shared memory, which is written by that child
+ * only.  Thus the counters can be incremented without locks or atomic
+ * operations, children never share cache lines of the counters and no
+ * update is lost.  Readers sum up the counters of all shards.
+ *
+ * An extra shard after those of the children is owned by the streaming
+ * replication check worker, so that the bytes it exchanges with the
+ * backends are counted too.  Other processes do not count up.
  */
 typedef struct
 {
-	uint64		select_cnt;		/* number of read SELECT queries issued */
-	uint64		insert_cnt;		/* number of INSERT queries issued */
-	uint64		update_cnt;		/* number of UPDATE queries issued */
-	uint64		delete_cnt;		/* number of DELETE queries issued */
-	uint64		ddl_cnt;		/* number of DDL queries issued */
-	uint64		other_cnt;		/* number of any other queries issued */
+	uint64		query_cnt[STAT_NUM_STATEMENT_TYPES];	/* number of queries
+														 * issued for each
+														 * statement type */
 	uint64		panic_cnt;		/* number of PANIC messages */
 	uint64		fatal_cnt;		/* number of FATAL messages */
 	uint64		error_cnt;		/* number of ERROR messages */
+	uint64		bytes_in;		/* bytes received from the backend */
+	uint64		bytes_out;		/* bytes sent to the backend */
+	uint64		queries_in_progress;	/* 1 while a query is outstanding */
 }			PER_NODE_STAT;
 
+/*
+ * Latency histogram.
+ *
+ * Latencies are recorded in microseconds in log-linear buckets, like HDR
+ * histograms do: values less than STAT_HIST_SUB_BUCKETS have their own
+ * bucket, and each power of 2 range above is split into
+ * STAT_HIST_SUB_BUCKETS buckets.  So a bucket covers at most 1/8 of its
+ * value.  Latencies longer than 2^STAT_HIST_MAX_EXP microseconds (about
+ * 4.7 hours) go into the last bucket.
+ *
+ * Histograms are too large to have a copy per child process.  They are
+ * shared by all processes and updated with atomic increments, so that no
+ * update is lost.  Since a query increments only one bucket, concurrent
+ * updates rarely touch the same cache line.
+ */
+#define STAT_HIST_SUB_BITS		3
+#define STAT_HIST_SUB_BUCKETS	(1 << STAT_HIST_SUB_BITS)
+#define STAT_HIST_MAX_EXP		34
+#define STAT_HIST_BUCKETS		((STAT_HIST_MAX_EXP - STAT_HIST_SUB_BITS + 1) * STAT_HIST_SUB_BUCKETS)
+
+typedef struct
+{
+	uint64		bucket[STAT_HIST_BUCKETS];
+}			LATENCY_HISTOGRAM;
+
+typedef struct
+{
+	LATENCY_HISTOGRAM hist[STAT_NUM_STATEMENT_TYPES];
+	double		ewma_latency;	/* exponentially weighted moving average of
+								 * the latency in microseconds.  0 if no
+								 * latency has been recorded yet. */
+	time_t		ewma_time;		/* when ewma_latency was last updated */
+}			PER_NODE_LATENCY;
+
+/*
+ * Weight of the latest sample in the moving average latency.  Updates of
+ * the average by concurrent children may overwrite each other, which just
+ * drops a sample.
+ *
+ * The average halves every STAT_EWMA_HALF_LIFE seconds without samples.
+ * Otherwise a node which was slow once would never get queries again under
+ * latency aware load balancing, and its latency would never be updated.
+ */
+#define STAT_EWMA_ALPHA		0.2
+#define STAT_EWMA_HALF_LIFE	5
+
 static volatile PER_NODE_STAT *per_node_stat;
+static volatile PER_NODE_LATENCY *per_node_latency;
+
+/*
+ * Start time and statement type of the query in progress on each backend
+ * node.  These are local to the child process.
+ */
+static bool query_in_progress[MAX_NUM_BACKENDS];
+static StatStatementType query_type[MAX_NUM_BACKENDS];
+static struct timeval query_start_time[MAX_NUM_BACKENDS];
+
+static int	stat_num_shards(void);
+static volatile PER_NODE_STAT *stat_my_shard(int backend_node_id);
+static uint64 stat_sum(int backend_node_id, size_t offset);
+static StatStatementType stat_statement_type(Node *parse_tree);
+static int	latency_bucket(uint64 usec);
+static uint64 latency_bucket_upper_bound(int bucket);
+
+/*
+ * Number of counter shards, one for each child process plus one for the
+ * streaming replication check worker
+ */
+static int
+stat_num_shards(void)
+{
+	return pool_config->num_init_children + 1;
+}
+
+/*
+ * Return the counters of the backend node owned by this process.  NULL if
+ * this process does not count up.
+ */
+static volatile PER_NODE_STAT *
+stat_my_shard(int backend_node_id)
+{
+	int			shard;
+
+	if (backend_node_id < 0 || backend_node_id >= MAX_NUM_BACKENDS)
+		return NULL;
+
+	if (processType == PT_CHILD)
+	{
+		if (my_proc_id < 0 || my_proc_id >= pool_config->num_init_children)
+			return NULL;
+		shard = my_proc_id;
+	}
+	else if (processType == PT_WORKER)
+		shard = pool_config->num_init_children;
+	else
+		return NULL;
+
+	return &per_node_stat[shard * MAX_NUM_BACKENDS + backend_node_id];
+}
+
+/*
+ * Sum up a counter of the backend node over all shards.  offset is the
+ * offset of the counter in PER_NODE_STAT.
+ */
+static uint64
+stat_sum(int backend_node_id, size_t offset)
+{
+	uint64		sum = 0;
+	int			i;
+
+	for (i = 0; i < stat_num_shards(); i++)
+		sum += *(volatile uint64 *) ((char *) &per_node_stat[i * MAX_NUM_BACKENDS + backend_node_id] + offset);
+
+	return sum;
+}
 
 /*
  * Return shared memory size necessary for this module
@@ -50,7 +177,10 @@ stat_shared_memory_size(void)
 	size_t		size;
 
 	/* query counter area */
-	size = MAXALIGN(MAX_NUM_BACKENDS * sizeof(PER_NODE_STAT));
+	size = MAXALIGN(stat_num_shards() * MAX_NUM_BACKENDS * sizeof(PER_NODE_STAT));
+
+	/* latency histogram area */
+	size += MAXALIGN(MAX_NUM_BACKENDS * sizeof(PER_NODE_LATENCY));
 
 	return size;
 }
@@ -63,6 +193,8 @@ void
 stat_set_stat_area(void *address)
 {
 	per_node_stat = (PER_NODE_STAT *) address;
+	per_node_latency = (PER_NODE_LATENCY *) ((char *) address +
+											 MAXALIGN(stat_num_shards() * MAX_NUM_BACKENDS * sizeof(PER_NODE_STAT)));
 }
 
 /*
@@ -75,11 +207,57 @@ stat_init_stat_area(void)
 }
 
 /*
- * Update stat counter
+ * Classify a parse tree into the statement types
+ */
+static StatStatementType
+stat_statement_type(Node *parse_tree)
+{
+	if (IsA(parse_tree, SelectStmt))
+		return STAT_SELECT;
+
+	else if (IsA(parse_tree, InsertStmt))
+		return STAT_INSERT;
+
+	else if (IsA(parse_tree, UpdateStmt))
+		return STAT_UPDATE;
+
+	else if (IsA(parse_tree, DeleteStmt))
+		return STAT_DELETE;
+
+	switch(nodeTag(parse_tree))
+	{
+		case(T_CheckPointStmt):
+		case(T_DeallocateStmt):
+		case(T_DiscardStmt):
+		case(T_ExecuteStmt):
+		case(T_ExplainStmt):
+		case(T_ListenStmt):
+		case(T_LoadStmt):
+		case(T_LockStmt):
+		case(T_NotifyStmt):
+		case(T_PrepareStmt):
+		case(T_TransactionStmt):
+		case(T_UnlistenStmt):
+		case(T_VacuumStmt):
+		case(T_VariableSetStmt):
+		case(T_VariableShowStmt):
+			return STAT_OTHER;
+
+		default:
+			return STAT_DDL;
+	}
+}
+
+/*
+ * Update stat counter.  Also remember the start time of the query to
+ * record its latency when the backend node becomes ready for query.
  */
 void
 stat_count_up(int backend_node_id, Node *parse_tree)
 {
+	volatile PER_NODE_STAT *stat;
+	StatStatementType type;
+
 	if (parse_tree == NULL)
 	{
 		/*
@@ -91,51 +269,80 @@ stat_count_up(int backend_node_id, Node *parse_tree)
 		return;
 	}
 
-	if (IsA(parse_tree, SelectStmt))
-	{
-		per_node_stat[backend_node_id].select_cnt++;
-	}
+	stat = stat_my_shard(backend_node_id);
+	if (stat == NULL)
+		return;
 
-	else if (IsA(parse_tree, InsertStmt))
-	{
-		per_node_stat[backend_node_id].insert_cnt++;
-	}
+	type = stat_statement_type(parse_tree);
+	stat->query_cnt[type]++;
+	stat->queries_in_progress = 1;
 
-	else if (IsA(parse_tree, UpdateStmt))
-	{
-		per_node_stat[backend_node_id].update_cnt++;
-	}
+	query_in_progress[backend_node_id] = true;
+	query_type[backend_node_id] = type;
+	gettimeofday(&query_start_time[backend_node_id], NULL);
+}
 
-	else if (IsA(parse_tree, DeleteStmt))
-	{
-		per_node_stat[backend_node_id].delete_cnt++;
-	}
+/*
+ * Record the latency of the query in progress on the backend node.  This
+ * should be called when the backend node sends ReadyForQuery.  If more
+ * than one query were sent before that, the latency of the last one is
+ * recorded.
+ */
+void
+stat_end_query(int backend_node_id)
+{
+	volatile PER_NODE_STAT *stat;
+	volatile PER_NODE_LATENCY *latency;
+	struct timeval now;
+	int64		usec;
+	double		ewma;
+
+	if (backend_node_id < 0 || backend_node_id >= MAX_NUM_BACKENDS ||
+		!query_in_progress[backend_node_id])
+		return;
 
+	query_in_progress[backend_node_id] = false;
+
+	stat = stat_my_shard(backend_node_id);
+	if (stat)
+		stat->queries_in_progress = 0;
+
+	gettimeofday(&now, NULL);
+	usec = (now.tv_sec - query_start_time[backend_node_id].tv_sec) * 1000000 +
+		(now.tv_usec - query_start_time[backend_node_id].tv_usec);
+	if (usec < 0)
+		usec = 0;
+
+	latency = &per_node_latency[backend_node_id];
+	__sync_fetch_and_add(&latency->hist[query_type[backend_node_id]].bucket[latency_bucket(usec)], 1);
+
+	ewma = stat_get_latency_ewma(backend_node_id);
+	if (ewma <= 0.0)
+		ewma = usec;
 	else
+		ewma += STAT_EWMA_ALPHA * (usec - ewma);
+	latency->ewma_latency = ewma;
+	latency->ewma_time = now.tv_sec;
+}
+
+/*
+ * Forget the queries in progress of this process.  Called upon child
+ * startup, since the shard may have been left over by a child which died
+ * in the middle of a query, and when a session is aborted, because
+ * ReadyForQuery of the query in progress will never arrive.
+ */
+void
+stat_reset_queries_in_progress(void)
+{
+	volatile PER_NODE_STAT *stat;
+	int			i;
+
+	for (i = 0; i < MAX_NUM_BACKENDS; i++)
 	{
-		switch(nodeTag(parse_tree))
-		{
-			case(T_CheckPointStmt):
-			case(T_DeallocateStmt):
-			case(T_DiscardStmt):
-			case(T_ExecuteStmt):
-			case(T_ExplainStmt):
-			case(T_ListenStmt):
-			case(T_LoadStmt):
-			case(T_LockStmt):
-			case(T_NotifyStmt):
-			case(T_PrepareStmt):
-			case(T_TransactionStmt):
-			case(T_UnlistenStmt):
-			case(T_VacuumStmt):
-			case(T_VariableSetStmt):
-			case(T_VariableShowStmt):
-				per_node_stat[backend_node_id].other_cnt++;
-				break;
-
-			default:
-				per_node_stat[backend_node_id].ddl_cnt++;
-		}
+		query_in_progress[i] = false;
+		stat = stat_my_shard(i);
+		if (stat)
+			stat->queries_in_progress = 0;
 	}
 }
 
@@ -145,12 +352,126 @@ stat_count_up(int backend_node_id, Node *parse_tree)
 void
 error_stat_count_up(int backend_node_id, char *str)
 {
+	volatile PER_NODE_STAT *stat;
+
+	stat = stat_my_shard(backend_node_id);
+	if (stat == NULL)
+		return;
+
 	if (strcasecmp(str, "PANIC") == 0)
-		per_node_stat[backend_node_id].panic_cnt++;
+		stat->panic_cnt++;
 	else if (strcasecmp(str, "FATAL") == 0)
-		per_node_stat[backend_node_id].fatal_cnt++;
+		stat->fatal_cnt++;
 	else if (strcasecmp(str, "ERROR") == 0)
-		per_node_stat[backend_node_id].error_cnt++;
+		stat->error_cnt++;
+}
+
+/*
+ * Update byte counters
+ */
+void
+stat_count_bytes_in(int backend_node_id, int len)
+{
+	volatile PER_NODE_STAT *stat;
+
+	stat = stat_my_shard(backend_node_id);
+	if (stat)
+		stat->bytes_in += len;
+}
+
+void
+stat_count_bytes_out(int backend_node_id, int len)
+{
+	volatile PER_NODE_STAT *stat;
+
+	stat = stat_my_shard(backend_node_id);
+	if (stat)
+		stat->bytes_out += len;
+}
+
+/*
+ * Return the histogram bucket of the latency
+ */
+static int
+latency_bucket(uint64 usec)
+{
+	int			exp;
+
+	if (usec < STAT_HIST_SUB_BUCKETS)
+		return usec;
+	if (usec >= ((uint64) 1 << STAT_HIST_MAX_EXP))
+		return STAT_HIST_BUCKETS - 1;
+
+	/* exp = floor(log2(usec)) */
+	for (exp = STAT_HIST_SUB_BITS; (usec >> (exp + 1)) != 0; exp++)
+		;
+
+	return (exp - STAT_HIST_SUB_BITS + 1) * STAT_HIST_SUB_BUCKETS +
+		((usec >> (exp - STAT_HIST_SUB_BITS)) & (STAT_HIST_SUB_BUCKETS - 1));
+}
+
+/*
+ * Return the highest latency which falls into the bucket
+ */
+static uint64
+latency_bucket_upper_bound(int bucket)
+{
+	int			exp;
+	int			sub;
+
+	if (bucket < STAT_HIST_SUB_BUCKETS)
+		return bucket;
+
+	exp = bucket / STAT_HIST_SUB_BUCKETS + STAT_HIST_SUB_BITS - 1;
+	sub = bucket % STAT_HIST_SUB_BUCKETS;
+
+	return ((uint64) (STAT_HIST_SUB_BUCKETS + sub + 1) << (exp - STAT_HIST_SUB_BITS)) - 1;
+}
+
+/*
+ * Return the latency percentile of the backend node in microseconds.
+ * percentile is between 0 and 100.  If type is STAT_NUM_STATEMENT_TYPES,
+ * queries of all statement types are considered.  Returns 0 if no latency
+ * has been recorded.
+ */
+uint64
+stat_get_latency_percentile(int backend_node_id, StatStatementType type, double percentile)
+{
+	uint64		counts[STAT_HIST_BUCKETS];
+	uint64		total = 0;
+	uint64		target;
+	uint64		sum = 0;
+	int			i;
+	int			t;
+
+	for (i = 0; i < STAT_HIST_BUCKETS; i++)
+	{
+		counts[i] = 0;
+		for (t = 0; t < STAT_NUM_STATEMENT_TYPES; t++)
+		{
+			if (type == STAT_NUM_STATEMENT_TYPES || type == t)
+				counts[i] += per_node_latency[backend_node_id].hist[t].bucket[i];
+		}
+		total += counts[i];
+	}
+
+	if (total == 0)
+		return 0;
+
+	target = (uint64) (total * percentile / 100.0 + 0.5);
+	if (target < 1)
+		target = 1;
+	if (target > total)
+		target = total;
+
+	for (i = 0; i < STAT_HIST_BUCKETS; i++)
+	{
+		sum += counts[i];
+		if (sum >= target)
+			break;
+	}
+
+	return latency_bucket_upper_bound(i);
 }
 
 /*
@@ -159,53 +480,92 @@ error_stat_count_up(int backend_node_id, char *str)
 uint64
 stat_get_select_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].select_cnt;
+	return stat_sum(backend_node_id, offsetof(PER_NODE_STAT, query_cnt[STAT_SELECT]));
 }
 
 uint64
 stat_get_insert_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].insert_cnt;
+	return stat_sum(backend_node_id, offsetof(PER_NODE_STAT, query_cnt[STAT_INSERT]));
 }
 
 uint64
 stat_get_update_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].update_cnt;
+	return stat_sum(backend_node_id, offsetof(PER_NODE_STAT, query_cnt[STAT_UPDATE]));
 }
 
 uint64
 stat_get_delete_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].delete_cnt;
+	return stat_sum(backend_node_id, offsetof(PER_NODE_STAT, query_cnt[STAT_DELETE]));
 }
 
 uint64
 stat_get_ddl_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].ddl_cnt;
+	return stat_sum(backend_node_id, offsetof(PER_NODE_STAT, query_cnt[STAT_DDL]));
 }
 
 uint64
 stat_get_other_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].other_cnt;
+	return stat_sum(backend_node_id, offsetof(PER_NODE_STAT, query_cnt[STAT_OTHER]));
 }
 
 uint64
 stat_get_panic_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].panic_cnt;
+	return stat_sum(backend_node_id, offsetof(PER_NODE_STAT, panic_cnt));
 }
 
 uint64
 stat_get_fatal_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].fatal_cnt;
+	return stat_sum(backend_node_id, offsetof(PER_NODE_STAT, fatal_cnt));
 }
 
 uint64
 stat_get_error_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].error_cnt;
+	return stat_sum(backend_node_id, offsetof(PER_NODE_STAT, error_cnt));
+}
+
+uint64
+stat_get_bytes_in(int backend_node_id)
+{
+	return stat_sum(backend_node_id, offsetof(PER_NODE_STAT, bytes_in));
+}
+
+uint64
+stat_get_bytes_out(int backend_node_id)
+{
+	return stat_sum(backend_node_id, offsetof(PER_NODE_STAT, bytes_out));
+}
+
+/*
+ * Number of queries currently outstanding on the backend node, summed
+ * over all child processes
+ */
+uint64
+stat_get_queries_in_progress(int backend_node_id)
+{
+	return stat_sum(backend_node_id, offsetof(PER_NODE_STAT, queries_in_progress));
+}
+
+/*
+ * Moving average latency of the backend node in microseconds.  0 if no
+ * latency has been recorded yet.
+ */
+double
+stat_get_latency_ewma(int backend_node_id)
+{
+	double		ewma = per_node_latency[backend_node_id].ewma_latency;
+	time_t		elapsed = time(NULL) - per_node_latency[backend_node_id].ewma_time;
+	int			i;
+
+	for (i = 0; i < elapsed / STAT_EWMA_HALF_LIFE && ewma > 1.0; i++)
+		ewma /= 2;
+
+	return ewma;
 }
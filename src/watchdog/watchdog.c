@@ -42,6 +42,11 @@
 #include <netdb.h>
 #include <fcntl.h>
 #include <ctype.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
 
 #include "pool.h"
 #include "pool_config.h"
@@ -388,12 +393,63 @@ typedef struct WDFailoverObject
 	int			state;
 }			WDFailoverObject;
 
+/* What a socket watched by the watchdog main loop is used for */
+typedef enum WDSocketKind
+{
+	WD_SOCK_KIND_NONE = 0,
+	WD_SOCK_KIND_WD_SERVER,
+	WD_SOCK_KIND_IPC_SERVER,
+	WD_SOCK_KIND_NETWORK_MONITOR,
+	WD_SOCK_KIND_NODE_CLIENT,
+	WD_SOCK_KIND_NODE_SERVER,
+	WD_SOCK_KIND_UNIDENTIFIED,
+	WD_SOCK_KIND_IPC_CLIENT,
+	WD_SOCK_KIND_NOTIFY_CLIENT
+}			WDSocketKind;
+
+#define WD_EV_READ	0x01
+#define WD_EV_WRITE	0x02
+
+/* Partially received IPC packet */
+typedef struct WDIPCReadState
+{
+	char		header[sizeof(char) + sizeof(int)];	/* type and data length */
+	int			header_read;
+	int			data_len;
+	char	   *data;
+	int			data_read;
+}			WDIPCReadState;
+
+typedef struct WDWatchedSocket
+{
+	WDSocketKind kind;
+	void	   *owner;			/* WatchdogNode or SocketConnection */
+	int			events;			/* WD_EV_* registered */
+	WDIPCReadState *ipc_read;	/* only for IPC clients */
+}			WDWatchedSocket;
+
+typedef struct WDReadySocket
+{
+	int			sock;
+	int			events;
+}			WDReadySocket;
+
+/* Maximum number of sockets processed per loop iteration */
+#define WD_MAX_READY_SOCKETS	64
+
 #ifdef WATCHDOG_DEBUG_OPTS
 #if WATCHDOG_DEBUG_OPTS > 0
 #define WATCHDOG_DEBUG
 #endif
 #endif
 
+static WDWatchedSocket *wd_watched = NULL;	/* indexed by socket */
+static int	wd_watched_size = 0;
+static WDReadySocket wd_ready[WD_MAX_READY_SOCKETS];
+#ifdef __linux__
+static int	wd_epoll_fd = -1;
+#endif
+
 static bool check_debug_request_do_not_send_beacon(void);
 static bool check_debug_request_do_not_reply_beacon(void);
 static bool check_debug_request_kill_all_communication(void);
@@ -444,8 +500,12 @@ static bool is_node_active_and_reachable(WatchdogNode * wdNode);
 static bool is_node_active(WatchdogNode * wdNode);
 static bool is_node_reachable(WatchdogNode * wdNode);
 
-static int	update_successful_outgoing_cons(fd_set *wmask, int pending_fds_count);
-static int	prepare_fds(fd_set *rmask, fd_set *wmask, fd_set *emask);
+static void update_outgoing_connection(WatchdogNode * wdNode);
+static void wd_watch_socket(int sock, WDSocketKind kind, void *owner, int events);
+static void wd_unwatch_socket(int sock);
+static void close_watched_socket(int sock);
+static int	wd_wait_for_sockets(int timeout_ms);
+static void process_ready_sockets(int nready);
 
 static void set_next_commandID_in_message(WDPacketData * pkt);
 static void set_message_commandID(WDPacketData * pkt, unsigned int commandID);
@@ -477,7 +537,11 @@ static int	get_minimum_remote_nodes_required_for_quorum(void);
 static int	get_minimum_votes_to_resolve_consensus(void);
 
 static bool write_packet_to_socket(int sock, WDPacketData * pkt, bool ipcPacket);
-static int	read_sockets(fd_set *rmask, int pending_fds_count);
+static void read_node_socket(WatchdogNode * wdNode, SocketConnection * conn);
+static void read_unidentified_socket(SocketConnection * conn);
+static void read_ipc_client_socket(int command_sock);
+static void read_notify_client_socket(int notify_sock);
+static void read_network_monitor_socket(void);
 static void set_timeout(unsigned int sec);
 static int	wd_create_command_server_socket(void);
 static void close_socket_connection(SocketConnection * conn);
@@ -493,7 +557,8 @@ static int	send_message_of_type(WatchdogNode * wdNode, char type, WDPacketData *
 static bool send_cluster_service_message(WatchdogNode * wdNode, WDPacketData * replyFor, char message);
 
 
-static int	accept_incomming_connections(fd_set *rmask, int pending_fds_count);
+static void accept_watchdog_connection(void);
+static void accept_ipc_connection(void);
 
 static int	standard_packet_processor(WatchdogNode * wdNode, WDPacketData * pkt);
 static void cluster_service_message_processor(WatchdogNode * wdNode, WDPacketData * pkt);
@@ -521,6 +586,7 @@ static bool beacon_message_received_from_node(WatchdogNode * wdNode, WDPacketDat
 
 static void cleanUpIPCCommand(WDCommandData * ipcCommand);
 static bool read_ipc_socket_and_process(int socket, bool *remove_socket);
+static int	read_ipc_packet_nonblocking(int sock, WDIPCReadState * rs);
 
 static JsonNode * get_node_list_json(int id);
 static bool add_nodeinfo_to_json(JsonNode * jNode, WatchdogNode * node);
@@ -1059,10 +1125,20 @@ connect_to_node(WatchdogNode * wdNode)
 	}
 	else
 	{
+		/*
+		 * wait for writing on the socket waiting for connection, while
+		 * already connected will be only be waiting for read
+		 */
 		if (connected)
+		{
 			wdNode->client_socket.sock_state = WD_SOCK_CONNECTED;
+			wd_watch_socket(wdNode->client_socket.sock, WD_SOCK_KIND_NODE_CLIENT, wdNode, WD_EV_READ);
+		}
 		else
+		{
 			wdNode->client_socket.sock_state = WD_SOCK_WAITING_FOR_CONNECT;
+			wd_watch_socket(wdNode->client_socket.sock, WD_SOCK_KIND_NODE_CLIENT, wdNode, WD_EV_WRITE);
+		}
 	}
 	return (wdNode->client_socket.sock_state != WD_SOCK_ERROR);
 }
@@ -1130,12 +1206,8 @@ fork_watchdog_child(void)
 static int
 watchdog_main(void)
 {
-	fd_set		rmask;
-	fd_set		wmask;
-	fd_set		emask;
-	const int	select_timeout = 1;
-	struct timeval tv,
-				ref_time;
+	const int	wait_timeout = 1;
+	struct timeval ref_time;
 
 	volatile int fd;
 	sigjmp_buf	local_sigjmp_buf;
@@ -1174,6 +1246,19 @@ watchdog_main(void)
 	/* try connecting to all watchdog nodes */
 	g_cluster.network_monitor_sock = create_monitoring_socket();
 
+#ifdef __linux__
+	wd_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (wd_epoll_fd < 0)
+		ereport(FATAL,
+				(return_code(POOL_EXIT_FATAL),
+				 errmsg("failed to create watchdog event loop"),
+				 errdetail("epoll_create1 failed with reason: \"%m\"")));
+#endif
+	wd_watch_socket(g_cluster.localNode->server_socket.sock, WD_SOCK_KIND_WD_SERVER, NULL, WD_EV_READ);
+	wd_watch_socket(g_cluster.command_server_sock, WD_SOCK_KIND_IPC_SERVER, NULL, WD_EV_READ);
+	if (g_cluster.network_monitor_sock > 0)
+		wd_watch_socket(g_cluster.network_monitor_sock, WD_SOCK_KIND_NETWORK_MONITOR, NULL, WD_EV_READ);
+
 	if (any_interface_available() == false)
 	{
 		ereport(FATAL,
@@ -1212,8 +1297,7 @@ watchdog_main(void)
 	/* watchdog child loop */
 	for (;;)
 	{
-		int			fd_max,
-					select_ret;
+		int			nready;
 		bool		timeout_event = false;
 
 		MemoryContextSwitchTo(ProcessLoopContext);
@@ -1221,10 +1305,7 @@ watchdog_main(void)
 
 		check_signals();
 
-		fd_max = prepare_fds(&rmask, &wmask, &emask);
-		tv.tv_sec = select_timeout;
-		tv.tv_usec = 0;
-		select_ret = select(fd_max + 1, &rmask, &wmask, &emask, &tv);
+		nready = wd_wait_for_sockets(wait_timeout * 1000);
 
 		gettimeofday(&ref_time, NULL);
 
@@ -1239,14 +1320,8 @@ watchdog_main(void)
 #ifdef WATCHDOG_DEBUG
 		load_watchdog_debug_test_option();
 #endif
-		if (select_ret > 0)
-		{
-			int			processed_fds = 0;
-
-			processed_fds += accept_incomming_connections(&rmask, (select_ret - processed_fds));
-			processed_fds += update_successful_outgoing_cons(&wmask, (select_ret - processed_fds));
-			processed_fds += read_sockets(&rmask, (select_ret - processed_fds));
-		}
+		if (nready > 0)
+			process_ready_sockets(nready);
 		if (WD_TIME_DIFF_SEC(ref_time, g_tm_set_time) >= 1)
 		{
 			process_wd_func_commands_for_timer_events();
@@ -1343,479 +1418,519 @@ FileUnlink(int code, Datum path)
 
 
 /*
- * sets all the valid watchdog cluster descriptors to the fd_set.
- returns the fd_max */
-static int
-prepare_fds(fd_set *rmask, fd_set *wmask, fd_set *emask)
+ * Watchdog event loop sockets.
+ *
+ * The sockets the watchdog waits on are kept in a table indexed by the
+ * file descriptor, which tells what the descriptor is used for so that a
+ * ready descriptor is dispatched without walking the node and IPC client
+ * lists.  On Linux the table is mirrored in an epoll set, elsewhere poll()
+ * is used.  A socket is registered when it is created or accepted and
+ * registered again when its use or the events waited for change.  Sockets
+ * must be closed with close_watched_socket() so that a reused descriptor
+ * number is never mistaken for the old socket.
+ */
+static void
+wd_watch_socket(int sock, WDSocketKind kind, void *owner, int events)
 {
-	int			i;
-	ListCell   *lc;
-	int			fd_max = g_cluster.localNode->server_socket.sock;
+	WDWatchedSocket *ws;
 
-	FD_ZERO(rmask);
-	FD_ZERO(wmask);
-	FD_ZERO(emask);
+	if (sock < 0)
+		return;
 
-	/* local node server socket will set the read and exception fds */
-	FD_SET(g_cluster.localNode->server_socket.sock, rmask);
-	FD_SET(g_cluster.localNode->server_socket.sock, emask);
+	if (sock >= wd_watched_size)
+	{
+		int			new_size = Max(sock + 1, wd_watched_size * 2);
+		MemoryContext oldCxt = MemoryContextSwitchTo(TopMemoryContext);
 
-	/* command server socket will set the read and exception fds */
-	FD_SET(g_cluster.command_server_sock, rmask);
-	FD_SET(g_cluster.command_server_sock, emask);
-	if (fd_max < g_cluster.command_server_sock)
-		fd_max = g_cluster.command_server_sock;
+		if (wd_watched)
+			wd_watched = repalloc(wd_watched, sizeof(WDWatchedSocket) * new_size);
+		else
+			wd_watched = palloc(sizeof(WDWatchedSocket) * new_size);
+		memset(&wd_watched[wd_watched_size], 0, sizeof(WDWatchedSocket) * (new_size - wd_watched_size));
+		wd_watched_size = new_size;
+		MemoryContextSwitchTo(oldCxt);
+	}
 
-	FD_SET(g_cluster.network_monitor_sock, rmask);
-	if (fd_max < g_cluster.network_monitor_sock)
-		fd_max = g_cluster.network_monitor_sock;
+	ws = &wd_watched[sock];
+	ws->kind = kind;
+	ws->owner = owner;
 
-	/*
-	 * set write fdset for all waiting for connection sockets, while already
-	 * connected will be only be waiting for read
-	 */
-	for (i = 0; i < g_cluster.remoteNodeCount; i++)
+	if (ws->events != events)
 	{
-		WatchdogNode *wdNode = &(g_cluster.remoteNodes[i]);
+#ifdef __linux__
+		struct epoll_event ev;
 
-		if (wdNode->client_socket.sock > 0)
+		memset(&ev, 0, sizeof(ev));
+		ev.events = ((events & WD_EV_READ) ? EPOLLIN : 0) | ((events & WD_EV_WRITE) ? EPOLLOUT : 0);
+		ev.data.fd = sock;
+		if (epoll_ctl(wd_epoll_fd, ws->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, sock, &ev) < 0 &&
+			(errno != ENOENT || epoll_ctl(wd_epoll_fd, EPOLL_CTL_ADD, sock, &ev) < 0))
 		{
-			if (fd_max < wdNode->client_socket.sock)
-				fd_max = wdNode->client_socket.sock;
+			ereport(DEBUG1,
+					(errmsg("failed to watch socket %d", sock),
+					 errdetail("epoll_ctl failed with error \"%m\"")));
+			ws->kind = WD_SOCK_KIND_NONE;
+			return;
+		}
+#endif
+		ws->events = events;
+	}
+}
 
-			FD_SET(wdNode->client_socket.sock, emask);
+/*
+ * Stop watching the socket.  Must be called before the socket is closed.
+ */
+static void
+wd_unwatch_socket(int sock)
+{
+	WDWatchedSocket *ws;
 
-			if (wdNode->client_socket.sock_state == WD_SOCK_WAITING_FOR_CONNECT)
-				FD_SET(wdNode->client_socket.sock, wmask);
-			else
-				FD_SET(wdNode->client_socket.sock, rmask);
-		}
-		if (wdNode->server_socket.sock > 0)
-		{
-			if (fd_max < wdNode->server_socket.sock)
-				fd_max = wdNode->server_socket.sock;
+	if (sock < 0 || sock >= wd_watched_size)
+		return;
 
-			FD_SET(wdNode->server_socket.sock, emask);
-			FD_SET(wdNode->server_socket.sock, rmask);
-		}
+	ws = &wd_watched[sock];
+#ifdef __linux__
+	if (ws->events)
+		epoll_ctl(wd_epoll_fd, EPOLL_CTL_DEL, sock, NULL);
+#endif
+	if (ws->ipc_read)
+	{
+		if (ws->ipc_read->data)
+			pfree(ws->ipc_read->data);
+		pfree(ws->ipc_read);
 	}
+	memset(ws, 0, sizeof(WDWatchedSocket));
+}
 
-	/*
-	 * I know this is getting complex but we need to add all incomming
-	 * unassigned connection sockets these one will go for reading
-	 */
-	foreach(lc, g_cluster.unidentified_socks)
-	{
-		SocketConnection *conn = lfirst(lc);
-		int			ui_sock = conn->sock;
+static void
+close_watched_socket(int sock)
+{
+	wd_unwatch_socket(sock);
+	close(sock);
+}
 
-		if (ui_sock > 0)
-		{
-			FD_SET(ui_sock, rmask);
-			FD_SET(ui_sock, emask);
-			if (fd_max < ui_sock)
-				fd_max = ui_sock;
-		}
+/*
+ * Wait for the watched sockets to become ready.  The ready sockets and
+ * their events are returned in wd_ready.  Returns the number of ready
+ * sockets, 0 on timeout or -1 on error.
+ */
+static int
+wd_wait_for_sockets(int timeout_ms)
+{
+	int			i;
+	int			nready = 0;
+#ifdef __linux__
+	struct epoll_event evs[WD_MAX_READY_SOCKETS];
+	int			ret;
+
+	ret = epoll_wait(wd_epoll_fd, evs, WD_MAX_READY_SOCKETS, timeout_ms);
+	if (ret <= 0)
+		return ret;
+
+	for (i = 0; i < ret; i++)
+	{
+		wd_ready[nready].sock = evs[i].data.fd;
+		wd_ready[nready].events = 0;
+		if (evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+			wd_ready[nready].events |= WD_EV_READ;
+		if (evs[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+			wd_ready[nready].events |= WD_EV_WRITE;
+		nready++;
 	}
+#else
+	static struct pollfd *pfds = NULL;
+	static int	pfds_size = 0;
+	int			nfds = 0;
+	int			ret;
 
-	/* Add the notification connected clients */
-	foreach(lc, g_cluster.notify_clients)
+	if (pfds_size < wd_watched_size)
 	{
-		int			ui_sock = lfirst_int(lc);
+		MemoryContext oldCxt = MemoryContextSwitchTo(TopMemoryContext);
 
-		if (ui_sock > 0)
-		{
-			FD_SET(ui_sock, rmask);
-			FD_SET(ui_sock, emask);
-			if (fd_max < ui_sock)
-				fd_max = ui_sock;
-		}
+		if (pfds)
+			pfree(pfds);
+		pfds = palloc(sizeof(struct pollfd) * wd_watched_size);
+		pfds_size = wd_watched_size;
+		MemoryContextSwitchTo(oldCxt);
 	}
 
-	/* Finally Add the command IPC sockets */
-	foreach(lc, g_cluster.ipc_command_socks)
+	for (i = 0; i < wd_watched_size; i++)
 	{
-		int			ui_sock = lfirst_int(lc);
-
-		if (ui_sock > 0)
-		{
-			FD_SET(ui_sock, rmask);
-			FD_SET(ui_sock, emask);
-			if (fd_max < ui_sock)
-				fd_max = ui_sock;
-		}
+		if (wd_watched[i].kind == WD_SOCK_KIND_NONE)
+			continue;
+		pfds[nfds].fd = i;
+		pfds[nfds].events = ((wd_watched[i].events & WD_EV_READ) ? POLLIN : 0) |
+			((wd_watched[i].events & WD_EV_WRITE) ? POLLOUT : 0);
+		pfds[nfds].revents = 0;
+		nfds++;
 	}
 
-	return fd_max;
+	ret = poll(pfds, nfds, timeout_ms);
+	if (ret <= 0)
+		return ret;
+
+	for (i = 0; i < nfds && nready < WD_MAX_READY_SOCKETS; i++)
+	{
+		if (pfds[i].revents == 0)
+			continue;
+		wd_ready[nready].sock = pfds[i].fd;
+		wd_ready[nready].events = 0;
+		if (pfds[i].revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL))
+			wd_ready[nready].events |= WD_EV_READ;
+		if (pfds[i].revents & (POLLOUT | POLLERR | POLLHUP | POLLNVAL))
+			wd_ready[nready].events |= WD_EV_WRITE;
+		nready++;
+	}
+#endif
+	return nready;
 }
 
-static int
-read_sockets(fd_set *rmask, int pending_fds_count)
+/*
+ * Process the sockets reported ready by wd_wait_for_sockets()
+ */
+static void
+process_ready_sockets(int nready)
 {
-	int			i,
-				count = 0;
-	List	   *socks_to_del = NIL;
-	ListCell   *lc;
+	int			i;
 
-	for (i = 0; i < g_cluster.remoteNodeCount; i++)
+	for (i = 0; i < nready; i++)
 	{
-		WatchdogNode *wdNode = &(g_cluster.remoteNodes[i]);
+		int			sock = wd_ready[i].sock;
+		WDWatchedSocket *ws;
+
+		/* the socket may have been closed while processing earlier ones */
+		if (sock >= wd_watched_size || wd_watched[sock].kind == WD_SOCK_KIND_NONE)
+			continue;
 
-		if (is_socket_connection_connected(&wdNode->client_socket))
+		ws = &wd_watched[sock];
+		switch (ws->kind)
 		{
-			if (FD_ISSET(wdNode->client_socket.sock, rmask))
-			{
-				ereport(DEBUG2,
-						(errmsg("client socket of %s is ready for reading", wdNode->nodeName)));
+			case WD_SOCK_KIND_WD_SERVER:
+				accept_watchdog_connection();
+				break;
 
-				WDPacketData *pkt = read_packet(&wdNode->client_socket);
+			case WD_SOCK_KIND_IPC_SERVER:
+				accept_ipc_connection();
+				break;
+
+			case WD_SOCK_KIND_NETWORK_MONITOR:
+				read_network_monitor_socket();
+				break;
 
-				if (pkt)
+			case WD_SOCK_KIND_NODE_CLIENT:
 				{
-					if (check_debug_request_kill_all_communication() == false &&
-						check_debug_request_kill_all_receivers() == false)
-					{
-						watchdog_state_machine(WD_EVENT_PACKET_RCV, wdNode, pkt, NULL);
-						/* since a packet is received reset last sent time */
-						wdNode->last_sent_time.tv_sec = 0;
-						wdNode->last_sent_time.tv_usec = 0;
-					}
-					free_packet(pkt);
+					WatchdogNode *wdNode = ws->owner;
+
+					if (wdNode->client_socket.sock_state == WD_SOCK_WAITING_FOR_CONNECT)
+						update_outgoing_connection(wdNode);
+					else if (is_socket_connection_connected(&wdNode->client_socket))
+						read_node_socket(wdNode, &wdNode->client_socket);
 				}
-				else
+				break;
+
+			case WD_SOCK_KIND_NODE_SERVER:
 				{
-					ereport(LOG,
-							(errmsg("client socket of %s is closed", wdNode->nodeName)));
+					WatchdogNode *wdNode = ws->owner;
+
+					if (is_socket_connection_connected(&wdNode->server_socket))
+						read_node_socket(wdNode, &wdNode->server_socket);
 				}
+				break;
 
-				count++;
-				if (count >= pending_fds_count)
-					return count;
-			}
+			case WD_SOCK_KIND_UNIDENTIFIED:
+				read_unidentified_socket(ws->owner);
+				break;
+
+			case WD_SOCK_KIND_IPC_CLIENT:
+				read_ipc_client_socket(sock);
+				break;
+
+			case WD_SOCK_KIND_NOTIFY_CLIENT:
+				read_notify_client_socket(sock);
+				break;
+
+			default:
+				break;
 		}
-		if (is_socket_connection_connected(&wdNode->server_socket))
-		{
-			if (FD_ISSET(wdNode->server_socket.sock, rmask))
-			{
-				ereport(DEBUG2,
-						(errmsg("server socket of %s is ready for reading", wdNode->nodeName)));
-				WDPacketData *pkt = read_packet(&wdNode->server_socket);
+	}
+}
 
-				if (pkt)
-				{
-					if (check_debug_request_kill_all_communication() == false &&
-						check_debug_request_kill_all_receivers() == false)
-					{
-						watchdog_state_machine(WD_EVENT_PACKET_RCV, wdNode, pkt, NULL);
-						/* since a packet is received reset last sent time */
-						wdNode->last_sent_time.tv_sec = 0;
-						wdNode->last_sent_time.tv_usec = 0;
-					}
-					free_packet(pkt);
-				}
-				else
-				{
-					ereport(LOG,
-							(errmsg("outbound socket of %s is closed", wdNode->nodeName)));
-				}
+/*
+ * Read a packet from the client or server socket of the node
+ */
+static void
+read_node_socket(WatchdogNode * wdNode, SocketConnection * conn)
+{
+	WDPacketData *pkt;
+	bool		client = (conn == &wdNode->client_socket);
 
-				count++;
-				if (count >= pending_fds_count)
-					return count;
-			}
+	ereport(DEBUG2,
+			(errmsg("%s socket of %s is ready for reading", client ? "client" : "server", wdNode->nodeName)));
+
+	pkt = read_packet(conn);
+
+	if (pkt)
+	{
+		if (check_debug_request_kill_all_communication() == false &&
+			check_debug_request_kill_all_receivers() == false)
+		{
+			watchdog_state_machine(WD_EVENT_PACKET_RCV, wdNode, pkt, NULL);
+			/* since a packet is received reset last sent time */
+			wdNode->last_sent_time.tv_sec = 0;
+			wdNode->last_sent_time.tv_usec = 0;
 		}
+		free_packet(pkt);
 	}
+	else
+	{
+		ereport(LOG,
+				(errmsg("%s socket of %s is closed", client ? "client" : "outbound", wdNode->nodeName)));
+	}
+}
 
-	foreach(lc, g_cluster.unidentified_socks)
+/*
+ * Read the ADD NODE message from an incomming connection not yet
+ * identified.  The connection is removed from the unidentified list
+ * whatever the outcome.
+ */
+static void
+read_unidentified_socket(SocketConnection * conn)
+{
+	int			i;
+	WDPacketData *pkt;
+
+	ereport(DEBUG2,
+			(errmsg("un-identified socket %d is ready for reading", conn->sock)));
+	/* we only entertain ADD NODE messages from unidentified sockets */
+	pkt = read_packet_of_type(conn, WD_ADD_NODE_MESSAGE);
+	if (pkt)
 	{
-		SocketConnection *conn = lfirst(lc);
+		struct timeval 	previous_startup_time;
+		char	   *authkey = NULL;
+		WatchdogNode *tempNode = parse_node_info_message(pkt, &authkey);
 
-		if (conn->sock > 0 && FD_ISSET(conn->sock, rmask))
+		if (tempNode)
 		{
-			WDPacketData *pkt;
+			WatchdogNode *wdNode;
+			bool		found = false;
+			bool		authenticated = false;
 
-			ereport(DEBUG2,
-					(errmsg("un-identified socket %d is ready for reading", conn->sock)));
-			/* we only entertain ADD NODE messages from unidentified sockets */
-			pkt = read_packet_of_type(conn, WD_ADD_NODE_MESSAGE);
-			if (pkt)
+			if (tempNode->pgpool_node_id == pool_config->pgpool_node_id)
 			{
-				struct timeval 	previous_startup_time;
-				char	   *authkey = NULL;
-				WatchdogNode *tempNode = parse_node_info_message(pkt, &authkey);
+				ereport(ERROR,
+						(errmsg("the pgpool node id configured on node \"%s\" cannot be same as local node", tempNode->nodeName),
+						 errdetail("this node id is \"%d\" while local node is \"%d\"",
+								   tempNode->pgpool_node_id,
+								   pool_config->pgpool_node_id)));
+			}
 
-				if (tempNode)
+			print_watchdog_node_info(tempNode);
+			authenticated = verify_authhash_for_node(tempNode, authkey);
+			ereport(DEBUG1,
+					(errmsg("ADD NODE MESSAGE from hostname:\"%s\" port:%d pgpool_port:%d", tempNode->hostname, tempNode->wd_port, tempNode->pgpool_port)));
+			/* verify this node */
+			if (authenticated)
+			{
+				WD_STATES oldNodeState = WD_DEAD;
+				for (i = 0; i < g_cluster.remoteNodeCount; i++)
 				{
-					WatchdogNode *wdNode;
-					bool		found = false;
-					bool		authenticated = false;
+					wdNode = &(g_cluster.remoteNodes[i]);
 
-					if (tempNode->pgpool_node_id == pool_config->pgpool_node_id)
+					if ((wdNode->wd_port == tempNode->wd_port && wdNode->pgpool_port == tempNode->pgpool_port &&
+						wdNode->pgpool_node_id == tempNode->pgpool_node_id) &&
+						((strcmp(wdNode->hostname, conn->addr) == 0) || (strcmp(wdNode->hostname, tempNode->hostname) == 0)))
 					{
-						ereport(ERROR,
-								(errmsg("the pgpool node id configured on node \"%s\" cannot be same as local node", tempNode->nodeName),
-								 errdetail("this node id is \"%d\" while local node is \"%d\"",
-										   tempNode->pgpool_node_id,
-										   pool_config->pgpool_node_id)));
+						/* We have found the match */
+						found = true;
+						previous_startup_time.tv_sec = wdNode->startup_time.tv_sec;
+						oldNodeState = wdNode->state;
+
+						close_socket_connection(&wdNode->server_socket);
+						strlcpy(wdNode->delegate_ip, tempNode->delegate_ip, WD_MAX_HOST_NAMELEN);
+						strlcpy(wdNode->nodeName, tempNode->nodeName, WD_MAX_HOST_NAMELEN);
+						strlcpy(wdNode->pgp_version, tempNode->pgp_version, MAX_VERSION_STR_LEN);
+						wdNode->state = tempNode->state;
+						wdNode->wd_data_major_version = tempNode->wd_data_major_version;
+						wdNode->wd_data_minor_version = tempNode->wd_data_minor_version;
+						wdNode->startup_time.tv_sec = tempNode->startup_time.tv_sec;
+						wdNode->wd_priority = tempNode->wd_priority;
+						wdNode->server_socket = *conn;
+						wdNode->server_socket.sock_state = WD_SOCK_CONNECTED;
+						wd_watch_socket(wdNode->server_socket.sock, WD_SOCK_KIND_NODE_SERVER, wdNode, WD_EV_READ);
+						if (tempNode->current_state_time.tv_sec)
+						{
+							wdNode->current_state_time.tv_sec = tempNode->current_state_time.tv_sec;
+							wdNode->escalated = tempNode->escalated;
+							wdNode->standby_nodes_count = tempNode->standby_nodes_count;
+							wdNode->quorum_status = tempNode->quorum_status;
+						}
+						break;
 					}
+				}
+				if (found)
+				{
+					/* reply with node info message */
+					ereport(LOG,
+							(errmsg("new node joined the cluster hostname:\"%s\" port:%d pgpool_port:%d", wdNode->hostname,
+									wdNode->wd_port,
+									wdNode->pgpool_port),
+							 errdetail("Pgpool-II version:\"%s\" watchdog messaging version: %d.%d",
+									   wdNode->pgp_version,
+									   wdNode->wd_data_major_version,
+									   wdNode->wd_data_minor_version)));
+
+					if (oldNodeState == WD_SHUTDOWN)
+					{
+						ereport(LOG,
+								(errmsg("The newly joined node:\"%s\" had left the cluster because it was shutdown",wdNode->nodeName)));
+						watchdog_state_machine(WD_EVENT_PACKET_RCV, wdNode, pkt, NULL);
 
-					print_watchdog_node_info(tempNode);
-					authenticated = verify_authhash_for_node(tempNode, authkey);
-					ereport(DEBUG1,
-							(errmsg("ADD NODE MESSAGE from hostname:\"%s\" port:%d pgpool_port:%d", tempNode->hostname, tempNode->wd_port, tempNode->pgpool_port)));
-					/* verify this node */
-					if (authenticated)
+					}
+					else if (oldNodeState == WD_LOST)
 					{
-						WD_STATES oldNodeState = WD_DEAD;
-						for (i = 0; i < g_cluster.remoteNodeCount; i++)
-						{
-							wdNode = &(g_cluster.remoteNodes[i]);
+						ereport(LOG,
+								(errmsg("The newly joined node:\"%s\" had left the cluster because it was lost",wdNode->nodeName),
+								 errdetail("lost reason was \"%s\" and startup time diff = %d",
+										   wd_node_lost_reasons[wdNode->node_lost_reason],
+										   abs((int)(previous_startup_time.tv_sec - wdNode->startup_time.tv_sec)))));
 
-							if ((wdNode->wd_port == tempNode->wd_port && wdNode->pgpool_port == tempNode->pgpool_port &&
-								wdNode->pgpool_node_id == tempNode->pgpool_node_id) &&
-								((strcmp(wdNode->hostname, conn->addr) == 0) || (strcmp(wdNode->hostname, tempNode->hostname) == 0)))
-							{
-								/* We have found the match */
-								found = true;
-								previous_startup_time.tv_sec = wdNode->startup_time.tv_sec;
-								oldNodeState = wdNode->state;
-
-								close_socket_connection(&wdNode->server_socket);
-								strlcpy(wdNode->delegate_ip, tempNode->delegate_ip, WD_MAX_HOST_NAMELEN);
-								strlcpy(wdNode->nodeName, tempNode->nodeName, WD_MAX_HOST_NAMELEN);
-								strlcpy(wdNode->pgp_version, tempNode->pgp_version, MAX_VERSION_STR_LEN);
-								wdNode->state = tempNode->state;
-								wdNode->wd_data_major_version = tempNode->wd_data_major_version;
-								wdNode->wd_data_minor_version = tempNode->wd_data_minor_version;
-								wdNode->startup_time.tv_sec = tempNode->startup_time.tv_sec;
-								wdNode->wd_priority = tempNode->wd_priority;
-								wdNode->server_socket = *conn;
-								wdNode->server_socket.sock_state = WD_SOCK_CONNECTED;
-								if (tempNode->current_state_time.tv_sec)
-								{
-									wdNode->current_state_time.tv_sec = tempNode->current_state_time.tv_sec;
-									wdNode->escalated = tempNode->escalated;
-									wdNode->standby_nodes_count = tempNode->standby_nodes_count;
-									wdNode->quorum_status = tempNode->quorum_status;
-								}
-								break;
-							}
-						}
-						if (found)
+						if (abs((int)(previous_startup_time.tv_sec - wdNode->startup_time.tv_sec)) <= 2 &&
+							wdNode->node_lost_reason == NODE_LOST_BY_LIFECHECK)
 						{
-							/* reply with node info message */
 							ereport(LOG,
-									(errmsg("new node joined the cluster hostname:\"%s\" port:%d pgpool_port:%d", wdNode->hostname,
-											wdNode->wd_port,
-											wdNode->pgpool_port),
-									 errdetail("Pgpool-II version:\"%s\" watchdog messaging version: %d.%d",
-											   wdNode->pgp_version,
-											   wdNode->wd_data_major_version,
-											   wdNode->wd_data_minor_version)));
-
-							if (oldNodeState == WD_SHUTDOWN)
-							{
-								ereport(LOG,
-										(errmsg("The newly joined node:\"%s\" had left the cluster because it was shutdown",wdNode->nodeName)));
-								watchdog_state_machine(WD_EVENT_PACKET_RCV, wdNode, pkt, NULL);
-
-							}
-							else if (oldNodeState == WD_LOST)
-							{
-								ereport(LOG,
-										(errmsg("The newly joined node:\"%s\" had left the cluster because it was lost",wdNode->nodeName),
-										 errdetail("lost reason was \"%s\" and startup time diff = %d",
-												   wd_node_lost_reasons[wdNode->node_lost_reason],
-												   abs((int)(previous_startup_time.tv_sec - wdNode->startup_time.tv_sec)))));
-
-								if (abs((int)(previous_startup_time.tv_sec - wdNode->startup_time.tv_sec)) <= 2 &&
-									wdNode->node_lost_reason == NODE_LOST_BY_LIFECHECK)
-								{
-									ereport(LOG,
-										(errmsg("node:\"%s\" was reported lost by the lifecheck process",wdNode->nodeName),
-											 errdetail("only lifecheck process can mark this node alive again")));
-									/* restore the node's lost state */
-									wdNode->state = oldNodeState;
-								}
-								else
-									watchdog_state_machine(WD_EVENT_PACKET_RCV, wdNode, pkt, NULL);
-
-							}
-
+								(errmsg("node:\"%s\" was reported lost by the lifecheck process",wdNode->nodeName),
+									 errdetail("only lifecheck process can mark this node alive again")));
+							/* restore the node's lost state */
+							wdNode->state = oldNodeState;
 						}
 						else
-							ereport(NOTICE,
-									(errmsg("add node from hostname:\"%s\" port:%d pgpool_port:%d rejected.", tempNode->hostname, tempNode->wd_port, tempNode->pgpool_port),
-									 errdetail("verify the other watchdog node configurations")));
-					}
-					else
-					{
-						ereport(NOTICE,
-								(errmsg("authentication failed for add node from hostname:\"%s\" port:%d pgpool_port:%d", tempNode->hostname, tempNode->wd_port, tempNode->pgpool_port),
-								 errdetail("make sure wd_authkey configuration is same on all nodes")));
-					}
+							watchdog_state_machine(WD_EVENT_PACKET_RCV, wdNode, pkt, NULL);
 
-					if (found == false || authenticated == false)
-					{
-						/*
-						 * reply with reject message, We do not need to go to
-						 * state processor
-						 */
-						/* For now, create a empty temp node. */
-						WatchdogNode tmpNode;
-
-						tmpNode.client_socket = *conn;
-						tmpNode.client_socket.sock_state = WD_SOCK_CONNECTED;
-						tmpNode.server_socket.sock = -1;
-						tmpNode.server_socket.sock_state = WD_SOCK_UNINITIALIZED;
-						reply_with_minimal_message(&tmpNode, WD_REJECT_MESSAGE, pkt);
-						close_socket_connection(conn);
 					}
-					pfree(tempNode);
+
 				}
 				else
-				{
-					/*
-					 * Probably some invalid data in the add message
-					 */
-					WatchdogNode tmpNode;
+					ereport(NOTICE,
+							(errmsg("add node from hostname:\"%s\" port:%d pgpool_port:%d rejected.", tempNode->hostname, tempNode->wd_port, tempNode->pgpool_port),
+							 errdetail("verify the other watchdog node configurations")));
+			}
+			else
+			{
+				ereport(NOTICE,
+						(errmsg("authentication failed for add node from hostname:\"%s\" port:%d pgpool_port:%d", tempNode->hostname, tempNode->wd_port, tempNode->pgpool_port),
+						 errdetail("make sure wd_authkey configuration is same on all nodes")));
+			}
 
-					ereport(LOG,
-							(errmsg("unable to parse the add node message")));
-					tmpNode.client_socket = *conn;
-					tmpNode.client_socket.sock_state = WD_SOCK_CONNECTED;
-					tmpNode.server_socket.sock = -1;
-					tmpNode.server_socket.sock_state = WD_SOCK_UNINITIALIZED;
-					reply_with_minimal_message(&tmpNode, WD_REJECT_MESSAGE, pkt);
-					close_socket_connection(conn);
-				}
-				if (authkey)
-					pfree(authkey);
-				free_packet(pkt);
-				count++;
+			if (found == false || authenticated == false)
+			{
+				/*
+				 * reply with reject message, We do not need to go to
+				 * state processor
+				 */
+				/* For now, create a empty temp node. */
+				WatchdogNode tmpNode;
+
+				tmpNode.client_socket = *conn;
+				tmpNode.client_socket.sock_state = WD_SOCK_CONNECTED;
+				tmpNode.server_socket.sock = -1;
+				tmpNode.server_socket.sock_state = WD_SOCK_UNINITIALIZED;
+				reply_with_minimal_message(&tmpNode, WD_REJECT_MESSAGE, pkt);
+				close_socket_connection(conn);
 			}
-			socks_to_del = lappend(socks_to_del, conn);
-			count++;
-			if (count >= pending_fds_count)
-				break;
+			pfree(tempNode);
 		}
-	}
+		else
+		{
+			/*
+			 * Probably some invalid data in the add message
+			 */
+			WatchdogNode tmpNode;
 
-	/* delete all the sockets from unidentified list which are now identified */
-	foreach(lc, socks_to_del)
-	{
-		g_cluster.unidentified_socks = list_delete_ptr(g_cluster.unidentified_socks, lfirst(lc));
+			ereport(LOG,
+					(errmsg("unable to parse the add node message")));
+			tmpNode.client_socket = *conn;
+			tmpNode.client_socket.sock_state = WD_SOCK_CONNECTED;
+			tmpNode.server_socket.sock = -1;
+			tmpNode.server_socket.sock_state = WD_SOCK_UNINITIALIZED;
+			reply_with_minimal_message(&tmpNode, WD_REJECT_MESSAGE, pkt);
+			close_socket_connection(conn);
+		}
+		if (authkey)
+			pfree(authkey);
+		free_packet(pkt);
 	}
+	/* the socket is now identified or closed */
+	g_cluster.unidentified_socks = list_delete_ptr(g_cluster.unidentified_socks, conn);
+	pfree(conn);
+}
 
-	list_free_deep(socks_to_del);
-	socks_to_del = NULL;
-
-	if (count >= pending_fds_count)
-		return count;
+static void
+read_ipc_client_socket(int command_sock)
+{
+	bool		remove_sock = false;
 
-	foreach(lc, g_cluster.ipc_command_socks)
+	read_ipc_socket_and_process(command_sock, &remove_sock);
+	if (remove_sock)
 	{
-		int			command_sock = lfirst_int(lc);
+		/* Also locate the command if it has this socket */
+		WDCommandData *ipcCommand = get_wd_IPC_command_from_socket(command_sock);
 
-		if (command_sock > 0 && FD_ISSET(command_sock, rmask))
+		if (ipcCommand)
 		{
-			bool		remove_sock = false;
-
-			read_ipc_socket_and_process(command_sock, &remove_sock);
-			if (remove_sock)
-			{
-				/* Also locate the command if it has this socket */
-				WDCommandData *ipcCommand = get_wd_IPC_command_from_socket(command_sock);
-
-				if (ipcCommand)
-				{
-					/*
-					 * special case we want to remove the socket from
-					 * ipc_command_sock list manually, so mark the issuing
-					 * socket of ipcComman to invalid value
-					 */
-					ipcCommand->sourceIPCSocket = -1;
-				}
-				close(command_sock);
-				socks_to_del = lappend_int(socks_to_del, command_sock);
-			}
-			count++;
-			if (count >= pending_fds_count)
-				break;
+			/*
+			 * special case we want to remove the socket from
+			 * ipc_command_sock list manually, so mark the issuing socket of
+			 * ipcComman to invalid value
+			 */
+			ipcCommand->sourceIPCSocket = -1;
 		}
+		close_watched_socket(command_sock);
+		g_cluster.ipc_command_socks = list_delete_int(g_cluster.ipc_command_socks, command_sock);
 	}
-	/* delete all the sockets from unidentified list which are now identified */
-	foreach(lc, socks_to_del)
-	{
-		g_cluster.ipc_command_socks = list_delete_int(g_cluster.ipc_command_socks, lfirst_int(lc));
-	}
-
-	list_free(socks_to_del);
-	socks_to_del = NULL;
-
-	if (count >= pending_fds_count)
-		return count;
-
-	foreach(lc, g_cluster.notify_clients)
-	{
-		int			notify_sock = lfirst_int(lc);
+}
 
-		if (notify_sock > 0 && FD_ISSET(notify_sock, rmask))
-		{
-			bool		remove_sock = false;
+static void
+read_notify_client_socket(int notify_sock)
+{
+	bool		remove_sock = false;
 
-			read_ipc_socket_and_process(notify_sock, &remove_sock);
-			if (remove_sock)
-			{
-				close(notify_sock);
-				socks_to_del = lappend_int(socks_to_del, notify_sock);
-			}
-			count++;
-			if (count >= pending_fds_count)
-				break;
-		}
-	}
-	/* delete all the sockets from unidentified list which are now identified */
-	foreach(lc, socks_to_del)
+	read_ipc_socket_and_process(notify_sock, &remove_sock);
+	if (remove_sock)
 	{
-		g_cluster.notify_clients = list_delete_int(g_cluster.notify_clients, lfirst_int(lc));
+		close_watched_socket(notify_sock);
+		g_cluster.notify_clients = list_delete_int(g_cluster.notify_clients, notify_sock);
 	}
+}
 
-	list_free(socks_to_del);
-	socks_to_del = NULL;
-
+/* Check what waits us on interface monitoring socket */
+static void
+read_network_monitor_socket(void)
+{
+	bool		deleted;
+	bool		link_event;
 
-	/* Finally check if something waits us on interface monitoring socket */
-	if (g_cluster.network_monitor_sock > 0 && FD_ISSET(g_cluster.network_monitor_sock, rmask))
+	if (read_interface_change_event(g_cluster.network_monitor_sock, &link_event, &deleted))
 	{
-		bool		deleted;
-		bool		link_event;
-
-		if (read_interface_change_event(g_cluster.network_monitor_sock, &link_event, &deleted))
+		ereport(DEBUG1,
+				(errmsg("network event received"),
+				 errdetail("deleted = %s Link change event = %s",
+						   deleted ? "YES" : "NO",
+						   link_event ? "YES" : "NO")));
+		if (link_event)
+		{
+			if (deleted)
+				watchdog_state_machine(WD_EVENT_NW_LINK_IS_INACTIVE, NULL, NULL, NULL);
+			else
+				watchdog_state_machine(WD_EVENT_NW_LINK_IS_ACTIVE, NULL, NULL, NULL);
+		}
+		else
 		{
-			ereport(DEBUG1,
-					(errmsg("network event received"),
-					 errdetail("deleted = %s Link change event = %s",
-							   deleted ? "YES" : "NO",
-							   link_event ? "YES" : "NO")));
-			if (link_event)
-			{
-				if (deleted)
-					watchdog_state_machine(WD_EVENT_NW_LINK_IS_INACTIVE, NULL, NULL, NULL);
-				else
-					watchdog_state_machine(WD_EVENT_NW_LINK_IS_ACTIVE, NULL, NULL, NULL);
-			}
+			if (deleted)
+				watchdog_state_machine(WD_EVENT_NW_IP_IS_REMOVED, NULL, NULL, NULL);
 			else
-			{
-				if (deleted)
-					watchdog_state_machine(WD_EVENT_NW_IP_IS_REMOVED, NULL, NULL, NULL);
-				else
-					watchdog_state_machine(WD_EVENT_NW_IP_IS_ASSIGNED, NULL, NULL, NULL);
-			}
+				watchdog_state_machine(WD_EVENT_NW_IP_IS_ASSIGNED, NULL, NULL, NULL);
 		}
-		count++;
 	}
-	return count;
 }
 
 static bool
@@ -1867,6 +1982,83 @@ static WDCommandData * create_command_object(int packet_data_length)
 	return wdCommand;
 }
 
+/*
+ * Read the available data of an IPC packet without blocking.  Returns 1 when
+ * the whole packet has been received, 0 if more data is needed and -1 if the
+ * connection is closed or broken.
+ */
+static int
+read_ipc_packet_nonblocking(int sock, WDIPCReadState * rs)
+{
+	for (;;)
+	{
+		char	   *buf;
+		int			len;
+		int			ret;
+
+		if (rs->header_read < sizeof(rs->header))
+		{
+			buf = rs->header + rs->header_read;
+			len = sizeof(rs->header) - rs->header_read;
+		}
+		else if (rs->data_read < rs->data_len)
+		{
+			buf = rs->data + rs->data_read;
+			len = rs->data_len - rs->data_read;
+		}
+		else
+			return 1;
+
+		ret = recv(sock, buf, len, MSG_DONTWAIT);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			ereport(WARNING,
+					(errmsg("error reading from IPC socket"),
+					 errdetail("read from socket failed with error \"%m\"")));
+			return -1;
+		}
+		if (ret == 0)			/* remote end has closed the connection */
+		{
+			if (rs->header_read > 0)
+				ereport(LOG,
+						(errmsg("error reading IPC from socket"),
+						 errdetail("remote end closed the connection in the middle of a packet")));
+			return -1;
+		}
+
+		if (rs->header_read < sizeof(rs->header))
+		{
+			rs->header_read += ret;
+			if (rs->header_read == sizeof(rs->header))
+			{
+				memcpy(&rs->data_len, rs->header + sizeof(char), sizeof(int));
+				rs->data_len = ntohl(rs->data_len);
+				if (rs->data_len < 0)
+				{
+					ereport(WARNING,
+							(errmsg("error reading from IPC socket"),
+							 errdetail("invalid packet length %d", rs->data_len)));
+					return -1;
+				}
+				if (rs->data_len > 0)
+					rs->data = MemoryContextAlloc(TopMemoryContext, rs->data_len);
+			}
+		}
+		else
+			rs->data_read += ret;
+	}
+}
+
+/*
+ * Read an IPC command from the socket and process it.  The socket is read
+ * without blocking, so that a slow client does not hold up the watchdog.
+ * If the command is not complete yet, it is kept and the rest is read when
+ * the socket becomes readable again.
+ */
 static bool
 read_ipc_socket_and_process(int sock, bool *remove_socket)
 {
@@ -1875,34 +2067,32 @@ read_ipc_socket_and_process(int sock, bool *remove_socket)
 				ret;
 	WDCommandData *ipcCommand;
 	IPC_CMD_PREOCESS_RES res;
+	WDWatchedSocket *ws;
+	WDIPCReadState *rs;
 
 	*remove_socket = true;
 
-	/* 1st byte is command type */
-	ret = socket_read(sock, &type, sizeof(char), 0);
-	if (ret == 0)				/* remote end has closed the connection */
+	if (sock < 0 || sock >= wd_watched_size)
 		return false;
 
-	if (ret != sizeof(char))
-	{
-		ereport(WARNING,
-				(errmsg("error reading from IPC socket"),
-				 errdetail("read from socket failed with error \"%m\"")));
-		return false;
-	}
+	ws = &wd_watched[sock];
+	if (ws->ipc_read == NULL)
+		ws->ipc_read = MemoryContextAllocZero(TopMemoryContext, sizeof(WDIPCReadState));
+	rs = ws->ipc_read;
 
-	/* We should have data length */
-	ret = socket_read(sock, &data_len, sizeof(int), 0);
-	if (ret != sizeof(int))
-	{
-		ereport(WARNING,
-				(errmsg("error reading from IPC socket"),
-				 errdetail("read from socket failed with error \"%m\"")));
+	ret = read_ipc_packet_nonblocking(sock, rs);
+	if (ret < 0)
 		return false;
+	if (ret == 0)
+	{
+		*remove_socket = false;
+		return true;
 	}
 
-	data_len = ntohl(data_len);
-	/* see if we have enough information to process this command */
+	/* 1st byte is command type, and then the data length */
+	type = rs->header[0];
+	data_len = rs->data_len;
+
 	ipcCommand = create_command_object(data_len);
 	ipcCommand->sourceIPCSocket = sock;
 	ipcCommand->commandSource = COMMAND_SOURCE_IPC;
@@ -1913,17 +2103,18 @@ read_ipc_socket_and_process(int sock, bool *remove_socket)
 
 	if (data_len > 0)
 	{
-		if (socket_read(sock, ipcCommand->sourcePacket.data, data_len, 0) <= 0)
-		{
-			ereport(LOG,
-					(errmsg("error reading IPC from socket"),
-					 errdetail("read from socket failed with error \"%m\"")));
-			return false;
-		}
+		memcpy(ipcCommand->sourcePacket.data, rs->data, data_len);
+		pfree(rs->data);
 	}
+	memset(rs, 0, sizeof(WDIPCReadState));
 
 	res = process_IPC_command(ipcCommand);
-	if (res == IPC_CMD_PROCESSING)
+	if (res == IPC_CMD_COMPLETE && type == WD_REGISTER_FOR_NOTIFICATION)
+	{
+		/* the socket is kept open to send notifications */
+		*remove_socket = false;
+	}
+	else if (res == IPC_CMD_PROCESSING)
 	{
 		/*
 		 * The command still needs further processing store it in the list
@@ -2001,8 +2192,16 @@ static IPC_CMD_PREOCESS_RES process_IPC_command(WDCommandData * ipcCommand)
 			break;
 
 		case WD_REGISTER_FOR_NOTIFICATION:
-			/* Add this socket to the notify socket list */
-			g_cluster.notify_clients = lappend_int(g_cluster.notify_clients, ipcCommand->sourceIPCSocket);
+			/* Move this socket from the command socket list to the notify socket list */
+			{
+				MemoryContext oldCxt = MemoryContextSwitchTo(TopMemoryContext);
+
+				g_cluster.ipc_command_socks = list_delete_int(g_cluster.ipc_command_socks, ipcCommand->sourceIPCSocket);
+				if (!list_member_int(g_cluster.notify_clients, ipcCommand->sourceIPCSocket))
+					g_cluster.notify_clients = lappend_int(g_cluster.notify_clients, ipcCommand->sourceIPCSocket);
+				MemoryContextSwitchTo(oldCxt);
+			}
+			wd_watch_socket(ipcCommand->sourceIPCSocket, WD_SOCK_KIND_NOTIFY_CLIENT, NULL, WD_EV_READ);
 			/* The command is completed successfully */
 			return IPC_CMD_COMPLETE;
 			break;
@@ -3260,7 +3459,7 @@ wd_system_will_go_down(int code, Datum arg)
 	}
 	/* close network monitoring socket */
 	if (g_cluster.network_monitor_sock > 0)
-		close(g_cluster.network_monitor_sock);
+		close_watched_socket(g_cluster.network_monitor_sock);
 	/* wait for sub-processes to exit */
 	if (g_cluster.de_escalation_pid > 0 || g_cluster.escalation_pid > 0)
 	{
@@ -3279,7 +3478,7 @@ close_socket_connection(SocketConnection * conn)
 	if ((conn->sock > 0 && conn->sock_state == WD_SOCK_CONNECTED)
 		|| conn->sock_state == WD_SOCK_WAITING_FOR_CONNECT)
 	{
-		close(conn->sock);
+		close_watched_socket(conn->sock);
 		conn->sock = -1;
 		conn->sock_state = WD_SOCK_CLOSED;
 	}
@@ -3318,142 +3517,115 @@ is_node_active_and_reachable(WatchdogNode * wdNode)
 	return false;
 }
 
-static int
-accept_incomming_connections(fd_set *rmask, int pending_fds_count)
+static void
+accept_watchdog_connection(void)
 {
-	int			processed_fds = 0;
 	int			fd;
+	struct sockaddr_in addr;
+	socklen_t	addrlen = sizeof(struct sockaddr_in);
 
-	if (FD_ISSET(g_cluster.localNode->server_socket.sock, rmask))
+	fd = accept(g_cluster.localNode->server_socket.sock, (struct sockaddr *) &addr, &addrlen);
+	if (fd < 0)
 	{
-		struct sockaddr_in addr;
-		socklen_t	addrlen = sizeof(struct sockaddr_in);
-
-		processed_fds++;
-		fd = accept(g_cluster.localNode->server_socket.sock, (struct sockaddr *) &addr, &addrlen);
-		if (fd < 0)
+		if (errno == EINTR || errno == 0 || errno == EAGAIN || errno == EWOULDBLOCK)
 		{
-			if (errno == EINTR || errno == 0 || errno == EAGAIN || errno == EWOULDBLOCK)
-			{
-				/* nothing to accept now */
-				ereport(DEBUG2,
-						(errmsg("Failed to accept incoming watchdog connection, Nothing to accept")));
-			}
-			/* accept failed */
-			ereport(DEBUG1,
-					(errmsg("Failed to accept incomming watchdog connection")));
-		}
-		else
-		{
-			MemoryContext oldCxt = MemoryContextSwitchTo(TopMemoryContext);
-			SocketConnection *conn = palloc(sizeof(SocketConnection));
-
-			conn->sock = fd;
-			conn->sock_state = WD_SOCK_CONNECTED;
-			gettimeofday(&conn->tv, NULL);
-			strncpy(conn->addr, inet_ntoa(addr.sin_addr), sizeof(conn->addr) - 1);
-			ereport(LOG,
-					(errmsg("new watchdog node connection is received from \"%s:%d\"", inet_ntoa(addr.sin_addr), addr.sin_port)));
-			g_cluster.unidentified_socks = lappend(g_cluster.unidentified_socks, conn);
-			MemoryContextSwitchTo(oldCxt);
+			/* nothing to accept now */
+			ereport(DEBUG2,
+					(errmsg("Failed to accept incoming watchdog connection, Nothing to accept")));
 		}
+		/* accept failed */
+		ereport(DEBUG1,
+				(errmsg("Failed to accept incomming watchdog connection")));
 	}
-
-	if (processed_fds >= pending_fds_count)
-		return processed_fds;
-
-	if (FD_ISSET(g_cluster.command_server_sock, rmask))
+	else
 	{
-		struct sockaddr addr;
-		socklen_t	addrlen = sizeof(struct sockaddr);
+		MemoryContext oldCxt = MemoryContextSwitchTo(TopMemoryContext);
+		SocketConnection *conn = palloc(sizeof(SocketConnection));
 
-		processed_fds++;
+		conn->sock = fd;
+		conn->sock_state = WD_SOCK_CONNECTED;
+		gettimeofday(&conn->tv, NULL);
+		strncpy(conn->addr, inet_ntoa(addr.sin_addr), sizeof(conn->addr) - 1);
+		ereport(LOG,
+				(errmsg("new watchdog node connection is received from \"%s:%d\"", inet_ntoa(addr.sin_addr), addr.sin_port)));
+		g_cluster.unidentified_socks = lappend(g_cluster.unidentified_socks, conn);
+		MemoryContextSwitchTo(oldCxt);
+		wd_watch_socket(fd, WD_SOCK_KIND_UNIDENTIFIED, conn, WD_EV_READ);
+	}
+}
+
+static void
+accept_ipc_connection(void)
+{
+	struct sockaddr addr;
+	socklen_t	addrlen = sizeof(struct sockaddr);
 
-		int			fd = accept(g_cluster.command_server_sock, &addr, &addrlen);
+	int			fd = accept(g_cluster.command_server_sock, &addr, &addrlen);
 
-		if (fd < 0)
+	if (fd < 0)
+	{
+		if (errno == EINTR || errno == 0 || errno == EAGAIN || errno == EWOULDBLOCK)
 		{
-			if (errno == EINTR || errno == 0 || errno == EAGAIN || errno == EWOULDBLOCK)
-			{
-				/* nothing to accept now */
-				ereport(WARNING,
-						(errmsg("failed to accept incoming watchdog IPC connection, Nothing to accept")));
-			}
-			/* accept failed */
+			/* nothing to accept now */
 			ereport(WARNING,
-					(errmsg("failed to accept incoming watchdog IPC connection")));
-		}
-		else
-		{
-			MemoryContext oldCxt = MemoryContextSwitchTo(TopMemoryContext);
-
-			ereport(LOG,
-					(errmsg("new IPC connection received")));
-			g_cluster.ipc_command_socks = lappend_int(g_cluster.ipc_command_socks, fd);
-			MemoryContextSwitchTo(oldCxt);
+					(errmsg("failed to accept incoming watchdog IPC connection, Nothing to accept")));
 		}
+		/* accept failed */
+		ereport(WARNING,
+				(errmsg("failed to accept incoming watchdog IPC connection")));
 	}
+	else
+	{
+		MemoryContext oldCxt = MemoryContextSwitchTo(TopMemoryContext);
 
-	return processed_fds;
+		ereport(LOG,
+				(errmsg("new IPC connection received")));
+		g_cluster.ipc_command_socks = lappend_int(g_cluster.ipc_command_socks, fd);
+		MemoryContextSwitchTo(oldCxt);
+		wd_watch_socket(fd, WD_SOCK_KIND_IPC_CLIENT, NULL, WD_EV_READ);
+	}
 }
 
-static int
-update_successful_outgoing_cons(fd_set *wmask, int pending_fds_count)
+static void
+update_outgoing_connection(WatchdogNode * wdNode)
 {
-	int			i;
-	int			count = 0;
-
-	for (i = 0; i < g_cluster.remoteNodeCount; i++)
-	{
-		WatchdogNode *wdNode = &(g_cluster.remoteNodes[i]);
-
-		if (wdNode->client_socket.sock > 0 && wdNode->client_socket.sock_state == WD_SOCK_WAITING_FOR_CONNECT)
-		{
-			if (FD_ISSET(wdNode->client_socket.sock, wmask))
-			{
-				socklen_t	lon;
-				int			valopt;
-
-				lon = sizeof(int);
+	socklen_t	lon;
+	int			valopt;
 
-				gettimeofday(&wdNode->client_socket.tv, NULL);
+	lon = sizeof(int);
 
-				if (getsockopt(wdNode->client_socket.sock, SOL_SOCKET, SO_ERROR, (void *) (&valopt), &lon) == 0)
-				{
-					if (valopt)
-					{
-						ereport(DEBUG1,
-								(errmsg("error in outbound connection to %s:%d", wdNode->hostname, wdNode->wd_port),
-								 errdetail("%s", strerror(valopt))));
-						close_socket_connection(&wdNode->client_socket);
-						wdNode->client_socket.sock_state = WD_SOCK_ERROR;
-					}
-					else
-					{
-						wdNode->client_socket.sock_state = WD_SOCK_CONNECTED;
-						ereport(LOG,
-								(errmsg("new outbound connection to %s:%d ", wdNode->hostname, wdNode->wd_port)));
-						/* set socket to blocking again */
-						socket_unset_nonblock(wdNode->client_socket.sock);
-						watchdog_state_machine(WD_EVENT_NEW_OUTBOUND_CONNECTION, wdNode, NULL, NULL);
-					}
-				}
-				else
-				{
-					ereport(DEBUG1,
-							(errmsg("error in outbound connection to %s:%d ", wdNode->hostname, wdNode->wd_port),
-							 errdetail("getsockopt failed with error \"%m\"")));
-					close_socket_connection(&wdNode->client_socket);
-					wdNode->client_socket.sock_state = WD_SOCK_ERROR;
+	gettimeofday(&wdNode->client_socket.tv, NULL);
 
-				}
-				count++;
-				if (count >= pending_fds_count)
-					break;
-			}
+	if (getsockopt(wdNode->client_socket.sock, SOL_SOCKET, SO_ERROR, (void *) (&valopt), &lon) == 0)
+	{
+		if (valopt)
+		{
+			ereport(DEBUG1,
+					(errmsg("error in outbound connection to %s:%d", wdNode->hostname, wdNode->wd_port),
+					 errdetail("%s", strerror(valopt))));
+			close_socket_connection(&wdNode->client_socket);
+			wdNode->client_socket.sock_state = WD_SOCK_ERROR;
+		}
+		else
+		{
+			wdNode->client_socket.sock_state = WD_SOCK_CONNECTED;
+			ereport(LOG,
+					(errmsg("new outbound connection to %s:%d ", wdNode->hostname, wdNode->wd_port)));
+			/* set socket to blocking again */
+			socket_unset_nonblock(wdNode->client_socket.sock);
+			wd_watch_socket(wdNode->client_socket.sock, WD_SOCK_KIND_NODE_CLIENT, wdNode, WD_EV_READ);
+			watchdog_state_machine(WD_EVENT_NEW_OUTBOUND_CONNECTION, wdNode, NULL, NULL);
 		}
 	}
-	return count;
+	else
+	{
+		ereport(DEBUG1,
+				(errmsg("error in outbound connection to %s:%d ", wdNode->hostname, wdNode->wd_port),
+				 errdetail("getsockopt failed with error \"%m\"")));
+		close_socket_connection(&wdNode->client_socket);
+		wdNode->client_socket.sock_state = WD_SOCK_ERROR;
+
+	}
 }
 
 static bool
@@ -3788,7 +3960,7 @@ cleanUpIPCCommand(WDCommandData * ipcCommand)
 	if (ipcCommand->commandSource == COMMAND_SOURCE_IPC &&
 		ipcCommand->sourceIPCSocket > 0)
 	{
-		close(ipcCommand->sourceIPCSocket);
+		close_watched_socket(ipcCommand->sourceIPCSocket);
 		g_cluster.ipc_command_socks = list_delete_int(g_cluster.ipc_command_socks, ipcCommand->sourceIPCSocket);
 		ipcCommand->sourceIPCSocket = -1;
 	}